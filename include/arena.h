@@ -0,0 +1,86 @@
+/* This module contains the Arena object, a region allocator for memory which lives exactly as long as the assembly of a single file.
+   An arena hands out memory from a few big blocks, and all of it is released at once by resetting the arena, instead of freeing each allocation.
+   Resetting keeps the blocks, so an arena which is reused for the next file does not allocate again unless the file needs more memory.
+   Vectors can be allocated in an arena as well (see vector.h).
+   When memory accounting is enabled (see memstats.h), the memory an arena hands out is accounted by site until the arena is reset. */
+#ifndef _MMN14_ARENA_H_
+#define _MMN14_ARENA_H_
+#include <stddef.h>
+#include "bool.h"
+#include "memstats.h"
+
+/* The size (in bytes) of a block of an arena. Bigger allocations get a block of their own. */
+#define ARENA_BLOCK_SIZE (64 * 1024)
+
+/* A block of memory of an arena. The memory of the block follows the header. */
+typedef struct ArenaBlock
+{
+    /* the next block */
+    struct ArenaBlock *next;
+    /* the amount of bytes in the block (not including the header) */
+    size_t size;
+    /* the amount of bytes which have been handed out from the block */
+    size_t used;
+} ArenaBlock;
+
+/* A region allocator. Consider all of the fields private. */
+typedef struct
+{
+    /* the first block, or NULL if no memory has been allocated yet */
+    ArenaBlock *first;
+    /* the block memory is handed out from. The blocks after it are empty */
+    ArenaBlock *current;
+    /* the last allocation, which can grow in place (see arena_realloc) */
+    void *last;
+    /* the amount of bytes which have been handed out by each site since the arena was last reset (only kept when memory accounting is enabled) */
+    size_t accounted[MEMORY_SITE_COUNT];
+} Arena;
+
+/**
+ * @brief Initialize an empty arena. This does not allocate any memory.
+ * @param arena out parameter - the Arena to initialize. Note: free it with arena_free after you're done using it.
+ */
+void arena_init(Arena *arena);
+
+/**
+ * @brief Allocate memory in an arena. The memory is aligned for any type, and lives until the arena is reset or freed.
+ * The memory is accounted as MEMORY_SITE_OBJECT (see memstats.h).
+ * @param arena the arena
+ * @param size the amount of bytes to allocate
+ * @return a pointer to the memory, or NULL if the allocation failed.
+ */
+void *arena_alloc(Arena *arena, size_t size);
+
+/**
+ * @brief Resize memory which was allocated in an arena. The last allocation of the arena grows in place when its block has room,
+ * otherwise the memory is copied into a new allocation (and the old one is only released when the arena is reset).
+ * @param arena the arena
+ * @param ptr the memory to resize, or NULL to allocate new memory
+ * @param old_size the size ptr was allocated with
+ * @param new_size the new size
+ * @param site the site the memory is accounted as (see memstats.h)
+ * @return a pointer to the resized memory, or NULL if the allocation failed (in which case ptr is still valid).
+ */
+void *arena_realloc(Arena *arena, void *ptr, size_t old_size, size_t new_size, MemorySite site);
+
+/**
+ * @brief Duplicate a string into an arena
+ * @param arena the arena
+ * @param str the string to duplicate
+ * @return a pointer to the duplicate, or NULL if the allocation failed.
+ */
+char *arena_strdup(Arena *arena, const char *str);
+
+/**
+ * @brief Release all of the memory which was allocated in an arena at once. The blocks are kept, so that they can be reused.
+ * @param arena the arena
+ */
+void arena_reset(Arena *arena);
+
+/**
+ * @brief Free all of the dynamic memory an arena is holding. The arena should not be used after calling this.
+ * @param arena the arena
+ */
+void arena_free(Arena *arena);
+
+#endif
@@ -0,0 +1,12 @@
+/* This module contains the identity of the assembler's build.
+   Results of different builds of the assembler may differ, so anything which is persisted between runs (see cache.h and incremental.h)
+   is tagged with it, and is not reused by a different build. */
+#ifndef _MMN14_BUILD_ID_H_
+#define _MMN14_BUILD_ID_H_
+
+/* The makefile defines it as a checksum of the sources for the modules which use it, the fallback is the time the module was compiled. */
+#ifndef ASSEMBLER_BUILD_ID
+#define ASSEMBLER_BUILD_ID __DATE__ " " __TIME__
+#endif
+
+#endif
@@ -0,0 +1,146 @@
+/* This module contains the Cache object, a local on-disk cache of assembly results.
+   Each entry is keyed by a hash of the contents of an .as file and of the assembler's build identity, and holds everything the assembly of that file
+   produced: the .am, .ob, .ent and .ext files, or the errors which were reported. On a hit, the file does not need to be assembled at all.
+
+   Each entry is a container file (see container.h) named <key>.asmc inside the cache directory. Along with the artifacts,
+   it stores the source itself, which is compared on every hit so that a hash collision can never restore the wrong result.
+   Entries are written into a temporary file and then renamed into place, so several assembler processes may share a cache directory:
+   a reader either sees a complete entry or no entry at all.
+   The cache is bounded in size: hits refresh the modification time of an entry, and at the end of each run the least recently used
+   entries are evicted until the cache fits in its size. Hit/miss statistics are kept in the cache directory as well. */
+#ifndef _MMN14_CACHE_H_
+#define _MMN14_CACHE_H_
+#include <stdio.h>
+#include "bool.h"
+#include "vector.h"
+#include "container.h"
+#include "second_pass.h"
+#include "utils.h" /* int types */
+
+/* The length of a cache key (in hex characters) */
+#define CACHE_KEY_LENGTH 16
+
+/* The default maximum size of the cache in bytes */
+#define CACHE_DEFAULT_MAX_SIZE (256UL * 1024 * 1024)
+
+/* The outcome of assembling a file */
+typedef enum
+{
+    /* the file was assembled successfully */
+    ASSEMBLY_SUCCEEDED,
+    /* the file had errors during macro expansion */
+    ASSEMBLY_MACRO_EXPANSION_FAILED,
+    /* the file had errors during the first pass */
+    ASSEMBLY_FIRST_PASS_FAILED,
+    /* the file had errors during the second pass */
+    ASSEMBLY_SECOND_PASS_FAILED
+} AssemblyOutcome;
+
+/* Statistics about the usage of a cache */
+typedef struct
+{
+    /* amount of lookups which found an entry */
+    unsigned long hits;
+    /* amount of lookups which did not find an entry */
+    unsigned long misses;
+    /* amount of entries which were stored */
+    unsigned long stores;
+    /* amount of entries which were evicted */
+    unsigned long evictions;
+    /* the size of all the entries in bytes */
+    unsigned long size;
+} CacheStats;
+
+/* A cache of assembly results inside a directory. Consider all of the fields private. */
+typedef struct
+{
+    /* the directory of the cache */
+    char *dir;
+    /* a buffer which is big enough for any path inside the cache directory */
+    char *path;
+    /* the maximum size of all the entries in bytes */
+    unsigned long max_size;
+    /* the amount of temporary files we have created, used to give them unique names */
+    uint32 temp_count;
+    /* the statistics of this run, which are added to the statistics of the cache when it is closed */
+    CacheStats run_stats;
+} Cache;
+
+/**
+ * @brief Initialize a cache in a directory. The directory is created if it does not exist.
+ * @param cache out parameter - the Cache to initialize. Note: close it with cache_close after you're done using it.
+ * @param dir the directory of the cache
+ * @param max_size the maximum size of all the entries in bytes
+ * @return TRUE if the initialization was successful, FALSE otherwise. Initialization fails if the directory could not be created or an allocation failed.
+ */
+bool cache_init(Cache *cache, const char *dir, unsigned long max_size);
+
+/**
+ * @brief Compute the cache key of a source file
+ * @param source the contents of the .as file
+ * @param source_len the length of source
+ * @param key out parameter - a buffer of at least CACHE_KEY_LENGTH + 1 characters which is filled with the null terminated key
+ */
+void cache_key(const char *source, uint32 source_len, char *key);
+
+/**
+ * @brief Look up an entry in the cache
+ * @param cache the cache
+ * @param key the key of the source (see cache_key)
+ * @param source the contents of the .as file
+ * @param source_len the length of source
+ * @return NULL if there is no entry for the source (a miss), otherwise the entry, opened for reading.
+ * Its artifacts are stored with an empty module name. Note: free the entry with cache_entry_free after you're done using it.
+ */
+Container *cache_lookup(Cache *cache, const char *key, const char *source, uint32 source_len);
+
+/**
+ * @brief Read the outcome and the error transcript of a cache entry
+ * @param entry an entry returned by cache_lookup
+ * @param outcome out parameter - the outcome of the assembly
+ * @param transcript out parameter - the errors reported during the assembly (as rendered by error_to_string), each followed by a null terminator.
+ * Note: you're responsible for freeing this buffer.
+ * @param transcript_len out parameter - the length of transcript
+ * @return TRUE if the entry was read successfully, FALSE otherwise.
+ */
+bool cache_entry_read_log(Container *entry, AssemblyOutcome *outcome, char **transcript, uint32 *transcript_len);
+
+/**
+ * @brief Free a cache entry returned by cache_lookup
+ * @param entry the entry
+ */
+void cache_entry_free(Container *entry);
+
+/**
+ * @brief Store the result of assembling a file in the cache. Failing to store is not an error, it only means that the next lookup will miss.
+ * @param cache the cache
+ * @param key the key of the source (see cache_key)
+ * @param source the contents of the .as file
+ * @param source_len the length of source
+ * @param outcome the outcome of the assembly
+ * @param transcript the errors reported during the assembly (as rendered by error_to_string), each followed by a null terminator
+ * @param am_file the .am file (read from its start), or NULL if there is none (i.e. macro expansion failed)
+ * @param second_pass_result the result of the second pass if the assembly succeeded, NULL otherwise
+ * @return TRUE if the entry was stored, FALSE otherwise.
+ */
+bool cache_store(Cache *cache, const char *key, const char *source, uint32 source_len, AssemblyOutcome outcome, CharVector *transcript,
+                 FILE *am_file, SecondPassResult *second_pass_result);
+
+/**
+ * @brief Add the statistics of this run to the statistics of the cache, evict the least recently used entries if the cache is over its size,
+ * and free any dynamic memory the cache is holding. The cache should not be used after calling this.
+ * @param cache the cache
+ * @param run_stats out parameter - the statistics of this run
+ * @param total_stats out parameter - the statistics of the cache over all runs (including this one)
+ */
+void cache_close(Cache *cache, CacheStats *run_stats, CacheStats *total_stats);
+
+/**
+ * @brief Read an entire stream into memory
+ * @param file the stream, read from its current position
+ * @param len out parameter - the amount of bytes read
+ * @return NULL if reading or an allocation failed, otherwise the contents of the stream (null terminated). Note: you're responsible for freeing it.
+ */
+char *read_whole_stream(FILE *file, uint32 *len);
+
+#endif
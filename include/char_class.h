@@ -0,0 +1,31 @@
+/* This module classifies the characters of the source for the lexing code, with a single table lookup per character.
+   The classes are those of the "C" locale regardless of the current locale, and characters outside of ASCII are in no class.
+   A character is looked up as an unsigned char, so it is safe to classify a plain (possibly negative) char. */
+#ifndef _MMN14_CHAR_CLASS_H_
+#define _MMN14_CHAR_CLASS_H_
+#include "utils.h" /* int types */
+
+/* an alphabethic character ('a' to 'z' and 'A' to 'Z') */
+#define CHAR_CLASS_ALPHA 1
+/* a decimal digit ('0' to '9') */
+#define CHAR_CLASS_DIGIT 2
+/* a character which may appear in a symbol (alphabethic characters and digits) */
+#define CHAR_CLASS_SYMBOL 4
+/* a whitespace character (' ', '\t', '\n', '\v', '\f' and '\r', as in isspace) */
+#define CHAR_CLASS_SPACE 8
+/* a structural character of the language (':', ',', '"', ';', '#', '&' and '.') */
+#define CHAR_CLASS_STRUCTURAL 16
+
+/* The classes of each character, indexed by the character as an unsigned char */
+extern const uint8 char_classes[UCHAR_MAX + 1];
+
+/* whether or not the character c is in any of the classes */
+#define CHAR_HAS_CLASS(c, classes) ((char_classes[(unsigned char)(c)] & (classes)) != 0)
+
+#define CHAR_IS_ALPHA(c) CHAR_HAS_CLASS(c, CHAR_CLASS_ALPHA)
+#define CHAR_IS_DIGIT(c) CHAR_HAS_CLASS(c, CHAR_CLASS_DIGIT)
+#define CHAR_IS_SYMBOL(c) CHAR_HAS_CLASS(c, CHAR_CLASS_SYMBOL)
+#define CHAR_IS_SPACE(c) CHAR_HAS_CLASS(c, CHAR_CLASS_SPACE)
+#define CHAR_IS_STRUCTURAL(c) CHAR_HAS_CLASS(c, CHAR_CLASS_STRUCTURAL)
+
+#endif
@@ -0,0 +1,138 @@
+/* This module contains the Container object, which stores the artifacts of many assembled files inside a single file.
+   When assembling many files in one run, creating up to 4 small files for each of them is expensive (each file costs an inode and its own open/write/close),
+   so instead every artifact is appended to one container file which has an index of where each artifact is.
+
+   The layout of a container file is (all integers are 32 bit little endian):
+   header: the magic "ASMCNTR1", the offset of the index, the amount of entries in the index
+   data:   the contents of the artifacts, one after the other
+   index:  for each artifact: its offset, its length, its ArtifactType, the length of its module name and then the module name itself (not null terminated)
+
+   The index is written at the end so that the artifacts can be streamed into the file with large sequential writes
+   without knowing their amount or size in advance. */
+#ifndef _MMN14_CONTAINER_H_
+#define _MMN14_CONTAINER_H_
+#include <stdio.h>
+#include "bool.h"
+#include "vector.h"
+#include "output.h" /* for ArtifactType */
+#include "utils.h"  /* int types */
+
+/* The extension of container files */
+#define CONTAINER_EXTENSION ".asmc"
+
+/* The maximum length of the module name of an artifact */
+#define CONTAINER_MAX_MODULE_LENGTH 4096
+
+/* An entry in the index of a container. */
+typedef struct
+{
+    /* The module (i.e. the base filename, e.g. "example" for "example.as") this artifact belongs to */
+    char *module;
+    /* The type of the artifact */
+    ArtifactType type;
+    /* The offset of the artifact's contents from the start of the container file */
+    uint32 offset;
+    /* The length of the artifact's contents in bytes */
+    uint32 length;
+} ContainerEntry;
+
+VECTOR_HEADER(ContainerEntry, ContainerEntryVector, container_entry)
+
+/* A container file which is either being written (see container_create) or read (see container_open).
+   Consider all of the fields private except for entries, which may be read (but not modified) in a container which has been opened for reading. */
+typedef struct
+{
+    /* the underlying file */
+    FILE *file;
+    /* the buffer we give the underlying file so that writes are made in big chunks */
+    char *io_buffer;
+    /* the offset at which the next artifact will be written */
+    uint32 offset;
+    /* whether or not writing an artifact failed. The stream may then hold part of the artifact, which would throw off the offsets
+       of every later artifact, so such a container is never given an index (see container_close) */
+    bool failed;
+    /* the index of the container */
+    ContainerEntryVector *entries;
+} Container;
+
+/**
+ * @brief Create a new container file for writing. Any existing file with the same path is overwritten.
+ * @param container out parameter - the Container object to initialize.
+ * Note: close the container with container_close after you're done writing to it, otherwise the file will not have an index.
+ * @param path the path of the container file
+ * @return TRUE if the container was created successfully, FALSE otherwise. Creation will fail if the file could not be opened or if an allocation failed.
+ */
+bool container_create(Container *container, const char *path);
+
+/**
+ * @brief Start writing an artifact into a container. Write the artifact's contents into the returned stream, and then call container_end_artifact.
+ * Note: only one artifact may be written at a time.
+ * @param container a container which has been created with container_create
+ * @return the stream to write the artifact's contents into
+ */
+FILE *container_begin_artifact(Container *container);
+
+/**
+ * @brief Finish writing an artifact into a container and add it to the container's index.
+ * @param container the container which container_begin_artifact has been called on
+ * @param module the module the artifact belongs to. Note: the name will be copied
+ * @param type the type of the artifact
+ * @param length the amount of bytes which have been written into the stream returned by container_begin_artifact, or -1 if writing them failed
+ * @return TRUE if the artifact was added successfully, FALSE otherwise. This will fail if length is negative, the container has grown past 4GiB,
+ * the module name is longer than CONTAINER_MAX_MODULE_LENGTH or if an allocation failed. Once this fails, the container fails as a whole (see container_close).
+ */
+bool container_end_artifact(Container *container, const char *module, ArtifactType type, long length);
+
+/**
+ * @brief Write the index of a container, close its file and free any dynamic memory it is holding.
+ * The container should not be used after calling this.
+ * @param container a container which has been created with container_create
+ * @return TRUE if the index was written and the file was closed successfully, FALSE otherwise.
+ * This fails if adding any of the artifacts failed (see container_end_artifact), in which case the file is left without an index.
+ */
+bool container_close(Container *container);
+
+/**
+ * @brief Open an existing container file for reading and read its index.
+ * @param container out parameter - the Container object to initialize. Note: free it with container_free after you're done using it.
+ * @param path the path of the container file
+ * @return TRUE if the container was opened successfully, FALSE otherwise. Opening will fail if the file could not be opened, it is not a valid container
+ * (e.g. its index or one of its artifacts lies outside the file, or a module name is longer than CONTAINER_MAX_MODULE_LENGTH) or if an allocation failed.
+ */
+bool container_open(Container *container, const char *path);
+
+/**
+ * @brief Copy the contents of an artifact inside a container which has been opened for reading into a stream
+ * @param container a container which has been opened with container_open
+ * @param entry the entry of the artifact inside the container's index
+ * @param out the stream to copy to
+ * @return TRUE if the contents were copied successfully, FALSE otherwise.
+ */
+bool container_read_artifact(Container *container, ContainerEntry *entry, FILE *out);
+
+/**
+ * @brief Read the contents of an artifact inside a container which has been opened for reading into a buffer
+ * @param container a container which has been opened with container_open
+ * @param entry the entry of the artifact inside the container's index
+ * @param buf a buffer to hold the contents. Note: it should be at least entry->length bytes big
+ * @return TRUE if the contents were read successfully, FALSE otherwise.
+ */
+bool container_read_artifact_data(Container *container, ContainerEntry *entry, char *buf);
+
+/**
+ * @brief Search the index of a container which has been opened for reading for an artifact
+ * @param container a container which has been opened with container_open
+ * @param module the module the artifact belongs to
+ * @param type the type of the artifact
+ * @return A pointer to the entry of the artifact if found, NULL otherwise.
+ */
+ContainerEntry *container_find(Container *container, const char *module, ArtifactType type);
+
+/**
+ * @brief Close a container which has been opened for reading and free any dynamic memory it is holding.
+ * The container should not be used after calling this.
+ * @param container a container which has been opened with container_open
+ */
+void container_free(Container *container);
+
+#endif
@@ -0,0 +1,119 @@
+/* This module contains the sink the errors of the assembled files are reported into.
+   An error is recorded as it is reported: the Error itself, with the strings it points to copied into the sink's arena (see error_copy),
+   and it is only rendered into text when the errors are flushed (see diagnostics_flush). The rendered errors of a file are written into the output
+   in a single write once the file is done, instead of a couple of stdio calls per error. Files are flushed in the order they are assembled,
+   so the output is the same as if each error was printed right away.
+   The errors are written either as text for people (with colors) or as JSON Lines for tools (see DiagnosticsFormat).
+   The sink can also bound the amount of errors of a file (see --max-errors): once the bound is reached, the errors which follow are dropped and
+   the stages stop reading the file (see diagnostics_limit_reached). */
+#ifndef _MMN14_DIAGNOSTICS_H_
+#define _MMN14_DIAGNOSTICS_H_
+#include <stdio.h>
+#include "errors.h"
+#include "vector.h"
+
+/* An error which was reported into a sink and was not flushed yet */
+typedef struct
+{
+    /* the name of the file the error is in. Copied into the arena of the sink */
+    const char *filename;
+    /* the error. Everything it points to is copied into the arena of the sink. Only valid when rendered is NULL */
+    Error error;
+    /* the error if it was already rendered with error_to_string (e.g. when it is replayed out of the cache), or NULL.
+       As JSON Lines, such an error only has its file and its message (the rendered error without colors). Note: this is not copied */
+    const char *rendered;
+} DiagnosticRecord;
+
+VECTOR_HEADER(DiagnosticRecord, DiagnosticRecordVector, diagnostic_record)
+
+/* The format the errors are written in */
+typedef enum
+{
+    /* Each error as error_to_string renders it, after the name of its file:
+       filename: error\n\n */
+    DIAGNOSTICS_FORMAT_TEXT,
+    /* A JSON object per line for each error, without colors:
+       {"file":..., "line":..., "type":..., "code":..., "fields":{...}, "source":..., "message":...}
+       type is the name of the ErrorType and code is the name of the most specific enum value (see error_code). fields has the values
+       the error carries (lengths, characters, symbols, etc. - see diagnostics_append_fields in diagnostics.c), source is the line and message is
+       the message alone (see error_message) */
+    DIAGNOSTICS_FORMAT_JSONL
+} DiagnosticsFormat;
+
+/* A sink of errors */
+typedef struct
+{
+    /* the stream the errors are flushed into */
+    FILE *out;
+    /* the format the errors are written in */
+    DiagnosticsFormat format;
+    /* the errors which were reported since the last flush, in the order they were reported */
+    DiagnosticRecordVector *records;
+    /* the arena the strings of the records are copied into. It is reset on each flush */
+    Arena arena;
+    /* the errors of a flush, rendered. Kept between flushes so that it is allocated once */
+    CharVector *buffer;
+    /* the amount of errors which were reported for the current file (see diagnostics_start_file) */
+    unsigned long error_count;
+    /* the biggest amount of errors reported for a single file, or 0 for no bound */
+    unsigned long max_errors;
+} DiagnosticsSink;
+
+/**
+ * @brief Initialize a sink
+ * @param sink out parameter - the sink to initialize. Note: free it with diagnostics_free after you're done using it.
+ * @param out the stream to flush the errors into
+ * @param format the format to write the errors in
+ * @param max_errors the biggest amount of errors to report for a single file, or 0 for no bound
+ * @return TRUE if successful, FALSE if an allocation failed.
+ */
+bool diagnostics_init(DiagnosticsSink *sink, FILE *out, DiagnosticsFormat format, unsigned long max_errors);
+
+/**
+ * @brief Start counting the errors of a new file (towards max_errors)
+ * @param sink the sink
+ */
+void diagnostics_start_file(DiagnosticsSink *sink);
+
+/**
+ * @brief Report an error. It is written once flushed, in the format of the sink (see DiagnosticsFormat).
+ * The error is dropped if the current file already has max_errors errors.
+ * @param sink the sink
+ * @param filename the name of the file the error is in
+ * @param error the error. It is copied, so it only has to live until this returns
+ * @return TRUE if successful, FALSE if an allocation failed.
+ */
+bool diagnostics_report(DiagnosticsSink *sink, const char *filename, Error error);
+
+/**
+ * @brief Report an error which has already been rendered with error_to_string (see diagnostics_report)
+ * @param sink the sink
+ * @param filename the name of the file the error is in
+ * @param rendered_error the rendered error. Note: this is not copied, so it has to live until the next flush
+ * @return TRUE if successful, FALSE if an allocation failed.
+ */
+bool diagnostics_report_rendered(DiagnosticsSink *sink, const char *filename, const char *rendered_error);
+
+/**
+ * @brief Check whether or not the current file has reached max_errors errors (in which case the stages should stop reading it)
+ * @param sink the sink
+ * @return TRUE if the current file has reached max_errors errors, FALSE otherwise.
+ */
+bool diagnostics_limit_reached(DiagnosticsSink *sink);
+
+/**
+ * @brief Render all the errors which were reported since the last flush and write them into the output in a single write
+ * @param sink the sink
+ * @param transcript if not NULL, each error as error_to_string renders it is pushed into it (followed by a null terminator), e.g. for the cache.
+ * This is the same regardless of the format
+ * @return TRUE if successful, FALSE if an allocation failed or writing failed.
+ */
+bool diagnostics_flush(DiagnosticsSink *sink, CharVector *transcript);
+
+/**
+ * @brief Flush and free a sink
+ * @param sink the sink
+ */
+void diagnostics_free(DiagnosticsSink *sink);
+
+#endif
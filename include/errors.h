@@ -142,6 +142,35 @@ typedef struct
  */
 void error_to_string(Error error, char *buf);
 
+/**
+ * @brief turn an error into its message alone: the same text as the info part of error_to_string, without the line and without colors
+ * @param error the error
+ * @param buf a buffer to hold the characters of the message. See ERROR_TO_STRING_BUF_SIZE_UPPER_BOUND for sufficient buffer size.
+ */
+void error_message(Error error, char *buf);
+
+/**
+ * @brief Get the stable code of an error: the name of the most specific enum value which describes it (e.g. "PARSE_ERROR_INVALID_INSTRUCTION"
+ * for an error of type ERROR_TYPE_PARSE, or "ERROR_TYPE_SYMBOL_NOT_DEFINED" for an error which has no nested error)
+ * @param error the error
+ * @return the code. It lives forever.
+ */
+const char *error_code(Error error);
+
+/**
+ * @brief Get the name of an error type (e.g. "ERROR_TYPE_PARSE")
+ * @param type the error type
+ * @return the name. It lives forever.
+ */
+const char *error_type_name(ErrorType type);
+
+/**
+ * @brief Get the name of a symbol parse error type (e.g. "SYMBOL_IS_A_REGISTER")
+ * @param type the symbol parse error type
+ * @return the name. It lives forever.
+ */
+const char *parse_symbol_error_type_name(ParseSymbolErrorType type);
+
 /* Represents an callback which is called each time there is an error in one of the passes, along with some local data which you can bring along with it. */
 typedef struct
 {
@@ -150,8 +179,22 @@ typedef struct
     void (*callback)(Error, void *);
     /* Local data which is provided to the callback each time it is called */
     void *data;
+    /* Called with the data field before each line a stage reads, or NULL if the stages always read the whole file.
+       Once it returns TRUE (e.g. once enough errors were reported, see --max-errors) the stages stop reading the file,
+       and a stage which stopped early reports that it encountered an error. */
+    bool (*should_stop)(void *);
 } ErrorCallback;
 
+/**
+ * @brief Copy an error so that it outlives the stage which reported it: everything the error points to (the line, the symbols,
+ * the names and the values of the nested errors) is copied into an arena
+ * @param copy out parameter - the copy
+ * @param error the error to copy
+ * @param arena the arena to copy into. The copy lives until the arena is reset
+ * @return TRUE if successful, FALSE if an allocation failed.
+ */
+bool error_copy(Error *copy, Error error, Arena *arena);
+
 /**
  * @brief call an error callback with a specified error
  * @param err_callback the error callback to call
@@ -159,4 +202,21 @@ typedef struct
  */
 void err(ErrorCallback err_callback, Error err);
 
+/**
+ * @brief call an error callback with a specified error, after reading the line of the error back from the file the stage reads.
+ * This way the stages do not have to keep a copy of each line they read, only its offset
+ * @param err_callback the error callback to call
+ * @param err the specified error. Its line is replaced by the line which was read
+ * @param file the file the stage reads (it is left at the same position)
+ * @param line_offset the offset of the line of the error in file (see next_line_offset in utils.h)
+ */
+void err_at_line(ErrorCallback err_callback, Error err, FILE *file, long line_offset);
+
+/**
+ * @brief Check whether or not the stages should stop reading the file (see the should_stop field of ErrorCallback)
+ * @param err_callback the error callback
+ * @return TRUE if the stages should stop, FALSE otherwise.
+ */
+bool err_should_stop(ErrorCallback err_callback);
+
 #endif
\ No newline at end of file
@@ -6,7 +6,9 @@
 #include <stdio.h>
 #include "bool.h"
 #include "vector.h"
+#include "image.h"
 #include "symbol_table.h"
+#include "arena.h"
 #include "errors.h"
 #include "utils.h" /* int types */
 
@@ -34,10 +36,12 @@ typedef struct
       2. Labels found before .data and .string directives and the address they should have in the object file
       3. Symbols found in .extern directives. However, the address for these entries will be invalid (0). */
    SymbolTable symbol_table;
-   /* Memory image of data from directives. Each uint32 number in the vector represents a 24-bit word.
-      Note: each word is represented as a 32bit unsigned number. As such, signed numbers will not have 24-bit values (due to being represented in two's complement),
-      meaning you should mask the values here to 24 bit before encoding them to a file. */
-   U32Vector *data_image;
+   /* Memory image of data from directives. Each word is truncated to 24 bits (negative numbers are in 24-bit two's complement), see image.h.
+      NULL if the pass did not build it (see first_pass_check). */
+   Image *data_image;
+   /* The instruction counter after the last instruction. The instruction image of the file is exactly IC - INSTRUCTION_MEMORY_START words long,
+      so the second pass allocates it once at its final size. */
+   uint32 IC;
 } FirstPassResult;
 
 /*
@@ -52,14 +56,19 @@ typedef struct
  * @param err_callback a callback function which will be called each time there is an error.
  * Note: the error received by err_callback will be invalid when exiting the callback. This means that if you wish to pass
  * data from the error, you should duplicate the data first.
+ * @param arena the arena the result is allocated in. The result lives until the arena is reset, so there is nothing to free.
  * @return FirstPassResult object. Read its documentaion for more info.
  */
-FirstPassResult first_pass(FILE *input, ErrorCallback err_callback);
+FirstPassResult first_pass(FILE *input, ErrorCallback err_callback, Arena *arena);
 
 /**
- * @brief Free dynamic memory held by a FirstPassResult object
- * @param first_pass_result the FirstPassResult object
+ * @brief Runs a first pass on an input file which only validates it (see --check): it reports the same errors and builds the same symbol table
+ * as first_pass, but does not build the data image.
+ * @param input the file you wish to perform first_pass_check on. This function assumes that this is an assembly file with no extensions (e.g. macros)
+ * @param err_callback a callback function which will be called each time there is an error. See first_pass.
+ * @param arena the arena the result is allocated in. The result lives until the arena is reset, so there is nothing to free.
+ * @return FirstPassResult object, whose data_image is NULL. Read its documentaion for more info.
  */
-void free_first_pass_result(FirstPassResult first_pass_result);
+FirstPassResult first_pass_check(FILE *input, ErrorCallback err_callback, Arena *arena);
 
 #endif
\ No newline at end of file
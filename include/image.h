@@ -0,0 +1,122 @@
+/* This module contains the Image object, a memory image of 24-bit words (see WORD_SIZE in parser.h) such as the instruction image and the data image.
+   Each word is packed into 3 bytes instead of being held in a 32-bit integer, so an image takes a quarter less memory.
+   Words are truncated to 24 bits when they are stored (negative numbers are kept in 24-bit two's complement), and are read back as 24-bit values.
+   Like a vector (see vector.h), an image grows by doubling its capacity and can be allocated inside an arena,
+   and it can be read and written a block of words at a time (see image_read and image_write). */
+#ifndef _MMN14_IMAGE_H_
+#define _MMN14_IMAGE_H_
+#include "bool.h"
+#include "arena.h"
+#include "utils.h" /* int types */
+
+/* The amount of bytes a word takes in an image */
+#define IMAGE_WORD_BYTES 3
+
+/* A memory image of 24-bit words. Len is the amount of words in the image. Consider the other fields as private fields. */
+typedef struct
+{
+    /* the words, IMAGE_WORD_BYTES bytes each (least significant byte first) */
+    uint8 *bytes;
+    /* the amount of words in the image */
+    uint32 len;
+    /* the amount of words the image has room for */
+    uint32 capacity;
+    /* the arena the image is allocated in, or NULL if it is allocated with malloc */
+    Arena *arena;
+} Image;
+
+/**
+ * @brief Create a new empty image
+ * @return a pointer to the image, or NULL if the allocation failed. Note: free it with image_free after you're done using it.
+ */
+Image *image_create();
+
+/**
+ * @brief Create a new empty image inside an arena. The image lives until the arena is reset.
+ * @param arena the arena
+ * @return a pointer to the image, or NULL if the allocation failed.
+ */
+Image *image_create_in(Arena *arena);
+
+/**
+ * @brief Ensure that an image has room for at least capacity words, so that growing it up to that length does not allocate.
+ * @param image the image
+ * @param capacity the amount of words
+ * @return TRUE if successful, FALSE if the allocation failed (in which case the image is unchanged).
+ */
+bool image_reserve(Image *image, uint32 capacity);
+
+/**
+ * @brief Set the amount of words in an image. Words past the old length are NOT initialized, and should be written before they're read.
+ * @param image the image
+ * @param len the amount of words
+ * @return TRUE if successful, FALSE if the allocation failed (in which case the image is unchanged).
+ */
+bool image_resize(Image *image, uint32 len);
+
+/**
+ * @brief Append a word to the end of an image
+ * @param image the image
+ * @param word the word. Only its 24 lowest bits are stored.
+ * @return TRUE if successful, FALSE if the allocation failed.
+ */
+bool image_append(Image *image, uint32 word);
+
+/**
+ * @brief Append words to the end of an image at once
+ * @param image the image
+ * @param words the words. Only the 24 lowest bits of each word are stored.
+ * @param count the amount of words
+ * @return TRUE if successful, FALSE if the allocation failed (in which case the image is unchanged).
+ */
+bool image_append_n(Image *image, const uint32 *words, uint32 count);
+
+/**
+ * @brief Append all of the words of another image to the end of an image
+ * @param image the image
+ * @param other the image whose words are appended
+ * @return TRUE if successful, FALSE if the allocation failed (in which case the image is unchanged).
+ */
+bool image_append_image(Image *image, const Image *other);
+
+/**
+ * @brief Get a word of an image
+ * @param image the image
+ * @param position the position of the word. Must be smaller than the length of the image.
+ * @return the word (a 24-bit value)
+ */
+uint32 image_get(const Image *image, uint32 position);
+
+/**
+ * @brief Set a word of an image
+ * @param image the image
+ * @param position the position of the word. Must be smaller than the length of the image.
+ * @param word the word. Only its 24 lowest bits are stored.
+ */
+void image_set(Image *image, uint32 position, uint32 word);
+
+/**
+ * @brief Read a block of consecutive words out of an image
+ * @param image the image
+ * @param position the position of the first word
+ * @param words out parameter - an array with room for count words
+ * @param count the amount of words to read. position + count must not be bigger than the length of the image.
+ */
+void image_read(const Image *image, uint32 position, uint32 *words, uint32 count);
+
+/**
+ * @brief Write a block of consecutive words into an image
+ * @param image the image
+ * @param position the position of the first word
+ * @param words the words. Only the 24 lowest bits of each word are stored.
+ * @param count the amount of words to write. position + count must not be bigger than the length of the image.
+ */
+void image_write(Image *image, uint32 position, const uint32 *words, uint32 count);
+
+/**
+ * @brief Free an image. The image should not be used after calling this. Does nothing for an image inside an arena.
+ * @param image the image
+ */
+void image_free(Image *image);
+
+#endif
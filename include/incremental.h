@@ -0,0 +1,135 @@
+/* This module contains the IncrementalState object and the incremental_assemble function, which reassemble an edited file
+   without running the first and second pass over all of it again.
+   The state of a file which assembled successfully is kept per line: the text of the line, the statement parsed out of it,
+   the amount of words it takes and its encoded words, along with the encoded images of the whole file.
+   When the file is assembled again, only the lines which changed are parsed, and the addresses and the images are only rewritten from the first change onwards.
+   The symbol table however is rebuilt out of the statements of all of the lines, and every symbol reference in the file is resolved again
+   (each with a constant time lookup), so that part takes time in proportion to the amount of references in the whole file.
+   Only the words whose encoding changed (since their symbol or their instruction moved) are patched into the instruction image.
+   The result is identical to the result of the first and second pass (tests/incremental_check.sh checks this on randomly edited files).
+
+   Errors are not reported by this module: when the edited file has any error, the state is discarded and the caller
+   runs the regular passes, which report the errors exactly like they always do.
+   The state can be saved to a file (next to the source, see INCREMENTAL_STATE_EXTENSION) so that it lives between runs. */
+#ifndef _MMN14_INCREMENTAL_H_
+#define _MMN14_INCREMENTAL_H_
+#include <stdio.h>
+#include "bool.h"
+#include "vector.h"
+#include "image.h"
+#include "instructions.h"
+#include "second_pass.h"
+#include "arena.h"
+#include "utils.h" /* int types */
+
+/* The extension of the files incremental states are saved into */
+#define INCREMENTAL_STATE_EXTENSION ".asmi"
+
+/* The kind of statement a line has */
+typedef enum
+{
+    /* An empty line or a comment */
+    STATEMENT_NONE,
+    /* An instruction */
+    STATEMENT_INSTRUCTION,
+    /* A .data or a .string directive */
+    STATEMENT_DATA,
+    /* An .entry directive */
+    STATEMENT_ENTRY,
+    /* An .extern directive */
+    STATEMENT_EXTERN
+} StatementKind;
+
+/* The state of a single line of an assembled file */
+typedef struct
+{
+    /* a hash of text, to compare lines quickly */
+    uint32 hash;
+    /* the text of the line (as read by fgets) */
+    char *text;
+    /* the statement in the line */
+    StatementKind kind;
+    /* the label defined by the line (for instructions and .data/.string directives), or NULL if there is none */
+    char *label;
+    /* the symbol of an .entry/.extern directive. Only valid when kind is STATEMENT_ENTRY or STATEMENT_EXTERN */
+    char *symbol;
+    /* the instruction. Only valid when kind is STATEMENT_INSTRUCTION */
+    Instruction instruction;
+    /* the instruction counter and the data counter before this line */
+    uint32 IC, DC;
+    /* the amount of words in the instruction image (for instructions) or the data image (for .data/.string directives) this line takes */
+    uint32 word_count;
+    /* the encoded words of the instruction. Only valid when kind is STATEMENT_INSTRUCTION */
+    uint32 instruction_words[MAX_INSTRUCTION_WORDS];
+    /* the words of the data. Only valid when kind is STATEMENT_DATA */
+    uint32 *data_words;
+} LineState;
+
+VECTOR_HEADER(LineState, LineStateVector, line_state)
+
+/* The state of an assembled file, which is used to assemble the next version of the file incrementally. Consider all of the fields private. */
+typedef struct
+{
+    /* the state of each line. Empty if there is no state yet */
+    LineStateVector *lines;
+    /* the instruction image and the data image of the file */
+    Image *instruction_image;
+    Image *data_image;
+    /* the instruction counter and the data counter after the last line */
+    uint32 IC, DC;
+} IncrementalState;
+
+/* The outcome of assembling a file incrementally */
+typedef enum
+{
+    /* the file was assembled successfully */
+    INCREMENTAL_ASSEMBLED,
+    /* the file has errors. They were not reported, and the state has been reset */
+    INCREMENTAL_HAS_ERRORS,
+    /* an allocation failed. The state has been reset */
+    INCREMENTAL_ALLOC_FAIL
+} IncrementalOutcome;
+
+/**
+ * @brief Initialize an empty incremental state. Assembling with an empty state parses every line.
+ * @param state out parameter - the IncrementalState to initialize. Note: free it with incremental_state_free after you're done using it.
+ * @return TRUE if the initialization was successful, FALSE otherwise. Initialization fails if an allocation failed.
+ */
+bool incremental_state_init(IncrementalState *state);
+
+/**
+ * @brief Free any dynamic memory an incremental state is holding. The state should not be used after calling this.
+ * @param state the state
+ */
+void incremental_state_free(IncrementalState *state);
+
+/**
+ * @brief Load an incremental state which has been saved with incremental_state_save into an empty state.
+ * A state saved by a different build of the assembler is not loaded.
+ * @param state an empty state (see incremental_state_init)
+ * @param path the path of the saved state
+ * @return TRUE if the state was loaded, FALSE otherwise (in which case the state is left empty).
+ */
+bool incremental_state_load(IncrementalState *state, const char *path);
+
+/**
+ * @brief Save an incremental state into a file. An empty state removes the file instead.
+ * The state is written into a temporary file which is then renamed, so a partially written state is never loaded.
+ * @param state the state
+ * @param path the path to save the state into
+ * @return TRUE if the state was saved, FALSE otherwise.
+ */
+bool incremental_state_save(IncrementalState *state, const char *path);
+
+/**
+ * @brief Assemble a file incrementally, parsing only the lines which changed since the state was last updated.
+ * @param state the state of the previous version of the file (or an empty state). It is updated to the new version of the file.
+ * @param input the file to assemble. This function assumes that this is an assembly file with no extensions (e.g. macros)
+ * @param arena the arena the result is allocated in. The result lives until the arena is reset.
+ * @param second_pass_result out parameter - the result, identical to the result of running the first and second pass on the file.
+ * Only valid if INCREMENTAL_ASSEMBLED is returned. It does not share any memory with the state.
+ * @return the outcome. See IncrementalOutcome.
+ */
+IncrementalOutcome incremental_assemble(IncrementalState *state, FILE *input, Arena *arena, SecondPassResult *second_pass_result);
+
+#endif
@@ -6,6 +6,9 @@
 #include "bool.h"
 #include "utils.h"
 
+/* The biggest amount of words a single instruction is encoded into (the instruction itself and an information word for each operand) */
+#define MAX_INSTRUCTION_WORDS 3
+
 /* The type of the instruction. */
 typedef enum
 {
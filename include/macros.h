@@ -3,6 +3,7 @@
 #include <stdio.h>
 #include "errors.h"
 #include "vector.h"
+#include "arena.h"
 #include "bool.h"
 
 /* the maximum name of a macro */
@@ -41,6 +42,8 @@ typedef struct
     /* whether or not we encountered an allocation failure during the expansion.
        Note: upon encountering an allocation failure, the expansion immediately stops. */
     bool alloc_fail;
+    /* the amount of lines in the input file. Only valid if there was no allocation failure. */
+    uint32 line_count;
 } MacroExpansionResult;
 
 /**
@@ -50,8 +53,9 @@ typedef struct
  * @param in the input file
  * @param out the output file
  * @param err_callback the callback to call upon an error
+ * @param arena the arena the macro table is allocated in. It is only needed during the expansion, so the arena may be reset right after it.
  * @return MacroExpansionResult object containing information gathered during the expansion. Read its documentaiton for more information.
  */
-MacroExpansionResult expand_macros(FILE *in, FILE *out, ErrorCallback err_callback);
+MacroExpansionResult expand_macros(FILE *in, FILE *out, ErrorCallback err_callback, Arena *arena);
 
 #endif
\ No newline at end of file
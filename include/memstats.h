@@ -0,0 +1,98 @@
+/* This module contains the opt-in accounting of the memory the assembler allocates (see memory_stats_enable).
+   Each allocation is attributed to the stage of the pipeline which made it (see memory_stats_set_stage) and to the site which made it
+   (e.g. the growth of a vector, or a string duplicated into an arena), and the accounting keeps track of the bytes which are live and their peak.
+   Memory handed out by an arena (see arena.h) is live from the time it is handed out until the arena is reset.
+   The blocks arenas allocate from the heap are accounted separately (as MEMORY_SITE_ARENA_BLOCK), as the memory reserved by arenas,
+   so that memory is not counted twice.
+   While the accounting is disabled (the default) each of the functions below returns right away. */
+#ifndef _MMN14_MEMSTATS_H_
+#define _MMN14_MEMSTATS_H_
+#include <stdio.h>
+#include <stddef.h>
+#include "bool.h"
+
+/* A stage of the assembler's pipeline */
+typedef enum
+{
+    /* Anything outside of the stages below (e.g. reading the source for the cache) */
+    MEMORY_STAGE_OTHER,
+    /* expand_macros */
+    MEMORY_STAGE_EXPAND_MACROS,
+    /* first_pass */
+    MEMORY_STAGE_FIRST_PASS,
+    /* second_pass */
+    MEMORY_STAGE_SECOND_PASS,
+    /* incremental_assemble, which replaces both passes for a file with an incremental state */
+    MEMORY_STAGE_INCREMENTAL,
+    /* writing the artifacts (see writer.h) */
+    MEMORY_STAGE_OUTPUT,
+    /* The amount of stages */
+    MEMORY_STAGE_COUNT
+} MemoryStage;
+
+/* The site an allocation was made by */
+typedef enum
+{
+    /* A block an arena allocated from the heap (memory reserved by the arena, not handed out yet) */
+    MEMORY_SITE_ARENA_BLOCK,
+    /* An object of a fixed size, e.g. the struct of a vector or a hash table's slots */
+    MEMORY_SITE_OBJECT,
+    /* A string duplicated into an arena (see arena_strdup), e.g. the name of a symbol or a macro's line */
+    MEMORY_SITE_STRDUP,
+    /* The array of a vector growing (see vector.h) */
+    MEMORY_SITE_VECTOR_GROWTH,
+    /* The words of an image growing (see image.h) */
+    MEMORY_SITE_IMAGE_GROWTH,
+    /* The amount of sites */
+    MEMORY_SITE_COUNT
+} MemorySite;
+
+/**
+ * @brief Enable the accounting. Should be called once, before any allocation is made and before any other thread is started.
+ * @return TRUE if successful, FALSE if the accounting could not be set up.
+ */
+bool memory_stats_enable();
+
+/**
+ * @brief Set the stage the allocations of the calling thread are attributed to (each thread starts in MEMORY_STAGE_OTHER)
+ * @param stage the stage
+ * @return the previous stage of the thread, so that it can be restored once the stage is done
+ */
+MemoryStage memory_stats_set_stage(MemoryStage stage);
+
+/**
+ * @brief Account for an allocation
+ * @param site the site of the allocation
+ * @param size the amount of bytes allocated
+ */
+void memory_stats_alloc(MemorySite site, size_t size);
+
+/**
+ * @brief Account for a reallocation (an allocation if old_size is 0)
+ * @param site the site of the reallocation
+ * @param old_size the amount of bytes before the reallocation
+ * @param new_size the amount of bytes after the reallocation
+ */
+void memory_stats_realloc(MemorySite site, size_t old_size, size_t new_size);
+
+/**
+ * @brief Account for memory being released
+ * @param site the site the memory was allocated by
+ * @param size the amount of bytes released
+ */
+void memory_stats_free(MemorySite site, size_t size);
+
+/**
+ * @brief Print a human readable report of the accounting
+ * @param out the stream to print to
+ */
+void memory_stats_print(FILE *out);
+
+/**
+ * @brief Write a report of the accounting as a JSON object in the format:
+ * {"total": {...}, "stages": {"expand_macros": {...}, ...}, "sites": {"arena_block": {...}, ...}}
+ * @param out the stream to write to
+ */
+void memory_stats_write_json(FILE *out);
+
+#endif
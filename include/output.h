@@ -0,0 +1,89 @@
+/* This module contains the functions which format the artifacts of an assembled file (.ob, .ent and .ext files) into a stream */
+#ifndef _MMN14_OUTPUT_H_
+#define _MMN14_OUTPUT_H_
+#include <stdio.h>
+#include "second_pass.h"
+#include "vector.h"
+#include "image.h"
+#include "utils.h" /* int types */
+
+/* The type of an artifact the assembler creates for a file */
+typedef enum
+{
+    /* The file after macro expansion (.am) */
+    ARTIFACT_AM,
+    /* The object file (.ob) */
+    ARTIFACT_OB,
+    /* The entry symbols file (.ent) */
+    ARTIFACT_ENT,
+    /* The external symbols file (.ext) */
+    ARTIFACT_EXT,
+    /* The source file (.as). Only stored by the cache (see cache.h) */
+    ARTIFACT_AS,
+    /* The errors which were reported while assembling the file. Only stored by the cache (see cache.h) */
+    ARTIFACT_LOG
+} ArtifactType;
+
+/* The amount of artifact types */
+#define ARTIFACT_TYPE_COUNT 6
+
+/* the biggest length out of all the artifact extensions (including the '.') */
+#define MAX_ARTIFACT_EXTENSION_LENGTH 4
+
+/**
+ * @brief Get the file extension of an artifact type
+ * @param type the artifact type
+ * @return the extension including the '.' (e.g. ".ob"). Note: this is a constant string. YOU SHOULD NOT MODIFY IT!
+ */
+const char *artifact_extension(ArtifactType type);
+
+/**
+ * @brief Check whether or not an assembled file has anything to write in an artifact of a certain type.
+ * e.g. an .ent file is only necessary when the file has .entry directives.
+ * @param type the artifact type. Note: ARTIFACT_AM is not produced by the second pass, and as such is never necessary here.
+ * @param second_pass_result the result of a successful second pass
+ * @return TRUE if the artifact should be created, FALSE otherwise.
+ */
+bool artifact_is_necessary(ArtifactType type, SecondPassResult *second_pass_result);
+
+/**
+ * @brief Write an artifact of an assembled file to a stream
+ * @param out the stream to write to
+ * @param type the type of the artifact. ARTIFACT_AM is not supported here, see write_stream_copy.
+ * @param second_pass_result the result of a successful second pass
+ * @return the amount of bytes written, or -1 if writing to the stream failed
+ */
+long write_artifact(FILE *out, ArtifactType type, SecondPassResult *second_pass_result);
+
+/**
+ * @brief Write the object file representation of an instruction image and a data image to a stream in the format:
+ * instruction_image_length data_image_length
+ * address word
+ * address word
+ * ...
+ * @param out the stream to write to
+ * @param instruction_image the instruction image
+ * @param data_image the data image
+ * @return the amount of bytes written, or -1 if writing to the stream failed
+ */
+long write_object(FILE *out, Image *instruction_image, Image *data_image);
+
+/**
+ * @brief Write each symbol reference in a SymbolReferenceVector to a stream in the format:
+ * symbol address
+ * @param out the stream to write to
+ * @param symbols the symbol references to write
+ * @param symbol_table the symbol table the references are to
+ * @return the amount of bytes written, or -1 if writing to the stream failed
+ */
+long write_symbols(FILE *out, SymbolReferenceVector *symbols, SymbolTable symbol_table);
+
+/**
+ * @brief Copy everything from the current position of a stream until its end into another stream
+ * @param in the stream to copy from
+ * @param out the stream to copy to
+ * @return the amount of bytes copied, or -1 if reading or writing failed
+ */
+long write_stream_copy(FILE *in, FILE *out);
+
+#endif
@@ -252,4 +252,33 @@ void parse_line(char *line, ParseLineData *parse_line_data);
  */
 bool is_a_register(const char *str);
 
+/**
+ * @brief Parse a 32 bits signed integer in base 10 (an optional '-' followed by digits) from the start of a string
+ * @param str the string to parse
+ * @param integer out parameter. The parsed integer. Contains garbage if the parse failed.
+ * @param chars_read out parameter. The amount of characters the integer occupies in the string, or 0 if there are no digits at all.
+ * @param is_negative out parameter. Whether or not the integer starts with a '-'.
+ * @return TRUE if the parse was successful, FALSE if there are no digits or the integer overflows a signed 32 bit integer.
+ */
+bool parse_int32_base10(const char *str, int32 *integer, int *chars_read, bool *is_negative);
+
+/**
+ * @brief Parse a symbol from the start of a line. A symbol is only found if it is followed by a character symbol_end_indicator accepts.
+ * @param line the line to parse
+ * @param symbol_end_indicator a function which returns TRUE for the characters which end a symbol (e.g. ':'), or NULL to end symbols at the null terminator
+ * @param parse_symbol_data out parameter. This function fills its fields in accordance with the parsing of the symbol. Read ParseSymbolData type for more information.
+ */
+void parse_symbol(char *line, bool (*symbol_end_indicator)(char), ParseSymbolData *parse_symbol_data);
+
+/**
+ * @brief Parse a single operand (an immediate, a register, a symbol or an &address) from the start of a string.
+ * Note: assumes that the string is not empty and does not start with a space or a ','
+ * @param str the string to parse
+ * @param operand_length out parameter. The amount of characters the operand occupies in the string, if the parse was successful.
+ * @param operand out parameter. The parsed operand, if the parse was successful.
+ * @param parse_error out parameter. The error, if the parse failed.
+ * @return TRUE if the parse failed, FALSE otherwise.
+ */
+bool parse_operand(char *str, uint32 *operand_length, Operand *operand, ParseError *parse_error);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,71 @@
+/* This module contains a structural pre-scan of a line: a single pass over the line (16 or 32 bytes at a time where the CPU allows it)
+   which builds bitmasks of the whitespace characters and of the structural characters of the language (':', ',', '"', ';', '#', '&' and '.').
+   The lexers then jump between token boundaries using the masks instead of walking the line byte by byte.
+   On x86 the scan uses SSE2, and AVX2 when the CPU supports it (chosen once, at the first scan). Elsewhere it is a plain loop.
+   The masks cover the first SCAN_MAX_LENGTH bytes of a line, which is more than any line the assembler reads (see MAX_LINE_LENGTH).
+   Past that (and for a pointer past the null terminator of the line), the functions of this module fall back to walking the line,
+   so they behave exactly like the plain loops they replace. */
+#ifndef _MMN14_SCAN_H_
+#define _MMN14_SCAN_H_
+#include "bool.h"
+#include "utils.h" /* int types */
+
+/* The amount of 32 bit words in each mask */
+#define SCAN_MASK_WORDS 3
+
+/* The amount of bytes of a line the masks cover */
+#define SCAN_MAX_LENGTH (SCAN_MASK_WORDS * 32)
+
+/* The length from which a line gets masks. Shorter lines are walked faster than they are scanned */
+#define SCAN_MIN_LENGTH 32
+
+/* The masks of a line. Bit i (bit i % 32 of word i / 32) describes the character at offset i of the line.
+   Bits at or after the null terminator are never set */
+typedef struct
+{
+    /* the line which was scanned */
+    const char *line;
+    /* the length of the line, or SCAN_MAX_LENGTH if it is at least that long */
+    uint32 length;
+    /* whether or not the line was long enough to build the masks (see SCAN_MIN_LENGTH). If not, the masks are not set */
+    bool has_masks;
+    /* the whitespace characters (see CHAR_CLASS_SPACE in char_class.h) */
+    uint32 space[SCAN_MASK_WORDS];
+    /* the structural characters (see CHAR_CLASS_STRUCTURAL in char_class.h) */
+    uint32 structural[SCAN_MASK_WORDS];
+} LineScan;
+
+/**
+ * @brief Scan a line and build its masks
+ * @param line the line to scan. Note: the masks are only valid as long as the line is not modified
+ * @param scan out parameter - the masks of the line
+ */
+void scan_line(const char *line, LineScan *scan);
+
+/**
+ * @brief Skip the whitespace characters at the start of a string which is a part of a scanned line (like skip_space does)
+ * @param scan the masks of the line
+ * @param str a pointer into the scanned line
+ * @return a pointer to the first character at or after str which is not a whitespace character.
+ */
+char *scan_skip_space(const LineScan *scan, char *str);
+
+/**
+ * @brief Find the first occurence of a structural character in a string which is a part of a scanned line (like strchr does)
+ * @param scan the masks of the line
+ * @param str a pointer into the scanned line
+ * @param c the structural character to look for
+ * @return a pointer to the first occurence of c at or after str, or NULL if there is none.
+ */
+char *scan_find(const LineScan *scan, char *str, char c);
+
+/**
+ * @brief Find the last occurence of a structural character in a string which is a part of a scanned line (like strrchr does)
+ * @param scan the masks of the line
+ * @param str a pointer into the scanned line
+ * @param c the structural character to look for
+ * @return a pointer to the last occurence of c at or after str, or NULL if there is none.
+ */
+char *scan_find_last(const LineScan *scan, char *str, char c);
+
+#endif
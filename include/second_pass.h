@@ -4,35 +4,35 @@
 #define _MMN14_SECOND_PASS_H_
 #include <stdio.h>
 #include "vector.h"
+#include "image.h"
 #include "first_pass.h"
 #include "errors.h"
+#include "instructions.h"
 #include "bool.h"
 
 /* The result of the second pass */
 typedef struct SecondPassResult
 {
-   /* The binary image of all the instructions in the file. Each 24 bit value is represented in 32 bits, which means that negative numbers overflow
-    24 bits. */
-   U32Vector *instruction_image;
-   /* The binary image of all the data in the file. Each 24 bit value is represented in 32 bits, which means that negative numbers overflow
-    24 bits. */
-   U32Vector *data_image;
+   /* The binary image of all the instructions in the file, packed 24 bits per word (see image.h). */
+   Image *instruction_image;
+   /* The binary image of all the data in the file, packed 24 bits per word (see image.h). */
+   Image *data_image;
 
-   /* All the entry symbols along with the address at which they are defined.
+   /* All the entry symbols (each one once, in the order of their first .entry) along with the address at which they are defined.
       e.g. if instructions start at address 0,
       .entry hi
       hi: inc r3
-      then 'hi' will be in the symbol vector with address 0.
-      Note: this contains refrences from symbol_table, and as such, should not be used after you free the symbol table. */
-   SymbolVector *entry_symbols;
+      then 'hi' will be in the vector with address 0.
+      Note: the references are to symbols of symbol_table (see symbol_table_get). */
+   SymbolReferenceVector *entry_symbols;
    /* All the external symbols along with the address in which they are used inside an instruction.
       So, to replace the symbols with actual values in the instruction image, you simply need to put the value in the external symbol's address.
       e.g. if instructions start at address 0,
       .extern external
       add external, r1
-      then 'external' will be in the symbol vector with address 1 (since it is encoded right after the instruction)
-      Note: this contains refrences from symbol_table, and as such, should not be used after you free the symbol table. */
-   SymbolVector *external_symbols;
+      then 'external' will be in the vector with address 1 (since it is encoded right after the instruction)
+      Note: the references are to symbols of symbol_table (see symbol_table_get). */
+   SymbolReferenceVector *external_symbols;
    /* The symbol table the first pass built up.
       It contains the following 3 things:
       1. Labels found before instructions and the address they should have in the object file
@@ -56,14 +56,39 @@ typedef struct SecondPassResult
  * @param input The assembly file to perform second_pass on. This function assumes that this is an assembly file with no extensions (e.g. macros)
  * @param first_pass_result The result from the first pass. This function should only be called after the first_pass or something equivalent returned a FirstPassResult object
  * @param err_callback The callback to call each time there is an error
+ * @param arena the arena the result is allocated in. Should be the arena of first_pass_result, since the result takes over its data image and symbol table.
+ * The result lives until the arena is reset, so there is nothing to free.
  * @return SecondPassResult object. See its documentation for more information.
  */
-SecondPassResult second_pass(FILE *input, FirstPassResult first_pass_result, ErrorCallback err_callback);
+SecondPassResult second_pass(FILE *input, FirstPassResult first_pass_result, ErrorCallback err_callback, Arena *arena);
 
 /**
- * @brief Free all dynamic data structures which are held by the SecondPassResult object.
- * Note: there is no need to free the FirstPassResult object which was given to second_pass.
- * @param second_pass_result the SecondPassResult object
+ * @brief Runs a second pass on an input file which only validates it (see --check): it reports the same errors as second_pass,
+ * but does not encode the instructions nor collect the entry and external symbols.
+ * @param input The assembly file to perform second_pass_check on. This function assumes that this is an assembly file with no extensions (e.g. macros)
+ * @param first_pass_result The result from the first pass (or first_pass_check)
+ * @param err_callback The callback to call each time there is an error
+ * @param arena the arena of first_pass_result
+ * @return SecondPassResult object, whose instruction image, entry symbols and external symbols are NULL. See its documentation for more information.
+ */
+SecondPassResult second_pass_check(FILE *input, FirstPassResult first_pass_result, ErrorCallback err_callback, Arena *arena);
+
+/**
+ * @brief Encode the information word of an operand whose symbol (if it has one) has already been looked up in the symbol table
+ * @param operand the operand
+ * @param symbol the symbol the operand refers to. Only used when the operand is of type OPERAND_SYMBOL or OPERAND_ADDRESS.
+ * @param current_instruction_addr the address of the instruction the operand belongs to
+ * @return the information word, or 0 if the operand does not need one (i.e. if it is a register)
  */
-void free_second_pass_result(SecondPassResult second_pass_result);
+uint32 encode_resolved_operand(Operand *operand, Symbol *symbol, uint32 current_instruction_addr);
+
+/**
+ * @brief Encode the information word of an operand, looking up its symbol (if it has one) in the symbol table
+ * @param operand the operand. If it refers to a symbol, the symbol must be in symbol_table.
+ * @param symbol_table the symbol table
+ * @param current_instruction_addr the address of the instruction the operand belongs to
+ * @return the information word, or 0 if the operand does not need one (i.e. if it is a register)
+ */
+uint32 encode_operand(Operand *operand, SymbolTable *symbol_table, uint32 current_instruction_addr);
+
 #endif
\ No newline at end of file
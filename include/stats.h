@@ -0,0 +1,179 @@
+/* This module contains the timing statistics of a run of the assembler (see --stats): the wall time and the CPU time of each stage of the pipeline
+   and of each artifact writer, per file and in total, along with the throughput derived from them.
+   The CPU time of a stage is the CPU time of the thread which ran it, so stages which run on the background writer's thread (see writer.h)
+   are measured correctly. Measuring a stage takes a couple of clock reads, so the statistics are cheap enough to keep on in production runs.
+   Where the kernel allows it (perf_event_open on Linux), hardware counters (cycles, instructions, branch misses and cache misses) are read
+   around each stage as well, on the thread which called stats_init. Counters which can't be opened (e.g. in a container without perf access,
+   or on a machine without a PMU) are reported as unavailable, and the rest of the statistics are unaffected. */
+#ifndef _MMN14_STATS_H_
+#define _MMN14_STATS_H_
+#include <stdio.h>
+#include "bool.h"
+
+/* A stage whose time is measured */
+typedef enum
+{
+    /* expand_macros */
+    STATS_STAGE_EXPAND_MACROS,
+    /* first_pass */
+    STATS_STAGE_FIRST_PASS,
+    /* second_pass */
+    STATS_STAGE_SECOND_PASS,
+    /* incremental_assemble, which replaces both passes for a file with an incremental state */
+    STATS_STAGE_INCREMENTAL,
+    /* writing the .am file into a container (without a container, the .am file is written by expand_macros) */
+    STATS_STAGE_WRITE_AM,
+    /* writing the .ob file */
+    STATS_STAGE_WRITE_OB,
+    /* writing the .ent file */
+    STATS_STAGE_WRITE_ENT,
+    /* writing the .ext file */
+    STATS_STAGE_WRITE_EXT,
+    /* The amount of stages */
+    STATS_STAGE_COUNT
+} StatsStage;
+
+/* A hardware counter which is read around the stages */
+typedef enum
+{
+    /* CPU cycles */
+    STATS_COUNTER_CYCLES,
+    /* retired instructions */
+    STATS_COUNTER_INSTRUCTIONS,
+    /* mispredicted branches */
+    STATS_COUNTER_BRANCH_MISSES,
+    /* L1 data cache read misses */
+    STATS_COUNTER_L1D_MISSES,
+    /* last level cache misses */
+    STATS_COUNTER_LLC_MISSES,
+    /* The amount of counters */
+    STATS_COUNTER_COUNT
+} StatsCounter;
+
+/* The time a stage took (summed over each time it ran) */
+typedef struct
+{
+    /* wall time in seconds */
+    double wall;
+    /* CPU time in seconds */
+    double cpu;
+    /* the amount of times the stage ran */
+    unsigned long runs;
+    /* the amount of those runs which the hardware counters measured (the ones on the thread which called stats_init),
+       and the counts of each counter over them (scaled up if the kernel multiplexed the counter) */
+    unsigned long counted_runs;
+    double counters[STATS_COUNTER_COUNT];
+} StageTime;
+
+/* The statistics of a single file. Each field is only written by the thread which runs the stage it belongs to. */
+typedef struct
+{
+    /* the base filename of the file. Note: this is not copied */
+    char *name;
+    /* the time of each stage */
+    StageTime stages[STATS_STAGE_COUNT];
+    /* the amount of times the file was assembled (more than once with --watch) */
+    unsigned long assemblies;
+    /* the amount of times the file's result was taken from the cache (see cache.h) instead of being assembled */
+    unsigned long cache_hits;
+    /* the amount of lines and bytes of source read by the assemblies */
+    unsigned long lines;
+    unsigned long bytes;
+    /* the amount of words (instructions and data) emitted into object files */
+    unsigned long words;
+    /* the amount of symbols the assemblies defined */
+    unsigned long symbols;
+} FileStats;
+
+/* The statistics of a run of the assembler */
+typedef struct
+{
+    /* the statistics of each file */
+    FileStats *files;
+    /* the amount of files */
+    int file_count;
+    /* the wall time and the CPU time (of all threads) of the whole run in seconds. Only valid after stats_finish */
+    double wall;
+    double cpu;
+} RunStats;
+
+/* A reading of a hardware counter: its count, and the time it was enabled for and the time it actually counted for (in nanoseconds),
+   which differ when the kernel multiplexes more counters than the PMU has */
+typedef struct
+{
+    double value;
+    double enabled;
+    double running;
+} StatsCounterReading;
+
+/* A measurement of a stage which is in progress (see stats_timer_start) */
+typedef struct
+{
+    /* the file the stage is measured for, or NULL if nothing is measured */
+    FileStats *file;
+    /* the wall time and the CPU time of the thread when the stage started */
+    double wall;
+    double cpu;
+    /* whether or not the hardware counters are read for the stage, and their readings when it started */
+    bool counting;
+    StatsCounterReading counters[STATS_COUNTER_COUNT];
+} StatsTimer;
+
+/**
+ * @brief Get the name of a stage, as it appears in the reports (e.g. "first_pass")
+ * @param stage the stage
+ * @return the name of the stage
+ */
+const char *stats_stage_name(StatsStage stage);
+
+/**
+ * @brief Initialize the statistics of a run and start measuring it. This opens the hardware counters of the calling thread, if it can.
+ * @param stats out parameter - the RunStats to initialize. Note: free it with stats_free after you're done using it.
+ * @param names the base filenames of the files of the run (not copied)
+ * @param file_count the amount of files
+ * @return TRUE if successful, FALSE if an allocation failed.
+ */
+bool stats_init(RunStats *stats, char **names, int file_count);
+
+/**
+ * @brief Stop measuring a run
+ * @param stats the statistics of the run
+ */
+void stats_finish(RunStats *stats);
+
+/**
+ * @brief Start measuring a stage of a file
+ * @param timer out parameter - the measurement
+ * @param file the statistics of the file, or NULL to measure nothing (in which case stats_timer_stop does nothing as well)
+ */
+void stats_timer_start(StatsTimer *timer, FileStats *file);
+
+/**
+ * @brief Stop measuring a stage and add the time it took to the statistics of its file. Must be called on the thread which started it.
+ * @param timer the measurement
+ * @param stage the stage which was measured
+ */
+void stats_timer_stop(StatsTimer *timer, StatsStage stage);
+
+/**
+ * @brief Print a human readable report of the statistics of a run
+ * @param stats the statistics of the run
+ * @param out the stream to print to
+ */
+void stats_print(RunStats *stats, FILE *out);
+
+/**
+ * @brief Write the statistics of a run as a JSON object in the format:
+ * {"counters_available": ..., "wall_seconds": ..., "cpu_seconds": ..., "throughput": {...}, "stages": {...}, "files": [{"name": ..., ...}, ...]}
+ * @param stats the statistics of the run
+ * @param out the stream to write to
+ */
+void stats_write_json(RunStats *stats, FILE *out);
+
+/**
+ * @brief Free the statistics of a run (and close the hardware counters)
+ * @param stats the statistics of the run
+ */
+void stats_free(RunStats *stats);
+
+#endif
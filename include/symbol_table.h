@@ -1,8 +1,10 @@
-/* This module contains the Symbol and SymbolTable objects (and related methods) which can be used to store symbols of an assembly file */
+/* This module contains the Symbol and SymbolTable objects (and related methods) which can be used to store symbols of an assembly file.
+   A symbol table and the names of its symbols live in an arena (see arena.h), so it is released along with the arena. */
 
 #ifndef _MMN14_SYMBOL_TABLE_H_
 #define _MMN14_SYMBOL_TABLE_H_
 #include "vector.h"
+#include "arena.h"
 #include "utils.h"
 
 /* The context in which the symbol was defined */
@@ -31,6 +33,18 @@ typedef struct Symbol
 
 VECTOR_HEADER(Symbol, SymbolVector, symbol)
 
+/* A reference to a symbol of a SymbolTable at some address, e.g. a use of an external symbol inside an instruction.
+   The symbol is referred to by its id (see symbol_table_id) rather than by a copy of it, so a reference takes only 8 bytes. */
+typedef struct
+{
+   /* The id of the symbol in its symbol table */
+   uint32 symbol_id;
+   /* The address of the reference */
+   uint32 addr;
+} SymbolReference;
+
+VECTOR_HEADER(SymbolReference, SymbolReferenceVector, symbol_ref)
+
 /*  This type represents a map between a symbol's name to itself. Read Symbol struct above and the methods below.
     Note: the symbol table acts as a pointer, meaning it is fine to return it by value. */
 typedef struct
@@ -38,6 +52,16 @@ typedef struct
    SymbolVector *inner;
 } SymbolTable;
 
+/* This type represents a set of symbols of a SymbolTable (by their ids), e.g. the symbols which already have an .entry directive.
+   A set has room for the symbols the table had when the set was initialized. */
+typedef struct
+{
+   /* whether each symbol id is in the set */
+   uint8 *members;
+   /* the amount of symbol ids the set has room for */
+   uint32 size;
+} SymbolSet;
+
 /* This type represents an iterator over a SymbolTable. Read symbol_table_iter for more info.
    Note: This object should be considered invalid the moment you use any modifying method (e.g. symbol_table_insert)
    on the underlying SymbolTable object. It is fine however to modify the symbols while iterating. */
@@ -50,16 +74,10 @@ typedef struct symbol_table_iterator
 /**
  * @brief Attempt to initialize a symbol table
  * @param symbol_table out parameter - a pointer a SymbolTable to initialize.
- * Note: Free the symbol table after you're done using it.
+ * @param arena the arena the symbol table (and the names of its symbols) is allocated in. The table lives until the arena is reset.
  * @return TRUE if the initialization was successful, FALSE otherwise. Initialization will fail if allocation of memory fail.
  */
-bool symbol_table_init(SymbolTable *symbol_table);
-
-/**
- * @brief Free any dynamic memory a SymbolTable object is holding
- * @param symbol_table the SymbolTable to free
- */
-void symbol_table_free(SymbolTable symbol_table);
+bool symbol_table_init(SymbolTable *symbol_table, Arena *arena);
 
 /**
  * @brief Search for a symbol in SymbolTable
@@ -72,7 +90,7 @@ Symbol *symbol_table_search(SymbolTable symbol_table, char *symbol);
 /**
  * @brief Attempt to insert a symbol into the SymbolTable
  * @param symbol_table The SymbolTable object to insert the symbol to
- * @param symbol_name The name of the symbol. Note: the name will be copied
+ * @param symbol_name The name of the symbol. Note: the name will be copied into the table's arena
  * @param addr The address of the symbol
  * @param region The region of the symbol
  * @param line_num The number in which the symbol was defined
@@ -80,6 +98,39 @@ Symbol *symbol_table_search(SymbolTable symbol_table, char *symbol);
  */
 bool symbol_table_insert(SymbolTable symbol_table, const char *symbol_name, uint32 addr, SymbolContext ctx, int line_num);
 
+/**
+ * @brief Get the id of a symbol in a symbol table. Ids are assigned in insertion order starting from 0, and never change.
+ * @param symbol_table the SymbolTable the symbol is in
+ * @param symbol a pointer to the symbol (e.g. as returned by symbol_table_search)
+ * @return the id of the symbol
+ */
+uint32 symbol_table_id(SymbolTable symbol_table, Symbol *symbol);
+
+/**
+ * @brief Get a symbol of a symbol table by its id
+ * @param symbol_table the SymbolTable
+ * @param symbol_id the id of the symbol. Must be the id of a symbol in the table.
+ * @return A pointer to the Symbol object
+ */
+Symbol *symbol_table_get(SymbolTable symbol_table, uint32 symbol_id);
+
+/**
+ * @brief Initialize an empty set with room for every symbol currently in a symbol table
+ * @param set out parameter - the SymbolSet to initialize
+ * @param symbol_table the SymbolTable whose symbols the set holds
+ * @param arena the arena the set is allocated in. The set lives until the arena is reset.
+ * @return TRUE if the initialization was successful, FALSE if an allocation failed.
+ */
+bool symbol_set_init(SymbolSet *set, SymbolTable symbol_table, Arena *arena);
+
+/**
+ * @brief Insert a symbol into a set
+ * @param set the SymbolSet
+ * @param symbol_id the id of the symbol. Must be smaller than the size of the set.
+ * @return TRUE if the symbol was inserted, FALSE if it was already in the set.
+ */
+bool symbol_set_insert(SymbolSet *set, uint32 symbol_id);
+
 /**
  * @brief Iterate over all of the symbols in the symbol table
  * @param symbol_table The symbol table to iterate on
@@ -0,0 +1,55 @@
+/* This module contains the opt-in timeline of a run of the assembler (see --trace): begin and end events of each file and of each stage,
+   tagged with the thread which ran them, written in the Chrome trace event format so that the timeline can be opened in Perfetto
+   (or chrome://tracing).
+   Each thread records its events into a buffer of its own, so recording an event takes no lock. A thread's buffer is registered
+   (under a lock) once, when the thread records its first event, and the buffers are only read by trace_write, after the other threads are done.
+   While tracing is disabled (the default) each of the functions below returns right away. */
+#ifndef _MMN14_TRACE_H_
+#define _MMN14_TRACE_H_
+#include "bool.h"
+
+/* The categories of the events */
+#define TRACE_CATEGORY_FILE "file"
+#define TRACE_CATEGORY_STAGE "stage"
+#define TRACE_CATEGORY_WRITE "write"
+
+/**
+ * @brief Enable tracing. Should be called once, before any other thread is started. The timestamps of the events are relative to this call.
+ * @return TRUE if successful, FALSE if tracing could not be set up.
+ */
+bool trace_enable();
+
+/**
+ * @brief Name the calling thread in the timeline (e.g. "main" or "writer")
+ * @param name the name of the thread. Note: this is not copied
+ */
+void trace_set_thread_name(const char *name);
+
+/**
+ * @brief Record the beginning of a span on the calling thread
+ * @param category the category of the span (one of the TRACE_CATEGORY_* above)
+ * @param name the name of the span (e.g. "first_pass"). Note: this is not copied
+ * @param file the base filename of the file the span belongs to, or NULL. Note: this is not copied
+ */
+void trace_begin(const char *category, const char *name, const char *file);
+
+/**
+ * @brief Record the end of the span the calling thread began last (see trace_begin)
+ */
+void trace_end();
+
+/**
+ * @brief Write all the recorded events into a file as a JSON object in the Chrome trace event format:
+ * {"traceEvents": [{"name": ..., "cat": ..., "ph": "B", "ts": ..., "pid": ..., "tid": ..., "args": {"file": ...}}, ...], ...}
+ * Must be called after all the other threads which recorded events are done.
+ * @param path the path of the file
+ * @return TRUE if successful, FALSE otherwise.
+ */
+bool trace_write(const char *path);
+
+/**
+ * @brief Free all the recorded events
+ */
+void trace_free();
+
+#endif
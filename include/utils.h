@@ -1,7 +1,9 @@
 /* This module consists of functions/definitions which are used in 2 or more files, do not fit in any of the modules, and do not deserve their own module */
 #ifndef _MMN14_UTILS_H_
 #define _MMN14_UTILS_H_
+#include <stdio.h>
 #include <limits.h>
+#include "bool.h"
 
 /* the maximum size of a label */
 #define MAX_LABEL_SIZE 31
@@ -42,14 +44,14 @@ typedef unsigned char uint8;
 #endif
 
 /**
- * @brief Skip the spaces (as defined in isspace) in a string
+ * @brief Skip the spaces (see CHAR_CLASS_SPACE in char_class.h) in a string
  * @param str The string to skip spaces in
  * @return A pointer to the same string after skipping all the spaces.
  */
 char *skip_space(char *str);
 
 /**
- * @brief Removes any trailing whitespaces (as defined in isspace) of a string
+ * @brief Removes any trailing whitespaces (see CHAR_CLASS_SPACE in char_class.h) of a string
  * @param str The string to remove trailing whitespaces from
  * @return The string which was given (for convenience)
  */
@@ -62,4 +64,56 @@ char *trim_end(char *str);
  */
 char *strdup(const char *str);
 
+/**
+ * @brief Write a 32 bit integer to a stream as little endian
+ * @param file the stream to write to
+ * @param value the integer to write
+ * @return TRUE if successful, FALSE otherwise.
+ */
+bool write_u32_le(FILE *file, uint32 value);
+
+/**
+ * @brief Read a 32 bit little endian integer from a stream
+ * @param file the stream to read from
+ * @param value out parameter - the integer which was read
+ * @return TRUE if successful, FALSE otherwise.
+ */
+bool read_u32_le(FILE *file, uint32 *value);
+
+/**
+ * @brief Read the line which starts at an offset of a file again (like fgets does), without changing the position of the file
+ * @param file the file to read from
+ * @param offset the offset of the start of the line (see next_line_offset)
+ * @param buf the buffer to read into
+ * @param size the size of buf
+ * @return buf, which holds an empty string if the line could not be read.
+ */
+char *read_line_at(FILE *file, long offset, char *buf, int size);
+
+/**
+ * @brief Get the offset of the line which follows a line that fgets has just read from a file
+ * @param file the file the line was read from
+ * @param offset the offset of the start of the line
+ * @param line the line
+ * @param length the length of the line
+ * @return the offset of the next line in file.
+ */
+long next_line_offset(FILE *file, long offset, const char *line, size_t length);
+
+/**
+ * @brief Get the length of the UTF-8 sequence a string starts with
+ * @param str the string. It must not be empty
+ * @return the amount of bytes of the sequence (1 for an ASCII character), or 0 if the string does not start with a valid UTF-8 sequence
+ * (e.g. a stray continuation byte, a truncated sequence, an overlong form, a surrogate or a code point past U+10FFFF).
+ */
+int utf8_sequence_length(const char *str);
+
+/**
+ * @brief Write a string to a stream as a JSON string (quoted, with quotes, backslashes and control characters escaped).
+ * Bytes which are not a part of a valid UTF-8 sequence are escaped as \u00XX, so the output is always valid JSON
+ * @param file the stream to write to
+ * @param str the string to write
+ */
+void write_json_string(FILE *file, const char *str);
+
 #endif
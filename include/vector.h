@@ -7,15 +7,31 @@
    For user created types (i.e. structs/typedefs) do the same thing but in your own module
    (e.g. in a module for an object called someObject, in someObject.h use VECTOR_HEADER and in someObject.c use VECTOR_IMPL)
 
-   The header and implementation macros are separated to prevent code duplication. */
+   The header and implementation macros are separated to prevent code duplication.
+
+   A vector can also be created inside an arena (see arena.h), in which case it grows inside the arena and freeing it does nothing:
+   it is released along with everything else in the arena when the arena is reset.
+   The memory of a vector is accounted by memstats.h (as MEMORY_SITE_VECTOR_GROWTH) when memory accounting is enabled.
+
+   A vector starts empty and allocates VECTOR_INITIAL_CAPACITY items on its first push. Once it reaches its capacity, its capacity is doubled.
+   When the final size of a vector is known (or can be bounded), reserve it up front with prefix##_vec_reserve, or grow it by that many items at once
+   with prefix##_vec_push_n or prefix##_vec_resize_uninitialized, so that it is allocated once instead of growing over and over. */
 #ifndef _MMN14_VECTOR_H_
 #define _MMN14_VECTOR_H_
 
 #include <malloc.h>
+#include <string.h>
 #include <assert.h>
 #include "bool.h"
+#include "arena.h"
+#include "memstats.h"
 #include "utils.h" /* for int types */
 
+/* The capacity a vector allocates on its first push. Can be configured at compile time (e.g. -DVECTOR_INITIAL_CAPACITY=16) */
+#ifndef VECTOR_INITIAL_CAPACITY
+#define VECTOR_INITIAL_CAPACITY 8
+#endif
+
 /* implement the vector container header (dynamic array) for some type.
    Note: this only implements the header, meaning you should use IMPL_VECTOR with the same parameters in the implementation file to
    fully implement the vector for the type.
@@ -24,20 +40,35 @@
    prefix - the prefix to the vector functions
    Read the macro's body for documentation of available methods. */
 #define VECTOR_HEADER(type, vec_type_name, prefix)                                                                             \
-    /* Len is the length of the vector. Consider the other two fields as private fields. */                                    \
+    /* Len is the length of the vector. Consider the other fields as private fields. */                                        \
     typedef struct                                                                                                             \
     {                                                                                                                          \
         type *array;                                                                                                           \
         uint32 len;                                                                                                            \
         uint32 capacity;                                                                                                       \
+        /* the arena the vector is allocated in, or NULL if it is allocated with malloc */                                     \
+        Arena *arena;                                                                                                          \
     } vec_type_name;                                                                                                           \
     /* Create a new vector.                                                                                                    \
      Returns a pointer to the newly allocated vector if successfull, and NULL if the allocation failed.  */                    \
     vec_type_name *prefix##_vec_create();                                                                                      \
+    /* Create a new vector inside an arena. The vector lives until the arena is reset.                                         \
+     Returns a pointer to the newly allocated vector if successfull, and NULL if the allocation failed.  */                    \
+    vec_type_name *prefix##_vec_create_in(Arena *arena);                                                                       \
     /* Push an item into the last place of the vector. A push may be unsuccessfull if allocation for more dynamic memory fail. \
        Returns TRUE if the push was successfull, FALSE otherwise.   */                                                         \
     bool prefix##_vec_push(vec_type_name *vec, type item);                                                                     \
-    /* Free the vector. The vector should not be used after calling this.                                                      \
+    /* Push count items (copied from items) into the last places of the vector at once.                                        \
+       Returns TRUE if the push was successfull, FALSE otherwise (in which case the vector is unchanged). */                   \
+    bool prefix##_vec_push_n(vec_type_name *vec, const type *items, uint32 count);                                             \
+    /* Ensure that the vector can hold at least capacity items, so that growing it up to that length does not allocate.        \
+       Returns TRUE if successfull, FALSE if the allocation failed (in which case the vector is unchanged). */                 \
+    bool prefix##_vec_reserve(vec_type_name *vec, uint32 capacity);                                                            \
+    /* Set the length of the vector. Items past the old length are NOT initialized,                                            \
+       and should be written (through array) before they're read.                                                              \
+       Returns TRUE if successfull, FALSE if the allocation failed (in which case the vector is unchanged). */                 \
+    bool prefix##_vec_resize_uninitialized(vec_type_name *vec, uint32 len);                                                    \
+    /* Free the vector. The vector should not be used after calling this. Does nothing for a vector inside an arena.           \
        Note: if the vector's items are pointers to allocated objects, it is your responsibility to free them. */               \
     void prefix##_vec_free(vec_type_name *vec);                                                                                \
     /* Get a copy of a value which is in a certain position in the vector */                                                   \
@@ -46,49 +77,117 @@
     type *prefix##_vec_get_ptr(const vec_type_name *vec, uint32 position);
 
 /* Implement the vector for some type. Do not use in a HEADER file, as that will result in multiple definitions of the same functions.
-   The implementation is fairly straightforward: it's basically an array, except once it reaches its capacity, it grows its size by 2. */
+   The implementation is fairly straightforward: it's basically an array, except once it reaches its capacity, it grows its size by 2
+   (with realloc, or inside its arena if it has one). */
 #define VECTOR_IMPL(type, vec_type_name, prefix)                                             \
     vec_type_name *prefix##_vec_create()                                                     \
     {                                                                                        \
         vec_type_name *vec = calloc(1, sizeof(vec_type_name));                               \
+        if (vec != NULL)                                                                     \
+        {                                                                                    \
+            memory_stats_alloc(MEMORY_SITE_OBJECT, sizeof(vec_type_name));                   \
+        }                                                                                    \
         return vec;                                                                          \
     }                                                                                        \
                                                                                              \
-    bool prefix##_vec_push(vec_type_name *vec, type item)                                    \
+    vec_type_name *prefix##_vec_create_in(Arena *arena)                                      \
+    {                                                                                        \
+        vec_type_name *vec = arena_alloc(arena, sizeof(vec_type_name));                      \
+        if (vec != NULL)                                                                     \
+        {                                                                                    \
+            vec->array = NULL;                                                               \
+            vec->len = 0;                                                                    \
+            vec->capacity = 0;                                                               \
+            vec->arena = arena;                                                              \
+        }                                                                                    \
+        return vec;                                                                          \
+    }                                                                                        \
+                                                                                             \
+    /* reallocate the array to hold exactly capacity items.                                  \
+       Returns TRUE if successfull, FALSE otherwise */                                       \
+    bool prefix##_vec_set_capacity(vec_type_name *vec, uint32 capacity)                      \
     {                                                                                        \
         type *new_alloc;                                                                     \
-        if (vec->capacity == 0)                                                              \
+        if (vec->arena != NULL)                                                              \
+        {                                                                                    \
+            new_alloc = arena_realloc(vec->arena, vec->array, sizeof(type) * vec->capacity,  \
+                                      sizeof(type) * capacity, MEMORY_SITE_VECTOR_GROWTH);   \
+        }                                                                                    \
+        else if ((new_alloc = realloc(vec->array, sizeof(type) * capacity)) != NULL)         \
+        {                                                                                    \
+            memory_stats_realloc(MEMORY_SITE_VECTOR_GROWTH, sizeof(type) * vec->capacity,    \
+                                 sizeof(type) * capacity);                                   \
+        }                                                                                    \
+        if (new_alloc == NULL)                                                               \
         {                                                                                    \
-            vec->array = malloc(sizeof(type));                                               \
-            if (vec->array == NULL)                                                          \
-            {                                                                                \
-                return FALSE;                                                                \
-            }                                                                                \
-            vec->capacity = 1;                                                               \
+            return FALSE;                                                                    \
         }                                                                                    \
-        else if (vec->capacity == vec->len)                                                  \
+        vec->array = new_alloc;                                                              \
+        vec->capacity = capacity;                                                            \
+        return TRUE;                                                                         \
+    }                                                                                        \
+                                                                                             \
+    /* grow the capacity (by doubling it) until it can hold at least min_capacity items */   \
+    bool prefix##_vec_grow(vec_type_name *vec, uint32 min_capacity)                          \
+    {                                                                                        \
+        uint32 capacity = vec->capacity == 0 ? VECTOR_INITIAL_CAPACITY : vec->capacity;      \
+        while (capacity < min_capacity)                                                      \
         {                                                                                    \
-            /* increase the size of the allocation by 2 once the len reaches the capacity */ \
-            new_alloc = realloc(vec->array, sizeof(type) * vec->len * 2);                    \
-            if (new_alloc != NULL)                                                           \
-            {                                                                                \
-                vec->array = new_alloc;                                                      \
-                vec->capacity = vec->len * 2;                                                \
-            }                                                                                \
-            else                                                                             \
-            {                                                                                \
-                return FALSE;                                                                \
-            }                                                                                \
+            capacity *= 2;                                                                   \
+        }                                                                                    \
+        return prefix##_vec_set_capacity(vec, capacity);                                     \
+    }                                                                                        \
+                                                                                             \
+    bool prefix##_vec_push(vec_type_name *vec, type item)                                    \
+    {                                                                                        \
+        if (vec->capacity == vec->len && !prefix##_vec_grow(vec, vec->len + 1))              \
+        {                                                                                    \
+            return FALSE;                                                                    \
         }                                                                                    \
         vec->array[vec->len] = item;                                                         \
         vec->len++;                                                                          \
         return TRUE;                                                                         \
     }                                                                                        \
                                                                                              \
+    bool prefix##_vec_push_n(vec_type_name *vec, const type *items, uint32 count)            \
+    {                                                                                        \
+        if (vec->capacity - vec->len < count &&                                              \
+            !prefix##_vec_grow(vec, vec->len + count))                                       \
+        {                                                                                    \
+            return FALSE;                                                                    \
+        }                                                                                    \
+        if (count > 0)                                                                       \
+        {                                                                                    \
+            memcpy(vec->array + vec->len, items, sizeof(type) * count);                      \
+        }                                                                                    \
+        vec->len += count;                                                                   \
+        return TRUE;                                                                         \
+    }                                                                                        \
+                                                                                             \
+    bool prefix##_vec_reserve(vec_type_name *vec, uint32 capacity)                           \
+    {                                                                                        \
+        return capacity <= vec->capacity || prefix##_vec_set_capacity(vec, capacity);        \
+    }                                                                                        \
+                                                                                             \
+    bool prefix##_vec_resize_uninitialized(vec_type_name *vec, uint32 len)                   \
+    {                                                                                        \
+        if (len > vec->capacity && !prefix##_vec_grow(vec, len))                             \
+        {                                                                                    \
+            return FALSE;                                                                    \
+        }                                                                                    \
+        vec->len = len;                                                                      \
+        return TRUE;                                                                         \
+    }                                                                                        \
+                                                                                             \
     void prefix##_vec_free(vec_type_name *vec)                                               \
     {                                                                                        \
-        free(vec->array);                                                                    \
-        free(vec);                                                                           \
+        if (vec->arena == NULL)                                                              \
+        {                                                                                    \
+            memory_stats_free(MEMORY_SITE_VECTOR_GROWTH, sizeof(type) * vec->capacity);      \
+            memory_stats_free(MEMORY_SITE_OBJECT, sizeof(vec_type_name));                    \
+            free(vec->array);                                                                \
+            free(vec);                                                                       \
+        }                                                                                    \
     }                                                                                        \
                                                                                              \
     type prefix##_vec_get(const vec_type_name *vec, uint32 position)                         \
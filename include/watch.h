@@ -0,0 +1,70 @@
+/* This module contains the Watcher object, which waits for assembly files to change (using inotify, so it is Linux only).
+   The directories of the files are watched rather than the files themselves, since many editors save a file by writing a new file
+   and renaming it over the old one, which replaces the watched file.
+   Changes come in bursts (e.g. an editor truncating and then writing a file), so after the first change the watcher waits for the burst to end
+   (debouncing) and then reports every file which changed in it at once.
+   Changes are recorded from the moment the watcher is initialized, so a change made before the first wait is reported by it.
+   Waiting can be interrupted from a signal handler (see watcher_interrupt): the watcher also waits on a pipe which the handler writes into,
+   so an interruption which arrives right before a wait starts still ends that wait. */
+#ifndef _MMN14_WATCH_H_
+#define _MMN14_WATCH_H_
+#include "bool.h"
+#include "utils.h" /* int types */
+
+/* The time (in milliseconds) without any change after which a burst of changes is considered over */
+#define WATCH_DEBOUNCE_MS 10
+
+/* A file which is being watched */
+typedef struct
+{
+    /* the watch descriptor of the file's directory */
+    int watch_descriptor;
+    /* the name of the file inside its directory (e.g. "example.as") */
+    char *name;
+} WatchedFile;
+
+/* Waits for files to change. Consider all of the fields private. */
+typedef struct
+{
+    /* the inotify file descriptor */
+    int fd;
+    /* the files which are watched */
+    WatchedFile *files;
+    /* the amount of files which are watched */
+    int file_count;
+    /* a pipe which is written into to interrupt waiting (the read end and then the write end) */
+    int interrupt_fds[2];
+} Watcher;
+
+/**
+ * @brief Start watching assembly files
+ * @param watcher out parameter - the Watcher to initialize. Note: free it with watcher_free after you're done using it.
+ * @param filename_bases the base filenames of the files to watch (e.g. "example" for "example.as")
+ * @param file_count the amount of files
+ * @return TRUE if the initialization was successful, FALSE otherwise. Initialization fails if inotify is unavailable,
+ * a directory could not be watched or an allocation failed.
+ */
+bool watcher_init(Watcher *watcher, char **filename_bases, int file_count);
+
+/**
+ * @brief Wait until at least one of the files changes, and then until the burst of changes is over (see WATCH_DEBOUNCE_MS).
+ * @param watcher the watcher
+ * @param changed out parameter - an array with an element for each file, which is set to TRUE if the file changed and FALSE otherwise
+ * @return TRUE if files changed, FALSE if waiting was interrupted (by watcher_interrupt or a signal) or failed.
+ */
+bool watcher_wait(Watcher *watcher, bool *changed);
+
+/**
+ * @brief Interrupt the current wait of a watcher, or the next one if it is not waiting. Every later wait is interrupted as well.
+ * This is async-signal-safe, so it may be called from a signal handler.
+ * @param watcher the watcher
+ */
+void watcher_interrupt(Watcher *watcher);
+
+/**
+ * @brief Stop watching and free any dynamic memory a watcher is holding. The watcher should not be used after calling this.
+ * @param watcher the watcher
+ */
+void watcher_free(Watcher *watcher);
+
+#endif
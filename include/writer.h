@@ -0,0 +1,122 @@
+/* This module contains the ArtifactWriter object, which writes the artifacts of assembled files (either into their own files or into a container).
+   The writer can run in the background on its own thread: assembled files are handed to it through a bounded queue,
+   and it does the formatting and the file I/O while the next file is being assembled.
+   The writer also owns the arenas (see arena.h) files are assembled in: an arena goes to the writer along with the job of its file,
+   and once the job is written the arena is reset and reused for another file. */
+#ifndef _MMN14_WRITER_H_
+#define _MMN14_WRITER_H_
+#include <stdio.h>
+#include <pthread.h>
+#include "bool.h"
+#include "second_pass.h"
+#include "container.h"
+#include "cache.h"
+#include "arena.h"
+#include "stats.h"
+#include "utils.h" /* int types */
+
+/* The maximum amount of jobs which may wait in the writer's queue. Submitting a job when the queue is full waits for the writer to catch up,
+   which bounds the amount of memory held by assembled files which have not been written yet. */
+#define WRITER_QUEUE_CAPACITY 8
+
+/* The amount of arenas of a writer: one for each job in the queue, one for the job which is being written and one for the file which is being assembled */
+#define WRITER_ARENA_COUNT (WRITER_QUEUE_CAPACITY + 2)
+
+/* A job for the writer: the artifacts of a single file */
+typedef struct
+{
+    /* The base filename of the file (e.g. "example" for "example.as"). Used to name the artifacts and to attribute write errors to the right file.
+       Note: this is not copied, it should live until the writer is closed. */
+    char *filename_base;
+    /* The .am file (read from its start) which should be copied into the container, or NULL if there is none. The writer closes it. */
+    FILE *am_file;
+    /* Whether or not second_pass_result is valid, i.e. the file was assembled successfully and has .ob, .ent and .ext files to write */
+    bool has_result;
+    /* The result of the second pass. Only valid if has_result is TRUE. */
+    SecondPassResult second_pass_result;
+    /* The arena the file was assembled in (see writer_acquire_arena), which holds second_pass_result, or NULL if there is none.
+       The writer releases it once it is done with the job. */
+    Arena *arena;
+    /* An entry of the cache (see cache.h) which holds the artifacts of the file, or NULL if the file was assembled in this run.
+       When this is set, am_file and has_result are ignored and the artifacts are copied out of the entry. The writer frees it. */
+    Container *cached_entry;
+    /* The statistics of the file (see stats.h), which the time of each write is added to, or NULL if writes are not measured */
+    FileStats *stats;
+} WriteJob;
+
+/* Writes the artifacts of assembled files. Consider all of the fields private. */
+typedef struct
+{
+    /* the container to write into, or NULL if each artifact is written into its own file */
+    Container *container;
+    /* the path of the container, used for error messages */
+    char *container_path;
+    /* whether or not the jobs are written on a background thread */
+    bool is_async;
+    /* the background thread. Only valid if is_async is TRUE */
+    pthread_t thread;
+    /* protects all of the fields below */
+    pthread_mutex_t lock;
+    /* signaled when a job is added to the queue or the writer is closing */
+    pthread_cond_t not_empty;
+    /* signaled when a job is removed from the queue */
+    pthread_cond_t not_full;
+    /* signaled when an arena is released */
+    pthread_cond_t arena_released;
+    /* a ring buffer of the jobs which have not been written yet */
+    WriteJob queue[WRITER_QUEUE_CAPACITY];
+    /* the position of the oldest job in the queue */
+    uint32 queue_start;
+    /* the amount of jobs in the queue */
+    uint32 queue_len;
+    /* whether or not writer_close has been called */
+    bool is_closing;
+    /* the arenas files are assembled in */
+    Arena arenas[WRITER_ARENA_COUNT];
+    /* the arenas which are not used by any file */
+    Arena *free_arenas[WRITER_ARENA_COUNT];
+    /* the amount of arenas in free_arenas */
+    uint32 free_arena_count;
+} ArtifactWriter;
+
+/**
+ * @brief Initialize a writer
+ * @param writer out parameter - the ArtifactWriter to initialize. Note: close it with writer_close after you're done submitting jobs.
+ * @param container the container to write into, or NULL to write each artifact into its own file
+ * @param container_path the path of the container (for error messages), or NULL if there is no container
+ * @param is_async whether to write the jobs on a background thread (TRUE), or right when they are submitted (FALSE)
+ * @return TRUE if the initialization was successful, FALSE otherwise. Initialization fails if the background thread could not be created.
+ */
+bool writer_init(ArtifactWriter *writer, Container *container, char *container_path, bool is_async);
+
+/**
+ * @brief Get an empty arena to assemble a file in. The arena is given back to the writer along with the job of the file (see WriteJob),
+ * or with writer_release_arena if the file has no job. If every arena is in use, this waits until one is released.
+ * @param writer the writer
+ * @return the arena
+ */
+Arena *writer_acquire_arena(ArtifactWriter *writer);
+
+/**
+ * @brief Give an arena back to the writer without submitting a job. The arena is reset, and should not be used after calling this.
+ * @param writer the writer
+ * @param arena an arena returned by writer_acquire_arena
+ */
+void writer_release_arena(ArtifactWriter *writer, Arena *arena);
+
+/**
+ * @brief Hand a job to the writer. The writer takes ownership of the job's am_file and arena.
+ * If the writer is asynchronous and its queue is full, this waits until there is room in the queue.
+ * Errors in writing the artifacts are reported on stdout along with the name of the artifact they happened in.
+ * @param writer the writer
+ * @param job the job to write
+ */
+void writer_submit(ArtifactWriter *writer, WriteJob job);
+
+/**
+ * @brief Wait for every submitted job to be written and free the writer's resources (including its arenas). The writer should not be used after calling this.
+ * @param writer the writer
+ */
+void writer_close(ArtifactWriter *writer);
+
+#endif
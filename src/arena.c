@@ -0,0 +1,168 @@
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+
+/* A type with the strictest alignment we hand memory out for */
+typedef union
+{
+    long l;
+    double d;
+    void *p;
+    void (*f)(void);
+} ArenaAlign;
+
+/* Round a size up to a multiple of the alignment */
+#define ARENA_ROUND_UP(size) (((size) + sizeof(ArenaAlign) - 1) / sizeof(ArenaAlign) * sizeof(ArenaAlign))
+
+/* The size of a block's header, rounded so that the memory after it is aligned */
+#define ARENA_HEADER_SIZE ARENA_ROUND_UP(sizeof(ArenaBlock))
+
+/* Get the memory of a block */
+#define ARENA_BLOCK_DATA(block) ((char *)(block) + ARENA_HEADER_SIZE)
+
+void arena_init(Arena *arena)
+{
+    int i;
+    arena->first = NULL;
+    arena->current = NULL;
+    arena->last = NULL;
+    for (i = 0; i < MEMORY_SITE_COUNT; ++i)
+    {
+        arena->accounted[i] = 0;
+    }
+}
+
+/* Make the current block one with at least size free bytes: the next (empty) block if it is big enough, otherwise a new block.
+   Returns TRUE if successful, FALSE if an allocation failed */
+bool arena_next_block(Arena *arena, size_t size)
+{
+    ArenaBlock *next = arena->current == NULL ? arena->first : arena->current->next;
+    ArenaBlock *block;
+    if (next != NULL && next->size >= size)
+    {
+        arena->current = next;
+        return TRUE;
+    }
+    if ((block = malloc(ARENA_HEADER_SIZE + (size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE))) == NULL)
+    {
+        return FALSE;
+    }
+    block->size = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+    block->used = 0;
+    memory_stats_alloc(MEMORY_SITE_ARENA_BLOCK, ARENA_HEADER_SIZE + block->size);
+    /* the new block goes right after the current one, so the empty blocks after it are still used later */
+    block->next = next;
+    if (arena->current == NULL)
+    {
+        arena->first = block;
+    }
+    else
+    {
+        arena->current->next = block;
+    }
+    arena->current = block;
+    return TRUE;
+}
+
+/* Allocate memory in an arena (see arena_alloc), accounted as site */
+void *arena_alloc_at(Arena *arena, size_t size, MemorySite site)
+{
+    void *ptr;
+    size = ARENA_ROUND_UP(size);
+    if ((arena->current == NULL || arena->current->size - arena->current->used < size) && !arena_next_block(arena, size))
+    {
+        return NULL;
+    }
+    ptr = ARENA_BLOCK_DATA(arena->current) + arena->current->used;
+    arena->current->used += size;
+    arena->last = ptr;
+    arena->accounted[site] += size;
+    memory_stats_alloc(site, size);
+    return ptr;
+}
+
+void *arena_alloc(Arena *arena, size_t size)
+{
+    return arena_alloc_at(arena, size, MEMORY_SITE_OBJECT);
+}
+
+void *arena_realloc(Arena *arena, void *ptr, size_t old_size, size_t new_size, MemorySite site)
+{
+    void *new_ptr;
+    size_t offset;
+    if (ptr == NULL)
+    {
+        return arena_alloc_at(arena, new_size, site);
+    }
+    if (ptr == arena->last)
+    {
+        /* the last allocation is at the end of the current block, so it can grow (or shrink) in place if the block has room */
+        offset = (char *)ptr - ARENA_BLOCK_DATA(arena->current);
+        if (arena->current->size - offset >= ARENA_ROUND_UP(new_size))
+        {
+            arena->current->used = offset + ARENA_ROUND_UP(new_size);
+            arena->accounted[site] += ARENA_ROUND_UP(new_size) - ARENA_ROUND_UP(old_size);
+            memory_stats_realloc(site, ARENA_ROUND_UP(old_size), ARENA_ROUND_UP(new_size));
+            return ptr;
+        }
+    }
+    if (new_size <= old_size)
+    {
+        return ptr;
+    }
+    if ((new_ptr = arena_alloc_at(arena, new_size, site)) == NULL)
+    {
+        return NULL;
+    }
+    memcpy(new_ptr, ptr, old_size);
+    return new_ptr;
+}
+
+char *arena_strdup(Arena *arena, const char *str)
+{
+    /* +1 for null termination */
+    size_t len = strlen(str) + 1;
+    char *out = arena_alloc_at(arena, len, MEMORY_SITE_STRDUP);
+    if (out != NULL)
+    {
+        memcpy(out, str, len);
+    }
+    return out;
+}
+
+/* Account for all of the memory an arena handed out being released */
+void arena_release_accounted(Arena *arena)
+{
+    int i;
+    for (i = 0; i < MEMORY_SITE_COUNT; ++i)
+    {
+        memory_stats_free(i, arena->accounted[i]);
+        arena->accounted[i] = 0;
+    }
+}
+
+void arena_reset(Arena *arena)
+{
+    ArenaBlock *block;
+    for (block = arena->first; block != NULL; block = block->next)
+    {
+        block->used = 0;
+    }
+    arena_release_accounted(arena);
+    arena->current = arena->first;
+    arena->last = NULL;
+}
+
+void arena_free(Arena *arena)
+{
+    ArenaBlock *block = arena->first, *next;
+    arena_release_accounted(arena);
+    while (block != NULL)
+    {
+        next = block->next;
+        memory_stats_free(MEMORY_SITE_ARENA_BLOCK, ARENA_HEADER_SIZE + block->size);
+        free(block);
+        block = next;
+    }
+    arena_init(arena);
+}
@@ -0,0 +1,445 @@
+/* we need POSIX for directories, file locks and file times */
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <utime.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include "cache.h"
+#include "output.h"
+#include "build_id.h"
+
+/* The name of the file which holds the statistics of the cache */
+#define CACHE_STATS_FILENAME "stats"
+/* The name of the file which is locked while the statistics are updated and entries are evicted */
+#define CACHE_LOCK_FILENAME "lock"
+/* The biggest length of a filename inside the cache directory (temporary files are "tmp-<pid>-<count>") */
+#define CACHE_MAX_FILENAME_LENGTH 64
+/* The prefix of the temporary files entries are written into before they are renamed (see cache_store) */
+#define CACHE_TEMP_PREFIX "tmp-"
+/* The amount of seconds after which a temporary file which was not written to is considered left behind, even if its process still exists */
+#define CACHE_TEMP_MAX_AGE (60 * 60)
+/* The size of the chunks we read streams with */
+#define READ_CHUNK_SIZE 4096
+
+/* A file of an entry inside the cache directory, used when evicting entries */
+typedef struct
+{
+    /* the name of the file */
+    char name[CACHE_KEY_LENGTH + sizeof(CONTAINER_EXTENSION)];
+    /* the size of the file in bytes */
+    unsigned long size;
+    /* the last time the entry was used */
+    time_t last_used;
+} CacheFile;
+
+VECTOR_HEADER(CacheFile, CacheFileVector, cache_file)
+VECTOR_IMPL(CacheFile, CacheFileVector, cache_file)
+
+/* Set cache->path to the path of a file inside the cache directory and return it */
+char *cache_path(Cache *cache, const char *filename)
+{
+    sprintf(cache->path, "%s/%s", cache->dir, filename);
+    return cache->path;
+}
+
+/* Set cache->path to the path of the entry with a certain key and return it */
+char *cache_entry_path(Cache *cache, const char *key)
+{
+    sprintf(cache->path, "%s/%s%s", cache->dir, key, CONTAINER_EXTENSION);
+    return cache->path;
+}
+
+bool cache_init(Cache *cache, const char *dir, unsigned long max_size)
+{
+    if (mkdir(dir, 0777) != 0 && errno != EEXIST)
+    {
+        return FALSE;
+    }
+    if ((cache->dir = strdup(dir)) == NULL)
+    {
+        return FALSE;
+    }
+    /* +2 for the '/' and null termination */
+    if ((cache->path = malloc(strlen(dir) + CACHE_MAX_FILENAME_LENGTH + 2)) == NULL)
+    {
+        free(cache->dir);
+        return FALSE;
+    }
+    cache->max_size = max_size;
+    cache->temp_count = 0;
+    memset(&cache->run_stats, 0, sizeof(cache->run_stats));
+    return TRUE;
+}
+
+/* Update two independent 32 bit hashes (FNV-1a and a murmur style hash) with some data */
+void cache_hash_update(uint32 *fnv, uint32 *murmur, const char *data, uint32 len)
+{
+    uint32 i;
+    for (i = 0; i < len; ++i)
+    {
+        *fnv = ((*fnv ^ (unsigned char)data[i]) * 16777619UL) & 0xffffffffUL;
+        *murmur = ((*murmur ^ (unsigned char)data[i]) * 0x5bd1e995UL) & 0xffffffffUL;
+        *murmur ^= *murmur >> 15;
+    }
+}
+
+/* The key is the two hashes of the build identity followed by the source. Since the source is also compared on every hit,
+   the hash does not need to be cryptographic, it only needs to spread the entries. */
+void cache_key(const char *source, uint32 source_len, char *key)
+{
+    uint32 fnv = 2166136261UL, murmur = 0x9747b28cUL;
+    /* include the null terminator to separate the build identity from the source */
+    cache_hash_update(&fnv, &murmur, ASSEMBLER_BUILD_ID, sizeof(ASSEMBLER_BUILD_ID));
+    cache_hash_update(&fnv, &murmur, source, source_len);
+    sprintf(key, "%08x%08x", fnv, murmur);
+}
+
+Container *cache_lookup(Cache *cache, const char *key, const char *source, uint32 source_len)
+{
+    Container *entry = malloc(sizeof(Container));
+    ContainerEntry *source_entry;
+    char *stored_source;
+    bool is_hit = FALSE;
+
+    if (entry == NULL)
+    {
+        cache->run_stats.misses++;
+        return NULL;
+    }
+    if (!container_open(entry, cache_entry_path(cache, key)))
+    {
+        free(entry);
+        cache->run_stats.misses++;
+        return NULL;
+    }
+    /* ensure the entry is of the same source, and not of another source with the same key */
+    source_entry = container_find(entry, "", ARTIFACT_AS);
+    if (source_entry != NULL && source_entry->length == source_len && (stored_source = malloc(source_len + 1)) != NULL)
+    {
+        is_hit = container_read_artifact_data(entry, source_entry, stored_source) && memcmp(stored_source, source, source_len) == 0;
+        free(stored_source);
+    }
+    if (!is_hit)
+    {
+        cache_entry_free(entry);
+        cache->run_stats.misses++;
+        return NULL;
+    }
+    /* refresh the time the entry was last used, for the LRU eviction */
+    utime(cache_entry_path(cache, key), NULL);
+    cache->run_stats.hits++;
+    return entry;
+}
+
+bool cache_entry_read_log(Container *entry, AssemblyOutcome *outcome, char **transcript, uint32 *transcript_len)
+{
+    ContainerEntry *log_entry = container_find(entry, "", ARTIFACT_LOG);
+    char *log;
+    /* the log is the outcome (1 byte) followed by the transcript */
+    if (log_entry == NULL || log_entry->length == 0 || (log = malloc(log_entry->length)) == NULL)
+    {
+        return FALSE;
+    }
+    if (!container_read_artifact_data(entry, log_entry, log))
+    {
+        free(log);
+        return FALSE;
+    }
+    *outcome = (AssemblyOutcome)log[0];
+    *transcript_len = log_entry->length - 1;
+    memmove(log, log + 1, *transcript_len);
+    *transcript = log;
+    return TRUE;
+}
+
+void cache_entry_free(Container *entry)
+{
+    container_free(entry);
+    free(entry);
+}
+
+/* Write the artifacts of an entry into a container. Returns TRUE if successful, FALSE otherwise. */
+bool write_cache_entry(Container *container, const char *source, uint32 source_len, AssemblyOutcome outcome, CharVector *transcript,
+                       FILE *am_file, SecondPassResult *second_pass_result)
+{
+    FILE *out;
+    ArtifactType artifact_type;
+    long bytes_written;
+
+    out = container_begin_artifact(container);
+    if (!container_end_artifact(container, "", ARTIFACT_AS, fwrite(source, 1, source_len, out) == source_len ? (long)source_len : -1))
+    {
+        return FALSE;
+    }
+    out = container_begin_artifact(container);
+    bytes_written = (putc(outcome, out) != EOF && (transcript->len == 0 || fwrite(transcript->array, 1, transcript->len, out) == transcript->len))
+                        ? (long)transcript->len + 1
+                        : -1;
+    if (!container_end_artifact(container, "", ARTIFACT_LOG, bytes_written))
+    {
+        return FALSE;
+    }
+    if (am_file != NULL)
+    {
+        fseek(am_file, 0, SEEK_SET);
+        bytes_written = write_stream_copy(am_file, container_begin_artifact(container));
+        fseek(am_file, 0, SEEK_SET);
+        if (!container_end_artifact(container, "", ARTIFACT_AM, bytes_written))
+        {
+            return FALSE;
+        }
+    }
+    if (second_pass_result != NULL)
+    {
+        for (artifact_type = ARTIFACT_OB; artifact_type <= ARTIFACT_EXT; ++artifact_type)
+        {
+            if (artifact_is_necessary(artifact_type, second_pass_result) &&
+                !container_end_artifact(container, "", artifact_type, write_artifact(container_begin_artifact(container), artifact_type, second_pass_result)))
+            {
+                return FALSE;
+            }
+        }
+    }
+    return TRUE;
+}
+
+bool cache_store(Cache *cache, const char *key, const char *source, uint32 source_len, AssemblyOutcome outcome, CharVector *transcript,
+                 FILE *am_file, SecondPassResult *second_pass_result)
+{
+    char temp_filename[CACHE_MAX_FILENAME_LENGTH];
+    char *temp_path;
+    Container container;
+    bool success, is_replacing;
+    struct stat entry_stat, replaced_stat;
+
+    /* write the entry into a temporary file, so that no other process sees it before it is complete */
+    sprintf(temp_filename, CACHE_TEMP_PREFIX "%ld-%u", (long)getpid(), cache->temp_count++);
+    if ((temp_path = strdup(cache_path(cache, temp_filename))) == NULL)
+    {
+        return FALSE;
+    }
+    if (!container_create(&container, temp_path))
+    {
+        free(temp_path);
+        return FALSE;
+    }
+    success = write_cache_entry(&container, source, source_len, outcome, transcript, am_file, second_pass_result);
+    success = container_close(&container) && success;
+
+    /* rename is atomic, so the entry appears all at once (replacing an identical entry if another process stored it meanwhile).
+       A replaced entry was already counted in the size of the cache */
+    is_replacing = stat(cache_entry_path(cache, key), &replaced_stat) == 0;
+    if (success && stat(temp_path, &entry_stat) == 0 && rename(temp_path, cache_entry_path(cache, key)) == 0)
+    {
+        cache->run_stats.stores++;
+        if (!is_replacing)
+        {
+            cache->run_stats.size += entry_stat.st_size;
+        }
+    }
+    else
+    {
+        remove(temp_path);
+        success = FALSE;
+    }
+    free(temp_path);
+    return success;
+}
+
+/* Read the statistics of the cache. A missing or malformed statistics file counts as empty statistics. */
+void read_cache_stats(Cache *cache, CacheStats *stats)
+{
+    FILE *file;
+    memset(stats, 0, sizeof(*stats));
+    if ((file = fopen(cache_path(cache, CACHE_STATS_FILENAME), "r")) == NULL)
+    {
+        return;
+    }
+    if (fscanf(file, "hits %lu\nmisses %lu\nstores %lu\nevictions %lu\nsize %lu\n",
+               &stats->hits, &stats->misses, &stats->stores, &stats->evictions, &stats->size) != 5)
+    {
+        memset(stats, 0, sizeof(*stats));
+    }
+    fclose(file);
+}
+
+/* Write the statistics of the cache */
+void write_cache_stats(Cache *cache, CacheStats *stats)
+{
+    FILE *file;
+    if ((file = fopen(cache_path(cache, CACHE_STATS_FILENAME), "w")) == NULL)
+    {
+        return;
+    }
+    fprintf(file, "hits %lu\nmisses %lu\nstores %lu\nevictions %lu\nsize %lu\n", stats->hits, stats->misses, stats->stores, stats->evictions, stats->size);
+    fclose(file);
+}
+
+/* Compare 2 cache files by the last time they were used (for qsort) */
+int compare_cache_files(const void *a, const void *b)
+{
+    time_t a_time = ((const CacheFile *)a)->last_used, b_time = ((const CacheFile *)b)->last_used;
+    return (a_time > b_time) - (a_time < b_time);
+}
+
+/* Check whether or not a file in the cache directory is a temporary file (see cache_store) which was left behind by a process that crashed
+   or was killed: either the process which writes it is gone, or it has not been written to for CACHE_TEMP_MAX_AGE seconds */
+bool is_stale_temp_file(const char *name, const struct stat *file_stat)
+{
+    long pid;
+    unsigned int count;
+    char extra;
+    if (sscanf(name, CACHE_TEMP_PREFIX "%ld-%u%c", &pid, &count, &extra) != 2)
+    {
+        return FALSE;
+    }
+    if (difftime(time(NULL), file_stat->st_mtime) > CACHE_TEMP_MAX_AGE)
+    {
+        return TRUE;
+    }
+    return pid != (long)getpid() && kill((pid_t)pid, 0) != 0 && errno == ESRCH;
+}
+
+/* Evict the least recently used entries until the cache fits in its maximum size, and remove the temporary files which were left behind
+   (they are not a part of the size of the cache, so nothing else would ever remove them).
+   Updates the size and the amount of evictions in stats. Must be called while holding the cache lock. */
+void evict_cache_entries(Cache *cache, CacheStats *stats)
+{
+    DIR *dir;
+    struct dirent *dirent;
+    struct stat file_stat;
+    CacheFile cache_file;
+    CacheFileVector *files = cache_file_vec_create();
+    unsigned long size = 0;
+    uint32 i, name_len;
+
+    if (files == NULL || (dir = opendir(cache->dir)) == NULL)
+    {
+        if (files != NULL)
+        {
+            cache_file_vec_free(files);
+        }
+        return;
+    }
+    /* collect all the entries, the size we have in stats may be off if other processes evicted entries */
+    while ((dirent = readdir(dir)) != NULL)
+    {
+        if (strncmp(dirent->d_name, CACHE_TEMP_PREFIX, sizeof(CACHE_TEMP_PREFIX) - 1) == 0)
+        {
+            if (stat(cache_path(cache, dirent->d_name), &file_stat) == 0 && is_stale_temp_file(dirent->d_name, &file_stat))
+            {
+                remove(cache_path(cache, dirent->d_name));
+            }
+            continue;
+        }
+        name_len = strlen(dirent->d_name);
+        if (name_len != sizeof(cache_file.name) - 1 || strcmp(dirent->d_name + CACHE_KEY_LENGTH, CONTAINER_EXTENSION) != 0 ||
+            stat(cache_path(cache, dirent->d_name), &file_stat) != 0)
+        {
+            continue;
+        }
+        strcpy(cache_file.name, dirent->d_name);
+        cache_file.size = file_stat.st_size;
+        cache_file.last_used = file_stat.st_mtime;
+        size += cache_file.size;
+        if (!cache_file_vec_push(files, cache_file))
+        {
+            break;
+        }
+    }
+    closedir(dir);
+
+    /* evict the least recently used entries first */
+    if (files->len > 0)
+    {
+        qsort(files->array, files->len, sizeof(CacheFile), compare_cache_files);
+    }
+    for (i = 0; i < files->len && size > cache->max_size; ++i)
+    {
+        if (remove(cache_path(cache, cache_file_vec_get_ptr(files, i)->name)) == 0)
+        {
+            stats->evictions++;
+        }
+        size -= cache_file_vec_get_ptr(files, i)->size;
+    }
+    stats->size = size;
+    cache_file_vec_free(files);
+}
+
+void cache_close(Cache *cache, CacheStats *run_stats, CacheStats *total_stats)
+{
+    int lock_fd;
+    struct flock lock;
+
+    *run_stats = cache->run_stats;
+    /* other processes may update the statistics or evict entries at the same time, so we do both while holding a lock on the lock file.
+       If we can't lock it, we skip updating them rather than risk corrupting them */
+    lock.l_type = F_WRLCK;
+    lock.l_whence = SEEK_SET;
+    lock.l_start = 0;
+    lock.l_len = 0;
+    lock_fd = open(cache_path(cache, CACHE_LOCK_FILENAME), O_RDWR | O_CREAT, 0666);
+    if (lock_fd >= 0 && fcntl(lock_fd, F_SETLKW, &lock) == 0)
+    {
+        read_cache_stats(cache, total_stats);
+        total_stats->hits += run_stats->hits;
+        total_stats->misses += run_stats->misses;
+        total_stats->stores += run_stats->stores;
+        total_stats->size += run_stats->size;
+        if (total_stats->size > cache->max_size)
+        {
+            evict_cache_entries(cache, total_stats);
+        }
+        write_cache_stats(cache, total_stats);
+    }
+    else
+    {
+        *total_stats = *run_stats;
+    }
+    if (lock_fd >= 0)
+    {
+        /* closing the file releases the lock */
+        close(lock_fd);
+    }
+    free(cache->path);
+    free(cache->dir);
+}
+
+char *read_whole_stream(FILE *file, uint32 *len)
+{
+    char *buf = NULL, *new_buf;
+    uint32 capacity = 0;
+    size_t chunk_len;
+    *len = 0;
+    do
+    {
+        if (capacity - *len < READ_CHUNK_SIZE + 1)
+        {
+            /* +1 for null termination */
+            capacity = capacity == 0 ? READ_CHUNK_SIZE + 1 : capacity * 2;
+            if ((new_buf = realloc(buf, capacity)) == NULL)
+            {
+                free(buf);
+                return NULL;
+            }
+            buf = new_buf;
+        }
+        chunk_len = fread(buf + *len, 1, READ_CHUNK_SIZE, file);
+        *len += chunk_len;
+    } while (chunk_len == READ_CHUNK_SIZE);
+
+    if (ferror(file))
+    {
+        free(buf);
+        return NULL;
+    }
+    buf[*len] = 0;
+    return buf;
+}
@@ -0,0 +1,235 @@
+#include <string.h>
+#include <stdlib.h>
+#include "container.h"
+
+VECTOR_IMPL(ContainerEntry, ContainerEntryVector, container_entry)
+
+/* The magic which every container file starts with */
+#define CONTAINER_MAGIC "ASMCNTR1"
+/* The length of CONTAINER_MAGIC */
+#define CONTAINER_MAGIC_LENGTH 8
+/* The size of the header: the magic, the offset of the index and the amount of entries */
+#define CONTAINER_HEADER_SIZE (CONTAINER_MAGIC_LENGTH + 4 + 4)
+/* The size of an entry in the index, not including its module name: its offset, its length, its type and the length of its module name */
+#define CONTAINER_ENTRY_SIZE (4 + 4 + 4 + 4)
+/* The size of the buffer we write the container with. Artifacts are small, so a big buffer turns many of them into a single write */
+#define CONTAINER_IO_BUFFER_SIZE (1 << 20)
+/* The biggest offset we can represent in the container (offsets are 32 bits) */
+#define CONTAINER_MAX_OFFSET 0xffffffffUL
+
+/* Write the header of a container. Returns TRUE if successful, FALSE otherwise. */
+bool write_container_header(FILE *file, uint32 index_offset, uint32 entry_count)
+{
+    return fwrite(CONTAINER_MAGIC, 1, CONTAINER_MAGIC_LENGTH, file) == CONTAINER_MAGIC_LENGTH &&
+           write_u32_le(file, index_offset) && write_u32_le(file, entry_count);
+}
+
+/* free the module names in the index and the index itself */
+void free_container_entries(ContainerEntryVector *entries)
+{
+    uint32 i;
+    for (i = 0; i < entries->len; ++i)
+    {
+        free(container_entry_vec_get_ptr(entries, i)->module);
+    }
+    container_entry_vec_free(entries);
+}
+
+bool container_create(Container *container, const char *path)
+{
+    container->io_buffer = NULL;
+    container->offset = CONTAINER_HEADER_SIZE;
+    container->failed = FALSE;
+    if ((container->entries = container_entry_vec_create()) == NULL)
+    {
+        return FALSE;
+    }
+    if ((container->file = fopen(path, "wb")) == NULL)
+    {
+        container_entry_vec_free(container->entries);
+        return FALSE;
+    }
+    /* if we can't allocate the buffer we simply use the default one */
+    if ((container->io_buffer = malloc(CONTAINER_IO_BUFFER_SIZE)) != NULL)
+    {
+        setvbuf(container->file, container->io_buffer, _IOFBF, CONTAINER_IO_BUFFER_SIZE);
+    }
+    /* write a placeholder header, the real one is written once we know where the index is */
+    if (!write_container_header(container->file, 0, 0))
+    {
+        fclose(container->file);
+        free(container->io_buffer);
+        container_entry_vec_free(container->entries);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+FILE *container_begin_artifact(Container *container)
+{
+    return container->file;
+}
+
+bool container_end_artifact(Container *container, const char *module, ArtifactType type, long length)
+{
+    ContainerEntry entry;
+    /* the stream may already hold (part of) the artifact, so once adding an artifact fails the container fails as a whole */
+    if (length < 0 || (unsigned long)length > CONTAINER_MAX_OFFSET - container->offset || strlen(module) > CONTAINER_MAX_MODULE_LENGTH)
+    {
+        container->failed = TRUE;
+        return FALSE;
+    }
+    entry.type = type;
+    entry.offset = container->offset;
+    entry.length = length;
+    /* not strdup, since the module name may be empty (the cache's entries have no module name) - +1 for null termination */
+    if ((entry.module = malloc(strlen(module) + 1)) == NULL)
+    {
+        container->failed = TRUE;
+        return FALSE;
+    }
+    strcpy(entry.module, module);
+    if (!container_entry_vec_push(container->entries, entry))
+    {
+        free(entry.module);
+        container->failed = TRUE;
+        return FALSE;
+    }
+    container->offset += length;
+    return TRUE;
+}
+
+bool container_close(Container *container)
+{
+    uint32 i, name_len;
+    ContainerEntry *entry;
+    bool success = !container->failed;
+
+    /* write the index right after the last artifact (unless an artifact failed, in which case the placeholder header stays) */
+    for (i = 0; i < container->entries->len && success; ++i)
+    {
+        entry = container_entry_vec_get_ptr(container->entries, i);
+        name_len = strlen(entry->module);
+        success = write_u32_le(container->file, entry->offset) && write_u32_le(container->file, entry->length) &&
+                  write_u32_le(container->file, entry->type) && write_u32_le(container->file, name_len) &&
+                  fwrite(entry->module, 1, name_len, container->file) == name_len;
+    }
+    /* now that we know where the index is, write the real header */
+    if (success)
+    {
+        success = fseek(container->file, 0, SEEK_SET) == 0 && write_container_header(container->file, container->offset, container->entries->len);
+    }
+    if (fclose(container->file) != 0)
+    {
+        success = FALSE;
+    }
+    free(container->io_buffer);
+    free_container_entries(container->entries);
+    return success;
+}
+
+bool container_open(Container *container, const char *path)
+{
+    char magic[CONTAINER_MAGIC_LENGTH];
+    uint32 index_offset, entry_count, type, name_len, i;
+    long file_size;
+    unsigned long index_left; /* the amount of bytes of the index we have not read yet */
+    ContainerEntry entry;
+
+    container->io_buffer = NULL;
+    container->offset = 0;
+    container->failed = FALSE;
+    if ((container->entries = container_entry_vec_create()) == NULL)
+    {
+        return FALSE;
+    }
+    if ((container->file = fopen(path, "rb")) == NULL)
+    {
+        container_entry_vec_free(container->entries);
+        return FALSE;
+    }
+    /* the index must lie between the header and the end of the file, and be big enough to hold all of its entries */
+    if (fseek(container->file, 0, SEEK_END) != 0 || (file_size = ftell(container->file)) < 0 || fseek(container->file, 0, SEEK_SET) != 0 ||
+        fread(magic, 1, sizeof(magic), container->file) != sizeof(magic) || memcmp(magic, CONTAINER_MAGIC, CONTAINER_MAGIC_LENGTH) != 0 ||
+        !read_u32_le(container->file, &index_offset) || !read_u32_le(container->file, &entry_count) ||
+        index_offset < CONTAINER_HEADER_SIZE || index_offset > (unsigned long)file_size ||
+        entry_count > ((unsigned long)file_size - index_offset) / CONTAINER_ENTRY_SIZE || fseek(container->file, index_offset, SEEK_SET) != 0)
+    {
+        container_free(container);
+        return FALSE;
+    }
+
+    index_left = (unsigned long)file_size - index_offset;
+    for (i = 0; i < entry_count; ++i)
+    {
+        /* each artifact must lie between the header and the index, and each module name must fit in what is left of the index */
+        if (!read_u32_le(container->file, &entry.offset) || !read_u32_le(container->file, &entry.length) ||
+            !read_u32_le(container->file, &type) || !read_u32_le(container->file, &name_len) || type >= ARTIFACT_TYPE_COUNT ||
+            entry.offset < CONTAINER_HEADER_SIZE || entry.offset > index_offset || entry.length > index_offset - entry.offset ||
+            index_left < CONTAINER_ENTRY_SIZE || name_len > CONTAINER_MAX_MODULE_LENGTH || name_len > index_left - CONTAINER_ENTRY_SIZE ||
+            (entry.module = malloc(name_len + 1)) == NULL)
+        {
+            container_free(container);
+            return FALSE;
+        }
+        index_left -= CONTAINER_ENTRY_SIZE + name_len;
+        entry.type = type;
+        entry.module[name_len] = 0;
+        if (fread(entry.module, 1, name_len, container->file) != name_len || !container_entry_vec_push(container->entries, entry))
+        {
+            free(entry.module);
+            container_free(container);
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+bool container_read_artifact(Container *container, ContainerEntry *entry, FILE *out)
+{
+    char chunk[4096];
+    uint32 remaining = entry->length;
+    size_t chunk_len;
+    if (fseek(container->file, entry->offset, SEEK_SET) != 0)
+    {
+        return FALSE;
+    }
+    while (remaining > 0)
+    {
+        chunk_len = remaining < sizeof(chunk) ? remaining : sizeof(chunk);
+        if (fread(chunk, 1, chunk_len, container->file) != chunk_len || fwrite(chunk, 1, chunk_len, out) != chunk_len)
+        {
+            return FALSE;
+        }
+        remaining -= chunk_len;
+    }
+    return TRUE;
+}
+
+bool container_read_artifact_data(Container *container, ContainerEntry *entry, char *buf)
+{
+    return fseek(container->file, entry->offset, SEEK_SET) == 0 && fread(buf, 1, entry->length, container->file) == entry->length;
+}
+
+/* Searches the index via a simple linear search */
+ContainerEntry *container_find(Container *container, const char *module, ArtifactType type)
+{
+    uint32 i;
+    ContainerEntry *entry;
+    for (i = 0; i < container->entries->len; ++i)
+    {
+        entry = container_entry_vec_get_ptr(container->entries, i);
+        if (entry->type == type && strcmp(entry->module, module) == 0)
+        {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+void container_free(Container *container)
+{
+    fclose(container->file);
+    free(container->io_buffer);
+    free_container_entries(container->entries);
+}
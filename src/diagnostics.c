@@ -0,0 +1,458 @@
+/* we need POSIX for fileno and write */
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include "diagnostics.h"
+#include "instructions.h" /* operand_type_name */
+#include "utils.h"
+
+VECTOR_IMPL(DiagnosticRecord, DiagnosticRecordVector, diagnostic_record)
+
+bool diagnostics_init(DiagnosticsSink *sink, FILE *out, DiagnosticsFormat format, unsigned long max_errors)
+{
+    sink->out = out;
+    sink->format = format;
+    sink->error_count = 0;
+    sink->max_errors = max_errors;
+    arena_init(&sink->arena);
+    if ((sink->records = diagnostic_record_vec_create()) == NULL)
+    {
+        return FALSE;
+    }
+    if ((sink->buffer = char_vec_create()) == NULL)
+    {
+        diagnostic_record_vec_free(sink->records);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+void diagnostics_start_file(DiagnosticsSink *sink)
+{
+    sink->error_count = 0;
+}
+
+/* Start a record of an error of a file, copying the filename into the arena unless the previous record is of the same file.
+   Returns the record, or NULL if the error is dropped (see max_errors) or an allocation failed (in which case *alloc_fail is set) */
+DiagnosticRecord *diagnostics_new_record(DiagnosticsSink *sink, const char *filename, bool *alloc_fail)
+{
+    DiagnosticRecord record;
+    DiagnosticRecordVector *records = sink->records;
+    *alloc_fail = FALSE;
+    if (diagnostics_limit_reached(sink))
+    {
+        return NULL;
+    }
+    if (records->len > 0 && strcmp(records->array[records->len - 1].filename, filename) == 0)
+    {
+        record.filename = records->array[records->len - 1].filename;
+    }
+    else if ((record.filename = arena_strdup(&sink->arena, filename)) == NULL)
+    {
+        *alloc_fail = TRUE;
+        return NULL;
+    }
+    record.rendered = NULL;
+    if (!diagnostic_record_vec_push(records, record))
+    {
+        *alloc_fail = TRUE;
+        return NULL;
+    }
+    sink->error_count++;
+    return &records->array[records->len - 1];
+}
+
+bool diagnostics_report(DiagnosticsSink *sink, const char *filename, Error error)
+{
+    bool alloc_fail;
+    DiagnosticRecord *record = diagnostics_new_record(sink, filename, &alloc_fail);
+    if (record == NULL)
+    {
+        return !alloc_fail;
+    }
+    if (!error_copy(&record->error, error, &sink->arena))
+    {
+        /* drop the record, which would point to a partial copy */
+        sink->records->len--;
+        sink->error_count--;
+        return FALSE;
+    }
+    return TRUE;
+}
+
+bool diagnostics_report_rendered(DiagnosticsSink *sink, const char *filename, const char *rendered_error)
+{
+    bool alloc_fail;
+    DiagnosticRecord *record = diagnostics_new_record(sink, filename, &alloc_fail);
+    if (record == NULL)
+    {
+        return !alloc_fail;
+    }
+    record->rendered = rendered_error;
+    return TRUE;
+}
+
+bool diagnostics_limit_reached(DiagnosticsSink *sink)
+{
+    return sink->max_errors != 0 && sink->error_count >= sink->max_errors;
+}
+
+/* Append a string into the buffer of a sink. Returns TRUE if successful, FALSE if an allocation failed */
+bool diagnostics_append(DiagnosticsSink *sink, const char *str)
+{
+    return char_vec_push_n(sink->buffer, str, strlen(str));
+}
+
+/* Append a string into the buffer of a sink as a JSON string (quoted, with quotes, backslashes and control characters escaped).
+   Colors (ANSI escape sequences) are left out, and bytes which are not a part of a valid UTF-8 sequence (e.g. a Latin-1 character
+   in a source line) are escaped as \u00XX so that the output is always valid JSON. Returns TRUE if successful, FALSE if an allocation failed */
+bool diagnostics_append_json_string(DiagnosticsSink *sink, const char *str)
+{
+    char escaped[8];
+    const char *run = str;
+    int sequence_length;
+    bool success = char_vec_push(sink->buffer, '"');
+    for (; success && *str != 0; ++str)
+    {
+        if ((unsigned char)*str >= 0x80 && (sequence_length = utf8_sequence_length(str)) != 0)
+        {
+            /* a valid UTF-8 sequence is a part of the run */
+            str += sequence_length - 1;
+            continue;
+        }
+        if (*str != '"' && *str != '\\' && (unsigned char)*str >= ' ' && (unsigned char)*str < 0x80)
+        {
+            continue;
+        }
+        /* the characters which need no escaping are appended in runs */
+        success = char_vec_push_n(sink->buffer, run, str - run);
+        if (*str == '\033' && str[1] == '[')
+        {
+            /* skip a color, e.g. "\033[1;31m" */
+            for (str += 2; *str != 0 && (*str < '@' || *str > '~'); ++str)
+                ;
+            if (*str == 0)
+            {
+                --str;
+            }
+        }
+        else if (*str == '"' || *str == '\\')
+        {
+            sprintf(escaped, "\\%c", *str);
+            success = success && diagnostics_append(sink, escaped);
+        }
+        else
+        {
+            sprintf(escaped, "\\u%04x", (unsigned char)*str);
+            success = success && diagnostics_append(sink, escaped);
+        }
+        run = str + 1;
+    }
+    return success && char_vec_push_n(sink->buffer, run, str - run) && char_vec_push(sink->buffer, '"');
+}
+
+/* Append the key of a member of a JSON object (preceded by a comma, unless it's the first member).
+   Returns TRUE if successful, FALSE if an allocation failed */
+bool diagnostics_append_key(DiagnosticsSink *sink, const char *key)
+{
+    if (sink->buffer->array[sink->buffer->len - 1] != '{' && !char_vec_push(sink->buffer, ','))
+    {
+        return FALSE;
+    }
+    return diagnostics_append_json_string(sink, key) && char_vec_push(sink->buffer, ':');
+}
+
+/* Append a member of a JSON object whose value is a string. Returns TRUE if successful, FALSE if an allocation failed */
+bool diagnostics_append_string_member(DiagnosticsSink *sink, const char *key, const char *value)
+{
+    return diagnostics_append_key(sink, key) && diagnostics_append_json_string(sink, value);
+}
+
+/* Append a member of a JSON object whose value is a single character (as a string). Returns TRUE if successful, FALSE if an allocation failed */
+bool diagnostics_append_char_member(DiagnosticsSink *sink, const char *key, char value)
+{
+    char str[2];
+    str[0] = value;
+    str[1] = 0;
+    return diagnostics_append_string_member(sink, key, str);
+}
+
+/* Append a member of a JSON object whose value is an integer. Returns TRUE if successful, FALSE if an allocation failed */
+bool diagnostics_append_int_member(DiagnosticsSink *sink, const char *key, long value)
+{
+    char str[32];
+    sprintf(str, "%ld", value);
+    return diagnostics_append_key(sink, key) && diagnostics_append(sink, str);
+}
+
+/* Append the members which describe a symbol parse error (into an object which is already open).
+   Returns TRUE if successful, FALSE if an allocation failed */
+bool diagnostics_append_symbol_fields(DiagnosticsSink *sink, ParseSymbolError *error)
+{
+    switch (error->type)
+    {
+    case INVALID_CHARACTER_IN_SYMBOL:
+    {
+        return diagnostics_append_string_member(sink, "symbol", error->val.invalid_char_in_symbol.symbol) &&
+               diagnostics_append_char_member(sink, "character", error->val.invalid_char_in_symbol.invalid_char) &&
+               diagnostics_append_int_member(sink, "position", error->val.invalid_char_in_symbol.position);
+    }
+    case SYMBOL_STARTS_WITH_NON_ALPHABETHIC_CHARACTER:
+    {
+        return diagnostics_append_string_member(sink, "symbol", error->val.symbol_starts_with_non_alphabethic_char.symbol) &&
+               diagnostics_append_char_member(sink, "character", error->val.symbol_starts_with_non_alphabethic_char.non_alphabethic_char);
+    }
+    case BUFFER_TOO_SMALL:
+    {
+        return diagnostics_append_int_member(sink, "len", (long)error->val.symbol_length) &&
+               diagnostics_append_int_member(sink, "expected_len", MAX_LABEL_SIZE);
+    }
+    case SYMBOL_IS_A_DIRECTIVE:
+    case SYMBOL_IS_AN_INSTRUCTION:
+    case SYMBOL_IS_A_REGISTER:
+    {
+        return diagnostics_append_string_member(sink, "symbol", error->val.symbol);
+    }
+    default:
+    {
+        return TRUE;
+    }
+    }
+}
+
+/* Append the members which describe a parse error (into an object which is already open).
+   Returns TRUE if successful, FALSE if an allocation failed */
+bool diagnostics_append_parse_fields(DiagnosticsSink *sink, ParseError *error)
+{
+    uint32 i;
+    switch (error->type)
+    {
+    case PARSE_ERROR_INVALID_DIRECTIVE:
+    {
+        return diagnostics_append_string_member(sink, "directive", error->val.invalid_directive);
+    }
+    case PARSE_ERROR_INVALID_INSTRUCTION:
+    {
+        return diagnostics_append_string_member(sink, "instruction", error->val.invalid_instruction);
+    }
+    case PARSE_ERROR_DATA_DIRECTIVE_INVALID_CHARACTER_AFTER_INTEGER:
+    case PARSE_ERROR_OPERAND_INVALID_CHARACTER_AFTER_OPERAND:
+    {
+        return diagnostics_append_char_member(sink, "character", error->val.invalid_character);
+    }
+    case PARSE_ERROR_DATA_DIRECTIVE_INTEGER_BIGGER_THAN_LIMIT:
+    case PARSE_ERROR_DATA_DIRECTIVE_INTEGER_SMALLER_THAN_LIMIT:
+    case PARSE_ERROR_OPERAND_IMMEDIATE_INTEGER_TOO_BIG:
+    case PARSE_ERROR_OPERAND_IMMEDIATE_INTEGER_TOO_SMALL:
+    {
+        return diagnostics_append_int_member(sink, "integer", (long)error->val.overflown_integer);
+    }
+    case PARSE_ERROR_INSTRUCTION_TOO_MANY_OPERANDS:
+    case PARSE_ERROR_INSTRUCTION_TOO_LITTLE_OPERANDS:
+    {
+        return diagnostics_append_int_member(sink, "expected_operands", (long)error->val.expected_amount_of_operands);
+    }
+    case PARSE_ERROR_ENTRY_DIRECTIVE_GOT_INVALID_SYMBOL:
+    case PARSE_ERROR_EXTERN_DIRECTIVE_GOT_INVALID_SYMBOL:
+    case PARSE_ERROR_OPERAND_INVALID_SYMBOL:
+    {
+        return diagnostics_append_string_member(sink, "symbol_error", parse_symbol_error_type_name(error->val.invalid_symbol.type)) &&
+               diagnostics_append_symbol_fields(sink, &error->val.invalid_symbol);
+    }
+    case PARSE_ERROR_INSTRUCTION_EXPECTED_A_DIFFERENT_OPERAND_TYPE:
+    {
+        if (!diagnostics_append_int_member(sink, "operand_index", error->val.expected_operands_type.op_index) ||
+            !diagnostics_append_string_member(sink, "operand_type", operand_type_name(error->val.expected_operands_type.bad_op_type)) ||
+            !diagnostics_append_key(sink, "expected_operand_types") || !char_vec_push(sink->buffer, '['))
+        {
+            return FALSE;
+        }
+        for (i = 0; i < error->val.expected_operands_type.len; ++i)
+        {
+            if ((i > 0 && !char_vec_push(sink->buffer, ',')) ||
+                !diagnostics_append_json_string(sink, operand_type_name(error->val.expected_operands_type.acceptable_operands[i])))
+            {
+                return FALSE;
+            }
+        }
+        return char_vec_push(sink->buffer, ']');
+    }
+    default:
+    {
+        return TRUE;
+    }
+    }
+}
+
+/* Append the members which describe the values an error carries (into an object which is already open).
+   Returns TRUE if successful, FALSE if an allocation failed */
+bool diagnostics_append_fields(DiagnosticsSink *sink, Error error)
+{
+    switch (error.type)
+    {
+    case ERROR_TYPE_MACRO:
+    {
+        ExpandMacroError *macro_error = error.val.expand_macro_err;
+        switch (macro_error->type)
+        {
+        case EXPAND_MACRO_ERROR_LINE_TOO_LONG:
+        case EXPAND_MACRO_ERROR_NAME_IS_TOO_LONG:
+        {
+            return diagnostics_append_int_member(sink, "len", macro_error->val.is_too_long.len) &&
+                   diagnostics_append_int_member(sink, "expected_len", macro_error->val.is_too_long.expected_len);
+        }
+        case EXPAND_MACRO_ERROR_STARTS_WITH_INVALID_CHARACTER:
+        {
+            return diagnostics_append_char_member(sink, "character", macro_error->val.starts_with_invalid_character);
+        }
+        case EXPAND_MACRO_ERROR_INVALID_CHARACTER:
+        {
+            return diagnostics_append_char_member(sink, "character", macro_error->val.invalid_character.invalid_character) &&
+                   diagnostics_append_int_member(sink, "position", macro_error->val.invalid_character.position);
+        }
+        case EXPAND_MACRO_ERROR_MACRO_DEFINED_AS_LABEL:
+        {
+            return diagnostics_append_string_member(sink, "macro_name", macro_error->val.macro_name);
+        }
+        default:
+        {
+            return TRUE;
+        }
+        }
+    }
+    case ERROR_TYPE_SYMBOL_PARSE:
+    {
+        return diagnostics_append_symbol_fields(sink, error.val.symbol_parse_err);
+    }
+    case ERROR_TYPE_PARSE:
+    {
+        return diagnostics_append_parse_fields(sink, error.val.parse_err);
+    }
+    case ERROR_TYPE_SYMBOL_ALREADY_DEFINED:
+    case ERROR_TYPE_EXTERNAL_SYMBOL_USED_IN_ENTRY_DIRECTIVE:
+    {
+        return diagnostics_append_string_member(sink, "symbol", error.val.symbol->name) &&
+               diagnostics_append_int_member(sink, "defined_in_line", (long)error.val.symbol->line);
+    }
+    case ERROR_TYPE_MEMORY_OVERFLOWN:
+    {
+        return diagnostics_append_int_member(sink, "max_address", error.val.memory_overflown.max_address) &&
+               diagnostics_append_int_member(sink, "expected_max_address", error.val.memory_overflown.expected_max_address);
+    }
+    case ERROR_TYPE_SYMBOL_NOT_DEFINED:
+    {
+        return diagnostics_append_string_member(sink, "symbol", error.val.symbol_name);
+    }
+    default:
+    {
+        return TRUE;
+    }
+    }
+}
+
+/* Render a record into the buffer of a sink as a line of JSON (see DIAGNOSTICS_FORMAT_JSONL).
+   Returns TRUE if successful, FALSE if an allocation failed */
+bool diagnostics_render_json(DiagnosticsSink *sink, DiagnosticRecord *record)
+{
+    char message[ERROR_TO_STRING_BUF_SIZE_UPPER_BOUND];
+    if (!char_vec_push(sink->buffer, '{') || !diagnostics_append_string_member(sink, "file", record->filename))
+    {
+        return FALSE;
+    }
+    if (record->rendered != NULL)
+    {
+        return diagnostics_append_string_member(sink, "message", record->rendered) && diagnostics_append(sink, "}\n");
+    }
+    error_message(record->error, message);
+    return diagnostics_append_int_member(sink, "line", record->error.line_info.line_num) &&
+           diagnostics_append_string_member(sink, "type", error_type_name(record->error.type)) &&
+           diagnostics_append_string_member(sink, "code", error_code(record->error)) && diagnostics_append_key(sink, "fields") &&
+           char_vec_push(sink->buffer, '{') && diagnostics_append_fields(sink, record->error) && char_vec_push(sink->buffer, '}') &&
+           diagnostics_append_string_member(sink, "source", trim_end(record->error.line_info.line)) &&
+           diagnostics_append_string_member(sink, "message", message) && diagnostics_append(sink, "}\n");
+}
+
+/* Render a record into the buffer of a sink in its format (and into transcript, if it's not NULL).
+   Returns TRUE if successful, FALSE if an allocation failed */
+bool diagnostics_render(DiagnosticsSink *sink, DiagnosticRecord *record, CharVector *transcript)
+{
+    char buf[ERROR_TO_STRING_BUF_SIZE_UPPER_BOUND];
+    const char *rendered = record->rendered;
+    if (rendered == NULL && (transcript != NULL || sink->format == DIAGNOSTICS_FORMAT_TEXT))
+    {
+        error_to_string(record->error, buf);
+        rendered = buf;
+    }
+    if (transcript != NULL && !char_vec_push_n(transcript, rendered, strlen(rendered) + 1))
+    {
+        return FALSE;
+    }
+    if (sink->format == DIAGNOSTICS_FORMAT_JSONL)
+    {
+        return diagnostics_render_json(sink, record);
+    }
+    return diagnostics_append(sink, ANSI_CYAN) && diagnostics_append(sink, record->filename) && diagnostics_append(sink, ":") &&
+           diagnostics_append(sink, ANSI_NORMAL) && diagnostics_append(sink, " ") && diagnostics_append(sink, rendered) &&
+           diagnostics_append(sink, "\n\n");
+}
+
+/* Write the buffer of a sink into its output in a single write. Returns TRUE if successful, FALSE otherwise */
+bool diagnostics_write(DiagnosticsSink *sink)
+{
+    const char *data = sink->buffer->array;
+    uint32 left = sink->buffer->len;
+    long written;
+    int fd;
+    /* whatever was printed through the stream so far comes before the errors */
+    if (fflush(sink->out) != 0 || (fd = fileno(sink->out)) < 0)
+    {
+        return FALSE;
+    }
+    /* a single write, unless the output only takes part of it (e.g. a pipe which is full) */
+    while (left > 0)
+    {
+        if ((written = (long)write(fd, data, left)) < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (written <= 0)
+        {
+            return FALSE;
+        }
+        data += written;
+        left -= written;
+    }
+    return TRUE;
+}
+
+bool diagnostics_flush(DiagnosticsSink *sink, CharVector *transcript)
+{
+    uint32 i;
+    bool success = TRUE;
+    if (sink->records->len == 0)
+    {
+        return TRUE;
+    }
+    sink->buffer->len = 0;
+    for (i = 0; i < sink->records->len && success; ++i)
+    {
+        success = diagnostics_render(sink, &sink->records->array[i], transcript);
+    }
+    /* whatever was rendered is written even if rendering the rest failed */
+    success = diagnostics_write(sink) && success;
+    sink->records->len = 0;
+    arena_reset(&sink->arena);
+    return success;
+}
+
+void diagnostics_free(DiagnosticsSink *sink)
+{
+    diagnostics_flush(sink, NULL);
+    diagnostic_record_vec_free(sink->records);
+    char_vec_free(sink->buffer);
+    arena_free(&sink->arena);
+    sink->records = NULL;
+    sink->buffer = NULL;
+}
@@ -1,9 +1,35 @@
 #include <stdarg.h>
 #include <stdio.h>
+#include <string.h>
 #include "errors.h"
 #include "utils.h" /* int types */
 
+/* The names of the error types, which are the codes of the errors (see error_code). Each is indexed by its enum */
+const char *error_type_names[] = {"ERROR_TYPE_MACRO", "ERROR_TYPE_SYMBOL_PARSE", "ERROR_TYPE_PARSE", "ERROR_TYPE_SYMBOL_ALREADY_DEFINED",
+                                  "ERROR_TYPE_MEMORY_OVERFLOWN", "ERROR_TYPE_SYMBOL_NOT_DEFINED", "ERROR_TYPE_EXTERNAL_SYMBOL_USED_IN_ENTRY_DIRECTIVE"};
+const char *expand_macro_error_type_names[] = {"EXPAND_MACRO_ERROR_LINE_TOO_LONG", "EXPAND_MACRO_EXPECTED_MACRO_NAME",
+                                               "EXPAND_MACRO_ERROR_STARTS_WITH_INVALID_CHARACTER", "EXPAND_MACRO_ERROR_IS_AN_INSTRUCTION",
+                                               "EXPAND_MACRO_ERROR_IS_A_DIRECTIVE", "EXPAND_MACRO_ERROR_IS_A_REGISTER",
+                                               "EXPAND_MACRO_ERROR_INVALID_CHARACTER", "EXPAND_MACRO_ERROR_NAME_IS_TOO_LONG",
+                                               "EXPAND_MACRO_ERROR_MACRO_DEFINED_AS_LABEL"};
+const char *parse_symbol_error_type_names[] = {"SYMBOL_STARTS_WITH_NON_ALPHABETHIC_CHARACTER", "INVALID_CHARACTER_IN_SYMBOL", "BUFFER_TOO_SMALL",
+                                               "SYMBOL_EMPTY", "SYMBOL_IS_A_DIRECTIVE", "SYMBOL_IS_AN_INSTRUCTION", "SYMBOL_IS_A_REGISTER"};
+const char *parse_error_type_names[] = {"PARSE_ERROR_EXPECTED_INSTRUCTION_OR_DIRECTIVE_AFTER_LABEL", "PARSE_ERROR_EXPECTED_A_SPACE_AFTER_LABEL",
+                                        "PARSE_ERROR_INVALID_DIRECTIVE", "PARSE_ERROR_DATA_DIRECTIVE_EMPTY_DATA",
+                                        "PARSE_ERROR_DATA_DIRECTIVE_NOT_AN_INTEGER", "PARSE_ERROR_DATA_DIRECTIVE_INVALID_CHARACTER_AFTER_INTEGER",
+                                        "PARSE_ERROR_DATA_DIRECTIVE_COMMA_AFTER_LAST_INTEGER", "PARSE_ERROR_DATA_DIRECTIVE_INTEGER_BIGGER_THAN_LIMIT",
+                                        "PARSE_ERROR_DATA_DIRECTIVE_INTEGER_SMALLER_THAN_LIMIT", "PARSE_ERROR_STRING_DIRECTIVE_DOES_NOT_START_WITH_QUOTE",
+                                        "PARSE_ERROR_STRING_DIRECTIVE_DOES_NOT_END_WITH_QUOTE", "PARSE_ERROR_ENTRY_DIRECTIVE_GOT_NO_SYMBOL",
+                                        "PARSE_ERROR_ENTRY_DIRECTIVE_GOT_INVALID_SYMBOL", "PARSE_ERROR_EXTERN_DIRECTIVE_GOT_NO_SYMBOL",
+                                        "PARSE_ERROR_EXTERN_DIRECTIVE_GOT_INVALID_SYMBOL", "PARSE_ERROR_INVALID_INSTRUCTION",
+                                        "PARSE_ERROR_OPERAND_NO_INTEGER_AFTER_HASHTAG", "PARSE_ERROR_OPERAND_IMMEDIATE_INTEGER_TOO_BIG",
+                                        "PARSE_ERROR_OPERAND_IMMEDIATE_INTEGER_TOO_SMALL", "PARSE_ERROR_OPERAND_INVALID_CHARACTER_AFTER_OPERAND",
+                                        "PARSE_ERROR_OPERAND_INVALID_SYMBOL", "PARSE_ERROR_INSTRUCTION_TOO_MANY_OPERANDS",
+                                        "PARSE_ERROR_INSTRUCTION_TOO_LITTLE_OPERANDS", "PARSE_ERROR_INSTRUCTION_COMMA_AFTER_FINAL_OPERAND",
+                                        "PARSE_ERROR_INSTRUCTION_EXPECTED_A_DIFFERENT_OPERAND_TYPE", "PARSE_ERROR_INSTRUCTION_FIRST_OPERAND_EMPTY"};
+
 /* a function similar to sprintf which writes nice formatted output to a buf, given LineInfo.
+   If line_info.line is NULL, only the message itself is written, without colors (see error_message).
    Note: err_fmt and the variadic arguements work just like sprintf. See sprintf documentation for more info on how to use it. */
 void process_error(char *buf, LineInfo line_info, char *err_fmt, ...)
 {
@@ -11,6 +37,12 @@ void process_error(char *buf, LineInfo line_info, char *err_fmt, ...)
     int chars_written;
 
     va_start(args, err_fmt);
+    if (line_info.line == NULL)
+    {
+        vsprintf(buf, err_fmt, args);
+        va_end(args);
+        return;
+    }
     chars_written = sprintf(buf, "%serror in line %s%d:\n%sline: %s%s\n%sinfo:%s ", ANSI_RED, ANSI_YELLOW, line_info.line_num,
                             ANSI_CYAN, ANSI_YELLOW, trim_end(line_info.line), ANSI_CYAN, ANSI_RED);
     buf += chars_written;
@@ -383,7 +415,138 @@ void error_to_string(Error error, char *buf)
     }
 }
 
+void error_message(Error error, char *buf)
+{
+    error.line_info.line = NULL;
+    error_to_string(error, buf);
+}
+
+const char *error_type_name(ErrorType type)
+{
+    return error_type_names[type];
+}
+
+const char *parse_symbol_error_type_name(ParseSymbolErrorType type)
+{
+    return parse_symbol_error_type_names[type];
+}
+
+const char *error_code(Error error)
+{
+    switch (error.type)
+    {
+    case ERROR_TYPE_MACRO:
+    {
+        return expand_macro_error_type_names[error.val.expand_macro_err->type];
+    }
+    case ERROR_TYPE_SYMBOL_PARSE:
+    {
+        return parse_symbol_error_type_name(error.val.symbol_parse_err->type);
+    }
+    case ERROR_TYPE_PARSE:
+    {
+        return parse_error_type_names[error.val.parse_err->type];
+    }
+    default:
+    {
+        return error_type_name(error.type);
+    }
+    }
+}
+
 void err(ErrorCallback err_callback, Error err)
 {
     err_callback.callback(err, err_callback.data);
 }
+
+void err_at_line(ErrorCallback err_callback, Error err, FILE *file, long line_offset)
+{
+    /* the same size the stages read the lines with, so that the line is read exactly as the stage read it */
+    char line[MAX_LINE_LENGTH + 2];
+    err.line_info.line = read_line_at(file, line_offset, line, sizeof(line));
+    err_callback.callback(err, err_callback.data);
+}
+
+bool err_should_stop(ErrorCallback err_callback)
+{
+    return err_callback.should_stop != NULL && err_callback.should_stop(err_callback.data);
+}
+
+/* Copy an object of size bytes into an arena. Returns the copy, or NULL if the allocation failed */
+void *error_copy_object(Arena *arena, const void *object, size_t size)
+{
+    void *copy = arena_alloc(arena, size);
+    if (copy != NULL)
+    {
+        memcpy(copy, object, size);
+    }
+    return copy;
+}
+
+bool error_copy(Error *copy, Error error, Arena *arena)
+{
+    *copy = error;
+    if ((copy->line_info.line = arena_strdup(arena, error.line_info.line)) == NULL)
+    {
+        return FALSE;
+    }
+    switch (error.type)
+    {
+    case ERROR_TYPE_MACRO:
+    {
+        if ((copy->val.expand_macro_err = error_copy_object(arena, error.val.expand_macro_err, sizeof(ExpandMacroError))) == NULL)
+        {
+            return FALSE;
+        }
+        if (error.val.expand_macro_err->type == EXPAND_MACRO_ERROR_MACRO_DEFINED_AS_LABEL)
+        {
+            return (copy->val.expand_macro_err->val.macro_name = arena_strdup(arena, error.val.expand_macro_err->val.macro_name)) != NULL;
+        }
+        return TRUE;
+    }
+
+    case ERROR_TYPE_SYMBOL_PARSE:
+    {
+        return (copy->val.symbol_parse_err = error_copy_object(arena, error.val.symbol_parse_err, sizeof(ParseSymbolError))) != NULL;
+    }
+
+    case ERROR_TYPE_PARSE:
+    {
+        if ((copy->val.parse_err = error_copy_object(arena, error.val.parse_err, sizeof(ParseError))) == NULL)
+        {
+            return FALSE;
+        }
+        /* the acceptable operands of PARSE_ERROR_INSTRUCTION_EXPECTED_A_DIFFERENT_OPERAND_TYPE are a static array, so they are not copied */
+        if (error.val.parse_err->type == PARSE_ERROR_INVALID_DIRECTIVE)
+        {
+            return (copy->val.parse_err->val.invalid_directive = arena_strdup(arena, error.val.parse_err->val.invalid_directive)) != NULL;
+        }
+        if (error.val.parse_err->type == PARSE_ERROR_INVALID_INSTRUCTION)
+        {
+            return (copy->val.parse_err->val.invalid_instruction = arena_strdup(arena, error.val.parse_err->val.invalid_instruction)) != NULL;
+        }
+        return TRUE;
+    }
+
+    case ERROR_TYPE_SYMBOL_ALREADY_DEFINED:
+    case ERROR_TYPE_EXTERNAL_SYMBOL_USED_IN_ENTRY_DIRECTIVE:
+    {
+        if ((copy->val.symbol = error_copy_object(arena, error.val.symbol, sizeof(Symbol))) == NULL)
+        {
+            return FALSE;
+        }
+        return (copy->val.symbol->name = arena_strdup(arena, error.val.symbol->name)) != NULL;
+    }
+
+    case ERROR_TYPE_SYMBOL_NOT_DEFINED:
+    {
+        return (copy->val.symbol_name = arena_strdup(arena, error.val.symbol_name)) != NULL;
+    }
+
+    default:
+    {
+        /* ERROR_TYPE_MEMORY_OVERFLOWN only has integers */
+        return TRUE;
+    }
+    }
+}
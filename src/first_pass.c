@@ -2,46 +2,52 @@
 #include "first_pass.h"
 #include "parser.h"
 
-/* Takes a pointer to a Directive and a U32Vector and updates data_vec in accordance with the directive.
+/* Returns the amount of data words a .data or .string directive takes (0 for any other kind of directive) */
+uint32 directive_data_length(Directive *directive)
+{
+    if (directive->type == DIRECTIVE_DATA)
+    {
+        return directive->val.data.amount_of_integers;
+    }
+    if (directive->type == DIRECTIVE_STRING)
+    {
+        /* +1 for the null terminator */
+        return strlen(directive->val.string) + 1;
+    }
+    return 0;
+}
+
+/* Takes a pointer to a Directive and an Image and updates data_vec in accordance with the directive.
    For .data directive, it will push in data_vec each number.
-   For .string directive, it will push each character into data_vec.
+   For .string directive, it will push each character into data_vec (along with a null terminator).
    This function does not handle any other kind of directive.
+   The data of the directive is written into data_vec at once, after growing it by the amount of data.
    The function returns the amount of data written to data_vec. */
-uint32 handle_data_and_string_directive(Directive *directive, U32Vector *data_vec, bool *alloc_fail)
+uint32 handle_data_and_string_directive(Directive *directive, Image *data_vec, bool *alloc_fail)
 {
     uint32 i;
-    int integer;
-    char *str;
-    uint32 amount_of_data = 0;
+    uint32 start = data_vec->len; /* the position the directive's data starts at */
+    uint32 amount_of_data = directive_data_length(directive);
+    *alloc_fail = FALSE;
+    if ((*alloc_fail = !image_resize(data_vec, start + amount_of_data)))
+    {
+        return 0;
+    }
+
     if (directive->type == DIRECTIVE_DATA)
     {
-        for (i = 0; i < directive->val.data.amount_of_integers; ++i)
+        for (i = 0; i < amount_of_data; ++i)
         {
-            integer = directive->val.data.integers[i];
-            if ((*alloc_fail = !u32_vec_push(data_vec, integer)))
-            {
-                return 0;
-            }
-            amount_of_data += 1;
+            image_set(data_vec, start + i, directive->val.data.integers[i]);
         }
     }
     else if (directive->type == DIRECTIVE_STRING)
     {
-        str = directive->val.string;
-        while (*str != 0)
-        {
-            if ((*alloc_fail = !u32_vec_push(data_vec, *str)))
-            {
-                return 0;
-            }
-            str++;
-            amount_of_data += 1;
-        }
-        if ((*alloc_fail = !u32_vec_push(data_vec, 0)))
+        /* this copies the null terminator as well */
+        for (i = 0; i < amount_of_data; ++i)
         {
-            return 0;
+            image_set(data_vec, start + i, directive->val.string[i]);
         }
-        amount_of_data += 1;
     }
     return amount_of_data;
 }
@@ -69,20 +75,23 @@ uint32 handle_data_and_string_directive(Directive *directive, U32Vector *data_ve
     If the instruction is valid, we raise IC by the amount of words necessary to encode the instruction.
 
     Once we read the entire file, we return the symbol table, the data image and a flag representing whether or not we encountered any errors.
+    When build_data_image is FALSE (see first_pass_check), DC is raised by the amount of data without building the data image.
 */
-FirstPassResult first_pass(FILE *input, ErrorCallback err_callback)
+FirstPassResult first_pass_run(FILE *input, ErrorCallback err_callback, Arena *arena, bool build_data_image)
 {
     uint32 IC = INSTRUCTION_MEMORY_START, DC = 0;  /* instruction counter, data counter */
     char instruction_buf[MAX_LINE_LENGTH + 2];     /* +2 for newline + null termination */
-    char instruction_dup[sizeof(instruction_buf)]; /* duplicate instruction buffer for use in line_info */
+    long line_offset;                              /* the offset of the current line in input, from which errors read the line back */
+    long next_offset;                              /* the offset of the line after the current line in input */
     LineInfo line_info;                            /* information about the line which is passed to error */
     FirstPassResult first_pass_result;             /* the result we return  */
-    U32Vector *data_vec = u32_vec_create();        /* the data image */
+    Image *data_vec = NULL;                        /* the data image, or NULL if it is not built */
     Error error;                                   /* error used for err_callback */
     bool should_skip_table_insertion;              /* whether or not we should not skip inserting a label into a the table*/
     bool alloc_fail = FALSE;                       /* whether or not we failed a emory allocation */
     bool memory_overflown = FALSE;                 /* whether or not we have overflowed the address space */
     LineInfo mem_overflow_line_info;               /* line information about a line which caused a memory overflow*/
+    long mem_overflow_line_offset;                 /* the offset of the line which caused a memory overflow in input */
     Symbol *symbol;
     uint32 addr;
     SymbolContext symbol_ctx;
@@ -94,7 +103,12 @@ FirstPassResult first_pass(FILE *input, ErrorCallback err_callback)
     first_pass_result.encountered_error = FALSE;
     first_pass_result.alloc_fail = FALSE;
     first_pass_result.data_image = data_vec;
-    if (!symbol_table_init(&first_pass_result.symbol_table) || data_vec == NULL)
+    first_pass_result.IC = IC;
+    if (build_data_image)
+    {
+        first_pass_result.data_image = data_vec = image_create_in(arena);
+    }
+    if (!symbol_table_init(&first_pass_result.symbol_table, arena) || (build_data_image && data_vec == NULL))
     {
         first_pass_result.alloc_fail = TRUE;
         first_pass_result.encountered_error = TRUE;
@@ -103,13 +117,16 @@ FirstPassResult first_pass(FILE *input, ErrorCallback err_callback)
 
     /* initialize line_info */
     line_info.line_num = 0;
-    line_info.line = instruction_dup;
+    line_info.line = NULL; /* the line is read back from input only when we report an error on it (see err_at_line) */
+    next_offset = ftell(input);
 
-    while (fgets(instruction_buf, sizeof(instruction_buf), input))
+    while (!err_should_stop(err_callback) && fgets(instruction_buf, sizeof(instruction_buf), input))
     {
         line_info.line_num++;
         error.line_info = line_info; /* update error's line info */
-        memcpy(line_info.line, instruction_buf, sizeof(instruction_buf));
+        /* parse_line modifies the line, so we find where the next line starts before parsing */
+        line_offset = next_offset;
+        next_offset = next_line_offset(input, line_offset, instruction_buf, strlen(instruction_buf));
 
         parse_line(instruction_buf, &parse_line_data);
         if (parse_line_data.type == PARSE_LINE_COMMENT || parse_line_data.type == PARSE_LINE_EMPTY)
@@ -150,7 +167,7 @@ FirstPassResult first_pass(FILE *input, ErrorCallback err_callback)
                     {
                         error.type = ERROR_TYPE_SYMBOL_ALREADY_DEFINED;
                         error.val.symbol = symbol;
-                        err(err_callback, error);
+                        err_at_line(err_callback, error, input, line_offset);
                         first_pass_result.encountered_error = TRUE;
                     }
                     else
@@ -170,7 +187,7 @@ FirstPassResult first_pass(FILE *input, ErrorCallback err_callback)
             /* we have an error with the label */
             error.type = ERROR_TYPE_SYMBOL_PARSE;
             error.val.symbol_parse_err = &parse_line_data.parse_label_data.val.symbol_parse_error;
-            err(err_callback, error);
+            err_at_line(err_callback, error, input, line_offset);
             first_pass_result.encountered_error = TRUE;
         }
 
@@ -178,7 +195,7 @@ FirstPassResult first_pass(FILE *input, ErrorCallback err_callback)
         {
             error.type = ERROR_TYPE_PARSE;
             error.val.parse_err = &parse_line_data.val.parse_error;
-            err(err_callback, error);
+            err_at_line(err_callback, error, input, line_offset);
             first_pass_result.encountered_error = TRUE;
         }
         else if (parse_line_data.type == PARSE_LINE_DIRECTIVE)
@@ -191,7 +208,7 @@ FirstPassResult first_pass(FILE *input, ErrorCallback err_callback)
                 {
                     error.type = ERROR_TYPE_SYMBOL_ALREADY_DEFINED;
                     error.val.symbol = symbol;
-                    err(err_callback, error);
+                    err_at_line(err_callback, error, input, line_offset);
                     first_pass_result.encountered_error = TRUE;
                 }
                 else
@@ -204,6 +221,10 @@ FirstPassResult first_pass(FILE *input, ErrorCallback err_callback)
                     }
                 }
             }
+            else if (!build_data_image)
+            {
+                DC += directive_data_length(&parse_line_data.val.directive);
+            }
             else
             {
                 /* insert the directive data into the data image and increase DC appropriately */
@@ -222,28 +243,33 @@ FirstPassResult first_pass(FILE *input, ErrorCallback err_callback)
             /* increase IC by the amount of words an instruction takes */
             IC += instruction_encoding_word_count(&parse_line_data.val.instruction);
         }
-        if (!memory_overflown && (IC + data_vec->len > MAX_ADDRESS))
+        if (!memory_overflown && (IC + DC > MAX_ADDRESS))
         {
             /* We've overflown, save info for later so that we can report it after reporting any other error found in the file */
             memory_overflown = TRUE;
             mem_overflow_line_info.line_num = line_info.line_num;
-            mem_overflow_line_info.line = strdup(line_info.line);
+            mem_overflow_line_info.line = NULL;
+            mem_overflow_line_offset = line_offset;
         }
     }
 
-    /* report memory overflown */
-    if (memory_overflown)
+    /* report memory overflown (unless the file was not read to its end) */
+    if (err_should_stop(err_callback))
+    {
+        first_pass_result.encountered_error = TRUE;
+    }
+    else if (memory_overflown)
     {
         error.type = ERROR_TYPE_MEMORY_OVERFLOWN;
         error.line_info = mem_overflow_line_info;
         error.val.memory_overflown.expected_max_address = MAX_ADDRESS;
-        error.val.memory_overflown.max_address = IC + data_vec->len;
-        err(err_callback, error);
+        error.val.memory_overflown.max_address = IC + DC;
+        err_at_line(err_callback, error, input, mem_overflow_line_offset);
         first_pass_result.encountered_error = TRUE;
-        /* free the duplicated string */
-        free(mem_overflow_line_info.line);
     }
 
+    first_pass_result.IC = IC;
+
     /* add IC to every data symbol  */
     symbol_table_iterator = symbol_table_iter(first_pass_result.symbol_table);
     for (symbol = symbol_table_iter_next(&symbol_table_iterator); symbol != NULL; symbol = symbol_table_iter_next(&symbol_table_iterator))
@@ -257,8 +283,12 @@ FirstPassResult first_pass(FILE *input, ErrorCallback err_callback)
     return first_pass_result;
 }
 
-void free_first_pass_result(FirstPassResult first_pass_result)
+FirstPassResult first_pass(FILE *input, ErrorCallback err_callback, Arena *arena)
+{
+    return first_pass_run(input, err_callback, arena, TRUE);
+}
+
+FirstPassResult first_pass_check(FILE *input, ErrorCallback err_callback, Arena *arena)
 {
-    u32_vec_free(first_pass_result.data_image);
-    symbol_table_free(first_pass_result.symbol_table);
+    return first_pass_run(input, err_callback, arena, FALSE);
 }
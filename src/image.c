@@ -0,0 +1,179 @@
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "image.h"
+#include "vector.h" /* for VECTOR_INITIAL_CAPACITY */
+
+/* Store the 24 lowest bits of a word into the bytes of a word in an image */
+#define IMAGE_STORE(bytes, word)                         \
+    do                                                   \
+    {                                                    \
+        (bytes)[0] = (uint8)((word) & 0xff);             \
+        (bytes)[1] = (uint8)(((word) >> 8) & 0xff);      \
+        (bytes)[2] = (uint8)(((word) >> 16) & 0xff);     \
+    } while (0)
+
+/* Load a word out of its bytes in an image */
+#define IMAGE_LOAD(bytes) ((uint32)(bytes)[0] | ((uint32)(bytes)[1] << 8) | ((uint32)(bytes)[2] << 16))
+
+Image *image_create()
+{
+    Image *image = calloc(1, sizeof(Image));
+    if (image != NULL)
+    {
+        memory_stats_alloc(MEMORY_SITE_OBJECT, sizeof(Image));
+    }
+    return image;
+}
+
+Image *image_create_in(Arena *arena)
+{
+    Image *image = arena_alloc(arena, sizeof(Image));
+    if (image != NULL)
+    {
+        image->bytes = NULL;
+        image->len = 0;
+        image->capacity = 0;
+        image->arena = arena;
+    }
+    return image;
+}
+
+/* Reallocate the bytes of an image to hold exactly capacity words. Returns TRUE if successful, FALSE otherwise */
+bool image_set_capacity(Image *image, uint32 capacity)
+{
+    uint8 *new_alloc;
+    if (image->arena != NULL)
+    {
+        new_alloc = arena_realloc(image->arena, image->bytes, (size_t)image->capacity * IMAGE_WORD_BYTES, (size_t)capacity * IMAGE_WORD_BYTES,
+                                  MEMORY_SITE_IMAGE_GROWTH);
+    }
+    else if ((new_alloc = realloc(image->bytes, (size_t)capacity * IMAGE_WORD_BYTES)) != NULL)
+    {
+        memory_stats_realloc(MEMORY_SITE_IMAGE_GROWTH, (size_t)image->capacity * IMAGE_WORD_BYTES, (size_t)capacity * IMAGE_WORD_BYTES);
+    }
+    if (new_alloc == NULL)
+    {
+        return FALSE;
+    }
+    image->bytes = new_alloc;
+    image->capacity = capacity;
+    return TRUE;
+}
+
+/* Grow the capacity of an image (by doubling it, the same way vectors grow) until it has room for at least min_capacity words */
+bool image_grow(Image *image, uint32 min_capacity)
+{
+    uint32 capacity = image->capacity == 0 ? VECTOR_INITIAL_CAPACITY : image->capacity;
+    while (capacity < min_capacity)
+    {
+        capacity *= 2;
+    }
+    return image_set_capacity(image, capacity);
+}
+
+bool image_reserve(Image *image, uint32 capacity)
+{
+    return capacity <= image->capacity || image_set_capacity(image, capacity);
+}
+
+bool image_resize(Image *image, uint32 len)
+{
+    if (len > image->capacity && !image_grow(image, len))
+    {
+        return FALSE;
+    }
+    image->len = len;
+    return TRUE;
+}
+
+bool image_append(Image *image, uint32 word)
+{
+    if (image->len == image->capacity && !image_grow(image, image->len + 1))
+    {
+        return FALSE;
+    }
+    IMAGE_STORE(image->bytes + (size_t)image->len * IMAGE_WORD_BYTES, word);
+    image->len++;
+    return TRUE;
+}
+
+bool image_append_n(Image *image, const uint32 *words, uint32 count)
+{
+    uint32 position = image->len;
+    if (!image_resize(image, image->len + count))
+    {
+        return FALSE;
+    }
+    image_write(image, position, words, count);
+    return TRUE;
+}
+
+bool image_append_image(Image *image, const Image *other)
+{
+    uint32 position = image->len;
+    if (!image_resize(image, image->len + other->len))
+    {
+        return FALSE;
+    }
+    if (other->len > 0)
+    {
+        memcpy(image->bytes + (size_t)position * IMAGE_WORD_BYTES, other->bytes, (size_t)other->len * IMAGE_WORD_BYTES);
+    }
+    return TRUE;
+}
+
+uint32 image_get(const Image *image, uint32 position)
+{
+    assert(position < image->len);
+    return IMAGE_LOAD(image->bytes + (size_t)position * IMAGE_WORD_BYTES);
+}
+
+void image_set(Image *image, uint32 position, uint32 word)
+{
+    assert(position < image->len);
+    IMAGE_STORE(image->bytes + (size_t)position * IMAGE_WORD_BYTES, word);
+}
+
+void image_read(const Image *image, uint32 position, uint32 *words, uint32 count)
+{
+    const uint8 *bytes;
+    uint32 i;
+    if (count == 0)
+    {
+        return;
+    }
+    assert(position + count <= image->len);
+    bytes = image->bytes + (size_t)position * IMAGE_WORD_BYTES;
+    for (i = 0; i < count; ++i, bytes += IMAGE_WORD_BYTES)
+    {
+        words[i] = IMAGE_LOAD(bytes);
+    }
+}
+
+void image_write(Image *image, uint32 position, const uint32 *words, uint32 count)
+{
+    uint8 *bytes;
+    uint32 i;
+    if (count == 0)
+    {
+        return;
+    }
+    assert(position + count <= image->len);
+    bytes = image->bytes + (size_t)position * IMAGE_WORD_BYTES;
+    for (i = 0; i < count; ++i, bytes += IMAGE_WORD_BYTES)
+    {
+        IMAGE_STORE(bytes, words[i]);
+    }
+}
+
+void image_free(Image *image)
+{
+    if (image->arena == NULL)
+    {
+        memory_stats_free(MEMORY_SITE_IMAGE_GROWTH, (size_t)image->capacity * IMAGE_WORD_BYTES);
+        memory_stats_free(MEMORY_SITE_OBJECT, sizeof(Image));
+        free(image->bytes);
+        free(image);
+    }
+}
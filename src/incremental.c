@@ -0,0 +1,877 @@
+#include <string.h>
+#include <stdlib.h>
+#include "incremental.h"
+#include "parser.h"
+#include "first_pass.h" /* for INSTRUCTION_MEMORY_START and MAX_ADDRESS */
+#include "build_id.h"
+
+VECTOR_IMPL(LineState, LineStateVector, line_state)
+
+/* The magic which every saved state starts with */
+#define INCREMENTAL_STATE_MAGIC "ASMINC01"
+/* The length of INCREMENTAL_STATE_MAGIC */
+#define INCREMENTAL_STATE_MAGIC_LENGTH 8
+/* The extension of the temporary file a state is saved into before it is renamed */
+#define TEMP_EXTENSION ".tmp"
+/* The smallest amount of slots in a SymbolIndex */
+#define MIN_SYMBOL_INDEX_SLOTS 16
+
+/* An index of a symbol table by name (an open addressing hash table), so that each symbol reference is looked up in constant time */
+typedef struct
+{
+    /* the table which is indexed */
+    SymbolTable symbol_table;
+    /* each slot is either 0 (empty) or the position of a symbol in the table + 1 */
+    uint32 *slots;
+    /* the amount of slots. Always a power of 2 */
+    uint32 slot_count;
+} SymbolIndex;
+
+/* FNV-1a hash of a null terminated string */
+uint32 hash_string(const char *str)
+{
+    uint32 hash = 2166136261UL;
+    while (*str != 0)
+    {
+        hash = ((hash ^ (unsigned char)*str) * 16777619UL) & 0xffffffffUL;
+        str++;
+    }
+    return hash;
+}
+
+/* Initialize an index (inside an arena) for a symbol table which will hold at most max_symbols symbols.
+   Returns TRUE if successful, FALSE if an allocation failed */
+bool symbol_index_init(SymbolIndex *index, SymbolTable symbol_table, uint32 max_symbols, Arena *arena)
+{
+    index->symbol_table = symbol_table;
+    /* keep the index at most half full so that probe sequences stay short */
+    index->slot_count = MIN_SYMBOL_INDEX_SLOTS;
+    while (index->slot_count < max_symbols * 2)
+    {
+        index->slot_count *= 2;
+    }
+    if ((index->slots = arena_alloc(arena, index->slot_count * sizeof(uint32))) == NULL)
+    {
+        return FALSE;
+    }
+    memset(index->slots, 0, index->slot_count * sizeof(uint32));
+    return TRUE;
+}
+
+/* Find the slot of a symbol in the index, or the empty slot it should be put in if it is not in the index */
+uint32 *symbol_index_slot(SymbolIndex *index, const char *name)
+{
+    uint32 position = hash_string(name) & (index->slot_count - 1);
+    while (index->slots[position] != 0 && strcmp(symbol_vec_get_ptr(index->symbol_table.inner, index->slots[position] - 1)->name, name) != 0)
+    {
+        position = (position + 1) & (index->slot_count - 1);
+    }
+    return &index->slots[position];
+}
+
+/* Search for a symbol in the index. Returns a pointer to the symbol if found, NULL otherwise */
+Symbol *symbol_index_search(SymbolIndex *index, const char *name)
+{
+    uint32 slot = *symbol_index_slot(index, name);
+    return slot == 0 ? NULL : symbol_vec_get_ptr(index->symbol_table.inner, slot - 1);
+}
+
+/* Insert a symbol into the table and the index. Returns FALSE if the symbol is already defined (*alloc_fail is set if an allocation failed) */
+bool symbol_index_insert(SymbolIndex *index, const char *name, uint32 addr, SymbolContext ctx, int line_num, bool *alloc_fail)
+{
+    uint32 *slot = symbol_index_slot(index, name);
+    if (*slot != 0)
+    {
+        return FALSE;
+    }
+    if ((*alloc_fail = !symbol_table_insert(index->symbol_table, name, addr, ctx, line_num)))
+    {
+        return FALSE;
+    }
+    *slot = index->symbol_table.inner->len;
+    return TRUE;
+}
+
+/* Free the dynamic memory held by a line's state */
+void free_line_state(LineState *line)
+{
+    free(line->text);
+    free(line->label);
+    free(line->symbol);
+    free(line->data_words);
+}
+
+/* Free the state of each line in a vector, and the vector itself */
+void free_line_states(LineStateVector *lines)
+{
+    uint32 i;
+    for (i = 0; i < lines->len; ++i)
+    {
+        free_line_state(line_state_vec_get_ptr(lines, i));
+    }
+    line_state_vec_free(lines);
+}
+
+/* Reset a state to be empty. Returns TRUE if successful, FALSE if an allocation failed (in which case the state has no lines vector) */
+bool reset_incremental_state(IncrementalState *state)
+{
+    if (state->lines != NULL)
+    {
+        free_line_states(state->lines);
+    }
+    state->lines = line_state_vec_create();
+    state->instruction_image->len = 0;
+    state->data_image->len = 0;
+    state->IC = INSTRUCTION_MEMORY_START;
+    state->DC = 0;
+    return state->lines != NULL;
+}
+
+bool incremental_state_init(IncrementalState *state)
+{
+    state->lines = NULL;
+    state->instruction_image = image_create();
+    state->data_image = image_create();
+    if (state->instruction_image == NULL || state->data_image == NULL || !reset_incremental_state(state))
+    {
+        incremental_state_free(state);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+void incremental_state_free(IncrementalState *state)
+{
+    if (state->lines != NULL)
+    {
+        free_line_states(state->lines);
+    }
+    if (state->instruction_image != NULL)
+    {
+        image_free(state->instruction_image);
+    }
+    if (state->data_image != NULL)
+    {
+        image_free(state->data_image);
+    }
+    state->lines = NULL;
+    state->instruction_image = NULL;
+    state->data_image = NULL;
+}
+
+/* Copy a symbol name out of a parsed line into *out. Returns TRUE if successful, FALSE if an allocation failed */
+bool copy_symbol_name(const char *name, char **out)
+{
+    return (*out = strdup(name)) != NULL;
+}
+
+/* Parse the text of a line into its state, the same way the first pass does.
+   Returns TRUE if successful, FALSE if the line has an error or if an allocation failed (in which case *alloc_fail is set). */
+bool parse_line_state(LineState *line, bool *alloc_fail)
+{
+    char buf[MAX_LINE_LENGTH + 2]; /* +2 for newline + null termination */
+    ParseLineData parse_line_data;
+    Directive *directive = &parse_line_data.val.directive;
+    Instruction *instruction = &parse_line_data.val.instruction;
+    uint32 i, word;
+    char *str;
+
+    strcpy(buf, line->text);
+    parse_line(buf, &parse_line_data);
+    if (parse_line_data.type == PARSE_LINE_COMMENT || parse_line_data.type == PARSE_LINE_EMPTY)
+    {
+        return TRUE;
+    }
+    if (parse_line_data.type == PARSE_LINE_ERROR || parse_line_data.parse_label_data.result == SYMBOL_PARSE_ERROR)
+    {
+        return FALSE;
+    }
+
+    if (parse_line_data.type == PARSE_LINE_INSTRUCTION)
+    {
+        line->kind = STATEMENT_INSTRUCTION;
+        line->instruction = *instruction;
+        line->word_count = instruction_encoding_word_count(instruction);
+        line->instruction_words[0] = encode_instruction(instruction);
+        /* the words of operands which refer to symbols are encoded once the symbols are resolved */
+        word = 1;
+        if (instruction->operand_amount >= 1 && instruction->operand1.type != OPERAND_REGISTER)
+        {
+            line->instruction_words[word++] = instruction->operand1.type == OPERAND_IMMEDIATE ? encode_resolved_operand(&instruction->operand1, NULL, 0) : 0;
+        }
+        if (instruction->operand_amount >= 2 && instruction->operand2.type != OPERAND_REGISTER)
+        {
+            line->instruction_words[word++] = instruction->operand2.type == OPERAND_IMMEDIATE ? encode_resolved_operand(&instruction->operand2, NULL, 0) : 0;
+        }
+    }
+    else if (directive->type == DIRECTIVE_ENTRY || directive->type == DIRECTIVE_EXTERN)
+    {
+        line->kind = directive->type == DIRECTIVE_ENTRY ? STATEMENT_ENTRY : STATEMENT_EXTERN;
+        if ((*alloc_fail = !copy_symbol_name(directive->type == DIRECTIVE_ENTRY ? directive->val.entry_symbol : directive->val.extern_symbol,
+                                             &line->symbol)))
+        {
+            return FALSE;
+        }
+        /* labels before .entry and .extern directives are ignored */
+        return TRUE;
+    }
+    else
+    {
+        line->kind = STATEMENT_DATA;
+        /* a .string directive has each of its characters and a null terminator */
+        line->word_count = directive->type == DIRECTIVE_DATA ? directive->val.data.amount_of_integers : strlen(directive->val.string) + 1;
+        if ((*alloc_fail = (line->data_words = malloc(line->word_count * sizeof(uint32))) == NULL))
+        {
+            return FALSE;
+        }
+        if (directive->type == DIRECTIVE_DATA)
+        {
+            for (i = 0; i < line->word_count; ++i)
+            {
+                line->data_words[i] = directive->val.data.integers[i];
+            }
+        }
+        else
+        {
+            for (str = directive->val.string, i = 0; i < line->word_count; ++i, ++str)
+            {
+                line->data_words[i] = *str;
+            }
+        }
+    }
+
+    if (parse_line_data.parse_label_data.result == HAS_SYMBOL &&
+        (*alloc_fail = !copy_symbol_name(parse_line_data.parse_label_data.val.symbol_buffer, &line->label)))
+    {
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/* Initialize the state of a line out of its text (without parsing it). Takes ownership of text. */
+void init_line_state(LineState *line, char *text)
+{
+    line->hash = hash_string(text);
+    line->text = text;
+    line->kind = STATEMENT_NONE;
+    line->label = NULL;
+    line->symbol = NULL;
+    line->word_count = 0;
+    line->data_words = NULL;
+}
+
+/* Read every line of a file into a vector of unparsed line states. Returns NULL if an allocation failed */
+LineStateVector *read_line_states(FILE *input)
+{
+    char buf[MAX_LINE_LENGTH + 2]; /* +2 for newline + null termination, the same as the passes so that lines are split the same way */
+    LineStateVector *lines = line_state_vec_create();
+    LineState line;
+    char *text;
+    if (lines == NULL)
+    {
+        return NULL;
+    }
+    while (fgets(buf, sizeof(buf), input))
+    {
+        if ((text = strdup(buf)) == NULL)
+        {
+            free_line_states(lines);
+            return NULL;
+        }
+        init_line_state(&line, text);
+        if (!line_state_vec_push(lines, line))
+        {
+            free(text);
+            free_line_states(lines);
+            return NULL;
+        }
+    }
+    return lines;
+}
+
+/* Check whether or not 2 lines have the same text */
+bool same_line(LineState *a, LineState *b)
+{
+    return a->hash == b->hash && strcmp(a->text, b->text) == 0;
+}
+
+/* Set the counters of each line starting from first_line, and the counters after the last line in the state */
+void shift_addresses(IncrementalState *state, uint32 first_line, uint32 IC, uint32 DC)
+{
+    uint32 i;
+    LineState *line;
+    for (i = first_line; i < state->lines->len; ++i)
+    {
+        line = line_state_vec_get_ptr(state->lines, i);
+        line->IC = IC;
+        line->DC = DC;
+        if (line->kind == STATEMENT_INSTRUCTION)
+        {
+            IC += line->word_count;
+        }
+        else if (line->kind == STATEMENT_DATA)
+        {
+            DC += line->word_count;
+        }
+    }
+    state->IC = IC;
+    state->DC = DC;
+}
+
+/* Rewrite the images from the line first_line onwards out of the words of each line. IC and DC are the counters before first_line.
+   The addresses must have been shifted already (see shift_addresses), so that the images are sized once by the final counters.
+   Returns TRUE if successful, FALSE if an allocation failed */
+bool rewrite_images(IncrementalState *state, uint32 first_line, uint32 IC, uint32 DC)
+{
+    uint32 i;
+    LineState *line;
+    /* everything before the first line stays in place */
+    state->instruction_image->len = IC - INSTRUCTION_MEMORY_START;
+    state->data_image->len = DC;
+    if (!image_resize(state->instruction_image, state->IC - INSTRUCTION_MEMORY_START) ||
+        !image_resize(state->data_image, state->DC))
+    {
+        return FALSE;
+    }
+    for (i = first_line; i < state->lines->len; ++i)
+    {
+        line = line_state_vec_get_ptr(state->lines, i);
+        if (line->kind == STATEMENT_INSTRUCTION)
+        {
+            image_write(state->instruction_image, line->IC - INSTRUCTION_MEMORY_START, line->instruction_words, line->word_count);
+        }
+        else if (line->kind == STATEMENT_DATA)
+        {
+            image_write(state->data_image, line->DC, line->data_words, line->word_count);
+        }
+    }
+    return TRUE;
+}
+
+/* Replace the lines of the state by new lines, parsing only the lines which differ from the state's lines.
+   The new lines which are the same as lines in the state take the state of those lines.
+   Returns TRUE if successful, FALSE if a line has an error or an allocation failed (in which case *alloc_fail is set).
+   *first_changed is set to the first line which differs (or the amount of lines if none do), and *IC and *DC to the counters before it. */
+bool update_lines(IncrementalState *state, LineStateVector *new_lines, uint32 *first_changed, uint32 *IC, uint32 *DC, bool *alloc_fail)
+{
+    LineStateVector *old_lines = state->lines;
+    uint32 prefix = 0, suffix = 0, i;
+    LineState *old_line, *new_line;
+
+    /* find the lines which stayed the same at the start and at the end of the file */
+    while (prefix < old_lines->len && prefix < new_lines->len &&
+           same_line(line_state_vec_get_ptr(old_lines, prefix), line_state_vec_get_ptr(new_lines, prefix)))
+    {
+        prefix++;
+    }
+    while (suffix < old_lines->len - prefix && suffix < new_lines->len - prefix &&
+           same_line(line_state_vec_get_ptr(old_lines, old_lines->len - 1 - suffix), line_state_vec_get_ptr(new_lines, new_lines->len - 1 - suffix)))
+    {
+        suffix++;
+    }
+
+    /* parse the lines in between */
+    for (i = prefix; i < new_lines->len - suffix; ++i)
+    {
+        if (!parse_line_state(line_state_vec_get_ptr(new_lines, i), alloc_fail))
+        {
+            return FALSE;
+        }
+    }
+
+    /* the counters before the first changed line did not change */
+    if (prefix < old_lines->len)
+    {
+        old_line = line_state_vec_get_ptr(old_lines, prefix);
+        *IC = old_line->IC;
+        *DC = old_line->DC;
+    }
+    else
+    {
+        *IC = state->IC;
+        *DC = state->DC;
+    }
+
+    /* move the state of the lines which stayed the same into the new lines */
+    for (i = 0; i < old_lines->len; ++i)
+    {
+        old_line = line_state_vec_get_ptr(old_lines, i);
+        if (i < prefix || i >= old_lines->len - suffix)
+        {
+            new_line = line_state_vec_get_ptr(new_lines, i < prefix ? i : i - old_lines->len + new_lines->len);
+            free_line_state(new_line);
+            *new_line = *old_line;
+        }
+        else
+        {
+            free_line_state(old_line);
+        }
+    }
+    line_state_vec_free(old_lines);
+    state->lines = new_lines;
+    *first_changed = prefix;
+    return TRUE;
+}
+
+/* Build the symbol table out of the lines' states, the same way the first pass does.
+   Returns TRUE if successful, FALSE if a symbol is defined twice or an allocation failed (in which case *alloc_fail is set). */
+bool build_symbol_table(IncrementalState *state, SymbolIndex *index, bool *alloc_fail)
+{
+    uint32 i;
+    LineState *line;
+    for (i = 0; i < state->lines->len; ++i)
+    {
+        line = line_state_vec_get_ptr(state->lines, i);
+        /* data symbols come after all of the instructions */
+        if ((line->kind == STATEMENT_INSTRUCTION && line->label != NULL &&
+             !symbol_index_insert(index, line->label, line->IC, SYMBOL_CONTEXT_CODE, i + 1, alloc_fail)) ||
+            (line->kind == STATEMENT_DATA && line->label != NULL &&
+             !symbol_index_insert(index, line->label, line->DC + state->IC, SYMBOL_CONTEXT_DATA, i + 1, alloc_fail)) ||
+            (line->kind == STATEMENT_EXTERN && !symbol_index_insert(index, line->symbol, 0, SYMBOL_CONTEXT_EXTERNAL, i + 1, alloc_fail)))
+        {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+/* Resolve the symbol of an operand of an instruction in a line, the same way the second pass does:
+   encode the operand again (patching the instruction image if its word changed), and push it onto the external symbols if it is external.
+   word is the position of the operand's word in the instruction, ext_offset is the offset from the instruction the second pass records for the external symbol.
+   Returns TRUE if successful, FALSE if the symbol is not defined or an allocation failed (in which case *alloc_fail is set). */
+bool resolve_operand(IncrementalState *state, SymbolIndex *index, LineState *line, Operand *operand, uint32 word, uint32 ext_offset,
+                     SymbolReferenceVector *external_symbols, bool *alloc_fail)
+{
+    Symbol *symbol;
+    SymbolReference reference;
+    uint32 encoding;
+    if (operand->type != OPERAND_SYMBOL && operand->type != OPERAND_ADDRESS)
+    {
+        return TRUE;
+    }
+    if ((symbol = symbol_index_search(index, operand->value.symbol_name)) == NULL)
+    {
+        return FALSE;
+    }
+    if (symbol->context == SYMBOL_CONTEXT_EXTERNAL)
+    {
+        reference.symbol_id = symbol_table_id(index->symbol_table, symbol);
+        reference.addr = line->IC + ext_offset;
+        if ((*alloc_fail = !symbol_ref_vec_push(external_symbols, reference)))
+        {
+            return FALSE;
+        }
+    }
+    /* only the words of references whose symbol (or instruction) moved change */
+    encoding = encode_resolved_operand(operand, symbol, line->IC);
+    if (encoding != line->instruction_words[word])
+    {
+        line->instruction_words[word] = encoding;
+        image_set(state->instruction_image, line->IC - INSTRUCTION_MEMORY_START + word, encoding);
+    }
+    return TRUE;
+}
+
+/* Resolve every symbol reference in the lines' states, the same way the second pass does.
+   Returns TRUE if successful, FALSE if a symbol is not defined, an .entry directive has an external symbol,
+   or an allocation failed (in which case *alloc_fail is set). */
+bool resolve_symbols(IncrementalState *state, SymbolIndex *index, SecondPassResult *second_pass_result, Arena *arena, bool *alloc_fail)
+{
+    uint32 i, word;
+    LineState *line;
+    Instruction *instruction;
+    Symbol *symbol;
+    SymbolSet entry_set; /* the symbols we already pushed onto the entry symbols */
+    SymbolReference reference;
+    if ((*alloc_fail = !symbol_set_init(&entry_set, index->symbol_table, arena)))
+    {
+        return FALSE;
+    }
+    for (i = 0; i < state->lines->len; ++i)
+    {
+        line = line_state_vec_get_ptr(state->lines, i);
+        if (line->kind == STATEMENT_ENTRY)
+        {
+            if ((symbol = symbol_index_search(index, line->symbol)) == NULL || symbol->context == SYMBOL_CONTEXT_EXTERNAL)
+            {
+                return FALSE;
+            }
+            reference.symbol_id = symbol_table_id(index->symbol_table, symbol);
+            reference.addr = symbol->addr;
+            if (symbol_set_insert(&entry_set, reference.symbol_id) && (*alloc_fail = !symbol_ref_vec_push(second_pass_result->entry_symbols, reference)))
+            {
+                return FALSE;
+            }
+        }
+        else if (line->kind == STATEMENT_INSTRUCTION)
+        {
+            instruction = &line->instruction;
+            word = 1;
+            if (instruction->operand_amount >= 1)
+            {
+                if (!resolve_operand(state, index, line, &instruction->operand1, word, 1, second_pass_result->external_symbols, alloc_fail))
+                {
+                    return FALSE;
+                }
+                word += instruction->operand1.type != OPERAND_REGISTER;
+            }
+            /* the second pass records the second operand at IC + 2 even when the first operand has no word */
+            if (instruction->operand_amount >= 2 &&
+                !resolve_operand(state, index, line, &instruction->operand2, word, 2, second_pass_result->external_symbols, alloc_fail))
+            {
+                return FALSE;
+            }
+        }
+    }
+    return TRUE;
+}
+
+/* Copy an image into an arena (allocated at its exact size). Returns NULL if an allocation failed */
+Image *copy_image(Image *image, Arena *arena)
+{
+    Image *copy = image_create_in(arena);
+    if (copy == NULL || !image_reserve(copy, image->len) || !image_append_image(copy, image))
+    {
+        return NULL;
+    }
+    return copy;
+}
+
+/* Count the amount of symbols the lines' states define */
+uint32 count_symbols(IncrementalState *state)
+{
+    uint32 i, count = 0;
+    LineState *line;
+    for (i = 0; i < state->lines->len; ++i)
+    {
+        line = line_state_vec_get_ptr(state->lines, i);
+        count += line->label != NULL || line->kind == STATEMENT_EXTERN;
+    }
+    return count;
+}
+
+/* Initialize an empty second pass result inside an arena. Returns TRUE if successful, FALSE if an allocation failed */
+bool init_second_pass_result(SecondPassResult *second_pass_result, Arena *arena)
+{
+    second_pass_result->encountered_error = FALSE;
+    second_pass_result->alloc_fail = FALSE;
+    second_pass_result->instruction_image = NULL;
+    second_pass_result->data_image = NULL;
+    second_pass_result->entry_symbols = symbol_ref_vec_create_in(arena);
+    second_pass_result->external_symbols = symbol_ref_vec_create_in(arena);
+    return second_pass_result->entry_symbols != NULL && second_pass_result->external_symbols != NULL &&
+           symbol_table_init(&second_pass_result->symbol_table, arena);
+}
+
+/* Algorithm:
+   We read every line of the file and compare it with the lines of the state. Lines at the start and at the end of the file which stayed the same
+   keep their state, and only the lines in between are parsed. Any error in them means the file has errors.
+   From the first changed line onwards, the counters of each line are shifted and the images are rewritten out of the words each line has.
+   Then, the symbol table is built out of the labels and .extern directives of the lines (data symbols are placed after the instructions),
+   and every symbol reference is resolved: an operand whose word changed (since its symbol or its instruction moved) is patched in the instruction image.
+   The .entry directives and external references are collected in the same order the second pass collects them.
+   Any undefined symbol, symbol defined twice, .entry of an external symbol or memory overflow means the file has errors. */
+IncrementalOutcome incremental_assemble(IncrementalState *state, FILE *input, Arena *arena, SecondPassResult *second_pass_result)
+{
+    LineStateVector *new_lines;
+    SymbolIndex index;
+    uint32 first_changed, IC, DC;
+    bool alloc_fail = FALSE, success;
+
+    if ((new_lines = read_line_states(input)) == NULL)
+    {
+        reset_incremental_state(state);
+        return INCREMENTAL_ALLOC_FAIL;
+    }
+    if (!update_lines(state, new_lines, &first_changed, &IC, &DC, &alloc_fail))
+    {
+        free_line_states(new_lines);
+        reset_incremental_state(state);
+        return alloc_fail ? INCREMENTAL_ALLOC_FAIL : INCREMENTAL_HAS_ERRORS;
+    }
+
+    /* shift the addresses and rewrite the images from the first changed line */
+    shift_addresses(state, first_changed, IC, DC);
+    if (state->IC + state->DC > MAX_ADDRESS)
+    {
+        reset_incremental_state(state);
+        return INCREMENTAL_HAS_ERRORS;
+    }
+    if (!rewrite_images(state, first_changed, IC, DC))
+    {
+        reset_incremental_state(state);
+        return INCREMENTAL_ALLOC_FAIL;
+    }
+
+    /* rebuild the symbol table and resolve every symbol reference against it */
+    if (!init_second_pass_result(second_pass_result, arena) ||
+        !symbol_index_init(&index, second_pass_result->symbol_table, count_symbols(state), arena))
+    {
+        reset_incremental_state(state);
+        return INCREMENTAL_ALLOC_FAIL;
+    }
+    success = build_symbol_table(state, &index, &alloc_fail) && resolve_symbols(state, &index, second_pass_result, arena, &alloc_fail);
+    if (success)
+    {
+        second_pass_result->instruction_image = copy_image(state->instruction_image, arena);
+        second_pass_result->data_image = copy_image(state->data_image, arena);
+        alloc_fail = second_pass_result->instruction_image == NULL || second_pass_result->data_image == NULL;
+    }
+    if (!success || alloc_fail)
+    {
+        reset_incremental_state(state);
+        return alloc_fail ? INCREMENTAL_ALLOC_FAIL : INCREMENTAL_HAS_ERRORS;
+    }
+    return INCREMENTAL_ASSEMBLED;
+}
+
+/* Write a string (which may be NULL) to a stream as its length followed by its characters. Returns TRUE if successful, FALSE otherwise */
+bool write_string(FILE *file, const char *str)
+{
+    uint32 len = str == NULL ? 0 : strlen(str);
+    return write_u32_le(file, len) && fwrite(str == NULL ? "" : str, 1, len, file) == len;
+}
+
+/* Read a string written with write_string into *str (NULL for an empty string). Strings longer than max_len are rejected.
+   Returns TRUE if successful, FALSE otherwise */
+bool read_string(FILE *file, uint32 max_len, char **str)
+{
+    uint32 len;
+    *str = NULL;
+    if (!read_u32_le(file, &len) || len > max_len)
+    {
+        return FALSE;
+    }
+    if (len == 0)
+    {
+        return TRUE;
+    }
+    /* +1 for null termination */
+    if ((*str = malloc(len + 1)) == NULL)
+    {
+        return FALSE;
+    }
+    (*str)[len] = 0;
+    return fread(*str, 1, len, file) == len && strlen(*str) == len;
+}
+
+/* Write an operand to a stream. Returns TRUE if successful, FALSE otherwise */
+bool write_operand(FILE *file, Operand *operand)
+{
+    if (!write_u32_le(file, operand->type))
+    {
+        return FALSE;
+    }
+    switch (operand->type)
+    {
+    case OPERAND_IMMEDIATE:
+    {
+        return write_u32_le(file, operand->value.immediate);
+    }
+    case OPERAND_REGISTER:
+    {
+        return write_u32_le(file, operand->value.register_num);
+    }
+    default:
+    {
+        return write_string(file, operand->value.symbol_name);
+    }
+    }
+}
+
+/* Read an operand written with write_operand. Returns TRUE if successful, FALSE otherwise */
+bool read_operand(FILE *file, Operand *operand)
+{
+    uint32 value;
+    char *symbol_name;
+    if (!read_u32_le(file, &value) || value > OPERAND_REGISTER)
+    {
+        return FALSE;
+    }
+    operand->type = value;
+    if (operand->type == OPERAND_SYMBOL || operand->type == OPERAND_ADDRESS)
+    {
+        if (!read_string(file, MAX_LABEL_SIZE, &symbol_name) || symbol_name == NULL)
+        {
+            free(symbol_name);
+            return FALSE;
+        }
+        strcpy(operand->value.symbol_name, symbol_name);
+        free(symbol_name);
+        return TRUE;
+    }
+    if (!read_u32_le(file, &value))
+    {
+        return FALSE;
+    }
+    if (operand->type == OPERAND_IMMEDIATE)
+    {
+        operand->value.immediate = (int32)value;
+    }
+    else
+    {
+        operand->value.register_num = value;
+    }
+    return TRUE;
+}
+
+/* Write the state of a line to a stream. Returns TRUE if successful, FALSE otherwise */
+bool write_line_state(FILE *file, LineState *line)
+{
+    uint32 i;
+    bool success = write_string(file, line->text) && write_u32_le(file, line->kind) && write_string(file, line->label) &&
+                   write_string(file, line->symbol) && write_u32_le(file, line->word_count);
+    if (success && line->kind == STATEMENT_INSTRUCTION)
+    {
+        success = write_u32_le(file, line->instruction.type) && write_u32_le(file, line->instruction.operand_amount) &&
+                  (line->instruction.operand_amount < 1 || write_operand(file, &line->instruction.operand1)) &&
+                  (line->instruction.operand_amount < 2 || write_operand(file, &line->instruction.operand2));
+    }
+    for (i = 0; i < line->word_count && success; ++i)
+    {
+        success = write_u32_le(file, line->kind == STATEMENT_INSTRUCTION ? line->instruction_words[i] : line->data_words[i]);
+    }
+    return success;
+}
+
+/* Read the state of a line written with write_line_state. Returns TRUE if successful, FALSE otherwise (in which case the line should still be freed) */
+bool read_line_state(FILE *file, LineState *line)
+{
+    uint32 i, value;
+    char *text;
+    if (!read_string(file, MAX_LINE_LENGTH + 1, &text) || text == NULL)
+    {
+        free(text);
+        init_line_state(line, NULL);
+        return FALSE;
+    }
+    init_line_state(line, text);
+    if (!read_u32_le(file, &value) || value > STATEMENT_EXTERN)
+    {
+        return FALSE;
+    }
+    line->kind = value;
+    if (!read_string(file, MAX_LABEL_SIZE, &line->label) || !read_string(file, MAX_LABEL_SIZE, &line->symbol) ||
+        !read_u32_le(file, &line->word_count))
+    {
+        return FALSE;
+    }
+    if (line->kind == STATEMENT_INSTRUCTION)
+    {
+        if (line->word_count > MAX_INSTRUCTION_WORDS || !read_u32_le(file, &value) || value > INSTRUCTION_STOP ||
+            !read_u32_le(file, &line->instruction.operand_amount) || line->instruction.operand_amount > 2 ||
+            (line->instruction.operand_amount >= 1 && !read_operand(file, &line->instruction.operand1)) ||
+            (line->instruction.operand_amount >= 2 && !read_operand(file, &line->instruction.operand2)))
+        {
+            return FALSE;
+        }
+        line->instruction.type = value;
+        for (i = 0; i < line->word_count; ++i)
+        {
+            if (!read_u32_le(file, &line->instruction_words[i]))
+            {
+                return FALSE;
+            }
+        }
+        return TRUE;
+    }
+    /* a .string directive has at most a word for each character of the line and a null terminator */
+    if (line->kind != STATEMENT_DATA || line->word_count == 0)
+    {
+        return line->word_count == 0;
+    }
+    if (line->word_count > MAX_LINE_LENGTH + 1 || (line->data_words = malloc(line->word_count * sizeof(uint32))) == NULL)
+    {
+        return FALSE;
+    }
+    for (i = 0; i < line->word_count; ++i)
+    {
+        if (!read_u32_le(file, &line->data_words[i]))
+        {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+bool incremental_state_load(IncrementalState *state, const char *path)
+{
+    FILE *file;
+    char magic[INCREMENTAL_STATE_MAGIC_LENGTH];
+    char *build_id = NULL;
+    uint32 line_count, i;
+    LineState line;
+    bool success;
+
+    if ((file = fopen(path, "rb")) == NULL)
+    {
+        return FALSE;
+    }
+    success = fread(magic, 1, sizeof(magic), file) == sizeof(magic) && memcmp(magic, INCREMENTAL_STATE_MAGIC, sizeof(magic)) == 0 &&
+              read_string(file, sizeof(ASSEMBLER_BUILD_ID), &build_id) && build_id != NULL && strcmp(build_id, ASSEMBLER_BUILD_ID) == 0 &&
+              read_u32_le(file, &line_count);
+    free(build_id);
+    for (i = 0; success && i < line_count; ++i)
+    {
+        success = read_line_state(file, &line);
+        if (!success || !line_state_vec_push(state->lines, line))
+        {
+            free_line_state(&line);
+            success = FALSE;
+        }
+    }
+    /* there should be nothing after the last line */
+    success = success && fgetc(file) == EOF;
+    fclose(file);
+
+    /* the counters and the images follow from the lines */
+    if (success)
+    {
+        shift_addresses(state, 0, INSTRUCTION_MEMORY_START, 0);
+        success = rewrite_images(state, 0, INSTRUCTION_MEMORY_START, 0);
+    }
+    if (!success)
+    {
+        reset_incremental_state(state);
+    }
+    return success;
+}
+
+bool incremental_state_save(IncrementalState *state, const char *path)
+{
+    FILE *file;
+    char *temp_path;
+    uint32 i;
+    bool success;
+
+    if (state->lines->len == 0)
+    {
+        remove(path);
+        return TRUE;
+    }
+    /* +1 for null termination */
+    if ((temp_path = malloc(strlen(path) + strlen(TEMP_EXTENSION) + 1)) == NULL)
+    {
+        return FALSE;
+    }
+    sprintf(temp_path, "%s%s", path, TEMP_EXTENSION);
+    if ((file = fopen(temp_path, "wb")) == NULL)
+    {
+        free(temp_path);
+        return FALSE;
+    }
+    success = fwrite(INCREMENTAL_STATE_MAGIC, 1, INCREMENTAL_STATE_MAGIC_LENGTH, file) == INCREMENTAL_STATE_MAGIC_LENGTH &&
+              write_string(file, ASSEMBLER_BUILD_ID) && write_u32_le(file, state->lines->len);
+    for (i = 0; i < state->lines->len && success; ++i)
+    {
+        success = write_line_state(file, line_state_vec_get_ptr(state->lines, i));
+    }
+    success = fclose(file) == 0 && success;
+    success = success && rename(temp_path, path) == 0;
+    if (!success)
+    {
+        remove(temp_path);
+    }
+    free(temp_path);
+    return success;
+}
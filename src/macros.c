@@ -1,9 +1,10 @@
 #include <string.h>
-#include <ctype.h>
 #include "macros.h"
 #include "instructions.h"
 #include "directives.h"
 #include "parser.h"
+#include "scan.h"
+#include "char_class.h"
 #include "utils.h"
 
 VECTOR_IMPL(Macro, MacroVector, macro)
@@ -12,23 +13,15 @@ VECTOR_IMPL(Macro, MacroVector, macro)
    Returns TRUE if the write was successfull, FALSE otherwise. */
 bool char_vec_write_str(CharVector *vec, char *str)
 {
-    while (*str != 0)
-    {
-        if (!char_vec_push(vec, *str))
-        {
-            return FALSE;
-        }
-        str++;
-    }
-    return TRUE;
+    return char_vec_push_n(vec, str, strlen(str));
 }
 
-/* Initialize a new macro table.
+/* Initialize a new macro table inside an arena (the bodies of its macros are allocated in the arena as well).
    macro_table is an out parameter. It is the MacroTable to initialize. And initialization may fail if alloacting memory for it fails.
    Returns TRUE if initialization was successfull, FALSE otherwise. */
-bool macro_table_init(MacroTable *macro_table)
+bool macro_table_init(MacroTable *macro_table, Arena *arena)
 {
-    macro_table->inner = macro_vec_create();
+    macro_table->inner = macro_vec_create_in(arena);
     if (macro_table->inner == NULL)
     {
         return FALSE;
@@ -36,12 +29,6 @@ bool macro_table_init(MacroTable *macro_table)
     return TRUE;
 }
 
-/* free the macro table */
-void macro_table_free(MacroTable macro_table)
-{
-    macro_vec_free(macro_table.inner);
-}
-
 /* Search for a macro inside the table. The search is implemented via a simple linear search.
    Returns a pointer to the Macro if it was found, NULL otherwise. */
 Macro *macro_table_search(MacroTable *table, char *name)
@@ -64,7 +51,7 @@ bool macro_table_insert(MacroTable *table, char *name)
     Macro macro;
     memcpy(macro.name, name, MAX_MACRO_NAME_LENGTH);
     macro.name[MAX_MACRO_NAME_LENGTH] = 0;
-    macro.data = char_vec_create();
+    macro.data = char_vec_create_in(table->inner->arena);
     if (macro.data == NULL)
     {
         return FALSE;
@@ -93,7 +80,7 @@ bool macro_table_write(MacroTable *table, char *name, char *data)
 bool has_invalid_characters(const char *mcro_name, char *invalid_char, int *invalid_char_pos)
 {
     int pos = 1;
-    while (isalnum(*mcro_name) || *mcro_name == '_')
+    while (CHAR_IS_SYMBOL(*mcro_name) || *mcro_name == '_')
     {
         mcro_name++;
         pos++;
@@ -131,16 +118,20 @@ bool has_invalid_characters(const char *mcro_name, char *invalid_char, int *inva
   and call err_callback with the approrpiate error if they have.
   At the end we return MacroExpansionResult with the result that we got.
      */
-MacroExpansionResult expand_macros(FILE *in, FILE *out, ErrorCallback err_callback)
+MacroExpansionResult expand_macros(FILE *in, FILE *out, ErrorCallback err_callback, Arena *arena)
 {
     char line[MAX_LINE_LENGTH + 2];                     /* the buffer for the line in the file */
-    char line_copy[sizeof(line)];                       /* a copy of the buffer, used for line_info */
-    char *mcro_name, *line_ptr;                         /* the name of the macro and a pointer to the line buffer*/
+    size_t line_length;                                 /* the length of the line */
+    long line_offset;                                   /* the offset of the line in the file, from which errors read the line back */
+    long next_offset;                                   /* the offset of the line after the current line in the file */
+    char *mcro_name, *line_ptr, *label, *line_end;      /* the name of the macro, a pointer to the line buffer, the start of a label and the end of a line */
+    char line_end_char;                                 /* the character at line_end */
     char current_macro_name[MAX_MACRO_NAME_LENGTH + 1]; /* the name of the current macro that is being defined */
     bool is_in_macro = FALSE;                           /* whether or not we're currently in a macro definition */
     MacroTable macro_table;                             /* the table which holds all the macros and their definition */
     Macro *macro;                                       /* a pointer to a macro in the macro table */
     LineInfo line_info;                                 /* information about the current line */
+    LineScan scan;                                      /* the masks of the current line */
     bool encountered_error = FALSE;                     /* whether or not we encountered an error */
     ExpandMacroError expand_macro_err;                  /* an error we encountered during macro expansion, if we find any*/
     Error error;                                        /* error we return for err_callback */
@@ -151,7 +142,7 @@ MacroExpansionResult expand_macros(FILE *in, FILE *out, ErrorCallback err_callba
     char c;
 
     /* initialize the macro table */
-    if (!macro_table_init(&macro_table))
+    if (!macro_table_init(&macro_table, arena))
     {
         /* we encountered an allocation failure - immediately return */
         macro_expansion_result.alloc_fail = TRUE;
@@ -159,8 +150,9 @@ MacroExpansionResult expand_macros(FILE *in, FILE *out, ErrorCallback err_callba
         return macro_expansion_result;
     }
     /* initialize line_info */
-    line_info.line = line_copy;
+    line_info.line = NULL; /* the line is read back from the file only when we report an error on it (see err_at_line) */
     line_info.line_num = 0;
+    next_offset = ftell(in);
 
     /* we only have one error type here - predefine error */
     error.type = ERROR_TYPE_MACRO;
@@ -170,10 +162,13 @@ MacroExpansionResult expand_macros(FILE *in, FILE *out, ErrorCallback err_callba
     macro_expansion_result.encountered_error = FALSE;
     macro_expansion_result.alloc_fail = FALSE;
 
-    while (fgets(line, sizeof(line), in))
+    while (!err_should_stop(err_callback) && fgets(line, sizeof(line), in))
     {
         line_info.line_num++;
-        if (strlen(line) == (sizeof(line) - 1) && line[sizeof(line) - 1] != '\n')
+        line_length = strlen(line);
+        line_offset = next_offset;
+        next_offset = next_line_offset(in, line_offset, line, line_length);
+        if (line_length == (sizeof(line) - 1) && line[sizeof(line) - 1] != '\n')
         {
             /* we're at a line which is longer than MAX_LINE_LENGTH  */
             expand_macro_err.type = EXPAND_MACRO_ERROR_LINE_TOO_LONG;
@@ -184,23 +179,23 @@ MacroExpansionResult expand_macros(FILE *in, FILE *out, ErrorCallback err_callba
             {
                 expand_macro_err.val.is_too_long.len++;
             }
+            next_offset = ftell(in);
             /* we duplicate this string since it may be modified by err_callback (could result in a seg fault)*/
-            error.line_info.line = strdup("line is too long to be displayed");
+            error.line_info.line = arena_strdup(arena, "line is too long to be displayed");
             error.line_info.line_num = line_info.line_num;
             err(err_callback, error);
-            free(error.line_info.line);
             encountered_error = TRUE;
             continue;
         }
-        strcpy(line_copy, line);
         error.line_info = line_info; /* update error's line info */
 
-        line_ptr = skip_space(line);
+        scan_line(line, &scan);
+        line_ptr = scan_skip_space(&scan, line);
 
         if (is_in_macro)
         {
             /* we copy each line of the macro until we reach mcroend*/
-            if (strncmp(line_ptr, "mcroend", 7) == 0 && *skip_space(line_ptr + 7) == 0)
+            if (strncmp(line_ptr, "mcroend", 7) == 0 && *scan_skip_space(&scan, line_ptr + 7) == 0)
             {
                 is_in_macro = FALSE;
             }
@@ -219,42 +214,42 @@ MacroExpansionResult expand_macros(FILE *in, FILE *out, ErrorCallback err_callba
         {
             /* we found a macro definition */
             is_in_macro = TRUE;
-            mcro_name = skip_space(line_ptr + 4);
+            mcro_name = scan_skip_space(&scan, line_ptr + 4);
             trim_end(mcro_name);
 
             if (*mcro_name == 0)
             {
                 /* error - empty macro name */
                 expand_macro_err.type = EXPAND_MACRO_EXPECTED_MACRO_NAME;
-                err(err_callback, error);
+                err_at_line(err_callback, error, in, line_offset);
             }
-            else if (!isalpha(*mcro_name) && *mcro_name != '_')
+            else if (!CHAR_IS_ALPHA(*mcro_name) && *mcro_name != '_')
             {
                 /* error - macro does not start with alphabethic character and does not start with _ */
                 expand_macro_err.type = EXPAND_MACRO_ERROR_STARTS_WITH_INVALID_CHARACTER;
                 expand_macro_err.val.starts_with_invalid_character = *mcro_name;
-                err(err_callback, error);
+                err_at_line(err_callback, error, in, line_offset);
                 encountered_error = TRUE;
             }
             else if (is_an_instruction(mcro_name))
             {
                 /* error - macro is an instruction */
                 expand_macro_err.type = EXPAND_MACRO_ERROR_IS_AN_INSTRUCTION;
-                err(err_callback, error);
+                err_at_line(err_callback, error, in, line_offset);
                 encountered_error = TRUE;
             }
             else if (is_a_directive(mcro_name))
             {
                 /* error - macro is an directive */
                 expand_macro_err.type = EXPAND_MACRO_ERROR_IS_A_DIRECTIVE;
-                err(err_callback, error);
+                err_at_line(err_callback, error, in, line_offset);
                 encountered_error = TRUE;
             }
             else if (is_a_register(mcro_name))
             {
                 /* error - macro has a name of a register */
                 expand_macro_err.type = EXPAND_MACRO_ERROR_IS_A_REGISTER;
-                err(err_callback, error);
+                err_at_line(err_callback, error, in, line_offset);
                 encountered_error = TRUE;
             }
             else if (strlen(mcro_name) > MAX_MACRO_NAME_LENGTH)
@@ -263,7 +258,7 @@ MacroExpansionResult expand_macros(FILE *in, FILE *out, ErrorCallback err_callba
                 expand_macro_err.type = EXPAND_MACRO_ERROR_NAME_IS_TOO_LONG;
                 expand_macro_err.val.is_too_long.expected_len = MAX_MACRO_NAME_LENGTH;
                 expand_macro_err.val.is_too_long.len = strlen(mcro_name);
-                err(err_callback, error);
+                err_at_line(err_callback, error, in, line_offset);
                 encountered_error = TRUE;
             }
             else if (has_invalid_characters(mcro_name, &invalid_character, &invalid_character_pos))
@@ -272,7 +267,7 @@ MacroExpansionResult expand_macros(FILE *in, FILE *out, ErrorCallback err_callba
                 expand_macro_err.type = EXPAND_MACRO_ERROR_INVALID_CHARACTER;
                 expand_macro_err.val.invalid_character.invalid_character = invalid_character;
                 expand_macro_err.val.invalid_character.position = invalid_character_pos;
-                err(err_callback, error);
+                err_at_line(err_callback, error, in, line_offset);
                 encountered_error = TRUE;
             }
             else
@@ -289,52 +284,70 @@ MacroExpansionResult expand_macros(FILE *in, FILE *out, ErrorCallback err_callba
                 }
             }
         }
-        else if ((macro = macro_table_search(&macro_table, trim_end(line_ptr))))
+        else
         {
-            /* paste the macro */
-            for (i = 0; i < macro->data->len; ++i)
+            /* look the line up as a macro without its trailing whitespaces (like trim_end does), restoring the line afterwards so that it can be written as is */
+            line_end = line + line_length;
+            while (line_end > line_ptr && CHAR_IS_SPACE(line_end[-1]))
             {
-                fputc(char_vec_get(macro->data, i), out);
+                line_end--;
+            }
+            line_end_char = *line_end;
+            *line_end = 0;
+            macro = macro_table_search(&macro_table, line_ptr);
+            *line_end = line_end_char;
+            if (macro != NULL)
+            {
+                /* paste the macro */
+                for (i = 0; i < macro->data->len; ++i)
+                {
+                    fputc(char_vec_get(macro->data, i), out);
+                }
+            }
+            else
+            {
+                /* write the line to the output file */
+                fwrite(line, sizeof(*line), line_length, out);
             }
-        }
-        else
-        {
-            /* write the line to the output file. We use line_copy instead of line since line may have been modified by the above if condition */
-            fwrite(line_copy, sizeof(*line_copy), strlen(line_copy), out);
         }
     }
 
     /* ensure that no macro has been defined as a label */
     line_info.line_num = 0;
     fseek(in, 0, SEEK_SET);
-    while (fgets(line, sizeof(line), in))
+    next_offset = 0;
+    while (!err_should_stop(err_callback) && fgets(line, sizeof(line), in))
     {
         line_info.line_num++;
-        strcpy(line_copy, line);
+        line_offset = next_offset;
+        next_offset = next_line_offset(in, line_offset, line, strlen(line));
         error.line_info = line_info; /* update error's line info */
 
         /* check if the line is a label*/
-        line_ptr = skip_space(line);
-        while (*line_ptr != LABEL_END_CHAR && *line_ptr != 0)
-        {
-            line_ptr++;
-        }
-        if (*line_ptr == LABEL_END_CHAR)
+        scan_line(line, &scan);
+        label = scan_skip_space(&scan, line);
+        line_ptr = scan_find(&scan, label, LABEL_END_CHAR);
+        if (line_ptr != NULL)
         {
             /* the line is a label - check if the label has been defined as a macro */
             *line_ptr = 0;
-            if ((macro = macro_table_search(&macro_table, skip_space(line))) != NULL)
+            if ((macro = macro_table_search(&macro_table, label)) != NULL)
             {
                 /* error - the macro has been defined as a label */
                 expand_macro_err.type = EXPAND_MACRO_ERROR_MACRO_DEFINED_AS_LABEL;
                 expand_macro_err.val.macro_name = macro->name;
-                err(err_callback, error);
+                err_at_line(err_callback, error, in, line_offset);
                 encountered_error = TRUE;
             }
         }
     }
 
-    macro_table_free(macro_table);
+    /* a file which was not read to its end is not expanded */
+    if (err_should_stop(err_callback))
+    {
+        encountered_error = TRUE;
+    }
     macro_expansion_result.encountered_error = encountered_error;
+    macro_expansion_result.line_count = line_info.line_num;
     return macro_expansion_result;
 }
\ No newline at end of file
@@ -1,247 +1,1024 @@
+/* we need POSIX for sigaction */
+#define _POSIX_C_SOURCE 200809L
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <signal.h>
+#include <errno.h>
 #include "macros.h"
 #include "first_pass.h"
 #include "second_pass.h"
 #include "errors.h"
+#include "output.h"
+#include "container.h"
+#include "writer.h"
+#include "cache.h"
+#include "incremental.h"
+#include "watch.h"
+#include "memstats.h"
+#include "stats.h"
+#include "trace.h"
+#include "diagnostics.h"
 #include "utils.h"
 
-/* trunecate x to 24 bits by making any bits above bit 23 equal 0 */
-#define TO_24_BITS(x) ((x) & 0xffffff)
-
 /* Exit code for an allocation failure */
 #define ALLOC_ERROR_EXIT_CODE 1
 
 /* Exit code for when the user calls this binary in a wrong manner  */
 #define BAD_USAGE_EXIT_CODE 2
 
+/* Exit code for when the container file could not be created or written */
+#define CONTAINER_ERROR_EXIT_CODE 3
+
+/* Exit code for when the background writer could not be started */
+#define WRITER_ERROR_EXIT_CODE 4
+
+/* Exit code for when the cache directory could not be used */
+#define CACHE_ERROR_EXIT_CODE 5
+
+/* Exit code for when the files could not be watched */
+#define WATCH_ERROR_EXIT_CODE 6
+
+/* Exit code for when the memory accounting could not be enabled or its report could not be written */
+#define MEMORY_STATS_ERROR_EXIT_CODE 7
+
+/* Exit code for when the timing statistics could not be written */
+#define STATS_ERROR_EXIT_CODE 8
+
+/* Exit code for when tracing could not be enabled or the trace could not be written */
+#define TRACE_ERROR_EXIT_CODE 9
+
 /* the biggest length out of all the file extensions we create */
-#define MAX_FILE_EXTENSION_LENGTH 3
+#define MAX_FILE_EXTENSION_LENGTH MAX_ARTIFACT_EXTENSION_LENGTH
+
+/* The command line options of the assembler */
+typedef struct
+{
+    /* the path of the container file which all artifacts are written into (see container.h), or NULL if each artifact is written into its own file */
+    char *container_path;
+    /* whether or not the artifacts are written on a background thread while the next file is assembled (see writer.h) */
+    bool async_write;
+    /* the directory of the result cache (see cache.h), or NULL if results are not cached */
+    char *cache_dir;
+    /* the maximum size of the result cache in bytes */
+    unsigned long cache_size;
+    /* whether or not to print the statistics of the result cache at the end of the run */
+    bool cache_stats;
+    /* whether or not to assemble files incrementally out of the state of their previous assembly (see incremental.h) */
+    bool incremental;
+    /* whether or not to keep reassembling the files whenever they change (see watch.h) */
+    bool watch;
+    /* whether or not to print a report of the memory each stage allocated at the end of the run (see memstats.h) */
+    bool memory_stats;
+    /* the path to write the report of the memory accounting into as JSON, or NULL if it is not written */
+    char *memory_stats_json;
+    /* whether or not to print the time each stage took at the end of the run (see stats.h) */
+    bool stats;
+    /* the path to write the timing statistics into as JSON, or NULL if they are not written */
+    char *stats_json;
+    /* the path to write the timeline of the run into (see trace.h), or NULL if the run is not traced */
+    char *trace_path;
+    /* the biggest amount of errors to report for a single file before it stops being read (see diagnostics.h), or 0 for no bound */
+    unsigned long max_errors;
+    /* whether or not to only check that the files assemble: the same errors are reported, but no images are built and no files are written */
+    bool check;
+    /* the format the errors are written in (see diagnostics.h). Errors are written into stdout as text, and into stderr as JSON Lines */
+    DiagnosticsFormat diagnostics_format;
+    /* the base filenames of the files to assemble */
+    char **files;
+    /* the amount of files to assemble */
+    int file_count;
+} Options;
+
+/* The data of our error_callback */
+typedef struct
+{
+    /* the name of the file being assembled */
+    char *filename;
+    /* the rendered errors (each followed by a null terminator) to store in the cache, or NULL if the result is not cached.
+       The errors are rendered into it when they are flushed (see flush_file_errors) */
+    CharVector *transcript;
+    /* whether or not recording an error into transcript failed, in which case the result should not be cached */
+    bool transcript_failed;
+} ErrorReport;
+
+/* The sink the errors of the files are reported into. Each file's errors are flushed once the file is done */
+DiagnosticsSink diagnostics_sink;
+
+void exit_due_to_alloc_failure()
+{
+    /* the errors which were reported so far still go out */
+    if (diagnostics_sink.records != NULL)
+    {
+        diagnostics_flush(&diagnostics_sink, NULL);
+    }
+    printf("exiting early due to an allocation failure");
+    exit(ALLOC_ERROR_EXIT_CODE);
+}
 
 /* Our error_callback function which gets called each time there is an error in the assembly file.
-   prints an error with nice colors in the format:
-   filename: error\n\n
-   */
-void error_callback(Error error, void *filename)
+   records the error in the diagnostics sink, which renders it once the file's errors are flushed */
+void error_callback(Error error, void *data)
 {
-    char buf[ERROR_TO_STRING_BUF_SIZE_UPPER_BOUND];
-    error_to_string(error, buf);
-    printf("%s%s:%s ", ANSI_CYAN, (char *)filename, ANSI_NORMAL);
-    printf("%s\n\n", buf);
+    ErrorReport *report = data;
+    if (!diagnostics_report(&diagnostics_sink, report->filename, error))
+    {
+        exit_due_to_alloc_failure();
+    }
 }
 
-/* Write each symbol in a SymbolVector to a file with name filename in the format:
-   symbol address
-   returns TRUE if it successfully opened and wrote to the file, FALSE otherwise */
-bool symbol_vec_write_to_file(char *filename, SymbolVector *vec)
+/* Our should_stop function: the stages stop reading a file once it has reached the bound of --max-errors */
+bool error_should_stop(void *data)
 {
-    FILE *file;
-    uint32 i;
-    Symbol *symbol;
-    if ((file = fopen(filename, "w")) == NULL)
+    (void)data;
+    return diagnostics_limit_reached(&diagnostics_sink);
+}
+
+/* Flush the errors of the file being assembled (rendering them into report->transcript as well, if it's not NULL),
+   and say so if the file had more errors than were reported. filename is the name of the .am file. */
+void flush_file_errors(char *filename, ErrorReport *report)
+{
+    if (!diagnostics_flush(&diagnostics_sink, report != NULL ? report->transcript : NULL) && report != NULL)
     {
-        return FALSE;
+        report->transcript_failed = TRUE;
     }
-    else
+    if (diagnostics_limit_reached(&diagnostics_sink))
+    {
+        printf("%s: stopped after %lu errors (see --max-errors)\n", filename, diagnostics_sink.max_errors);
+    }
+}
+
+/* Parse the command line arguments into options. Returns TRUE if the arguments are valid, FALSE otherwise.
+   Note: options->files points into argv */
+bool parse_options(int argc, char **argv, Options *options)
+{
+    int i;
+    char *end;
+    options->container_path = NULL;
+    options->async_write = FALSE;
+    options->cache_dir = NULL;
+    options->cache_size = CACHE_DEFAULT_MAX_SIZE;
+    options->cache_stats = FALSE;
+    options->incremental = FALSE;
+    options->watch = FALSE;
+    options->memory_stats = FALSE;
+    options->memory_stats_json = NULL;
+    options->stats = FALSE;
+    options->stats_json = NULL;
+    options->trace_path = NULL;
+    options->max_errors = 0;
+    options->check = FALSE;
+    options->diagnostics_format = DIAGNOSTICS_FORMAT_TEXT;
+    options->files = argv + 1;
+    options->file_count = 0;
+    for (i = 1; i < argc; ++i)
     {
-        for (i = 0; i < vec->len; ++i)
+        if (strcmp(argv[i], "--container") == 0)
         {
-            symbol = symbol_vec_get_ptr(vec, i);
-            fprintf(file, "%s %07u\n", symbol->name, symbol->addr);
+            if (i + 1 >= argc)
+            {
+                return FALSE;
+            }
+            options->container_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--async-write") == 0)
+        {
+            options->async_write = TRUE;
+        }
+        else if (strcmp(argv[i], "--cache") == 0)
+        {
+            if (i + 1 >= argc)
+            {
+                return FALSE;
+            }
+            options->cache_dir = argv[++i];
+        }
+        else if (strcmp(argv[i], "--cache-size") == 0)
+        {
+            /* the size is given in MiB */
+            if (i + 1 >= argc || argv[i + 1][0] < '0' || argv[i + 1][0] > '9' ||
+                (options->cache_size = strtoul(argv[++i], &end, 10)) == 0 || *end != 0)
+            {
+                return FALSE;
+            }
+            options->cache_size *= 1024UL * 1024;
+        }
+        else if (strcmp(argv[i], "--cache-stats") == 0)
+        {
+            options->cache_stats = TRUE;
+        }
+        else if (strcmp(argv[i], "--incremental") == 0)
+        {
+            options->incremental = TRUE;
+        }
+        else if (strcmp(argv[i], "--watch") == 0)
+        {
+            options->watch = TRUE;
+        }
+        else if (strcmp(argv[i], "--memory-stats") == 0)
+        {
+            options->memory_stats = TRUE;
+        }
+        else if (strcmp(argv[i], "--memory-stats-json") == 0)
+        {
+            if (i + 1 >= argc)
+            {
+                return FALSE;
+            }
+            options->memory_stats_json = argv[++i];
+        }
+        else if (strcmp(argv[i], "--stats") == 0)
+        {
+            options->stats = TRUE;
+        }
+        else if (strcmp(argv[i], "--stats-json") == 0)
+        {
+            if (i + 1 >= argc)
+            {
+                return FALSE;
+            }
+            options->stats_json = argv[++i];
+        }
+        else if (strcmp(argv[i], "--trace") == 0)
+        {
+            if (i + 1 >= argc)
+            {
+                return FALSE;
+            }
+            options->trace_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--check") == 0)
+        {
+            options->check = TRUE;
+        }
+        else if (strcmp(argv[i], "--diagnostics=text") == 0)
+        {
+            options->diagnostics_format = DIAGNOSTICS_FORMAT_TEXT;
+        }
+        else if (strcmp(argv[i], "--diagnostics=jsonl") == 0)
+        {
+            options->diagnostics_format = DIAGNOSTICS_FORMAT_JSONL;
+        }
+        else if (strcmp(argv[i], "--max-errors") == 0)
+        {
+            if (i + 1 >= argc || argv[i + 1][0] < '0' || argv[i + 1][0] > '9' ||
+                (options->max_errors = strtoul(argv[++i], &end, 10)) == 0 || *end != 0)
+            {
+                return FALSE;
+            }
+        }
+        else
+        {
+            /* files are collected in place, at the start of the arguments */
+            options->files[options->file_count++] = argv[i];
         }
     }
-    fclose(file);
-    return TRUE;
+    /* a container is only complete once it's closed, so it can't be rewritten whenever a file changes.
+       the cache only has the errors as text, which has none of the fields of the JSON Lines.
+       a check writes nothing, so there is no container, cache or incremental state to write */
+    return options->file_count > 0 && !(options->watch && options->container_path != NULL) &&
+           !(options->cache_dir != NULL && options->diagnostics_format == DIAGNOSTICS_FORMAT_JSONL) &&
+           !(options->check && (options->container_path != NULL || options->cache_dir != NULL || options->incremental || options->watch));
 }
 
-void exit_due_to_alloc_failure()
+/* Print the message about a file which failed to assemble. filename is the name of the .am file. */
+void print_failure(AssemblyOutcome outcome, char *filename)
 {
-    printf("exiting early due to an allocation failure");
-    exit(ALLOC_ERROR_EXIT_CODE);
+    switch (outcome)
+    {
+    case ASSEMBLY_MACRO_EXPANSION_FAILED:
+    {
+        printf("%s: macro expansion failed; moving to next file\n", filename);
+        break;
+    }
+    case ASSEMBLY_FIRST_PASS_FAILED:
+    {
+        printf("%s: first pass failed; moving to next file\n", filename);
+        break;
+    }
+    case ASSEMBLY_SECOND_PASS_FAILED:
+    {
+        printf("%s: second pass failed; moving to next file\n", filename);
+        break;
+    }
+    default:
+    {
+        break;
+    }
+    }
 }
 
-int main(int argc, char **argv)
+/* Replay the assembly of a file out of a cache entry: print the same output assembling it would have printed and hand the entry to the writer.
+   filename is a buffer which is big enough to hold filename_base with any extension. stats are the statistics of the file, or NULL.
+   Returns TRUE if successful, FALSE if the entry could not be read (in which case nothing has been printed and the entry is not freed). */
+bool assemble_from_cache(char *filename_base, char *filename, ArtifactWriter *writer, Container *cached_entry, FileStats *stats)
 {
-    char *filename_base; /* the base of the filename (e.g. it would be "example" for "example.asm")*/
-    char *filename;      /* actual filename with an extension */
-    FILE *input_file,
-        *macro_expand_out, *ob_file; /* .as file, .am file, .ob file */
-    MacroExpansionResult macro_expansion_result;
-    FirstPassResult first_pass_result;
-    SecondPassResult second_pass_result;
-    uint32 IC, word, DC;
-    ErrorCallback err_callback;
-    int i;
+    AssemblyOutcome outcome;
+    char *transcript, *rendered_error;
+    uint32 transcript_len;
+    WriteJob job;
 
-    if (argc == 1)
+    if (!cache_entry_read_log(cached_entry, &outcome, &transcript, &transcript_len))
     {
-        printf("usage: assembler [file1] [file2] [file3] ...\nNote: files should be without extension, i.e. you should enter \"file\" instead of \"file.as\"\n");
-        return BAD_USAGE_EXIT_CODE;
+        return FALSE;
     }
-    for (i = 1; i < argc; ++i)
+    sprintf(filename, "%s.am", filename_base);
+    printf("assembling %s\n", filename_base);
+    diagnostics_start_file(&diagnostics_sink);
+    for (rendered_error = transcript; rendered_error < transcript + transcript_len; rendered_error += strlen(rendered_error) + 1)
     {
-        /* get the base filename from command line args*/
-        filename_base = argv[i];
-
-        /* allocate enough memory for filename - +1 for null termination */
-        filename = malloc(strlen(filename_base) + MAX_FILE_EXTENSION_LENGTH + 1);
-        if (filename == NULL)
+        if (!diagnostics_report_rendered(&diagnostics_sink, filename, rendered_error))
         {
+            free(transcript);
             exit_due_to_alloc_failure();
         }
+    }
+    /* the rendered errors point into the transcript, so they are flushed before it is freed */
+    flush_file_errors(filename, NULL);
+    free(transcript);
+    if (outcome == ASSEMBLY_MACRO_EXPANSION_FAILED && writer->container == NULL)
+    {
+        /* there is no .am file when macro expansion fails, so remove any leftover from a previous run */
+        remove(filename);
+    }
+    print_failure(outcome, filename);
 
-        /* initialize our print error callback */
-        err_callback.callback = error_callback;
-        err_callback.data = filename;
+    job.filename_base = filename_base;
+    job.am_file = NULL;
+    job.has_result = FALSE;
+    job.arena = NULL;
+    job.cached_entry = cached_entry;
+    job.stats = stats;
+    writer_submit(writer, job);
+    if (outcome == ASSEMBLY_SUCCEEDED)
+    {
+        printf("assembled %s successfully\n", filename_base);
+    }
+    return TRUE;
+}
 
-        /* open the .as file for reading */
-        sprintf(filename, "%s.as", filename_base);
-        if ((input_file = fopen(filename, "r")) == NULL)
-        {
-            printf("error: could not open file %s for reading\n", filename);
-            free(filename);
-            continue;
-        }
-        /* open the .am file for reading & writing*/
-        filename[0] = 0;
-        sprintf(filename, "%s.am", filename_base);
-        if ((macro_expand_out = fopen(filename, "w+")) == NULL)
+/* Run the first and the second pass on an .am file (read from its start), reporting errors through err_callback.
+   Everything is allocated in the arena of job. If the file assembled successfully, the result is put in job. filename is the name of the .am file.
+   If check_only is TRUE, the passes only validate the file (see first_pass_check and second_pass_check), so there is never a result.
+   Returns the outcome. Exits the program upon an allocation failure. */
+AssemblyOutcome run_passes(FILE *am_file, ErrorCallback err_callback, char *filename, WriteJob *job, bool check_only)
+{
+    FirstPassResult first_pass_result;
+    SecondPassResult second_pass_result;
+    AssemblyOutcome outcome;
+    StatsTimer timer;
+
+    memory_stats_set_stage(MEMORY_STAGE_FIRST_PASS);
+    trace_begin(TRACE_CATEGORY_STAGE, stats_stage_name(STATS_STAGE_FIRST_PASS), job->filename_base);
+    stats_timer_start(&timer, job->stats);
+    first_pass_result = check_only ? first_pass_check(am_file, err_callback, job->arena) : first_pass(am_file, err_callback, job->arena);
+    stats_timer_stop(&timer, STATS_STAGE_FIRST_PASS);
+    trace_end();
+    memory_stats_set_stage(MEMORY_STAGE_OTHER);
+    if (first_pass_result.encountered_error)
+    {
+
+        if (first_pass_result.alloc_fail)
         {
-            printf("error: could not open file %s for write & read\n", filename);
-            fclose(input_file);
+            fclose(am_file);
             free(filename);
-            continue;
+            exit_due_to_alloc_failure();
         }
-        printf("assembling %s\n", filename_base);
-        /* expand macros */
-        macro_expansion_result = expand_macros(input_file, macro_expand_out, err_callback);
-        if (macro_expansion_result.encountered_error)
+        else if (!err_should_stop(err_callback))
         {
-            /* we have errors in the expand macro stage, delete the .am file */
-            fclose(macro_expand_out);
-            remove(filename);
-
-            if (macro_expansion_result.alloc_fail)
+            /* run the second pass to obtain more errors (unless the file already has as many as we report) */
+            fseek(am_file, 0, SEEK_SET);
+            memory_stats_set_stage(MEMORY_STAGE_SECOND_PASS);
+            trace_begin(TRACE_CATEGORY_STAGE, stats_stage_name(STATS_STAGE_SECOND_PASS), job->filename_base);
+            stats_timer_start(&timer, job->stats);
+            second_pass_result = check_only ? second_pass_check(am_file, first_pass_result, err_callback, job->arena)
+                                            : second_pass(am_file, first_pass_result, err_callback, job->arena);
+            stats_timer_stop(&timer, STATS_STAGE_SECOND_PASS);
+            trace_end();
+            memory_stats_set_stage(MEMORY_STAGE_OTHER);
+            if (second_pass_result.alloc_fail)
             {
+                fclose(am_file);
                 free(filename);
                 exit_due_to_alloc_failure();
             }
-            printf("%s: macro expansion failed; moving to next file\n", filename);
-            free(filename);
-
-            continue;
         }
-        /* we no longer need the input file */
-        fclose(input_file);
 
-        /* read the .am file from the start and run first_pass on it */
-        fseek(macro_expand_out, 0, SEEK_SET);
-        first_pass_result = first_pass(macro_expand_out, err_callback);
-        if (first_pass_result.encountered_error)
+        outcome = ASSEMBLY_FIRST_PASS_FAILED;
+    }
+    else
+    {
+        /* read the .am file from the start and run second_pass on it  */
+        fseek(am_file, 0, SEEK_SET);
+        memory_stats_set_stage(MEMORY_STAGE_SECOND_PASS);
+        trace_begin(TRACE_CATEGORY_STAGE, stats_stage_name(STATS_STAGE_SECOND_PASS), job->filename_base);
+        stats_timer_start(&timer, job->stats);
+        second_pass_result = check_only ? second_pass_check(am_file, first_pass_result, err_callback, job->arena)
+                                        : second_pass(am_file, first_pass_result, err_callback, job->arena);
+        stats_timer_stop(&timer, STATS_STAGE_SECOND_PASS);
+        trace_end();
+        memory_stats_set_stage(MEMORY_STAGE_OTHER);
+        if (second_pass_result.encountered_error)
         {
-
-            if (first_pass_result.alloc_fail)
+            if (second_pass_result.alloc_fail)
             {
-                free_first_pass_result(first_pass_result);
-                fclose(macro_expand_out);
+                fclose(am_file);
                 free(filename);
                 exit_due_to_alloc_failure();
             }
-            else
+            outcome = ASSEMBLY_SECOND_PASS_FAILED;
+        }
+        else if (check_only)
+        {
+            outcome = ASSEMBLY_SUCCEEDED;
+        }
+        else
+        {
+            /* now there were no errors and we're in position to create the .ob, .ent and .ext files */
+            job->has_result = TRUE;
+            job->second_pass_result = second_pass_result;
+            outcome = ASSEMBLY_SUCCEEDED;
+        }
+    }
+    return outcome;
+}
+
+/* Assemble a single file and hand its artifacts to the writer.
+   filename_base is the base of the filename (e.g. it would be "example" for "example.as").
+   When the writer writes into a container, the .am file is a temporary file which the writer copies into the container.
+   If cache is not NULL, the result is looked up in it first and stored into it after assembling.
+   If state is not NULL, the file is assembled incrementally out of its previous state (see incremental.h), and the state is updated.
+   If stats is not NULL, the time each stage takes and the amount of lines, bytes, words and symbols are added to it.
+   If check_only is TRUE (see --check), the file is only validated: the expanded macros go into a temporary file, no images are built
+   and nothing goes to the writer. It is assumed that there is no cache nor state in this case.
+   Exits the program upon an allocation failure. */
+void assemble_file(char *filename_base, ArtifactWriter *writer, Cache *cache, IncrementalState *state, FileStats *stats, bool check_only)
+{
+    char *filename; /* actual filename with an extension */
+    FILE *input_file,
+        *macro_expand_out; /* .as file, .am file */
+    MacroExpansionResult macro_expansion_result;
+    IncrementalOutcome incremental_outcome = INCREMENTAL_HAS_ERRORS;
+    ErrorCallback err_callback;
+    ErrorReport error_report;
+    bool use_container = writer->container != NULL;
+    WriteJob job;
+    AssemblyOutcome outcome;
+    char *source = NULL; /* the contents of the .as file, only read when caching */
+    uint32 source_len = 0;
+    char key[CACHE_KEY_LENGTH + 1];
+    Container *cached_entry;
+    StatsTimer timer;
+
+    /* allocate enough memory for filename - +1 for null termination */
+    filename = malloc(strlen(filename_base) + MAX_FILE_EXTENSION_LENGTH + 1);
+    if (filename == NULL)
+    {
+        exit_due_to_alloc_failure();
+    }
+
+    /* initialize our print error callback */
+    error_report.filename = filename;
+    error_report.transcript = NULL;
+    error_report.transcript_failed = FALSE;
+    err_callback.callback = error_callback;
+    err_callback.should_stop = error_should_stop;
+    err_callback.data = &error_report;
+
+    /* open the .as file for reading */
+    sprintf(filename, "%s.as", filename_base);
+    if ((input_file = fopen(filename, "r")) == NULL)
+    {
+        printf("error: could not open file %s for reading\n", filename);
+        free(filename);
+        return;
+    }
+
+    if (cache != NULL)
+    {
+        if ((source = read_whole_stream(input_file, &source_len)) == NULL)
+        {
+            printf("error: could not read file %s\n", filename);
+            fclose(input_file);
+            free(filename);
+            return;
+        }
+        cache_key(source, source_len, key);
+        if ((cached_entry = cache_lookup(cache, key, source, source_len)) != NULL)
+        {
+            if (assemble_from_cache(filename_base, filename, writer, cached_entry, stats))
             {
-                /* run the second pass to obtain more errors */
-                fseek(macro_expand_out, 0, SEEK_SET);
-                second_pass_result = second_pass(macro_expand_out, first_pass_result, err_callback);
-                free_second_pass_result(second_pass_result);
-                fclose(macro_expand_out);
-                if (second_pass_result.alloc_fail)
+                if (stats != NULL)
                 {
-                    free(filename);
-                    exit_due_to_alloc_failure();
+                    stats->cache_hits++;
                 }
+                free(source);
+                fclose(input_file);
+                free(filename);
+                return;
             }
-
-            printf("%s: first pass failed; moving to next file\n", filename);
+            /* the entry could not be read, assemble the file as if it was a miss */
+            cache_entry_free(cached_entry);
+        }
+        if ((error_report.transcript = char_vec_create()) == NULL)
+        {
+            free(source);
+            fclose(input_file);
             free(filename);
-            continue;
+            exit_due_to_alloc_failure();
         }
+        fseek(input_file, 0, SEEK_SET);
+    }
 
-        /* read the .am file from the start and run second_pass on it  */
-        fseek(macro_expand_out, 0, SEEK_SET);
-        second_pass_result = second_pass(macro_expand_out, first_pass_result, err_callback);
-        if (second_pass_result.encountered_error)
+    /* open the .am file for reading & writing */
+    filename[0] = 0;
+    sprintf(filename, "%s.am", filename_base);
+    if ((macro_expand_out = (use_container || check_only ? tmpfile() : fopen(filename, "w+"))) == NULL)
+    {
+        printf("error: could not open file %s for write & read\n", filename);
+        fclose(input_file);
+        free(filename);
+        free(source);
+        if (error_report.transcript != NULL)
+        {
+            char_vec_free(error_report.transcript);
+        }
+        return;
+    }
+    printf("assembling %s\n", filename_base);
+    diagnostics_start_file(&diagnostics_sink);
+    /* everything the file needs is allocated in its arena, which goes to the writer along with the result */
+    job.arena = writer_acquire_arena(writer);
+    /* expand macros */
+    memory_stats_set_stage(MEMORY_STAGE_EXPAND_MACROS);
+    trace_begin(TRACE_CATEGORY_STAGE, stats_stage_name(STATS_STAGE_EXPAND_MACROS), filename_base);
+    stats_timer_start(&timer, stats);
+    macro_expansion_result = expand_macros(input_file, macro_expand_out, err_callback, job.arena);
+    stats_timer_stop(&timer, STATS_STAGE_EXPAND_MACROS);
+    trace_end();
+    memory_stats_set_stage(MEMORY_STAGE_OTHER);
+    if (stats != NULL)
+    {
+        /* expand_macros reads the whole input file */
+        stats->assemblies++;
+        stats->lines += macro_expansion_result.line_count;
+        stats->bytes += ftell(input_file);
+    }
+    if (macro_expansion_result.encountered_error)
+    {
+        /* we have errors in the expand macro stage, delete the .am file */
+        fclose(macro_expand_out);
+        if (!use_container && !check_only)
         {
-            free_second_pass_result(second_pass_result);
-            fclose(macro_expand_out);
+            remove(filename);
+        }
 
-            if (second_pass_result.alloc_fail)
-            {
-                free(filename);
-                exit_due_to_alloc_failure();
-            }
-            printf("%s: second pass failed; moving to next file\n", filename);
+        if (macro_expansion_result.alloc_fail)
+        {
             free(filename);
-            continue;
+            exit_due_to_alloc_failure();
+        }
+        flush_file_errors(filename, &error_report);
+        printf("%s: macro expansion failed; moving to next file\n", filename);
+        /* a file which was cut short by --max-errors is not cached, as its errors are not all there */
+        if (cache != NULL && !error_report.transcript_failed && !diagnostics_limit_reached(&diagnostics_sink))
+        {
+            cache_store(cache, key, source, source_len, ASSEMBLY_MACRO_EXPANSION_FAILED, error_report.transcript, NULL, NULL);
+        }
+        if (error_report.transcript != NULL)
+        {
+            char_vec_free(error_report.transcript);
         }
+        writer_release_arena(writer, job.arena);
+        free(source);
+        fclose(input_file);
+        free(filename);
+        return;
+    }
+    /* we no longer need the input file, nor the macros */
+    fclose(input_file);
+    arena_reset(job.arena);
+
+    /* from this point on the .am file is kept even if one of the passes fails, so it goes to the writer along with the result (if there is one) */
+    job.filename_base = filename_base;
+    job.am_file = NULL;
+    job.has_result = FALSE;
+    job.cached_entry = NULL;
+    job.stats = stats;
+
+    /* read the .am file from the start and assemble it incrementally if we have its previous state. If it has errors, the passes report them */
+    fseek(macro_expand_out, 0, SEEK_SET);
+    if (state != NULL)
+    {
+        memory_stats_set_stage(MEMORY_STAGE_INCREMENTAL);
+        trace_begin(TRACE_CATEGORY_STAGE, stats_stage_name(STATS_STAGE_INCREMENTAL), filename_base);
+        stats_timer_start(&timer, stats);
+        incremental_outcome = incremental_assemble(state, macro_expand_out, job.arena, &job.second_pass_result);
+        stats_timer_stop(&timer, STATS_STAGE_INCREMENTAL);
+        trace_end();
+        memory_stats_set_stage(MEMORY_STAGE_OTHER);
+    }
+    if (incremental_outcome == INCREMENTAL_ALLOC_FAIL)
+    {
         fclose(macro_expand_out);
+        free(filename);
+        exit_due_to_alloc_failure();
+    }
+    if (state != NULL && incremental_outcome == INCREMENTAL_ASSEMBLED)
+    {
+        job.has_result = TRUE;
+        outcome = ASSEMBLY_SUCCEEDED;
+    }
+    else
+    {
+        fseek(macro_expand_out, 0, SEEK_SET);
+        outcome = run_passes(macro_expand_out, err_callback, filename, &job, check_only);
+    }
+    flush_file_errors(filename, &error_report);
+    print_failure(outcome, filename);
+    if (stats != NULL && job.has_result)
+    {
+        stats->words += job.second_pass_result.instruction_image->len + job.second_pass_result.data_image->len;
+        stats->symbols += job.second_pass_result.symbol_table.inner->len;
+    }
 
-        /* now there were no errors and we're in position to create the files!
-           we first create the object file (if necessary) */
-        if (second_pass_result.instruction_image->len > 0 || second_pass_result.data_image->len > 0)
+    if (cache != NULL)
+    {
+        if (!error_report.transcript_failed && !diagnostics_limit_reached(&diagnostics_sink))
         {
-            filename[0] = 0;
-            sprintf(filename, "%s.ob", filename_base);
-            if ((ob_file = fopen(filename, "w")) == NULL)
-            {
-                printf("error: could not open file %s for writing\n", filename);
-            }
-            else
-            {
-                /* first line of the object file is the length of the instruction image and data image*/
-                fprintf(ob_file, "%7d %d\n", second_pass_result.instruction_image->len, second_pass_result.data_image->len);
-                /* write the instruction image */
-                for (IC = INSTRUCTION_MEMORY_START; IC < second_pass_result.instruction_image->len + INSTRUCTION_MEMORY_START; ++IC)
-                {
-                    word = u32_vec_get(second_pass_result.instruction_image, IC - INSTRUCTION_MEMORY_START);
-                    fprintf(ob_file, "%07d %06x\n", IC, TO_24_BITS(word));
-                }
-                /* write the data imgage */
-                for (DC = IC; DC < IC + second_pass_result.data_image->len; ++DC)
-                {
-                    word = u32_vec_get(second_pass_result.data_image, DC - IC);
-                    fprintf(ob_file, "%07d %06x\n", DC, TO_24_BITS(word));
-                }
-                fclose(ob_file);
-            }
+            cache_store(cache, key, source, source_len, outcome, error_report.transcript, macro_expand_out,
+                        job.has_result ? &job.second_pass_result : NULL);
         }
+        char_vec_free(error_report.transcript);
+        free(source);
+    }
 
-        /* create .ent file if necessary*/
-        if (second_pass_result.entry_symbols->len > 0)
+    if (use_container && !check_only)
+    {
+        fseek(macro_expand_out, 0, SEEK_SET);
+        job.am_file = macro_expand_out;
+    }
+    else
+    {
+        fclose(macro_expand_out);
+    }
+    if (job.am_file != NULL || job.has_result)
+    {
+        writer_submit(writer, job);
+    }
+    else
+    {
+        writer_release_arena(writer, job.arena);
+    }
+    free(filename);
+
+    if (outcome == ASSEMBLY_SUCCEEDED)
+    {
+        printf("assembled %s successfully\n", filename_base);
+    }
+}
+
+/* Build the path a file's incremental state is saved into (filename_base + INCREMENTAL_STATE_EXTENSION).
+   Exits the program upon an allocation failure. Note: you're responsible for freeing the path. */
+char *incremental_state_path(char *filename_base)
+{
+    /* +1 for null termination */
+    char *state_path = malloc(strlen(filename_base) + strlen(INCREMENTAL_STATE_EXTENSION) + 1);
+    if (state_path == NULL)
+    {
+        exit_due_to_alloc_failure();
+    }
+    sprintf(state_path, "%s%s", filename_base, INCREMENTAL_STATE_EXTENSION);
+    return state_path;
+}
+
+/* Create an incremental state for each file. With --incremental, the state of each file's previous assembly is loaded from its saved state.
+   Exits the program upon an allocation failure. */
+IncrementalState *create_incremental_states(Options *options)
+{
+    IncrementalState *states = malloc(options->file_count * sizeof(IncrementalState));
+    char *state_path;
+    int i;
+    if (states == NULL)
+    {
+        exit_due_to_alloc_failure();
+    }
+    for (i = 0; i < options->file_count; ++i)
+    {
+        if (!incremental_state_init(&states[i]))
         {
-            filename[0] = 0;
-            sprintf(filename, "%s.ent", filename_base);
-            if (!symbol_vec_write_to_file(filename, second_pass_result.entry_symbols))
-            {
-                printf("error: could not open file %s for writing\n", filename);
-            }
+            exit_due_to_alloc_failure();
+        }
+        if (options->incremental)
+        {
+            state_path = incremental_state_path(options->files[i]);
+            incremental_state_load(&states[i], state_path);
+            free(state_path);
+        }
+    }
+    return states;
+}
+
+/* Assemble the i-th file of the options (see assemble_file). If states is not NULL, the file is assembled incrementally out of its state,
+   and with --incremental the updated state is saved (a file which did not assemble successfully has no state).
+   If stats is not NULL, the statistics of the assembly are added to the file's statistics. Exits the program upon an allocation failure. */
+void assemble_nth_file(Options *options, int i, ArtifactWriter *writer, Cache *cache, IncrementalState *states, RunStats *stats)
+{
+    char *state_path;
+    trace_begin(TRACE_CATEGORY_FILE, options->files[i], NULL);
+    assemble_file(options->files[i], writer, cache, states == NULL ? NULL : &states[i], stats == NULL ? NULL : &stats->files[i], options->check);
+    if (options->incremental)
+    {
+        state_path = incremental_state_path(options->files[i]);
+        if (!incremental_state_save(&states[i], state_path))
+        {
+            printf("error: could not save the incremental state of %s into %s\n", options->files[i], state_path);
         }
-        /* create .ext file if necessary */
-        if (second_pass_result.external_symbols->len > 0)
+        free(state_path);
+    }
+    trace_end();
+}
+
+/* Set when the assembler is asked to stop watching (see watch_files) */
+volatile sig_atomic_t stop_watching = 0;
+/* The watcher to interrupt when the assembler is asked to stop watching, NULL if nothing is watched */
+Watcher *active_watcher = NULL;
+
+/* Signal handler which asks the assembler to stop watching */
+void request_stop_watching(int signal_number)
+{
+    int saved_errno = errno;
+    (void)signal_number;
+    stop_watching = 1;
+    /* the flag alone isn't enough: the signal may arrive right before the watcher starts waiting (or in another thread) */
+    if (active_watcher != NULL)
+    {
+        watcher_interrupt(active_watcher);
+    }
+    errno = saved_errno;
+}
+
+/* Start watching the files, before they are first assembled so that a change made while they are assembled isn't missed,
+   and stop watching on Ctrl+C (or a termination request). Returns TRUE on success, FALSE if the files could not be watched. */
+bool start_watching(Options *options, Watcher *watcher)
+{
+    struct sigaction action;
+
+    if (!watcher_init(watcher, options->files, options->file_count))
+    {
+        return FALSE;
+    }
+    active_watcher = watcher;
+    /* stopping through the handler (rather than being killed) makes sure everything is written and closed properly */
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = request_stop_watching;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    return TRUE;
+}
+
+/* Keep reassembling each file which changes (reusing the incremental states) until the assembler is interrupted, and then stop watching.
+   The watcher should be started with start_watching. If stats is not NULL, the statistics of each reassembly are added to them.
+   Returns TRUE if watching stopped because of an interruption, FALSE if waiting for changes failed. */
+bool watch_files(Options *options, Watcher *watcher, ArtifactWriter *writer, Cache *cache, IncrementalState *states, RunStats *stats)
+{
+    bool *changed;
+    int i;
+
+    if ((changed = malloc(options->file_count * sizeof(bool))) == NULL)
+    {
+        exit_due_to_alloc_failure();
+    }
+    printf("watching %d files for changes; press Ctrl+C to stop\n", options->file_count);
+    fflush(stdout);
+    while (!stop_watching && watcher_wait(watcher, changed))
+    {
+        for (i = 0; i < options->file_count; ++i)
         {
-            filename[0] = 0;
-            sprintf(filename, "%s.ext", filename_base);
-            if (!symbol_vec_write_to_file(filename, second_pass_result.external_symbols))
+            if (changed[i])
             {
-                printf("error: could not open file %s for writing\n", filename);
+                assemble_nth_file(options, i, writer, cache, states, stats);
             }
         }
+        /* whoever watches the output (e.g. an editor) should see it right away */
+        fflush(stdout);
+    }
+    active_watcher = NULL;
+    watcher_free(watcher);
+    free(changed);
+    return stop_watching;
+}
 
-        free_second_pass_result(second_pass_result);
-        free(filename);
+/* Print statistics of the result cache */
+void print_cache_stats(char *title, CacheStats *stats)
+{
+    printf("cache %s: %lu hits, %lu misses, %lu stores, %lu evictions, %lu bytes\n", title, stats->hits, stats->misses, stats->stores,
+           stats->evictions, stats->size);
+}
 
-        printf("assembled %s successfully\n", filename_base);
+/* Write the report of the memory accounting as JSON into a file. Returns TRUE if successful, FALSE otherwise */
+bool write_memory_stats_json(char *path)
+{
+    FILE *out = fopen(path, "w");
+    bool success;
+    if (out == NULL)
+    {
+        return FALSE;
+    }
+    memory_stats_write_json(out);
+    success = !ferror(out);
+    return fclose(out) == 0 && success;
+}
+
+/* Write the timing statistics of the run as JSON into a file. Returns TRUE if successful, FALSE otherwise */
+bool write_stats_json(RunStats *stats, char *path)
+{
+    FILE *out = fopen(path, "w");
+    bool success;
+    if (out == NULL)
+    {
+        return FALSE;
+    }
+    stats_write_json(stats, out);
+    success = !ferror(out);
+    return fclose(out) == 0 && success;
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+    Container container;
+    Container *output_container = NULL; /* the container we write into, or NULL if we write each artifact into its own file */
+    ArtifactWriter writer;
+    Cache cache;
+    Cache *result_cache = NULL; /* the cache of assembly results, or NULL if results are not cached */
+    CacheStats run_stats, total_stats;
+    IncrementalState *states = NULL; /* the incremental state of each file, or NULL if files are not assembled incrementally */
+    RunStats run_timing;
+    RunStats *timing_stats = NULL; /* the timing statistics of the run, or NULL if they are not measured */
+    Watcher watcher; /* watches the files for changes if --watch is given */
+    bool success;
+    int i;
+
+    if (!parse_options(argc, argv, &options))
+    {
+        printf("usage: assembler [--container out" CONTAINER_EXTENSION "] [--async-write] [--cache dir] [--cache-size MiB] [--cache-stats] [--incremental] [--watch]"
+               " [--memory-stats] [--memory-stats-json out.json] [--stats] [--stats-json out.json] [--trace out.json]"
+               " [--max-errors N] [--diagnostics=text|jsonl] [--check] [file1] [file2] [file3] ...\n");
+        printf("Note: files should be without extension, i.e. you should enter \"file\" instead of \"file.as\"\n"
+               "--container: write the artifacts of all the files into a single container file instead of a file per artifact\n"
+               "--async-write: write the artifacts on a background thread while the next file is being assembled\n");
+        printf("--cache: reuse the results of files which have already been assembled, stored in a cache directory\n"
+               "--cache-size: the maximum size of the cache in MiB (default: 256)\n"
+               "--cache-stats: print the hit/miss statistics of the cache at the end of the run\n"
+               "--incremental: keep the state of each assembled file (in file" INCREMENTAL_STATE_EXTENSION ") and only reassemble the lines which changed\n"
+               "--watch: after assembling the files, keep reassembling each file whenever it changes until interrupted (can't be used with --container)\n");
+        printf("--memory-stats: print the memory each stage of the assembler allocated at the end of the run\n"
+               "--memory-stats-json: write the memory each stage of the assembler allocated into a JSON file at the end of the run\n");
+        printf("--stats: print the time each stage took (per file and in total) and the throughput at the end of the run\n"
+               "--stats-json: write the time each stage took and the throughput into a JSON file at the end of the run\n"
+               "--trace: write a timeline of each file and each stage (per thread) into a JSON file in the Chrome trace event format,"
+               " which can be opened in Perfetto\n");
+        printf("--max-errors: report at most N errors for each file, and stop reading a file once it has that many\n"
+               "--diagnostics=jsonl: write the errors into stderr as JSON Lines (an object per error, without colors) instead of"
+               " into stdout as text (can't be used with --cache)\n"
+               "--check: only check that the files assemble, reporting the same errors, without writing any file"
+               " (can't be used with --container, --cache, --incremental or --watch)\n");
+        return BAD_USAGE_EXIT_CODE;
+    }
+    /* the accounting is enabled before anything is allocated, so that everything which is released was accounted */
+    if ((options.memory_stats || options.memory_stats_json != NULL) && !memory_stats_enable())
+    {
+        printf("error: could not enable memory accounting\n");
+        return MEMORY_STATS_ERROR_EXIT_CODE;
+    }
+    if (!diagnostics_init(&diagnostics_sink, options.diagnostics_format == DIAGNOSTICS_FORMAT_JSONL ? stderr : stdout,
+                          options.diagnostics_format, options.max_errors))
+    {
+        exit_due_to_alloc_failure();
+    }
+    if (options.stats || options.stats_json != NULL)
+    {
+        if (!stats_init(&run_timing, options.files, options.file_count))
+        {
+            exit_due_to_alloc_failure();
+        }
+        timing_stats = &run_timing;
+    }
+    /* tracing is enabled before the background writer is started */
+    if (options.trace_path != NULL)
+    {
+        if (!trace_enable())
+        {
+            printf("error: could not enable tracing\n");
+            return TRACE_ERROR_EXIT_CODE;
+        }
+        trace_set_thread_name("main");
+    }
+    if (options.cache_dir != NULL)
+    {
+        if (!cache_init(&cache, options.cache_dir, options.cache_size))
+        {
+            printf("error: could not use cache directory %s\n", options.cache_dir);
+            return CACHE_ERROR_EXIT_CODE;
+        }
+        result_cache = &cache;
+    }
+    if (options.container_path != NULL)
+    {
+        if (!container_create(&container, options.container_path))
+        {
+            printf("error: could not create container %s\n", options.container_path);
+            return CONTAINER_ERROR_EXIT_CODE;
+        }
+        output_container = &container;
+    }
+    if (!writer_init(&writer, output_container, options.container_path, options.async_write))
+    {
+        printf("error: could not start the background writer\n");
+        return WRITER_ERROR_EXIT_CODE;
+    }
+
+    if (options.incremental || options.watch)
+    {
+        states = create_incremental_states(&options);
+    }
+    if (options.watch && !start_watching(&options, &watcher))
+    {
+        printf("error: could not watch the files for changes\n");
+        writer_close(&writer);
+        return WATCH_ERROR_EXIT_CODE;
+    }
+    for (i = 0; i < options.file_count; ++i)
+    {
+        assemble_nth_file(&options, i, &writer, result_cache, states, timing_stats);
+    }
+    if (options.watch && !watch_files(&options, &watcher, &writer, result_cache, states, timing_stats))
+    {
+        printf("error: could not watch the files for changes\n");
+        writer_close(&writer);
+        return WATCH_ERROR_EXIT_CODE;
+    }
+    diagnostics_free(&diagnostics_sink);
+
+    /* wait for all of the artifacts to be written */
+    writer_close(&writer);
+    if (options.trace_path != NULL)
+    {
+        success = trace_write(options.trace_path);
+        trace_free();
+        if (!success)
+        {
+            printf("error: could not write the trace into %s\n", options.trace_path);
+            return TRACE_ERROR_EXIT_CODE;
+        }
+    }
+    if (timing_stats != NULL)
+    {
+        stats_finish(timing_stats);
+    }
+    if (output_container != NULL && !container_close(output_container))
+    {
+        printf("error: could not write container %s (it has no index)\n", options.container_path);
+        return CONTAINER_ERROR_EXIT_CODE;
+    }
+    if (result_cache != NULL)
+    {
+        cache_close(result_cache, &run_stats, &total_stats);
+        if (options.cache_stats)
+        {
+            print_cache_stats("run", &run_stats);
+            print_cache_stats("total", &total_stats);
+        }
+    }
+    for (i = 0; states != NULL && i < options.file_count; ++i)
+    {
+        incremental_state_free(&states[i]);
+    }
+    free(states);
+    if (timing_stats != NULL)
+    {
+        if (options.stats)
+        {
+            stats_print(timing_stats, stdout);
+        }
+        if (options.stats_json != NULL && !write_stats_json(timing_stats, options.stats_json))
+        {
+            printf("error: could not write the statistics into %s\n", options.stats_json);
+            return STATS_ERROR_EXIT_CODE;
+        }
+        stats_free(timing_stats);
+    }
+    if (options.memory_stats)
+    {
+        memory_stats_print(stdout);
+    }
+    if (options.memory_stats_json != NULL && !write_memory_stats_json(options.memory_stats_json))
+    {
+        printf("error: could not write the memory statistics into %s\n", options.memory_stats_json);
+        return MEMORY_STATS_ERROR_EXIT_CODE;
     }
     printf("assembler done; exiting\n");
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,204 @@
+#include <pthread.h>
+#include "memstats.h"
+
+/* The counters of a stage or of a site */
+typedef struct
+{
+    /* the amount of allocations */
+    unsigned long allocations;
+    /* the amount of reallocations */
+    unsigned long reallocations;
+    /* the amount of bytes allocated (reallocations count the bytes they grew by) */
+    unsigned long bytes_allocated;
+    /* of a site: the amount of bytes live. Of a stage: the amount of bytes live (of all sites) when the stage was last done */
+    unsigned long live;
+    /* of a site: the peak of its live bytes. Of a stage: the peak of the live bytes (of all sites) while the stage was running */
+    unsigned long peak;
+    /* of a stage: the peak of the bytes reserved by arenas while the stage was running. Unused for a site */
+    unsigned long reserved_peak;
+} MemoryCounters;
+
+/* The names of the stages and of the sites in the reports */
+const char *memory_stage_names[MEMORY_STAGE_COUNT] = {"other", "expand_macros", "first_pass", "second_pass", "incremental", "output"};
+const char *memory_site_names[MEMORY_SITE_COUNT] = {"arena_block", "object", "strdup", "vector_growth", "image_growth"};
+
+/* The value of each stage, which the thread specific stage points to */
+const MemoryStage memory_stage_values[MEMORY_STAGE_COUNT] = {MEMORY_STAGE_OTHER, MEMORY_STAGE_EXPAND_MACROS, MEMORY_STAGE_FIRST_PASS,
+                                                             MEMORY_STAGE_SECOND_PASS, MEMORY_STAGE_INCREMENTAL, MEMORY_STAGE_OUTPUT};
+
+/* Whether or not the accounting is enabled. Only set before other threads are started, so it is read without the lock */
+bool memory_stats_enabled = FALSE;
+
+/* The stage of each thread (a pointer into memory_stage_values, or NULL for MEMORY_STAGE_OTHER) */
+pthread_key_t memory_stats_stage_key;
+
+/* protects all of the counters below */
+pthread_mutex_t memory_stats_lock = PTHREAD_MUTEX_INITIALIZER;
+MemoryCounters memory_stage_counters[MEMORY_STAGE_COUNT];
+MemoryCounters memory_site_counters[MEMORY_SITE_COUNT];
+/* the bytes live out of all the sites except for MEMORY_SITE_ARENA_BLOCK, and their peak */
+unsigned long memory_live_bytes = 0;
+unsigned long memory_peak_bytes = 0;
+
+bool memory_stats_enable()
+{
+    if (pthread_key_create(&memory_stats_stage_key, NULL) != 0)
+    {
+        return FALSE;
+    }
+    memory_stats_enabled = TRUE;
+    return TRUE;
+}
+
+/* Get the stage of the calling thread */
+MemoryStage memory_stats_current_stage()
+{
+    const MemoryStage *stage = pthread_getspecific(memory_stats_stage_key);
+    return stage == NULL ? MEMORY_STAGE_OTHER : *stage;
+}
+
+/* Raise the peaks of a stage to the current amount of bytes. Must be called with the lock held */
+void memory_stats_update_stage_peaks(MemoryCounters *stage)
+{
+    if (memory_live_bytes > stage->peak)
+    {
+        stage->peak = memory_live_bytes;
+    }
+    if (memory_site_counters[MEMORY_SITE_ARENA_BLOCK].live > stage->reserved_peak)
+    {
+        stage->reserved_peak = memory_site_counters[MEMORY_SITE_ARENA_BLOCK].live;
+    }
+}
+
+MemoryStage memory_stats_set_stage(MemoryStage stage)
+{
+    MemoryStage previous;
+    if (!memory_stats_enabled)
+    {
+        return MEMORY_STAGE_OTHER;
+    }
+    previous = memory_stats_current_stage();
+    pthread_mutex_lock(&memory_stats_lock);
+    memory_stage_counters[previous].live = memory_live_bytes;
+    memory_stats_update_stage_peaks(&memory_stage_counters[stage]);
+    pthread_mutex_unlock(&memory_stats_lock);
+    pthread_setspecific(memory_stats_stage_key, &memory_stage_values[stage]);
+    return previous;
+}
+
+void memory_stats_alloc(MemorySite site, size_t size)
+{
+    memory_stats_realloc(site, 0, size);
+}
+
+void memory_stats_realloc(MemorySite site, size_t old_size, size_t new_size)
+{
+    MemoryCounters *stage, *counters = &memory_site_counters[site];
+    /* the heap blocks of arenas are only counted by their site, so that the stages do not count the memory arenas hand out twice */
+    bool count_in_stage = site != MEMORY_SITE_ARENA_BLOCK;
+    if (!memory_stats_enabled)
+    {
+        return;
+    }
+    pthread_mutex_lock(&memory_stats_lock);
+    stage = &memory_stage_counters[memory_stats_current_stage()];
+    if (old_size == 0)
+    {
+        counters->allocations++;
+        stage->allocations += count_in_stage;
+    }
+    else
+    {
+        counters->reallocations++;
+        stage->reallocations += count_in_stage;
+    }
+    if (new_size >= old_size)
+    {
+        counters->bytes_allocated += new_size - old_size;
+        counters->live += new_size - old_size;
+        if (count_in_stage)
+        {
+            stage->bytes_allocated += new_size - old_size;
+            memory_live_bytes += new_size - old_size;
+        }
+    }
+    else
+    {
+        counters->live -= old_size - new_size;
+        memory_live_bytes -= count_in_stage ? old_size - new_size : 0;
+    }
+    if (counters->live > counters->peak)
+    {
+        counters->peak = counters->live;
+    }
+    if (memory_live_bytes > memory_peak_bytes)
+    {
+        memory_peak_bytes = memory_live_bytes;
+    }
+    memory_stats_update_stage_peaks(stage);
+    pthread_mutex_unlock(&memory_stats_lock);
+}
+
+void memory_stats_free(MemorySite site, size_t size)
+{
+    if (!memory_stats_enabled || size == 0)
+    {
+        return;
+    }
+    pthread_mutex_lock(&memory_stats_lock);
+    memory_site_counters[site].live -= size;
+    memory_live_bytes -= site != MEMORY_SITE_ARENA_BLOCK ? size : 0;
+    pthread_mutex_unlock(&memory_stats_lock);
+}
+
+void memory_stats_print(FILE *out)
+{
+    int i;
+    MemoryCounters *counters;
+    pthread_mutex_lock(&memory_stats_lock);
+    fprintf(out, "memory total: %lu bytes live, %lu bytes peak; %lu bytes reserved by arenas, %lu bytes peak\n", memory_live_bytes,
+            memory_peak_bytes, memory_site_counters[MEMORY_SITE_ARENA_BLOCK].live, memory_site_counters[MEMORY_SITE_ARENA_BLOCK].peak);
+    for (i = 0; i < MEMORY_STAGE_COUNT; ++i)
+    {
+        counters = &memory_stage_counters[i];
+        fprintf(out, "memory stage %s: %lu allocations, %lu reallocations, %lu bytes allocated, %lu bytes peak, %lu bytes live after, ",
+                memory_stage_names[i], counters->allocations, counters->reallocations, counters->bytes_allocated, counters->peak, counters->live);
+        fprintf(out, "%lu bytes reserved by arenas at peak\n", counters->reserved_peak);
+    }
+    for (i = 0; i < MEMORY_SITE_COUNT; ++i)
+    {
+        counters = &memory_site_counters[i];
+        fprintf(out, "memory site %s: %lu allocations, %lu reallocations, %lu bytes allocated, %lu bytes live, %lu bytes peak\n",
+                memory_site_names[i], counters->allocations, counters->reallocations, counters->bytes_allocated, counters->live, counters->peak);
+    }
+    pthread_mutex_unlock(&memory_stats_lock);
+}
+
+void memory_stats_write_json(FILE *out)
+{
+    int i;
+    MemoryCounters *counters;
+    pthread_mutex_lock(&memory_stats_lock);
+    fprintf(out, "{\n  \"total\": {\"live_bytes\": %lu, \"peak_bytes\": %lu, \"arena_reserved_bytes\": %lu, \"arena_reserved_peak_bytes\": %lu},\n",
+            memory_live_bytes, memory_peak_bytes, memory_site_counters[MEMORY_SITE_ARENA_BLOCK].live,
+            memory_site_counters[MEMORY_SITE_ARENA_BLOCK].peak);
+    fprintf(out, "  \"stages\": {\n");
+    for (i = 0; i < MEMORY_STAGE_COUNT; ++i)
+    {
+        counters = &memory_stage_counters[i];
+        fprintf(out, "    \"%s\": {\"allocations\": %lu, \"reallocations\": %lu, \"bytes_allocated\": %lu, \"peak_bytes\": %lu, ",
+                memory_stage_names[i], counters->allocations, counters->reallocations, counters->bytes_allocated, counters->peak);
+        fprintf(out, "\"live_bytes_after\": %lu, \"arena_reserved_peak_bytes\": %lu}%s\n", counters->live, counters->reserved_peak,
+                i + 1 < MEMORY_STAGE_COUNT ? "," : "");
+    }
+    fprintf(out, "  },\n  \"sites\": {\n");
+    for (i = 0; i < MEMORY_SITE_COUNT; ++i)
+    {
+        counters = &memory_site_counters[i];
+        fprintf(out, "    \"%s\": {\"allocations\": %lu, \"reallocations\": %lu, \"bytes_allocated\": %lu, \"live_bytes\": %lu, \"peak_bytes\": %lu}%s\n",
+                memory_site_names[i], counters->allocations, counters->reallocations, counters->bytes_allocated, counters->live, counters->peak,
+                i + 1 < MEMORY_SITE_COUNT ? "," : "");
+    }
+    fprintf(out, "  }\n}\n");
+    pthread_mutex_unlock(&memory_stats_lock);
+}
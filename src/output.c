@@ -0,0 +1,156 @@
+#include "output.h"
+#include "first_pass.h" /* for INSTRUCTION_MEMORY_START */
+
+/* the size of the chunks we copy streams with */
+#define COPY_CHUNK_SIZE 4096
+
+const char *artifact_extension(ArtifactType type)
+{
+    switch (type)
+    {
+    case ARTIFACT_AM:
+    {
+        return ".am";
+    }
+    case ARTIFACT_OB:
+    {
+        return ".ob";
+    }
+    case ARTIFACT_ENT:
+    {
+        return ".ent";
+    }
+    case ARTIFACT_EXT:
+    {
+        return ".ext";
+    }
+    case ARTIFACT_AS:
+    {
+        return ".as";
+    }
+    case ARTIFACT_LOG:
+    {
+        return ".log";
+    }
+    }
+    return ""; /* should be unreachable */
+}
+
+bool artifact_is_necessary(ArtifactType type, SecondPassResult *second_pass_result)
+{
+    switch (type)
+    {
+    case ARTIFACT_OB:
+    {
+        return second_pass_result->instruction_image->len > 0 || second_pass_result->data_image->len > 0;
+    }
+    case ARTIFACT_ENT:
+    {
+        return second_pass_result->entry_symbols->len > 0;
+    }
+    case ARTIFACT_EXT:
+    {
+        return second_pass_result->external_symbols->len > 0;
+    }
+    default:
+    {
+        return FALSE;
+    }
+    }
+}
+
+long write_artifact(FILE *out, ArtifactType type, SecondPassResult *second_pass_result)
+{
+    switch (type)
+    {
+    case ARTIFACT_OB:
+    {
+        return write_object(out, second_pass_result->instruction_image, second_pass_result->data_image);
+    }
+    case ARTIFACT_ENT:
+    {
+        return write_symbols(out, second_pass_result->entry_symbols, second_pass_result->symbol_table);
+    }
+    case ARTIFACT_EXT:
+    {
+        return write_symbols(out, second_pass_result->external_symbols, second_pass_result->symbol_table);
+    }
+    default:
+    {
+        return -1;
+    }
+    }
+}
+
+long write_object(FILE *out, Image *instruction_image, Image *data_image)
+{
+    uint32 IC, DC, word;
+    long bytes_written = 0;
+    int chars_written;
+
+    /* first line of the object file is the length of the instruction image and data image*/
+    if ((chars_written = fprintf(out, "%7u %u\n", instruction_image->len, data_image->len)) < 0)
+    {
+        return -1;
+    }
+    bytes_written += chars_written;
+    /* write the instruction image */
+    for (IC = INSTRUCTION_MEMORY_START; IC < instruction_image->len + INSTRUCTION_MEMORY_START; ++IC)
+    {
+        word = image_get(instruction_image, IC - INSTRUCTION_MEMORY_START);
+        if ((chars_written = fprintf(out, "%07u %06x\n", IC, word)) < 0)
+        {
+            return -1;
+        }
+        bytes_written += chars_written;
+    }
+    /* write the data imgage */
+    for (DC = IC; DC < IC + data_image->len; ++DC)
+    {
+        word = image_get(data_image, DC - IC);
+        if ((chars_written = fprintf(out, "%07u %06x\n", DC, word)) < 0)
+        {
+            return -1;
+        }
+        bytes_written += chars_written;
+    }
+    return bytes_written;
+}
+
+long write_symbols(FILE *out, SymbolReferenceVector *symbols, SymbolTable symbol_table)
+{
+    uint32 i;
+    SymbolReference *reference;
+    long bytes_written = 0;
+    int chars_written;
+    for (i = 0; i < symbols->len; ++i)
+    {
+        reference = symbol_ref_vec_get_ptr(symbols, i);
+        if ((chars_written = fprintf(out, "%s %07u\n", symbol_table_get(symbol_table, reference->symbol_id)->name, reference->addr)) < 0)
+        {
+            return -1;
+        }
+        bytes_written += chars_written;
+    }
+    return bytes_written;
+}
+
+long write_stream_copy(FILE *in, FILE *out)
+{
+    char chunk[COPY_CHUNK_SIZE];
+    size_t chunk_len;
+    long bytes_written = 0;
+    while ((chunk_len = fread(chunk, 1, sizeof(chunk), in)) > 0)
+    {
+        if (fwrite(chunk, 1, chunk_len, out) != chunk_len)
+        {
+            return -1;
+        }
+        bytes_written += chunk_len;
+    }
+    if (ferror(in))
+    {
+        return -1;
+    }
+    return bytes_written;
+}
@@ -1,12 +1,13 @@
-#include <ctype.h>
 #include <string.h>
 #include "parser.h"
+#include "scan.h"
+#include "char_class.h"
 
 /* Trim any characters found after the first space. Returns the string back. */
 char *trim_after_space(char *str)
 {
     char *str_start = str;
-    while (!isspace((unsigned char)*str) && *str != 0)
+    while (!CHAR_IS_SPACE(*str) && *str != 0)
     {
         str++;
     }
@@ -20,87 +21,169 @@ char *trim_after_space(char *str)
 /* maximum digits a 32 bits number has in base 10 */
 #define BITS_32_INT_MAX_DIGITS 10
 
-/* Parse a single 32 bits signed integer from str, assuming it is represented in base 10.
-   Returns the integer in the out parameter integer, along with the amount of characters the integer occupies in the string, chars_read,
-   and whether or not the integer is negative.
-   Returns TRUE if the parse was successful, FALSE otherwise. A parse may fail if there are no digits at all, or if the integer overflows a signed 32 bit integer.
-   In the case of a failure, the out parameter integer will contain garbage and the is_negative parameter will work as expected.
-   In the former case of failure, chars_read will be 0, and in the latter it will be the
-   amount of characters the integer occupies. */
-bool parse_int32_base10(const char *str, int32 *integer, int *chars_read, bool *is_negative)
+/* The biggest digit each position of an integer with BITS_32_INT_MAX_DIGITS digits may have (see parse_int32_base10) */
+#define BITS_32_INT_MAX_DIGITS_STR "2147483648"
+
+/* The digits of an integer are handled a word at a time: 8 of them in an unsigned long where it is 64 bits wide, and 4 otherwise.
+   The characters of a word are loaded with the first one in the lowest byte (regardless of the endianness of the machine) */
+#if ULONG_MAX > 0xFFFFFFFFUL
+#define DIGITS_PER_WORD 8
+#define DIGITS_LOAD(chars) ((unsigned long)(uint8)(chars)[0] | ((unsigned long)(uint8)(chars)[1] << 8) |               \
+                            ((unsigned long)(uint8)(chars)[2] << 16) | ((unsigned long)(uint8)(chars)[3] << 24) |      \
+                            ((unsigned long)(uint8)(chars)[4] << 32) | ((unsigned long)(uint8)(chars)[5] << 40) |      \
+                            ((unsigned long)(uint8)(chars)[6] << 48) | ((unsigned long)(uint8)(chars)[7] << 56))
+/* Merge the digit values in the bytes of a word into the value of the number they make, the first digit being the most significant
+   one: the neighbouring digits are merged into pairs, then the pairs into quadruples and so on */
+#define DIGITS_MERGE(word)                                                          \
+    (word) = ((word) * 10 + ((word) >> 8)) & 0x00FF00FF00FF00FFUL;                  \
+    (word) = ((word) * 100 + ((word) >> 16)) & 0x0000FFFF0000FFFFUL;                \
+    (word) = ((word) * 10000 + ((word) >> 32)) & 0xFFFFFFFFUL
+#else
+#define DIGITS_PER_WORD 4
+#define DIGITS_LOAD(chars) ((unsigned long)(uint8)(chars)[0] | ((unsigned long)(uint8)(chars)[1] << 8) | \
+                            ((unsigned long)(uint8)(chars)[2] << 16) | ((unsigned long)(uint8)(chars)[3] << 24))
+#define DIGITS_MERGE(word)                                         \
+    (word) = ((word) * 10 + ((word) >> 8)) & 0x00FF00FFUL;         \
+    (word) = ((word) * 100 + ((word) >> 16)) & 0xFFFFUL
+#endif
+
+/* A word with every byte set to b */
+#define DIGITS_REPEAT(b) (~0UL / 0xFF * (b))
+
+/* The powers of 10 up to 10^DIGITS_PER_WORD */
+const uint32 powers_of_10[] = {1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000};
+
+/* Returns the amount of characters a word starts with which are digits, given the word's mask of the characters which are not
+   (the high bit of each such character's byte) */
+uint32 digits_leading(unsigned long not_digits)
 {
-    uint32 digit_count = 0;
-    int bits_32_max_int_digits[] = {2, 1, 4, 7, 4, 8, 3, 6, 4, 7};
-    int i;
-    int last_digit;
-    *integer = 0;
-    *chars_read = 0;
-    *is_negative = FALSE;
-    if (*str == '-')
+    if (not_digits == 0)
     {
-        *is_negative = TRUE;
-        str++;
-        *chars_read += 1;
+        return DIGITS_PER_WORD;
     }
-
-    while (*str >= '0' && *str <= '9' && *str != 0)
+#ifdef __GNUC__
+    return __builtin_ctzl(not_digits) / 8;
+#else
     {
-        *integer *= 10;
-        *integer += CHAR_DIGIT_TO_INT(*str);
-        digit_count++;
-        str++;
+        uint32 count = 0;
+        while ((not_digits & 0x80) == 0)
+        {
+            not_digits >>= 8;
+            count++;
+        }
+        return count;
     }
-    *chars_read += digit_count;
+#endif
+}
 
-    if (digit_count > BITS_32_INT_MAX_DIGITS)
+/* Returns TRUE if no digit of the BITS_32_INT_MAX_DIGITS digits at digits is bigger than the digit at the same position
+   of BITS_32_INT_MAX_DIGITS_STR. Each byte of a limit with its high bit set stays at 0x80 or above after a digit is subtracted from it
+   exactly when the digit is not bigger than the limit (and it never borrows from the next byte), so a word of positions is compared at once
+   and all of them are tested together. The last word overlaps the ones before it. */
+bool digits_within_max_digits(const char *digits)
+{
+    const char *max_digits = BITS_32_INT_MAX_DIGITS_STR;
+    unsigned long within = DIGITS_REPEAT(0x80);
+    uint32 i;
+    for (i = 0; i + DIGITS_PER_WORD < BITS_32_INT_MAX_DIGITS; i += DIGITS_PER_WORD)
     {
-        return FALSE;
+        within &= (DIGITS_LOAD(max_digits + i) | DIGITS_REPEAT(0x80)) - DIGITS_LOAD(digits + i);
     }
-    else if (digit_count == 0)
+    i = BITS_32_INT_MAX_DIGITS - DIGITS_PER_WORD;
+    within &= (DIGITS_LOAD(max_digits + i) | DIGITS_REPEAT(0x80)) - DIGITS_LOAD(digits + i);
+    return (within & DIGITS_REPEAT(0x80)) == DIGITS_REPEAT(0x80);
+}
+
+/* Parse a single 32 bits signed integer from str like parse_int32_base10 does, where str is a part of the line [line, line_end)
+   (line and line_end may both be NULL if the line is not known).
+   Within a line the characters are handled a word at a time (SIMD within a register, see DIGITS_PER_WORD): the digits a word starts with
+   are found with a single test, and all of them are converted at once (see DIGITS_MERGE). A word which would go past the end of the line
+   is loaded so that it ends at the end of the line instead, and is shifted back into place.
+   The value wraps around like a 32 bit int would, so that an integer which overflows gets the same garbage it always got.
+   An integer of BITS_32_INT_MAX_DIGITS digits overflows if any of its digits is bigger than the one at the same position of
+   BITS_32_INT_MAX_DIGITS_STR (e.g. 2147483648 does not, and becomes -2147483648, while 1999999999 does), which is tested at once. */
+bool parse_int32_base10_in_line(const char *str, const char *line, const char *line_end, int32 *integer, int *chars_read, bool *is_negative)
+{
+    const char *digits = str, *chars;
+    uint32 digit_count = 0, value = 0, word_digits = DIGITS_PER_WORD;
+    unsigned long word, not_digits;
+    bool is_valid;
+    *is_negative = FALSE;
+    if (*digits == '-')
     {
-        *chars_read = 0;
-        return FALSE;
+        *is_negative = TRUE;
+        digits++;
     }
-    else if (digit_count == BITS_32_INT_MAX_DIGITS)
+
+    while (word_digits == DIGITS_PER_WORD && line != NULL && digits + digit_count < line_end && line_end - line >= DIGITS_PER_WORD)
     {
-        /* we need to check that the number does not go over the limit */
-        str--; /* to get back to the integer */
-        last_digit = CHAR_DIGIT_TO_INT(*str);
-        str--; /* skip last digit */
-        /* -2 to skip the last digit */
-        for (i = BITS_32_INT_MAX_DIGITS - 2; i >= 0; --i)
+        chars = digits + digit_count;
+        if (line_end - chars >= DIGITS_PER_WORD)
         {
-            if (CHAR_DIGIT_TO_INT(*str) > bits_32_max_int_digits[i])
-            {
-                return FALSE;
-            }
-            str--;
+            word = DIGITS_LOAD(chars);
         }
-        /* check the last digit - negative numbers allow for 1 more in the last digit
-           we don't need to ensure the last digit is less than 9. To see this, we note that numbers of the form 2^n never end in 0,
-           and thus numbers of the form (2^n) -1 never end in 9. Since numbers which represent the maximum limit of a signed integer are always
-           of the latter form, the last digit is always less than  9. */
-        if (is_negative)
+        else
         {
-            if (last_digit > (bits_32_max_int_digits[BITS_32_INT_MAX_DIGITS - 1] + 1))
-            {
-                return FALSE;
-            }
+            /* the bytes past the end of the line become 0, which is not a digit */
+            word = DIGITS_LOAD(line_end - DIGITS_PER_WORD) >> ((DIGITS_PER_WORD - (line_end - chars)) * 8);
         }
-        else
+        /* a character is a digit if subtracting '0' does not take it below 0 and adding 0x46 does not take it to 0x80 or above.
+           A character which is not a digit may borrow from the ones after it, but never from the digits before it */
+        not_digits = ((word - DIGITS_REPEAT('0')) | (word + DIGITS_REPEAT(0x46)) | word) & DIGITS_REPEAT(0x80);
+        word_digits = digits_leading(not_digits);
+        if (word_digits > 0)
         {
-            if (last_digit > bits_32_max_int_digits[BITS_32_INT_MAX_DIGITS - 1])
-            {
-                return FALSE;
-            }
+            /* move the digits to the top of the word (which drops the characters after them) and merge them */
+            word = (word - DIGITS_REPEAT('0')) << ((DIGITS_PER_WORD - word_digits) * 8);
+            DIGITS_MERGE(word);
+            value = value * powers_of_10[word_digits] + (uint32)word;
+            digit_count += word_digits;
+        }
+        if (chars + word_digits == line_end)
+        {
+            /* the digits go on to the end of the line */
+            word_digits = DIGITS_PER_WORD;
+            break;
+        }
+    }
+    if (word_digits == DIGITS_PER_WORD)
+    {
+        /* the line is not known (or the digits go on to its end) */
+        while (CHAR_IS_DIGIT(digits[digit_count]))
+        {
+            value = value * 10 + CHAR_DIGIT_TO_INT(digits[digit_count]);
+            digit_count++;
         }
     }
 
-    if (*is_negative)
+    if (digit_count == 0)
     {
-        *integer *= -1;
+        *integer = 0;
+        *chars_read = 0;
+        return FALSE;
     }
-    return TRUE;
+    *chars_read = (digits - str) + digit_count;
+    is_valid = digit_count < BITS_32_INT_MAX_DIGITS || (digit_count == BITS_32_INT_MAX_DIGITS && digits_within_max_digits(digits));
+    if (is_valid && *is_negative)
+    {
+        value = 0 - value;
+    }
+    /* reinterpret the low 32 bits as a signed integer, without relying on the implementation defined conversion */
+    value &= 0xFFFFFFFFUL;
+    *integer = value <= 0x7FFFFFFFUL ? (int32)value : -(int32)(0xFFFFFFFFUL - value) - 1;
+    return is_valid;
+}
+
+/* Parse a single 32 bits signed integer from str, assuming it is represented in base 10.
+   Returns the integer in the out parameter integer, along with the amount of characters the integer occupies in the string, chars_read,
+   and whether or not the integer is negative.
+   Returns TRUE if the parse was successful, FALSE otherwise. A parse may fail if there are no digits at all, or if the integer overflows a signed 32 bit integer.
+   In the case of a failure, the out parameter integer will contain garbage and the is_negative parameter will work as expected.
+   In the former case of failure, chars_read will be 0, and in the latter it will be the
+   amount of characters the integer occupies. */
+bool parse_int32_base10(const char *str, int32 *integer, int *chars_read, bool *is_negative)
+{
+    return parse_int32_base10_in_line(str, NULL, NULL, integer, chars_read, is_negative);
 }
 
 /* returns c == 0 */
@@ -143,7 +226,7 @@ void parse_symbol(char *line, bool (*symbol_end_indicator)(char), ParseSymbolDat
         parse_symbol_data->result = HAS_SYMBOL;
     }
     /* check that the first character is an alphabethic one */
-    if (!isalpha(c))
+    if (!CHAR_IS_ALPHA(c))
     {
         parse_symbol_data->val.symbol_parse_error.type = SYMBOL_STARTS_WITH_NON_ALPHABETHIC_CHARACTER;
         parse_symbol_data->val.symbol_parse_error.val.symbol_starts_with_non_alphabethic_char.non_alphabethic_char = c;
@@ -165,7 +248,7 @@ void parse_symbol(char *line, bool (*symbol_end_indicator)(char), ParseSymbolDat
             }
             break;
         }
-        else if (!isalnum(c))
+        else if (!CHAR_IS_SYMBOL(c))
         {
 
             parse_symbol_data->val.symbol_parse_error.type = INVALID_CHARACTER_IN_SYMBOL;
@@ -239,9 +322,9 @@ void parse_symbol(char *line, bool (*symbol_end_indicator)(char), ParseSymbolDat
     return;
 }
 
-/* Parse a .data's directive integer list from an str. Returns TRUE and fills parse_error if we encountered an error,
+/* Parse a .data's directive integer list from an str (a part of the line scan was built from). Returns TRUE and fills parse_error if we encountered an error,
    otherwise returns FALSE and fills directive with integer list of the .data directive */
-bool parse_data_directive(char *str, Directive *directive, ParseError *parse_error)
+bool parse_data_directive(char *str, Directive *directive, ParseError *parse_error, const LineScan *scan)
 {
     int chars_read;
     int32 integer;
@@ -258,7 +341,7 @@ bool parse_data_directive(char *str, Directive *directive, ParseError *parse_err
     /* scan the integer list */
     while (*str != 0)
     {
-        encountered_error = !parse_int32_base10(str, &integer, &chars_read, &is_negative);
+        encountered_error = !parse_int32_base10_in_line(str, scan->line, scan->line + scan->length, &integer, &chars_read, &is_negative);
         if (chars_read == 0)
         {
             parse_error->type = PARSE_ERROR_DATA_DIRECTIVE_NOT_AN_INTEGER;
@@ -297,7 +380,7 @@ bool parse_data_directive(char *str, Directive *directive, ParseError *parse_err
         directive->val.data.integers[directive->val.data.amount_of_integers] = integer;
         directive->val.data.amount_of_integers++;
         str += chars_read;
-        str = skip_space(str);
+        str = scan_skip_space(scan, str);
         if (*str != 0 && *str != ',')
         {
             /* error - invalid character after the integer*/
@@ -309,7 +392,7 @@ bool parse_data_directive(char *str, Directive *directive, ParseError *parse_err
         else if (*str == ',')
         {
             str += 1;
-            str = skip_space(str);
+            str = scan_skip_space(scan, str);
             /* check if the ',' is after the last number. */
             if (*str == 0)
             {
@@ -323,9 +406,9 @@ bool parse_data_directive(char *str, Directive *directive, ParseError *parse_err
     return encountered_error;
 }
 
-/* Parse the string of a .string directive. Returns TRUE and fills parse_error if there was an error,
+/* Parse the string of a .string directive from an str (a part of the line scan was built from). Returns TRUE and fills parse_error if there was an error,
    otherwise returns FALSE and fills directive with the string found */
-bool parse_string_directive(char *str, Directive *directive, ParseError *parse_error)
+bool parse_string_directive(char *str, Directive *directive, ParseError *parse_error, const LineScan *scan)
 {
     char *end;         /* end of the quoted region */
     char *start = str; /* start of the quoted region */
@@ -338,19 +421,9 @@ bool parse_string_directive(char *str, Directive *directive, ParseError *parse_e
         encountered_error = TRUE;
         return encountered_error;
     }
-    str++;
 
-    /* get to the end of the line */
-    while (*str != 0)
-    {
-        str++;
-    }
-    /* go back to the last quote */
-    while (*str != '"')
-    {
-        str--;
-    }
-    end = str;
+    /* find the last quote of the line (which is the starting quote if there is no other) */
+    end = scan_find_last(scan, start, '"');
 
     if (start == end)
     {
@@ -375,8 +448,9 @@ bool parse_string_directive(char *str, Directive *directive, ParseError *parse_e
     So for example a valid value for str would be "data 1, 2,3", however it would parse ".data 1,2,3" as invalid directive.
     Returns TRUE and fills the parse_error if an error was encounterd during the parsing.
     Otherwise returns FALSE and fills the directive object with data.
+    str is a part of the line scan was built from.
     Note: this function modifes the str */
-bool parse_directive(char *str, Directive *directive, ParseError *parse_error)
+bool parse_directive(char *str, Directive *directive, ParseError *parse_error, const LineScan *scan)
 {
     bool encountered_error = FALSE;
     ParseSymbolData parse_symbol_data;
@@ -392,7 +466,7 @@ bool parse_directive(char *str, Directive *directive, ParseError *parse_error)
     }
     str += directive_name_len(directive_type);
 
-    if (!isspace(*str) && *str != 0)
+    if (!CHAR_IS_SPACE(*str) && *str != 0)
     {
         /* if there is no space after the directive and we're not at the end of the string - we have an invalid directive */
         parse_error->type = PARSE_ERROR_INVALID_DIRECTIVE;
@@ -401,20 +475,20 @@ bool parse_directive(char *str, Directive *directive, ParseError *parse_error)
         return encountered_error;
     }
     directive->type = directive_type;
-    str = skip_space(str);
+    str = scan_skip_space(scan, str);
 
     /* parse each directive's data */
     switch (directive_type)
     {
     case DIRECTIVE_DATA:
     {
-        encountered_error = parse_data_directive(str, directive, parse_error);
+        encountered_error = parse_data_directive(str, directive, parse_error, scan);
         break;
     }
 
     case DIRECTIVE_STRING:
     {
-        encountered_error = parse_string_directive(str, directive, parse_error);
+        encountered_error = parse_string_directive(str, directive, parse_error, scan);
         break;
     }
 
@@ -485,7 +559,7 @@ bool parse_directive(char *str, Directive *directive, ParseError *parse_error)
 
 bool parse_operand_symbol_end_indicator(char c)
 {
-    return isspace(c) || (c == ',') || (c == 0);
+    return CHAR_IS_SPACE(c) || (c == ',') || (c == 0);
 }
 /* Parses a single operand from an str. If the parse is successfull it puts the length of the operand in the string into operand_length
    and fills the Operand object with the parsed operand. Otherwise it fills ParseError with details about the error.
@@ -585,10 +659,10 @@ bool parse_operand(char *str, uint32 *operand_length, Operand *operand, ParseErr
     }
 }
 
-/* Parse a single instruction from an str. If successfull, returns FALSE and fills instruction with information about the parsed instruction.
+/* Parse a single instruction from an str (a part of the line scan was built from). If successfull, returns FALSE and fills instruction with information about the parsed instruction.
    Otherwise returns TRUE and fills parse_error with infromation about the error encountered during parsing.
    Note: this function modifies the str */
-bool parse_instruction(char *str, Instruction *instruction, ParseError *parse_error)
+bool parse_instruction(char *str, Instruction *instruction, ParseError *parse_error, const LineScan *scan)
 {
     const OperandType *acceptable_operands; /* acceptable operands for an instruction */
     int acceptable_operands_amount, i;      /* amount of acceptable operands in the acceptable_operands array */
@@ -609,14 +683,14 @@ bool parse_instruction(char *str, Instruction *instruction, ParseError *parse_er
     str += instruction_name_len(instruction_type);
 
     /* str_to_instruction only checks as much characters as necessary. Thus for the instruction to be valid, we need to make sure that after it comes space or the end*/
-    if (!isspace(*str) && *str != 0)
+    if (!CHAR_IS_SPACE(*str) && *str != 0)
     {
         parse_error->type = PARSE_ERROR_INVALID_INSTRUCTION;
         parse_error->val.invalid_instruction = trim_after_space(str_start); /* we use str_start since we already moved away with str */
         encountered_error = TRUE;
         return encountered_error;
     }
-    str = skip_space(str);
+    str = scan_skip_space(scan, str);
     operand_amount = instruction_operand_amount(instruction_type);
     instruction->operand_amount = operand_amount;
     /* We have 4 cases:
@@ -660,7 +734,7 @@ bool parse_instruction(char *str, Instruction *instruction, ParseError *parse_er
         return encountered_error;
     }
     str += operand_len;
-    str = skip_space(str);
+    str = scan_skip_space(scan, str);
 
     /* We have 6 cases:
         case 1: after the first operand we found a character which is not null terminator or ',' or a space (error)
@@ -684,7 +758,7 @@ bool parse_instruction(char *str, Instruction *instruction, ParseError *parse_er
         encountered_error = TRUE;
         return encountered_error;
     }
-    else if (*str == ',' && operand_amount == 1 && *skip_space(str + 1) == 0)
+    else if (*str == ',' && operand_amount == 1 && *scan_skip_space(scan, str + 1) == 0)
     {
         parse_error->type = PARSE_ERROR_INSTRUCTION_COMMA_AFTER_FINAL_OPERAND;
         encountered_error = TRUE;
@@ -724,7 +798,7 @@ bool parse_instruction(char *str, Instruction *instruction, ParseError *parse_er
     }
     /* otherwise operand_amount > 1 and *str == ',' */
     str++; /* skip ',' */
-    str = skip_space(str);
+    str = scan_skip_space(scan, str);
     if (*str == 0)
     {
         parse_error->type = PARSE_ERROR_INSTRUCTION_TOO_LITTLE_OPERANDS;
@@ -740,7 +814,7 @@ bool parse_instruction(char *str, Instruction *instruction, ParseError *parse_er
         return encountered_error;
     }
     str += operand_len;
-    str = skip_space(str);
+    str = scan_skip_space(scan, str);
     /* we have 4 cases:
         case 1: The text isn't over and there is no ',' (error)
         case 2: The text isn't over and there is a ',' with nothing else after it (error)
@@ -753,7 +827,7 @@ bool parse_instruction(char *str, Instruction *instruction, ParseError *parse_er
         encountered_error = TRUE;
         return encountered_error;
     }
-    else if (*str == ',' && *skip_space(str + 1) == 0)
+    else if (*str == ',' && *scan_skip_space(scan, str + 1) == 0)
     {
         parse_error->type = PARSE_ERROR_INSTRUCTION_COMMA_AFTER_FINAL_OPERAND;
         encountered_error = TRUE;
@@ -824,6 +898,7 @@ void parse_line(char *line, ParseLineData *parse_line_data)
 {
     char *line_ptr = line;
     ParseSymbolData parse_symbol_data;
+    LineScan scan;
     bool encountered_error;
 
     if (line[0] == '\n' || line[0] == 0)
@@ -836,9 +911,20 @@ void parse_line(char *line, ParseLineData *parse_line_data)
         parse_line_data->type = PARSE_LINE_COMMENT;
         return;
     }
-    line_ptr = skip_space(line_ptr);
-    /* try to parse a label */
-    parse_symbol(line_ptr, parse_line_label_end_indicator, &parse_symbol_data);
+    /* find the spaces and the structural characters of the line once, so the rest of the parsing can jump between them */
+    scan_line(line, &scan);
+    line_ptr = scan_skip_space(&scan, line_ptr);
+    /* try to parse a label (there can only be one if the line has a ':').
+       A line of only spaces still goes through parse_symbol, which starts looking for the ':' past the null terminator in that case */
+    if (*line_ptr != 0 && scan_find(&scan, line_ptr, LABEL_END_CHAR) == NULL)
+    {
+        parse_symbol_data.result = DOES_NOT_HAVE_SYMBOL;
+        parse_symbol_data.symbol_length = 0;
+    }
+    else
+    {
+        parse_symbol(line_ptr, parse_line_label_end_indicator, &parse_symbol_data);
+    }
     parse_line_data->parse_label_data = parse_symbol_data;
 
     line_ptr += parse_symbol_data.symbol_length;
@@ -846,7 +932,7 @@ void parse_line(char *line, ParseLineData *parse_line_data)
     if (parse_symbol_data.result != DOES_NOT_HAVE_SYMBOL)
     {
         line_ptr++; /* if we have a label, even if invalid, we need to consider the ':' character */
-        if (!isspace(*line_ptr))
+        if (!CHAR_IS_SPACE(*line_ptr))
         {
             /* error - we have no space after the label */
             parse_line_data->type = PARSE_LINE_ERROR;
@@ -856,7 +942,7 @@ void parse_line(char *line, ParseLineData *parse_line_data)
     }
 
     /* skip any space which might be found after the end of the label */
-    line_ptr = skip_space(line_ptr);
+    line_ptr = scan_skip_space(&scan, line_ptr);
 
     if (*line_ptr == 0)
     {
@@ -869,7 +955,7 @@ void parse_line(char *line, ParseLineData *parse_line_data)
         /* we have a directive! */
         parse_line_data->type = PARSE_LINE_DIRECTIVE;
         line_ptr++; /* skip the '.' */
-        encountered_error = parse_directive(line_ptr, &parse_line_data->val.directive, &parse_line_data->val.parse_error);
+        encountered_error = parse_directive(line_ptr, &parse_line_data->val.directive, &parse_line_data->val.parse_error, &scan);
         if (encountered_error)
         {
             parse_line_data->type = PARSE_LINE_ERROR;
@@ -878,7 +964,7 @@ void parse_line(char *line, ParseLineData *parse_line_data)
     else
     {
         parse_line_data->type = PARSE_LINE_INSTRUCTION;
-        encountered_error = parse_instruction(line_ptr, &parse_line_data->val.instruction, &parse_line_data->val.parse_error);
+        encountered_error = parse_instruction(line_ptr, &parse_line_data->val.instruction, &parse_line_data->val.parse_error, &scan);
         if (encountered_error)
         {
             parse_line_data->type = PARSE_LINE_ERROR;
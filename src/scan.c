@@ -0,0 +1,300 @@
+#include <string.h>
+#include "scan.h"
+#include "char_class.h"
+
+/* the vectorized scans are only built with a compiler which has the x86 intrinsics and the target attribute (gcc and clang) */
+#if defined(__GNUC__) && (defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__)))
+#define SCAN_X86
+#include <emmintrin.h>
+#include <immintrin.h>
+#endif
+
+/* Returns the position of the lowest set bit of a non zero mask */
+int scan_lowest_bit(uint32 mask)
+{
+#ifdef __GNUC__
+    return __builtin_ctz(mask);
+#else
+    int bit = 0;
+    while ((mask & 1) == 0)
+    {
+        mask >>= 1;
+        bit++;
+    }
+    return bit;
+#endif
+}
+
+/* Returns the position of the highest set bit of a non zero mask */
+int scan_highest_bit(uint32 mask)
+{
+#ifdef __GNUC__
+    return 31 - __builtin_clz(mask);
+#else
+    int bit = 31;
+    while ((mask & 0x80000000UL) == 0)
+    {
+        mask <<= 1;
+        bit--;
+    }
+    return bit;
+#endif
+}
+
+/* Scan the bytes of a line up to length (exclusive) one at a time, setting the bits of the masks */
+void scan_bytes(const char *line, uint32 length, LineScan *scan)
+{
+    uint32 i;
+    for (i = 0; i < length; ++i)
+    {
+        if (CHAR_IS_SPACE(line[i]))
+        {
+            scan->space[i / 32] |= (uint32)1 << (i % 32);
+        }
+        else if (CHAR_IS_STRUCTURAL(line[i]))
+        {
+            scan->structural[i / 32] |= (uint32)1 << (i % 32);
+        }
+    }
+}
+
+#ifdef SCAN_X86
+/* 16 copies of a byte, so that it can be loaded as a vector */
+#define SCAN_REPEAT(c) {c, c, c, c, c, c, c, c, c, c, c, c, c, c, c, c}
+
+/* The bytes the SSE2 scan compares the chunks against. They are loaded from memory instead of being built with the set intrinsics for every chunk */
+const char scan_patterns[][16] = {SCAN_REPEAT(' '), SCAN_REPEAT('\t'), SCAN_REPEAT('\r' - '\t'),
+                                  SCAN_REPEAT(':'), SCAN_REPEAT(','), SCAN_REPEAT('"'), SCAN_REPEAT(';'),
+                                  SCAN_REPEAT('#'), SCAN_REPEAT('&'), SCAN_REPEAT('.')};
+
+#define SCAN_PATTERN(i) _mm_loadu_si128((const __m128i *)scan_patterns[i])
+
+/* Scan the 16 bytes at chunk, setting space and structural to the masks of the chunk */
+void scan_chunk_sse2(const char *chunk, uint32 *space, uint32 *structural)
+{
+    __m128i bytes = _mm_loadu_si128((const __m128i *)chunk), from_tab, matches;
+    /* '\t' to '\r' are a range: a byte is in it if subtracting '\t' leaves it (as an unsigned byte) at most '\r' - '\t' */
+    from_tab = _mm_sub_epi8(bytes, SCAN_PATTERN(1));
+    matches = _mm_or_si128(_mm_cmpeq_epi8(bytes, SCAN_PATTERN(0)), _mm_cmpeq_epi8(_mm_min_epu8(from_tab, SCAN_PATTERN(2)), from_tab));
+    *space = (uint32)_mm_movemask_epi8(matches);
+    matches = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(bytes, SCAN_PATTERN(3)), _mm_cmpeq_epi8(bytes, SCAN_PATTERN(4))),
+                           _mm_or_si128(_mm_cmpeq_epi8(bytes, SCAN_PATTERN(5)), _mm_cmpeq_epi8(bytes, SCAN_PATTERN(6))));
+    matches = _mm_or_si128(matches, _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(bytes, SCAN_PATTERN(7)), _mm_cmpeq_epi8(bytes, SCAN_PATTERN(8))),
+                                                 _mm_cmpeq_epi8(bytes, SCAN_PATTERN(9))));
+    *structural = (uint32)_mm_movemask_epi8(matches);
+}
+
+/* Scan a line up to length (exclusive) 16 bytes at a time, setting the bits of the masks.
+   The rest of the line is copied into a chunk which is padded with null characters (which are neither whitespace nor structural),
+   so nothing is read past the end of the line */
+void scan_chunks_sse2(const char *line, uint32 length, LineScan *scan)
+{
+    char tail[16];
+    uint32 i, space, structural;
+    for (i = 0; i < length; i += 16)
+    {
+        if (i + 16 <= length)
+        {
+            scan_chunk_sse2(line + i, &space, &structural);
+        }
+        else
+        {
+            memset(tail, 0, sizeof(tail));
+            memcpy(tail, line + i, length - i);
+            scan_chunk_sse2(tail, &space, &structural);
+        }
+        /* a chunk starts at a multiple of 16, so it is entirely in one word */
+        scan->space[i / 32] |= space << (i % 32);
+        scan->structural[i / 32] |= structural << (i % 32);
+    }
+}
+
+/* The classes of the AVX2 scan: a byte is looked up by its low nibble and by its high nibble, and the two results are and-ed.
+   The structural characters are 0x22, 0x23, 0x26, 0x2C, 0x2E (high nibble 2) and 0x3A, 0x3B (high nibble 3).
+   The whitespace characters are 0x20 (high nibble 2) and 0x09 to 0x0D (high nibble 0) */
+#define SCAN_CLASS_STRUCTURAL_2 1
+#define SCAN_CLASS_STRUCTURAL_3 2
+#define SCAN_CLASS_SPACE_2 4
+#define SCAN_CLASS_SPACE_0 8
+
+/* The classes a low nibble (the index) may be in. Repeated twice since the shuffle looks up each 16 bytes half separately */
+#define SCAN_LOW_NIBBLE_CLASSES SCAN_CLASS_SPACE_2, 0, SCAN_CLASS_STRUCTURAL_2, SCAN_CLASS_STRUCTURAL_2, 0, 0, SCAN_CLASS_STRUCTURAL_2, 0, 0, \
+                                SCAN_CLASS_SPACE_0, SCAN_CLASS_STRUCTURAL_3 | SCAN_CLASS_SPACE_0, SCAN_CLASS_STRUCTURAL_3 | SCAN_CLASS_SPACE_0, \
+                                SCAN_CLASS_STRUCTURAL_2 | SCAN_CLASS_SPACE_0, SCAN_CLASS_SPACE_0, SCAN_CLASS_STRUCTURAL_2, 0
+const char scan_low_nibble_classes[32] = {SCAN_LOW_NIBBLE_CLASSES, SCAN_LOW_NIBBLE_CLASSES};
+
+/* The classes a high nibble (the index) may be in (see scan_low_nibble_classes) */
+#define SCAN_HIGH_NIBBLE_CLASSES SCAN_CLASS_SPACE_0, 0, SCAN_CLASS_STRUCTURAL_2 | SCAN_CLASS_SPACE_2, SCAN_CLASS_STRUCTURAL_3, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+const char scan_high_nibble_classes[32] = {SCAN_HIGH_NIBBLE_CLASSES, SCAN_HIGH_NIBBLE_CLASSES};
+
+/* The masks which pick the nibbles and the classes out of a vector */
+const char scan_class_masks[][32] = {{15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+                                      15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15},
+                                     {3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3},
+                                     {12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12,
+                                      12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12}};
+
+/* Scan the 32 bytes at chunk (see scan_chunk_sse2). Only called when the CPU supports AVX2 */
+__attribute__((target("avx2"))) void scan_chunk_avx2(const char *chunk, uint32 *space, uint32 *structural)
+{
+    __m256i bytes = _mm256_loadu_si256((const __m256i *)chunk);
+    __m256i nibble_mask = _mm256_loadu_si256((const __m256i *)scan_class_masks[0]);
+    __m256i classes, zero = _mm256_setzero_si256();
+    /* bytes with the high bit set have a high nibble of 8 or above, which is in no class */
+    classes = _mm256_and_si256(_mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *)scan_low_nibble_classes), _mm256_and_si256(bytes, nibble_mask)),
+                               _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *)scan_high_nibble_classes),
+                                                   _mm256_and_si256(_mm256_srli_epi16(bytes, 4), nibble_mask)));
+    *structural = ~(uint32)_mm256_movemask_epi8(
+        _mm256_cmpeq_epi8(_mm256_and_si256(classes, _mm256_loadu_si256((const __m256i *)scan_class_masks[1])), zero));
+    *space = ~(uint32)_mm256_movemask_epi8(
+        _mm256_cmpeq_epi8(_mm256_and_si256(classes, _mm256_loadu_si256((const __m256i *)scan_class_masks[2])), zero));
+}
+
+/* Scan a line 32 bytes at a time (see scan_chunks_sse2). Only called when the CPU supports AVX2 */
+__attribute__((target("avx2"))) void scan_chunks_avx2(const char *line, uint32 length, LineScan *scan)
+{
+    char tail[32];
+    uint32 i;
+    for (i = 0; i < length; i += 32)
+    {
+        /* a chunk starts at a multiple of 32, so it is exactly one word */
+        if (i + 32 <= length)
+        {
+            scan_chunk_avx2(line + i, &scan->space[i / 32], &scan->structural[i / 32]);
+        }
+        else
+        {
+            memset(tail, 0, sizeof(tail));
+            memcpy(tail, line + i, length - i);
+            scan_chunk_avx2(tail, &scan->space[i / 32], &scan->structural[i / 32]);
+        }
+    }
+}
+
+/* Pick the scan the CPU supports, and scan with it (see scan_chunks_sse2) */
+void scan_chunks_select(const char *line, uint32 length, LineScan *scan);
+
+/* The scan which the CPU supports. It is picked at the first scan */
+void (*scan_chunks)(const char *, uint32, LineScan *) = scan_chunks_select;
+
+void scan_chunks_select(const char *line, uint32 length, LineScan *scan)
+{
+    /* every thread which gets here picks the same one, so there is no harm in racing */
+    scan_chunks = __builtin_cpu_supports("avx2") ? scan_chunks_avx2 : scan_chunks_sse2;
+    scan_chunks(line, length, scan);
+}
+#endif
+
+void scan_line(const char *line, LineScan *scan)
+{
+    uint32 length = strlen(line), i;
+    if (length > SCAN_MAX_LENGTH)
+    {
+        length = SCAN_MAX_LENGTH;
+    }
+    scan->line = line;
+    scan->length = length;
+    scan->has_masks = length >= SCAN_MIN_LENGTH;
+    if (!scan->has_masks)
+    {
+        return;
+    }
+    for (i = 0; i < SCAN_MASK_WORDS; ++i)
+    {
+        scan->space[i] = 0;
+        scan->structural[i] = 0;
+    }
+#ifdef SCAN_X86
+    scan_chunks(line, length, scan);
+#else
+    scan_bytes(line, length, scan);
+#endif
+}
+
+/* Returns a mask of the bits of word which are at or after position pos of the line */
+uint32 scan_bits_from(uint32 word, uint32 pos)
+{
+    if (pos <= word * 32)
+    {
+        return 0xFFFFFFFFUL;
+    }
+    return (uint32)0xFFFFFFFFUL << (pos - word * 32);
+}
+
+char *scan_skip_space(const LineScan *scan, char *str)
+{
+    uint32 pos = str - scan->line, word, not_space;
+    if (!scan->has_masks || pos > scan->length)
+    {
+        /* the line is too short to have masks, or str is past its null terminator (which the masks know nothing about) */
+        return skip_space(str);
+    }
+    for (word = pos / 32; word < SCAN_MASK_WORDS && word * 32 < scan->length; ++word)
+    {
+        /* the null terminator is not a space, so a line which ends in this word has a bit set here */
+        not_space = ~scan->space[word] & scan_bits_from(word, pos);
+        if (not_space != 0)
+        {
+            return (char *)scan->line + word * 32 + scan_lowest_bit(not_space);
+        }
+    }
+    /* the line is longer than the masks, or str is at its end */
+    return skip_space((char *)scan->line + scan->length);
+}
+
+char *scan_find(const LineScan *scan, char *str, char c)
+{
+    uint32 pos = str - scan->line, word, structural;
+    int bit;
+    if (!scan->has_masks || pos > scan->length)
+    {
+        /* see scan_skip_space */
+        return strchr(str, c);
+    }
+    for (word = pos / 32; word < SCAN_MASK_WORDS; ++word)
+    {
+        for (structural = scan->structural[word] & scan_bits_from(word, pos); structural != 0; structural &= structural - 1)
+        {
+            bit = scan_lowest_bit(structural);
+            if (scan->line[word * 32 + bit] == c)
+            {
+                return (char *)scan->line + word * 32 + bit;
+            }
+        }
+    }
+    if (scan->length < SCAN_MAX_LENGTH)
+    {
+        return NULL;
+    }
+    /* the line is longer than the masks */
+    return strchr(scan->line + SCAN_MAX_LENGTH, c);
+}
+
+char *scan_find_last(const LineScan *scan, char *str, char c)
+{
+    uint32 pos = str - scan->line, word, structural;
+    int bit;
+    char *last;
+    if (!scan->has_masks || pos > scan->length)
+    {
+        /* see scan_skip_space */
+        return strrchr(str, c);
+    }
+    if (scan->length == SCAN_MAX_LENGTH && (last = strrchr(scan->line + SCAN_MAX_LENGTH, c)) != NULL)
+    {
+        /* the line is longer than the masks, and c is past them */
+        return last;
+    }
+    for (word = SCAN_MASK_WORDS; word > pos / 32; --word)
+    {
+        for (structural = scan->structural[word - 1] & scan_bits_from(word - 1, pos); structural != 0; structural &= ~((uint32)1 << bit))
+        {
+            bit = scan_highest_bit(structural);
+            if (scan->line[(word - 1) * 32 + bit] == c)
+            {
+                return (char *)scan->line + (word - 1) * 32 + bit;
+            }
+        }
+    }
+    return NULL;
+}
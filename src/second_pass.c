@@ -5,12 +5,10 @@
 /* The bit at which the operand's data starts in the extra information word. (The first 3 bits are used for the 'A,R,E' field) */
 #define OPERAND_WORD_START_BIT 3
 
-/* Encodes an operand's information word if necessary. Returns 0 if the operand does not need an information word (i.e. if it is a register) */
-uint32 encode_operand(Operand *operand, SymbolTable *symbol_table, uint32 current_instruction_addr)
+uint32 encode_resolved_operand(Operand *operand, Symbol *symbol, uint32 current_instruction_addr)
 {
     uint32 encoding = 0;
     int offset;
-    Symbol *symbol;
     if (operand->type == OPERAND_IMMEDIATE)
     {
         encoding |= (operand->value.immediate << OPERAND_WORD_START_BIT);
@@ -18,8 +16,6 @@ uint32 encode_operand(Operand *operand, SymbolTable *symbol_table, uint32 curren
     }
     else if (operand->type == OPERAND_SYMBOL)
     {
-        symbol = symbol_table_search(*symbol_table, operand->value.symbol_name);
-
         encoding |= (symbol->addr << OPERAND_WORD_START_BIT);
         if (symbol->context == SYMBOL_CONTEXT_EXTERNAL)
         {
@@ -32,8 +28,6 @@ uint32 encode_operand(Operand *operand, SymbolTable *symbol_table, uint32 curren
     }
     else if (operand->type == OPERAND_ADDRESS)
     {
-        symbol = symbol_table_search(*symbol_table, operand->value.symbol_name);
-
         /* calculate the offset between the address of the symbol and the current instruction */
         offset = symbol->addr - current_instruction_addr;
 
@@ -44,19 +38,26 @@ uint32 encode_operand(Operand *operand, SymbolTable *symbol_table, uint32 curren
     return encoding;
 }
 
-/* Write an instruction onto instruction_image. Returns the amount of words written to the instruction image. */
-uint32 write_instruction(Instruction *instruction, U32Vector *instruction_image, SymbolTable *symbol_table, uint32 IC, bool *alloc_fail)
+/* Encodes an operand's information word if necessary. Returns 0 if the operand does not need an information word (i.e. if it is a register) */
+uint32 encode_operand(Operand *operand, SymbolTable *symbol_table, uint32 current_instruction_addr)
 {
-    uint32 words_written = 0; /* amount of words we wrote to the instruction_image vector */
-    uint32 encoding = encode_instruction(instruction);
-
-    *alloc_fail = FALSE;
-    /* write the instruction to the instruction image */
-    if ((*alloc_fail = !u32_vec_push(instruction_image, encoding)))
+    Symbol *symbol = NULL;
+    if (operand->type == OPERAND_SYMBOL || operand->type == OPERAND_ADDRESS)
     {
-        return 0;
+        symbol = symbol_table_search(*symbol_table, operand->value.symbol_name);
     }
-    words_written += 1;
+    return encode_resolved_operand(operand, symbol, current_instruction_addr);
+}
+
+/* Encode an instruction into words (which has room for MAX_INSTRUCTION_WORDS words).
+   Returns the amount of words written. */
+uint32 write_instruction(Instruction *instruction, uint32 *words, SymbolTable *symbol_table, uint32 IC)
+{
+    uint32 words_written = 0; /* amount of words we wrote into words */
+    uint32 encoding;
+
+    /* write the instruction to the instruction image */
+    words[words_written++] = encode_instruction(instruction);
     if (instruction->operand_amount >= 1)
     {
         /* encode the operand and write it to the vector if it is necessary */
@@ -64,11 +65,7 @@ uint32 write_instruction(Instruction *instruction, U32Vector *instruction_image,
         encoding = encode_operand(&instruction->operand1, symbol_table, IC);
         if (encoding != 0)
         {
-            if ((*alloc_fail = !u32_vec_push(instruction_image, encoding)))
-            {
-                return 0;
-            }
-            words_written += 1;
+            words[words_written++] = encoding;
         }
     }
     if (instruction->operand_amount >= 2)
@@ -76,11 +73,7 @@ uint32 write_instruction(Instruction *instruction, U32Vector *instruction_image,
         encoding = encode_operand(&instruction->operand2, symbol_table, IC);
         if (encoding != 0)
         {
-            if ((*alloc_fail = !u32_vec_push(instruction_image, encoding)))
-            {
-                return 0;
-            }
-            words_written += 1;
+            words[words_written++] = encoding;
         }
     }
     return words_written;
@@ -99,24 +92,39 @@ uint32 write_instruction(Instruction *instruction, U32Vector *instruction_image,
     After putting the external symbols (if there are any), we encode and write the instruction to the instruction image,
     as well as raise IC by the amount of words the instruction took.
 
+  The instruction image is allocated once at its exact size (the first pass counted every instruction word), and each instruction is written into its place.
+
   once we're done reading the file, we return the symbol table, the data image, the instruction image, the entry symbols array and external symbols array.
+  When build_images is FALSE (see second_pass_check), we only look the symbols up and report errors: nothing is encoded or collected.
 */
-SecondPassResult second_pass(FILE *input, FirstPassResult first_pass_result, ErrorCallback err_callback)
+SecondPassResult second_pass_run(FILE *input, FirstPassResult first_pass_result, ErrorCallback err_callback, Arena *arena, bool build_images)
 {
-    char buf[MAX_LINE_LENGTH + 2];                        /* instruction buffer; +2 for null termination and newline character */
-    Error error;                                          /* error we call err_callback with */
-    uint32 IC = 100;                                      /* Instruction count */
-    U32Vector *instruction_image = u32_vec_create();      /* The instruction image we return*/
-    SymbolVector *entry_symbols = symbol_vec_create();    /* the entry symbols vector we return */
-    SymbolVector *external_symbols = symbol_vec_create(); /* the extern symbols vector we return */
-    SecondPassResult second_pass_result;                  /* the second pass result we return */
-    bool instruction_has_invalid_operand;                 /* whether or not an instruction we're encoding has an invalid operand*/
-    bool alloc_fail = FALSE;                              /* whether or not we encounterd an allocation failure */
+    char buf[MAX_LINE_LENGTH + 2];                                /* instruction buffer; +2 for null termination and newline character */
+    Error error;                                                  /* error we call err_callback with */
+    uint32 IC = 100;                                              /* Instruction count */
+    Image *instruction_image = NULL;                              /* The instruction image we return*/
+    SymbolReferenceVector *entry_symbols = NULL;                  /* the entry symbols vector we return */
+    SymbolReferenceVector *external_symbols = NULL;               /* the extern symbols vector we return */
+    SymbolSet entry_set;                                                       /* the symbols we already pushed onto entry_symbols */
+    SecondPassResult second_pass_result;                          /* the second pass result we return */
+    bool instruction_has_invalid_operand;                         /* whether or not an instruction we're encoding has an invalid operand*/
     ParseLineData parse_line_data;
     LineInfo line_info;
-    Symbol *symbol, symbol_copy;
+    Symbol *symbol;
+    SymbolReference reference;
     Instruction *instruction;
-    uint32 i;
+    uint32 words[MAX_INSTRUCTION_WORDS]; /* the words of an instruction */
+    uint32 word_count;
+
+    /* the set is only used (and initialized with symbol_set_init) when building the images - keep it empty otherwise */
+    entry_set.members = NULL;
+    entry_set.size = 0;
+    if (build_images)
+    {
+        instruction_image = image_create_in(arena);
+        entry_symbols = symbol_ref_vec_create_in(arena);
+        external_symbols = symbol_ref_vec_create_in(arena);
+    }
 
     /* initialize second_pass_result*/
     second_pass_result.symbol_table = first_pass_result.symbol_table;
@@ -127,8 +135,10 @@ SecondPassResult second_pass(FILE *input, FirstPassResult first_pass_result, Err
     second_pass_result.encountered_error = FALSE;
     second_pass_result.alloc_fail = FALSE;
 
-    /* we check after initializing second_pass_result so that if the caller decides to free second_pass_result it won't try to free garbage*/
-    if (instruction_image == NULL || entry_symbols == NULL || external_symbols == NULL)
+    /* we check after initializing second_pass_result so that the caller always gets the data image and symbol table of the first pass back */
+    if (build_images && (instruction_image == NULL || entry_symbols == NULL || external_symbols == NULL ||
+                         !symbol_set_init(&entry_set, first_pass_result.symbol_table, arena) ||
+                         !image_reserve(instruction_image, first_pass_result.IC - INSTRUCTION_MEMORY_START)))
     {
         second_pass_result.alloc_fail = TRUE;
         second_pass_result.encountered_error = TRUE;
@@ -139,7 +149,7 @@ SecondPassResult second_pass(FILE *input, FirstPassResult first_pass_result, Err
     line_info.line = buf;
     line_info.line_num = 0;
 
-    while (fgets(buf, sizeof(buf), input))
+    while (!err_should_stop(err_callback) && fgets(buf, sizeof(buf), input))
     {
         line_info.line_num++;
         error.line_info = line_info; /* update error's line info */
@@ -171,18 +181,13 @@ SecondPassResult second_pass(FILE *input, FirstPassResult first_pass_result, Err
                     err(err_callback, error);
                     second_pass_result.encountered_error = TRUE;
                 }
-                else
+                else if (build_images)
                 {
                     /* ensure that we haven't already insereted the entry symbol
                     (since using .entry twice is allowed, but we only need to write it once to the entry file)*/
-                    for (i = 0; i < entry_symbols->len; ++i)
-                    {
-                        if (symbol_vec_get_ptr(entry_symbols, i)->name == symbol->name)
-                        {
-                            continue;
-                        }
-                    }
-                    if (!symbol_vec_push(entry_symbols, *symbol))
+                    reference.symbol_id = symbol_table_id(first_pass_result.symbol_table, symbol);
+                    reference.addr = symbol->addr;
+                    if (symbol_set_insert(&entry_set, reference.symbol_id) && !symbol_ref_vec_push(entry_symbols, reference))
                     {
                         second_pass_result.alloc_fail = TRUE;
                         second_pass_result.encountered_error = TRUE;
@@ -210,12 +215,12 @@ SecondPassResult second_pass(FILE *input, FirstPassResult first_pass_result, Err
                     err(err_callback, error);
                     instruction_has_invalid_operand = TRUE;
                 }
-                else if (symbol->context == SYMBOL_CONTEXT_EXTERNAL)
+                else if (build_images && symbol->context == SYMBOL_CONTEXT_EXTERNAL)
                 {
-                    symbol_copy = *symbol;
-                    /* update the address of the symbol to its address in the instruction image */
-                    symbol_copy.addr = IC + 1;
-                    if (!symbol_vec_push(external_symbols, symbol_copy))
+                    /* refer to the symbol at its address in the instruction image */
+                    reference.symbol_id = symbol_table_id(first_pass_result.symbol_table, symbol);
+                    reference.addr = IC + 1;
+                    if (!symbol_ref_vec_push(external_symbols, reference))
                     {
                         second_pass_result.alloc_fail = TRUE;
                         second_pass_result.encountered_error = TRUE;
@@ -234,12 +239,12 @@ SecondPassResult second_pass(FILE *input, FirstPassResult first_pass_result, Err
                     err(err_callback, error);
                     instruction_has_invalid_operand = TRUE;
                 }
-                else if (symbol->context == SYMBOL_CONTEXT_EXTERNAL)
+                else if (build_images && symbol->context == SYMBOL_CONTEXT_EXTERNAL)
                 {
-                    symbol_copy = *symbol;
-                    /* update the address of the symbol to its address in the instruction image */
-                    symbol_copy.addr = IC + 2;
-                    if (!symbol_vec_push(external_symbols, symbol_copy))
+                    /* refer to the symbol at its address in the instruction image */
+                    reference.symbol_id = symbol_table_id(first_pass_result.symbol_table, symbol);
+                    reference.addr = IC + 2;
+                    if (!symbol_ref_vec_push(external_symbols, reference))
                     {
                         second_pass_result.alloc_fail = TRUE;
                         second_pass_result.encountered_error = TRUE;
@@ -252,28 +257,33 @@ SecondPassResult second_pass(FILE *input, FirstPassResult first_pass_result, Err
                 /* we already reported the error */
                 second_pass_result.encountered_error = TRUE;
             }
-            else
+            else if (build_images)
             {
-                /* write the instruction to the instruction_image vector and raise IC by the amount of words we wrote*/
-                IC += write_instruction(&parse_line_data.val.instruction, instruction_image, &first_pass_result.symbol_table, IC, &alloc_fail);
-                if (alloc_fail)
-                {
-                    second_pass_result.alloc_fail = TRUE;
-                    second_pass_result.encountered_error = TRUE;
-                    return second_pass_result;
-                }
+                /* encode the instruction and write it into its place in the instruction image, and raise IC by the amount of words we wrote.
+                   The image has room for it since the first pass counted the same instructions */
+                word_count = write_instruction(instruction, words, &first_pass_result.symbol_table, IC);
+                assert(IC + word_count <= first_pass_result.IC);
+                instruction_image->len = IC + word_count - INSTRUCTION_MEMORY_START;
+                image_write(instruction_image, IC - INSTRUCTION_MEMORY_START, words, word_count);
+                IC += word_count;
             }
         }
     }
 
+    /* a file which was not read to its end has no result */
+    if (err_should_stop(err_callback))
+    {
+        second_pass_result.encountered_error = TRUE;
+    }
     return second_pass_result;
 }
 
-void free_second_pass_result(SecondPassResult second_pass_result)
+SecondPassResult second_pass(FILE *input, FirstPassResult first_pass_result, ErrorCallback err_callback, Arena *arena)
 {
-    u32_vec_free(second_pass_result.data_image);
-    u32_vec_free(second_pass_result.instruction_image);
-    symbol_vec_free(second_pass_result.entry_symbols);
-    symbol_vec_free(second_pass_result.external_symbols);
-    symbol_table_free(second_pass_result.symbol_table);
-}
\ No newline at end of file
+    return second_pass_run(input, first_pass_result, err_callback, arena, TRUE);
+}
+
+SecondPassResult second_pass_check(FILE *input, FirstPassResult first_pass_result, ErrorCallback err_callback, Arena *arena)
+{
+    return second_pass_run(input, first_pass_result, err_callback, arena, FALSE);
+}
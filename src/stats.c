@@ -0,0 +1,445 @@
+/* we need POSIX for clock_gettime, and the default features for syscall */
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+#include "stats.h"
+#include "utils.h"
+
+/* The size of the buffer which holds the reason the hardware counters are unavailable */
+#define STATS_COUNTERS_REASON_SIZE 128
+
+/* The names of the stages in the reports */
+const char *stats_stage_names[STATS_STAGE_COUNT] = {"expand_macros", "first_pass", "second_pass", "incremental",
+                                                    "write_am", "write_ob", "write_ent", "write_ext"};
+
+/* The names of the hardware counters in the reports */
+const char *stats_counter_names[STATS_COUNTER_COUNT] = {"cycles", "instructions", "branch_misses", "l1d_misses", "llc_misses"};
+
+/* The file descriptor of each hardware counter, or -1 if it could not be opened */
+int stats_counter_fds[STATS_COUNTER_COUNT] = {-1, -1, -1, -1, -1};
+
+/* Whether or not any of the hardware counters is open, and the thread they count (the one which called stats_init) */
+bool stats_counters_open = FALSE;
+pthread_t stats_counters_thread;
+
+/* The reason the first counter which could not be opened failed */
+char stats_counters_reason[STATS_COUNTERS_REASON_SIZE] = "";
+
+const char *stats_stage_name(StatsStage stage)
+{
+    return stats_stage_names[stage];
+}
+
+/* Open a hardware counter of the calling thread (user space only, so that it works under the default perf_event_paranoid).
+   Returns the file descriptor of the counter, or -1 if it could not be opened (in which case errno is set) */
+int stats_counter_open(StatsCounter counter)
+{
+#ifdef __linux__
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    switch (counter)
+    {
+    case STATS_COUNTER_CYCLES:
+        attr.config = PERF_COUNT_HW_CPU_CYCLES;
+        break;
+    case STATS_COUNTER_INSTRUCTIONS:
+        attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+        break;
+    case STATS_COUNTER_BRANCH_MISSES:
+        attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+        break;
+    case STATS_COUNTER_L1D_MISSES:
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        break;
+    default:
+        attr.config = PERF_COUNT_HW_CACHE_MISSES;
+        break;
+    }
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    /* pid 0 and cpu -1 count the calling thread on any CPU */
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+    (void)counter;
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+/* Open the hardware counters of the calling thread. The counters which can't be opened are left closed */
+void stats_counters_init()
+{
+    int counter;
+    stats_counters_open = FALSE;
+    stats_counters_reason[0] = 0;
+    for (counter = 0; counter < STATS_COUNTER_COUNT; ++counter)
+    {
+        if ((stats_counter_fds[counter] = stats_counter_open(counter)) >= 0)
+        {
+            stats_counters_open = TRUE;
+        }
+        else if (stats_counters_reason[0] == 0)
+        {
+            strncpy(stats_counters_reason, strerror(errno), STATS_COUNTERS_REASON_SIZE - 1);
+            stats_counters_reason[STATS_COUNTERS_REASON_SIZE - 1] = 0;
+        }
+    }
+    stats_counters_thread = pthread_self();
+}
+
+/* Read a hardware counter. Returns TRUE if successful, FALSE otherwise */
+bool stats_counter_read(StatsCounter counter, StatsCounterReading *reading)
+{
+#ifdef __linux__
+    /* the count, the time enabled and the time running (see PERF_FORMAT_TOTAL_TIME_ENABLED and PERF_FORMAT_TOTAL_TIME_RUNNING) */
+    __u64 values[3];
+    if (stats_counter_fds[counter] < 0 || read(stats_counter_fds[counter], values, sizeof(values)) != sizeof(values))
+    {
+        return FALSE;
+    }
+    reading->value = (double)values[0];
+    reading->enabled = (double)values[1];
+    reading->running = (double)values[2];
+    return TRUE;
+#else
+    (void)counter;
+    (void)reading;
+    return FALSE;
+#endif
+}
+
+/* Close the hardware counters */
+void stats_counters_close()
+{
+    int counter;
+    for (counter = 0; counter < STATS_COUNTER_COUNT; ++counter)
+    {
+#ifdef __linux__
+        if (stats_counter_fds[counter] >= 0)
+        {
+            close(stats_counter_fds[counter]);
+        }
+#endif
+        stats_counter_fds[counter] = -1;
+    }
+    stats_counters_open = FALSE;
+}
+
+/* Read a clock in seconds */
+double stats_clock(clockid_t clock)
+{
+    struct timespec now;
+    if (clock_gettime(clock, &now) != 0)
+    {
+        return 0;
+    }
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+bool stats_init(RunStats *stats, char **names, int file_count)
+{
+    int i;
+    /* +1 so that no files is not mistaken for an allocation failure */
+    if ((stats->files = calloc(file_count + 1, sizeof(FileStats))) == NULL)
+    {
+        return FALSE;
+    }
+    for (i = 0; i < file_count; ++i)
+    {
+        stats->files[i].name = names[i];
+    }
+    stats->file_count = file_count;
+    stats_counters_init();
+    stats->wall = stats_clock(CLOCK_MONOTONIC);
+    stats->cpu = stats_clock(CLOCK_PROCESS_CPUTIME_ID);
+    return TRUE;
+}
+
+void stats_finish(RunStats *stats)
+{
+    stats->wall = stats_clock(CLOCK_MONOTONIC) - stats->wall;
+    stats->cpu = stats_clock(CLOCK_PROCESS_CPUTIME_ID) - stats->cpu;
+}
+
+void stats_timer_start(StatsTimer *timer, FileStats *file)
+{
+    int counter;
+    timer->file = file;
+    if (file != NULL)
+    {
+        /* the counters only count the thread which opened them, so the stages of other threads (e.g. the writer's) are only timed */
+        timer->counting = stats_counters_open && pthread_equal(pthread_self(), stats_counters_thread);
+        for (counter = 0; counter < STATS_COUNTER_COUNT && timer->counting; ++counter)
+        {
+            if (!stats_counter_read(counter, &timer->counters[counter]))
+            {
+                timer->counters[counter].running = -1;
+            }
+        }
+        timer->wall = stats_clock(CLOCK_MONOTONIC);
+        timer->cpu = stats_clock(CLOCK_THREAD_CPUTIME_ID);
+    }
+}
+
+void stats_timer_stop(StatsTimer *timer, StatsStage stage)
+{
+    StageTime *time;
+    StatsCounterReading reading;
+    double count;
+    int counter;
+    if (timer->file == NULL)
+    {
+        return;
+    }
+    time = &timer->file->stages[stage];
+    time->wall += stats_clock(CLOCK_MONOTONIC) - timer->wall;
+    time->cpu += stats_clock(CLOCK_THREAD_CPUTIME_ID) - timer->cpu;
+    time->runs++;
+    if (!timer->counting)
+    {
+        return;
+    }
+    for (counter = 0; counter < STATS_COUNTER_COUNT; ++counter)
+    {
+        if (timer->counters[counter].running >= 0 && stats_counter_read(counter, &reading))
+        {
+            count = reading.value - timer->counters[counter].value;
+            /* scale the count up to the whole stage if the counter was multiplexed for part of it */
+            if (reading.running > timer->counters[counter].running && reading.running - timer->counters[counter].running <
+                                                                              reading.enabled - timer->counters[counter].enabled)
+            {
+                count *= (reading.enabled - timer->counters[counter].enabled) / (reading.running - timer->counters[counter].running);
+            }
+            time->counters[counter] += count;
+        }
+    }
+    time->counted_runs++;
+}
+
+/* Sum the statistics of all the files of a run into total */
+void stats_total(RunStats *stats, FileStats *total)
+{
+    int i, stage, counter;
+    FileStats *file;
+    total->name = "total";
+    total->assemblies = total->cache_hits = total->lines = total->bytes = total->words = total->symbols = 0;
+    for (stage = 0; stage < STATS_STAGE_COUNT; ++stage)
+    {
+        total->stages[stage].wall = total->stages[stage].cpu = 0;
+        total->stages[stage].runs = total->stages[stage].counted_runs = 0;
+        for (counter = 0; counter < STATS_COUNTER_COUNT; ++counter)
+        {
+            total->stages[stage].counters[counter] = 0;
+        }
+    }
+    for (i = 0; i < stats->file_count; ++i)
+    {
+        file = &stats->files[i];
+        total->assemblies += file->assemblies;
+        total->cache_hits += file->cache_hits;
+        total->lines += file->lines;
+        total->bytes += file->bytes;
+        total->words += file->words;
+        total->symbols += file->symbols;
+        for (stage = 0; stage < STATS_STAGE_COUNT; ++stage)
+        {
+            total->stages[stage].wall += file->stages[stage].wall;
+            total->stages[stage].cpu += file->stages[stage].cpu;
+            total->stages[stage].runs += file->stages[stage].runs;
+            total->stages[stage].counted_runs += file->stages[stage].counted_runs;
+            for (counter = 0; counter < STATS_COUNTER_COUNT; ++counter)
+            {
+                total->stages[stage].counters[counter] += file->stages[stage].counters[counter];
+            }
+        }
+    }
+}
+
+/* Sum the wall time (or the CPU time) of all the stages of a file */
+double stats_file_time(FileStats *file, bool cpu)
+{
+    int stage;
+    double time = 0;
+    for (stage = 0; stage < STATS_STAGE_COUNT; ++stage)
+    {
+        time += cpu ? file->stages[stage].cpu : file->stages[stage].wall;
+    }
+    return time;
+}
+
+/* Divide an amount by a time in seconds. Returns 0 if no time passed */
+double stats_rate(unsigned long amount, double seconds)
+{
+    return seconds > 0 ? amount / seconds : 0;
+}
+
+/* Divide a count by an amount. Returns 0 if the amount is 0 */
+double stats_ratio(double count, double amount)
+{
+    return amount > 0 ? count / amount : 0;
+}
+
+/* Print a per line rate of a hardware counter of a stage (or n/a if the counter is unavailable), followed by suffix */
+void stats_print_counter_per_line(FILE *out, StageTime *time, StatsCounter counter, unsigned long lines, const char *suffix)
+{
+    if (stats_counter_fds[counter] < 0)
+    {
+        fprintf(out, "n/a %s", suffix);
+    }
+    else
+    {
+        fprintf(out, "%.3f %s", stats_ratio(time->counters[counter], lines), suffix);
+    }
+}
+
+/* Print the hardware counters of a stage of a file (instructions per cycle, and the misses per line) */
+void stats_print_counters(FILE *out, char *kind, FileStats *file, StatsStage stage)
+{
+    StageTime *time = &file->stages[stage];
+    fprintf(out, "stats %s%s %s counters: ", kind, file->name, stats_stage_names[stage]);
+    if (stats_counter_fds[STATS_COUNTER_CYCLES] < 0 || stats_counter_fds[STATS_COUNTER_INSTRUCTIONS] < 0)
+    {
+        fprintf(out, "n/a IPC, ");
+    }
+    else
+    {
+        fprintf(out, "%.0f cycles, %.0f instructions, %.2f IPC, ", time->counters[STATS_COUNTER_CYCLES], time->counters[STATS_COUNTER_INSTRUCTIONS],
+                stats_ratio(time->counters[STATS_COUNTER_INSTRUCTIONS], time->counters[STATS_COUNTER_CYCLES]));
+    }
+    stats_print_counter_per_line(out, time, STATS_COUNTER_BRANCH_MISSES, file->lines, "branch misses/line, ");
+    stats_print_counter_per_line(out, time, STATS_COUNTER_L1D_MISSES, file->lines, "L1D misses/line, ");
+    stats_print_counter_per_line(out, time, STATS_COUNTER_LLC_MISSES, file->lines, "LLC misses/line\n");
+}
+
+/* Print the statistics of a file (or of the total, in which case wall and cpu are those of the whole run).
+   kind and the file's name are printed after "stats " at the start of each line */
+void stats_print_file(FILE *out, char *kind, FileStats *file, double wall, double cpu)
+{
+    int stage;
+    StageTime *time;
+    fprintf(out, "stats %s%s: %.3f ms wall, %.3f ms cpu, %lu assemblies, %lu cache hits, %lu lines, %lu bytes, %lu words, %lu symbols\n",
+            kind, file->name, wall * 1e3, cpu * 1e3, file->assemblies, file->cache_hits, file->lines, file->bytes, file->words, file->symbols);
+    fprintf(out, "stats %s%s throughput: %.0f lines/s, %.0f bytes/s, %.0f words/s, %.0f symbols/s\n", kind, file->name,
+            stats_rate(file->lines, wall), stats_rate(file->bytes, wall), stats_rate(file->words, wall), stats_rate(file->symbols, wall));
+    for (stage = 0; stage < STATS_STAGE_COUNT; ++stage)
+    {
+        time = &file->stages[stage];
+        if (time->runs > 0)
+        {
+            fprintf(out, "stats %s%s %s: %.3f ms wall, %.3f ms cpu, %lu runs\n", kind, file->name, stats_stage_names[stage], time->wall * 1e3,
+                    time->cpu * 1e3, time->runs);
+        }
+        if (time->counted_runs > 0)
+        {
+            stats_print_counters(out, kind, file, stage);
+        }
+    }
+}
+
+void stats_print(RunStats *stats, FILE *out)
+{
+    int i;
+    FileStats total;
+    if (stats_counters_reason[0] != 0)
+    {
+        fprintf(out, "stats counters: %s (%s)\n", stats_counters_open ? "partially available" : "unavailable", stats_counters_reason);
+    }
+    for (i = 0; i < stats->file_count; ++i)
+    {
+        stats_print_file(out, "file ", &stats->files[i], stats_file_time(&stats->files[i], FALSE), stats_file_time(&stats->files[i], TRUE));
+    }
+    stats_total(stats, &total);
+    stats_print_file(out, "", &total, stats->wall, stats->cpu);
+}
+
+/* Write the hardware counters of a stage as a JSON field (null for the unavailable ones), along with the instructions per cycle
+   and the per line rates of the counters */
+void stats_write_json_counters(FILE *out, StageTime *time, unsigned long lines)
+{
+    int counter;
+    fprintf(out, ", \"counters\": {");
+    for (counter = 0; counter < STATS_COUNTER_COUNT; ++counter)
+    {
+        fprintf(out, stats_counter_fds[counter] < 0 ? "\"%s\": null, " : "\"%s\": %.0f, ", stats_counter_names[counter], time->counters[counter]);
+    }
+    if (stats_counter_fds[STATS_COUNTER_CYCLES] < 0 || stats_counter_fds[STATS_COUNTER_INSTRUCTIONS] < 0)
+    {
+        fprintf(out, "\"ipc\": null");
+    }
+    else
+    {
+        fprintf(out, "\"ipc\": %.3f",
+                stats_ratio(time->counters[STATS_COUNTER_INSTRUCTIONS], time->counters[STATS_COUNTER_CYCLES]));
+    }
+    for (counter = STATS_COUNTER_BRANCH_MISSES; counter < STATS_COUNTER_COUNT; ++counter)
+    {
+        fprintf(out, stats_counter_fds[counter] < 0 ? ", \"%s_per_line\": null" : ", \"%s_per_line\": %.6f", stats_counter_names[counter],
+                stats_ratio(time->counters[counter], lines));
+    }
+    fprintf(out, "}");
+}
+
+/* Write the fields of the statistics of a file (or of the total, in which case wall and cpu are those of the whole run) as JSON,
+   indented by indent spaces */
+void stats_write_json_fields(FILE *out, FileStats *file, double wall, double cpu, int indent)
+{
+    int stage;
+    StageTime *time;
+    fprintf(out, "%*s\"wall_seconds\": %.9f,\n%*s\"cpu_seconds\": %.9f,\n", indent, "", wall, indent, "", cpu);
+    fprintf(out, "%*s\"assemblies\": %lu, \"cache_hits\": %lu, \"lines\": %lu, \"bytes\": %lu, \"words\": %lu, \"symbols\": %lu,\n", indent, "",
+            file->assemblies, file->cache_hits, file->lines, file->bytes, file->words, file->symbols);
+    fprintf(out, "%*s\"throughput\": {\"lines_per_second\": %.1f, \"bytes_per_second\": %.1f, \"words_per_second\": %.1f, ", indent, "",
+            stats_rate(file->lines, wall), stats_rate(file->bytes, wall), stats_rate(file->words, wall));
+    fprintf(out, "\"symbols_per_second\": %.1f},\n%*s\"stages\": {\n", stats_rate(file->symbols, wall), indent, "");
+    for (stage = 0; stage < STATS_STAGE_COUNT; ++stage)
+    {
+        time = &file->stages[stage];
+        fprintf(out, "%*s  \"%s\": {\"wall_seconds\": %.9f, \"cpu_seconds\": %.9f, \"runs\": %lu, \"counted_runs\": %lu", indent, "",
+                stats_stage_names[stage], time->wall, time->cpu, time->runs, time->counted_runs);
+        if (time->counted_runs > 0)
+        {
+            stats_write_json_counters(out, time, file->lines);
+        }
+        fprintf(out, "}%s\n", stage + 1 < STATS_STAGE_COUNT ? "," : "");
+    }
+    fprintf(out, "%*s}", indent, "");
+}
+
+void stats_write_json(RunStats *stats, FILE *out)
+{
+    int i;
+    FileStats total;
+    stats_total(stats, &total);
+    fprintf(out, "{\n  \"counters_available\": %s,\n", stats_counters_open ? "true" : "false");
+    stats_write_json_fields(out, &total, stats->wall, stats->cpu, 2);
+    fprintf(out, ",\n  \"files\": [\n");
+    for (i = 0; i < stats->file_count; ++i)
+    {
+        fprintf(out, "    {\n      \"name\": ");
+        write_json_string(out, stats->files[i].name);
+        fprintf(out, ",\n");
+        stats_write_json_fields(out, &stats->files[i], stats_file_time(&stats->files[i], FALSE), stats_file_time(&stats->files[i], TRUE), 6);
+        fprintf(out, "\n    }%s\n", i + 1 < stats->file_count ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+}
+
+void stats_free(RunStats *stats)
+{
+    free(stats->files);
+    stats->files = NULL;
+    stats_counters_close();
+}
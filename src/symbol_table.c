@@ -2,10 +2,11 @@
 #include "symbol_table.h"
 
 VECTOR_IMPL(Symbol, SymbolVector, symbol)
+VECTOR_IMPL(SymbolReference, SymbolReferenceVector, symbol_ref)
 
-bool symbol_table_init(SymbolTable *symbol_table)
+bool symbol_table_init(SymbolTable *symbol_table, Arena *arena)
 {
-    symbol_table->inner = symbol_vec_create();
+    symbol_table->inner = symbol_vec_create_in(arena);
     if (symbol_table->inner == NULL)
     {
         return FALSE;
@@ -13,19 +14,6 @@ bool symbol_table_init(SymbolTable *symbol_table)
     return TRUE;
 }
 
-void symbol_table_free(SymbolTable symbol_table)
-{
-    uint32 i;
-    /* first we free each name inside the symbol table */
-    for (i = 0; i < symbol_table.inner->len; ++i)
-    {
-        Symbol symbol = symbol_vec_get(symbol_table.inner, i);
-        free(symbol.name);
-    }
-
-    symbol_vec_free(symbol_table.inner);
-}
-
 /* Searches the SymbolTable via a simple linear search */
 Symbol *symbol_table_search(SymbolTable symbol_table, char *symbol_name)
 {
@@ -46,7 +34,7 @@ Symbol *symbol_table_search(SymbolTable symbol_table, char *symbol_name)
 bool symbol_table_insert(SymbolTable symbol_table, const char *symbol_name, uint32 addr, SymbolContext ctx, int line_num)
 {
     Symbol symbol;
-    symbol.name = strdup(symbol_name);
+    symbol.name = arena_strdup(symbol_table.inner->arena, symbol_name);
     if (symbol.name == NULL)
     {
         return FALSE;
@@ -57,6 +45,38 @@ bool symbol_table_insert(SymbolTable symbol_table, const char *symbol_name, uint
     return symbol_vec_push(symbol_table.inner, symbol);
 }
 
+uint32 symbol_table_id(SymbolTable symbol_table, Symbol *symbol)
+{
+    return (uint32)(symbol - symbol_table.inner->array);
+}
+
+Symbol *symbol_table_get(SymbolTable symbol_table, uint32 symbol_id)
+{
+    return symbol_vec_get_ptr(symbol_table.inner, symbol_id);
+}
+
+bool symbol_set_init(SymbolSet *set, SymbolTable symbol_table, Arena *arena)
+{
+    set->size = symbol_table.inner->len;
+    /* allocate at least a byte so that an empty set is not mistaken for an allocation failure */
+    if ((set->members = arena_alloc(arena, set->size + 1)) == NULL)
+    {
+        return FALSE;
+    }
+    memset(set->members, FALSE, set->size);
+    return TRUE;
+}
+
+bool symbol_set_insert(SymbolSet *set, uint32 symbol_id)
+{
+    if (set->members[symbol_id])
+    {
+        return FALSE;
+    }
+    set->members[symbol_id] = TRUE;
+    return TRUE;
+}
+
 SymbolTableIterator symbol_table_iter(SymbolTable symbol_table)
 {
     SymbolTableIterator iter;
@@ -0,0 +1,235 @@
+/* we need POSIX for clock_gettime and getpid */
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "trace.h"
+#include "utils.h"
+
+/* The capacity a thread's buffer starts with (it doubles whenever it's full) */
+#define TRACE_INITIAL_CAPACITY 256
+
+/* A single event of the timeline */
+typedef struct
+{
+    /* the category and the name of the span, and its file (or NULL). NULL for an end event */
+    const char *category;
+    const char *name;
+    const char *file;
+    /* the time of the event in microseconds since tracing was enabled */
+    double timestamp;
+} TraceEvent;
+
+/* The events one thread recorded. Only the thread which owns it writes into it */
+typedef struct TraceBuffer
+{
+    /* the events, in the order they were recorded. The array is not accounted by memstats.h, so that tracing doesn't skew the accounting */
+    TraceEvent *events;
+    unsigned long len;
+    unsigned long capacity;
+    /* the amount of events which were dropped because the buffer could not grow */
+    unsigned long dropped;
+    /* the id of the thread in the timeline */
+    int tid;
+    /* the name of the thread, or NULL if it wasn't named */
+    const char *thread_name;
+    /* the next registered buffer */
+    struct TraceBuffer *next;
+} TraceBuffer;
+
+/* Whether or not tracing is enabled. Only set before other threads are started, so it is read without the lock */
+bool trace_enabled = FALSE;
+
+/* The wall time tracing was enabled at, in microseconds */
+double trace_start;
+
+/* The buffer of each thread */
+pthread_key_t trace_buffer_key;
+
+/* protects the list of buffers and the counters below */
+pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+TraceBuffer *trace_buffers = NULL;
+/* the amount of buffers registered so far */
+int trace_thread_count = 0;
+/* the amount of threads whose buffer could not be allocated, whose events are lost */
+unsigned long trace_lost_threads = 0;
+
+/* Read the wall time in microseconds */
+double trace_now()
+{
+    struct timespec now;
+    if (clock_gettime(CLOCK_MONOTONIC, &now) != 0)
+    {
+        return 0;
+    }
+    return now.tv_sec * 1e6 + now.tv_nsec / 1e3;
+}
+
+bool trace_enable()
+{
+    if (pthread_key_create(&trace_buffer_key, NULL) != 0)
+    {
+        return FALSE;
+    }
+    trace_start = trace_now();
+    trace_enabled = TRUE;
+    return TRUE;
+}
+
+/* Get the buffer of the calling thread, registering it on the thread's first event. Returns NULL if it could not be allocated */
+TraceBuffer *trace_thread_buffer()
+{
+    TraceBuffer *buffer = pthread_getspecific(trace_buffer_key);
+    if (buffer != NULL)
+    {
+        return buffer;
+    }
+    buffer = calloc(1, sizeof(TraceBuffer));
+    pthread_mutex_lock(&trace_lock);
+    if (buffer == NULL || pthread_setspecific(trace_buffer_key, buffer) != 0)
+    {
+        free(buffer);
+        buffer = NULL;
+        trace_lost_threads++;
+    }
+    else
+    {
+        /* ids start from 1, in the order the threads first recorded an event */
+        buffer->tid = ++trace_thread_count;
+        buffer->next = trace_buffers;
+        trace_buffers = buffer;
+    }
+    pthread_mutex_unlock(&trace_lock);
+    return buffer;
+}
+
+/* Record an event into the calling thread's buffer */
+void trace_record(const char *category, const char *name, const char *file)
+{
+    TraceBuffer *buffer = trace_thread_buffer();
+    TraceEvent *new_events;
+    unsigned long new_capacity;
+    if (buffer == NULL)
+    {
+        return;
+    }
+    if (buffer->len == buffer->capacity)
+    {
+        new_capacity = buffer->capacity == 0 ? TRACE_INITIAL_CAPACITY : buffer->capacity * 2;
+        if ((new_events = realloc(buffer->events, new_capacity * sizeof(TraceEvent))) == NULL)
+        {
+            buffer->dropped++;
+            return;
+        }
+        buffer->events = new_events;
+        buffer->capacity = new_capacity;
+    }
+    buffer->events[buffer->len].category = category;
+    buffer->events[buffer->len].name = name;
+    buffer->events[buffer->len].file = file;
+    buffer->events[buffer->len].timestamp = trace_now() - trace_start;
+    buffer->len++;
+}
+
+void trace_set_thread_name(const char *name)
+{
+    TraceBuffer *buffer;
+    if (trace_enabled && (buffer = trace_thread_buffer()) != NULL)
+    {
+        buffer->thread_name = name;
+    }
+}
+
+void trace_begin(const char *category, const char *name, const char *file)
+{
+    if (trace_enabled)
+    {
+        trace_record(category, name, file);
+    }
+}
+
+void trace_end()
+{
+    if (trace_enabled)
+    {
+        trace_record(NULL, NULL, NULL);
+    }
+}
+
+/* Write the events of a buffer into the traceEvents array (after the events which were already written into it) */
+void trace_write_buffer(FILE *out, TraceBuffer *buffer, long pid)
+{
+    unsigned long i;
+    TraceEvent *event;
+    if (buffer->thread_name != NULL)
+    {
+        fprintf(out, ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": %ld, \"tid\": %d, \"args\": {\"name\": ", pid, buffer->tid);
+        write_json_string(out, buffer->thread_name);
+        fprintf(out, "}}");
+    }
+    for (i = 0; i < buffer->len; ++i)
+    {
+        event = &buffer->events[i];
+        fprintf(out, ",\n{");
+        if (event->name != NULL)
+        {
+            fprintf(out, "\"name\": ");
+            write_json_string(out, event->name);
+            fprintf(out, ", \"cat\": \"%s\", \"ph\": \"B\", ", event->category);
+        }
+        else
+        {
+            fprintf(out, "\"ph\": \"E\", ");
+        }
+        fprintf(out, "\"ts\": %.3f, \"pid\": %ld, \"tid\": %d", event->timestamp, pid, buffer->tid);
+        if (event->file != NULL)
+        {
+            fprintf(out, ", \"args\": {\"file\": ");
+            write_json_string(out, event->file);
+            fprintf(out, "}");
+        }
+        fprintf(out, "}");
+    }
+}
+
+bool trace_write(const char *path)
+{
+    FILE *out = fopen(path, "w");
+    TraceBuffer *buffer;
+    long pid = (long)getpid();
+    unsigned long dropped;
+    bool success;
+    if (out == NULL)
+    {
+        return FALSE;
+    }
+    pthread_mutex_lock(&trace_lock);
+    fprintf(out, "{\"traceEvents\": [\n{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": %ld, \"tid\": 0, \"args\": {\"name\": \"assembler\"}}", pid);
+    dropped = 0;
+    for (buffer = trace_buffers; buffer != NULL; buffer = buffer->next)
+    {
+        trace_write_buffer(out, buffer, pid);
+        dropped += buffer->dropped;
+    }
+    fprintf(out, "\n],\n\"displayTimeUnit\": \"ms\",\n\"otherData\": {\"dropped_events\": %lu, \"lost_threads\": %lu}}\n", dropped,
+            trace_lost_threads);
+    pthread_mutex_unlock(&trace_lock);
+    success = !ferror(out);
+    return fclose(out) == 0 && success;
+}
+
+void trace_free()
+{
+    TraceBuffer *next;
+    pthread_mutex_lock(&trace_lock);
+    while (trace_buffers != NULL)
+    {
+        next = trace_buffers->next;
+        free(trace_buffers->events);
+        free(trace_buffers);
+        trace_buffers = next;
+    }
+    pthread_mutex_unlock(&trace_lock);
+}
@@ -1,17 +1,18 @@
-#include <ctype.h>
 #include <stdlib.h>
 #include <string.h>
+#include "utils.h"
+#include "char_class.h"
 
 char *skip_space(char *str)
 {
-    while (isspace((unsigned char)*str))
+    while (CHAR_IS_SPACE(*str))
     {
         str++;
     }
     return str;
 }
 
-/* Removes any trailing whitespaces (as defined in isspace) of the string. */
+/* Removes any trailing whitespaces (see CHAR_CLASS_SPACE) of the string. */
 char *trim_end(char *str)
 {
     char *str_start = str;
@@ -27,7 +28,7 @@ char *trim_end(char *str)
     }
     /* this is safe since we're at the null terminator of the string and it cannot be empty */
     str--;
-    while (str >= str_start && isspace((unsigned char)*str))
+    while (str >= str_start && CHAR_IS_SPACE(*str))
     {
         str--;
     }
@@ -53,4 +54,123 @@ char *strdup(const char *str)
     memcpy(out, str, len);
     out[len] = 0;
     return out;
-}
\ No newline at end of file
+}
+
+bool write_u32_le(FILE *file, uint32 value)
+{
+    unsigned char bytes[4];
+    bytes[0] = value & 0xff;
+    bytes[1] = (value >> 8) & 0xff;
+    bytes[2] = (value >> 16) & 0xff;
+    bytes[3] = (value >> 24) & 0xff;
+    return fwrite(bytes, 1, sizeof(bytes), file) == sizeof(bytes);
+}
+
+bool read_u32_le(FILE *file, uint32 *value)
+{
+    unsigned char bytes[4];
+    if (fread(bytes, 1, sizeof(bytes), file) != sizeof(bytes))
+    {
+        return FALSE;
+    }
+    *value = (uint32)bytes[0] | ((uint32)bytes[1] << 8) | ((uint32)bytes[2] << 16) | ((uint32)bytes[3] << 24);
+    return TRUE;
+}
+
+char *read_line_at(FILE *file, long offset, char *buf, int size)
+{
+    long position = ftell(file);
+    if (position < 0 || fseek(file, offset, SEEK_SET) != 0 || fgets(buf, size, file) == NULL)
+    {
+        *buf = 0;
+    }
+    if (position >= 0)
+    {
+        fseek(file, position, SEEK_SET);
+    }
+    return buf;
+}
+
+long next_line_offset(FILE *file, long offset, const char *line, size_t length)
+{
+    /* a line which was read up to its newline ends exactly after its characters. Otherwise (the last line of the file,
+       a line which was longer than the buffer or a line with a null character in it) we ask the file where we are */
+    if (length > 0 && line[length - 1] == '\n')
+    {
+        return offset + (long)length;
+    }
+    return ftell(file);
+}
+
+int utf8_sequence_length(const char *str)
+{
+    const unsigned char *bytes = (const unsigned char *)str;
+    unsigned char second_min = 0x80, second_max = 0xbf; /* the range of the second byte, which rules out overlong forms, surrogates and code points past U+10FFFF */
+    int length, i;
+    if (bytes[0] < 0x80)
+    {
+        return 1;
+    }
+    if (bytes[0] >= 0xc2 && bytes[0] <= 0xdf)
+    {
+        length = 2;
+    }
+    else if (bytes[0] >= 0xe0 && bytes[0] <= 0xef)
+    {
+        length = 3;
+        second_min = bytes[0] == 0xe0 ? 0xa0 : second_min;
+        second_max = bytes[0] == 0xed ? 0x9f : second_max;
+    }
+    else if (bytes[0] >= 0xf0 && bytes[0] <= 0xf4)
+    {
+        length = 4;
+        second_min = bytes[0] == 0xf0 ? 0x90 : second_min;
+        second_max = bytes[0] == 0xf4 ? 0x8f : second_max;
+    }
+    else
+    {
+        return 0;
+    }
+    /* a null terminator is never in range, so we never read past the end of the string */
+    if (bytes[1] < second_min || bytes[1] > second_max)
+    {
+        return 0;
+    }
+    for (i = 2; i < length; ++i)
+    {
+        if (bytes[i] < 0x80 || bytes[i] > 0xbf)
+        {
+            return 0;
+        }
+    }
+    return length;
+}
+
+void write_json_string(FILE *file, const char *str)
+{
+    int sequence_length;
+    fputc('"', file);
+    for (; *str != 0; ++str)
+    {
+        if (*str == '"' || *str == '\\')
+        {
+            fprintf(file, "\\%c", *str);
+        }
+        else if ((unsigned char)*str >= 0x80 && (sequence_length = utf8_sequence_length(str)) != 0)
+        {
+            /* a valid UTF-8 sequence is written as is */
+            fwrite(str, 1, sequence_length, file);
+            str += sequence_length - 1;
+        }
+        else if ((unsigned char)*str < ' ' || (unsigned char)*str >= 0x80)
+        {
+            /* control characters, and bytes which are not valid UTF-8 (as the code point of the same value, so that the output stays valid JSON) */
+            fprintf(file, "\\u%04x", (unsigned char)*str);
+        }
+        else
+        {
+            fputc(*str, file);
+        }
+    }
+    fputc('"', file);
+}
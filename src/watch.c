@@ -0,0 +1,169 @@
+/* we need POSIX for poll and pipes */
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <sys/inotify.h>
+#include "watch.h"
+
+/* The events which mean a file has a new version: it was written and closed, or another file was renamed over it */
+#define WATCH_EVENTS (IN_CLOSE_WRITE | IN_MOVED_TO)
+
+/* The size of the buffer we read events into. Big enough for many events, since every event has a name of at most NAME_MAX characters */
+#define EVENT_BUFFER_SIZE 4096
+
+bool watcher_init(Watcher *watcher, char **filename_bases, int file_count)
+{
+    int i;
+    char *dir, *name;
+    size_t dir_len;
+    watcher->file_count = 0;
+    watcher->files = NULL;
+    watcher->interrupt_fds[0] = watcher->interrupt_fds[1] = -1;
+    /* the write end never blocks, so that interrupting from a signal handler can't hang (a full pipe interrupts anyway) */
+    if ((watcher->fd = inotify_init()) < 0 || pipe(watcher->interrupt_fds) != 0 ||
+        fcntl(watcher->interrupt_fds[1], F_SETFL, fcntl(watcher->interrupt_fds[1], F_GETFL) | O_NONBLOCK) != 0 ||
+        (watcher->files = malloc(file_count * sizeof(WatchedFile))) == NULL)
+    {
+        watcher_free(watcher);
+        return FALSE;
+    }
+    for (i = 0; i < file_count; ++i)
+    {
+        /* split "dir/name" into the directory and the name of the .as file inside it */
+        name = strrchr(filename_bases[i], '/');
+        name = name == NULL ? filename_bases[i] : name + 1;
+        dir_len = name - filename_bases[i];
+        /* +4 for ".as" and null termination, +2 for "." and null termination */
+        watcher->files[i].name = malloc(strlen(name) + 4);
+        if (watcher->files[i].name == NULL || (dir = malloc(dir_len + 2)) == NULL)
+        {
+            free(watcher->files[i].name);
+            watcher_free(watcher);
+            return FALSE;
+        }
+        watcher->file_count++;
+        sprintf(watcher->files[i].name, "%s.as", name);
+        if (dir_len == 0)
+        {
+            strcpy(dir, ".");
+        }
+        else
+        {
+            /* keep the '/' only when the directory is the root */
+            dir_len = dir_len == 1 ? 1 : dir_len - 1;
+            memcpy(dir, filename_bases[i], dir_len);
+            dir[dir_len] = 0;
+        }
+        /* watching the same directory again returns the same descriptor */
+        watcher->files[i].watch_descriptor = inotify_add_watch(watcher->fd, dir, WATCH_EVENTS);
+        free(dir);
+        if (watcher->files[i].watch_descriptor < 0)
+        {
+            watcher_free(watcher);
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+/* Read the pending events and mark the files they are about. Returns TRUE if successful, FALSE otherwise */
+bool read_watch_events(Watcher *watcher, bool *changed)
+{
+    /* the union aligns the buffer for struct inotify_event */
+    union
+    {
+        struct inotify_event event;
+        char bytes[EVENT_BUFFER_SIZE];
+    } buf;
+    struct inotify_event *event;
+    ssize_t len;
+    char *position;
+    int i;
+
+    if ((len = read(watcher->fd, buf.bytes, sizeof(buf.bytes))) <= 0)
+    {
+        return FALSE;
+    }
+    for (position = buf.bytes; position < buf.bytes + len; position += sizeof(struct inotify_event) + event->len)
+    {
+        event = (struct inotify_event *)position;
+        for (i = 0; i < watcher->file_count && event->len > 0; ++i)
+        {
+            if (watcher->files[i].watch_descriptor == event->wd && strcmp(watcher->files[i].name, event->name) == 0)
+            {
+                changed[i] = TRUE;
+            }
+        }
+    }
+    return TRUE;
+}
+
+bool watcher_wait(Watcher *watcher, bool *changed)
+{
+    struct pollfd poll_fds[2]; /* the inotify file descriptor and the read end of the interrupt pipe */
+    int i, ready;
+    bool has_changes = FALSE;
+
+    for (i = 0; i < watcher->file_count; ++i)
+    {
+        changed[i] = FALSE;
+    }
+    poll_fds[0].fd = watcher->fd;
+    poll_fds[0].events = POLLIN;
+    poll_fds[1].fd = watcher->interrupt_fds[0];
+    poll_fds[1].events = POLLIN;
+    /* wait for the first change without a timeout, and then for the burst to end */
+    while ((ready = poll(poll_fds, 2, has_changes ? WATCH_DEBOUNCE_MS : -1)) > 0)
+    {
+        /* the pipe is never drained, so that every later wait is interrupted too */
+        if (poll_fds[1].revents != 0)
+        {
+            return FALSE;
+        }
+        if (!read_watch_events(watcher, changed))
+        {
+            return FALSE;
+        }
+        for (i = 0; i < watcher->file_count; ++i)
+        {
+            has_changes = has_changes || changed[i];
+        }
+    }
+    /* a timeout means the burst is over, anything else means poll was interrupted or failed */
+    return ready == 0 && has_changes;
+}
+
+void watcher_interrupt(Watcher *watcher)
+{
+    char byte = 0;
+    /* write is async-signal-safe. If it fails the pipe is full, which interrupts the wait all the same */
+    if (write(watcher->interrupt_fds[1], &byte, 1) < 0)
+    {
+        return;
+    }
+}
+
+void watcher_free(Watcher *watcher)
+{
+    int i;
+    for (i = 0; i < watcher->file_count; ++i)
+    {
+        free(watcher->files[i].name);
+    }
+    if (watcher->fd >= 0)
+    {
+        /* closing the inotify file descriptor removes all of its watches */
+        close(watcher->fd);
+    }
+    for (i = 0; i < 2; ++i)
+    {
+        if (watcher->interrupt_fds[i] >= 0)
+        {
+            close(watcher->interrupt_fds[i]);
+        }
+    }
+    free(watcher->files);
+}
@@ -0,0 +1,337 @@
+#include <string.h>
+#include <stdlib.h>
+#include "writer.h"
+#include "output.h"
+#include "memstats.h"
+#include "trace.h"
+
+/* Get the stage of writing an artifact of some type (see stats.h) */
+StatsStage artifact_write_stage(ArtifactType type)
+{
+    switch (type)
+    {
+    case ARTIFACT_OB:
+    {
+        return STATS_STAGE_WRITE_OB;
+    }
+    case ARTIFACT_ENT:
+    {
+        return STATS_STAGE_WRITE_ENT;
+    }
+    case ARTIFACT_EXT:
+    {
+        return STATS_STAGE_WRITE_EXT;
+    }
+    default:
+    {
+        return STATS_STAGE_WRITE_AM;
+    }
+    }
+}
+
+/* Write an artifact of a file which assembled successfully. If container is NULL, the artifact is written into its own file
+   (with the name filename_base + the artifact's extension), otherwise it is appended to the container.
+   filename is a buffer which is big enough to hold filename_base with any extension.
+   returns TRUE if it successfully wrote the artifact, FALSE otherwise */
+bool write_artifact_to_target(Container *container, char *filename_base, char *filename, ArtifactType type, SecondPassResult *second_pass_result)
+{
+    FILE *file;
+    long bytes_written;
+    if (container != NULL)
+    {
+        bytes_written = write_artifact(container_begin_artifact(container), type, second_pass_result);
+        return container_end_artifact(container, filename_base, type, bytes_written);
+    }
+
+    if ((file = fopen(filename, "w")) == NULL)
+    {
+        return FALSE;
+    }
+    bytes_written = write_artifact(file, type, second_pass_result);
+    if (fclose(file) != 0)
+    {
+        return FALSE;
+    }
+    return bytes_written >= 0;
+}
+
+/* Copy all the artifacts of a file out of a cache entry. If container is NULL, each artifact is written into its own file,
+   otherwise it is appended to the container. filename is a buffer which is big enough to hold filename_base with any extension.
+   If stats is not NULL, the time of each write is added to it. */
+void write_cached_entry(ArtifactWriter *writer, char *filename_base, char *filename, Container *cached_entry, FileStats *stats)
+{
+    ArtifactType artifact_type;
+    ContainerEntry *entry;
+    FILE *file;
+    bool success;
+    StatsTimer timer;
+    for (artifact_type = ARTIFACT_AM; artifact_type <= ARTIFACT_EXT; ++artifact_type)
+    {
+        if ((entry = container_find(cached_entry, "", artifact_type)) == NULL)
+        {
+            continue;
+        }
+        sprintf(filename, "%s%s", filename_base, artifact_extension(artifact_type));
+        trace_begin(TRACE_CATEGORY_STAGE, stats_stage_name(artifact_write_stage(artifact_type)), filename_base);
+        stats_timer_start(&timer, stats);
+        if (writer->container != NULL)
+        {
+            success = container_read_artifact(cached_entry, entry, container_begin_artifact(writer->container));
+            if (!container_end_artifact(writer->container, filename_base, artifact_type, success ? (long)entry->length : -1))
+            {
+                printf("error: could not write %s into container %s\n", filename, writer->container_path);
+            }
+        }
+        else if ((file = fopen(filename, "w")) == NULL)
+        {
+            printf("error: could not open file %s for writing\n", filename);
+        }
+        else
+        {
+            success = container_read_artifact(cached_entry, entry, file);
+            if (fclose(file) != 0 || !success)
+            {
+                printf("error: could not write file %s\n", filename);
+            }
+        }
+        stats_timer_stop(&timer, artifact_write_stage(artifact_type));
+        trace_end();
+    }
+}
+
+/* Write all the artifacts of a single job and release the job's resources (see write_job). */
+void write_job_artifacts(ArtifactWriter *writer, WriteJob *job)
+{
+    ArtifactType artifact_type;
+    StatsTimer timer;
+    bool success;
+    /* +1 for null termination */
+    char *filename = malloc(strlen(job->filename_base) + MAX_ARTIFACT_EXTENSION_LENGTH + 1);
+    if (filename == NULL)
+    {
+        printf("error: could not write the files of %s due to an allocation failure\n", job->filename_base);
+    }
+
+    if (job->cached_entry != NULL)
+    {
+        if (filename != NULL)
+        {
+            write_cached_entry(writer, job->filename_base, filename, job->cached_entry, job->stats);
+        }
+        cache_entry_free(job->cached_entry);
+        free(filename);
+        return;
+    }
+
+    if (job->am_file != NULL)
+    {
+        trace_begin(TRACE_CATEGORY_STAGE, stats_stage_name(STATS_STAGE_WRITE_AM), job->filename_base);
+        stats_timer_start(&timer, job->stats);
+        if (filename != NULL && !container_end_artifact(writer->container, job->filename_base, ARTIFACT_AM,
+                                                        write_stream_copy(job->am_file, container_begin_artifact(writer->container))))
+        {
+            printf("error: could not write %s.am into container %s\n", job->filename_base, writer->container_path);
+        }
+        fclose(job->am_file);
+        stats_timer_stop(&timer, STATS_STAGE_WRITE_AM);
+        trace_end();
+    }
+
+    if (job->has_result)
+    {
+        /* create the .ob, .ent and .ext files (each only if necessary) */
+        for (artifact_type = ARTIFACT_OB; artifact_type <= ARTIFACT_EXT && filename != NULL; ++artifact_type)
+        {
+            if (!artifact_is_necessary(artifact_type, &job->second_pass_result))
+            {
+                continue;
+            }
+            sprintf(filename, "%s%s", job->filename_base, artifact_extension(artifact_type));
+            trace_begin(TRACE_CATEGORY_STAGE, stats_stage_name(artifact_write_stage(artifact_type)), job->filename_base);
+            stats_timer_start(&timer, job->stats);
+            success = write_artifact_to_target(writer->container, job->filename_base, filename, artifact_type, &job->second_pass_result);
+            stats_timer_stop(&timer, artifact_write_stage(artifact_type));
+            trace_end();
+            if (!success)
+            {
+                if (writer->container != NULL)
+                {
+                    printf("error: could not write %s into container %s\n", filename, writer->container_path);
+                }
+                else
+                {
+                    printf("error: could not open file %s for writing\n", filename);
+                }
+            }
+        }
+    }
+    if (job->arena != NULL)
+    {
+        writer_release_arena(writer, job->arena);
+    }
+    free(filename);
+}
+
+/* Write all the artifacts of a single job and release the job's resources. Its allocations are accounted as the output stage,
+   and it appears in the trace as a single span of the job's file (see trace.h) */
+void write_job(ArtifactWriter *writer, WriteJob *job)
+{
+    MemoryStage previous_stage = memory_stats_set_stage(MEMORY_STAGE_OUTPUT);
+    trace_begin(TRACE_CATEGORY_WRITE, job->filename_base, NULL);
+    write_job_artifacts(writer, job);
+    trace_end();
+    memory_stats_set_stage(previous_stage);
+}
+
+/* The background thread of an asynchronous writer: writes jobs from the queue until the writer is closing and the queue is empty */
+void *writer_thread(void *data)
+{
+    ArtifactWriter *writer = data;
+    WriteJob job;
+
+    trace_set_thread_name("writer");
+    pthread_mutex_lock(&writer->lock);
+    while (TRUE)
+    {
+        while (writer->queue_len == 0 && !writer->is_closing)
+        {
+            pthread_cond_wait(&writer->not_empty, &writer->lock);
+        }
+        if (writer->queue_len == 0)
+        {
+            /* we're closing and there is nothing left to write */
+            break;
+        }
+        job = writer->queue[writer->queue_start];
+        writer->queue_start = (writer->queue_start + 1) % WRITER_QUEUE_CAPACITY;
+        writer->queue_len--;
+        pthread_cond_signal(&writer->not_full);
+
+        /* the job is ours now - write it without holding the lock so that more jobs can be submitted meanwhile */
+        pthread_mutex_unlock(&writer->lock);
+        write_job(writer, &job);
+        pthread_mutex_lock(&writer->lock);
+    }
+    pthread_mutex_unlock(&writer->lock);
+    return NULL;
+}
+
+bool writer_init(ArtifactWriter *writer, Container *container, char *container_path, bool is_async)
+{
+    uint32 i;
+    writer->container = container;
+    writer->container_path = container_path;
+    writer->is_async = is_async;
+    writer->queue_start = 0;
+    writer->queue_len = 0;
+    writer->is_closing = FALSE;
+    /* the arenas only allocate memory once they're used, so a synchronous writer only ever allocates the blocks of one */
+    for (i = 0; i < WRITER_ARENA_COUNT; ++i)
+    {
+        arena_init(&writer->arenas[i]);
+        writer->free_arenas[i] = &writer->arenas[i];
+    }
+    writer->free_arena_count = WRITER_ARENA_COUNT;
+    if (!is_async)
+    {
+        return TRUE;
+    }
+
+    pthread_mutex_init(&writer->lock, NULL);
+    pthread_cond_init(&writer->not_empty, NULL);
+    pthread_cond_init(&writer->not_full, NULL);
+    pthread_cond_init(&writer->arena_released, NULL);
+    if (pthread_create(&writer->thread, NULL, writer_thread, writer) != 0)
+    {
+        pthread_mutex_destroy(&writer->lock);
+        pthread_cond_destroy(&writer->not_empty);
+        pthread_cond_destroy(&writer->not_full);
+        pthread_cond_destroy(&writer->arena_released);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+Arena *writer_acquire_arena(ArtifactWriter *writer)
+{
+    Arena *arena;
+    if (!writer->is_async)
+    {
+        return writer->free_arenas[--writer->free_arena_count];
+    }
+
+    pthread_mutex_lock(&writer->lock);
+    while (writer->free_arena_count == 0)
+    {
+        pthread_cond_wait(&writer->arena_released, &writer->lock);
+    }
+    arena = writer->free_arenas[--writer->free_arena_count];
+    pthread_mutex_unlock(&writer->lock);
+    return arena;
+}
+
+void writer_release_arena(ArtifactWriter *writer, Arena *arena)
+{
+    /* reset on the thread which is done with the arena, so that the thread which acquires it next doesn't have to */
+    arena_reset(arena);
+    if (!writer->is_async)
+    {
+        writer->free_arenas[writer->free_arena_count++] = arena;
+        return;
+    }
+
+    pthread_mutex_lock(&writer->lock);
+    writer->free_arenas[writer->free_arena_count++] = arena;
+    pthread_cond_signal(&writer->arena_released);
+    pthread_mutex_unlock(&writer->lock);
+}
+
+void writer_submit(ArtifactWriter *writer, WriteJob job)
+{
+    if (!writer->is_async)
+    {
+        write_job(writer, &job);
+        return;
+    }
+
+    pthread_mutex_lock(&writer->lock);
+    while (writer->queue_len == WRITER_QUEUE_CAPACITY)
+    {
+        pthread_cond_wait(&writer->not_full, &writer->lock);
+    }
+    writer->queue[(writer->queue_start + writer->queue_len) % WRITER_QUEUE_CAPACITY] = job;
+    writer->queue_len++;
+    pthread_cond_signal(&writer->not_empty);
+    pthread_mutex_unlock(&writer->lock);
+}
+
+/* Free the arenas of a writer */
+void free_writer_arenas(ArtifactWriter *writer)
+{
+    uint32 i;
+    for (i = 0; i < WRITER_ARENA_COUNT; ++i)
+    {
+        arena_free(&writer->arenas[i]);
+    }
+}
+
+void writer_close(ArtifactWriter *writer)
+{
+    if (!writer->is_async)
+    {
+        free_writer_arenas(writer);
+        return;
+    }
+
+    pthread_mutex_lock(&writer->lock);
+    writer->is_closing = TRUE;
+    pthread_cond_signal(&writer->not_empty);
+    pthread_mutex_unlock(&writer->lock);
+
+    pthread_join(writer->thread, NULL);
+    pthread_mutex_destroy(&writer->lock);
+    pthread_cond_destroy(&writer->not_empty);
+    pthread_cond_destroy(&writer->not_full);
+    pthread_cond_destroy(&writer->arena_released);
+    free_writer_arenas(writer);
+}
@@ -0,0 +1,78 @@
+#!/bin/sh
+# Checks that --incremental gives exactly the same result as a clean assembly.
+# Each of the example files is edited randomly over and over (lines are deleted, duplicated, swapped and new statements are inserted,
+# some of which add labels, .extern/.entry directives or errors). After each edit, the file is assembled with --incremental (reusing the
+# state of the previous version) and from scratch in another directory, and the output and every artifact of both are compared.
+# Once an edit leaves the file with errors (which drops the incremental state), the next edit starts over from the original file.
+# usage: tests/incremental_check.sh [iterations per file] [seed]   (run from the repository's root after make)
+ITERATIONS=${1:-200}
+SEED=${2:-1}
+ASSEMBLER=$(pwd)/assembler
+FILES="mmn14_example print_reverse_string sum_numbers first_pass_edge_cases"
+
+if [ ! -x "$ASSEMBLER" ]; then
+    echo "error: $ASSEMBLER not found, run make first"
+    exit 2
+fi
+WORK=$(mktemp -d) || exit 2
+trap 'rm -rf "$WORK"' EXIT
+failures=0
+incremental_runs=0
+
+for file in $FILES; do
+    rm -rf "$WORK/incremental" "$WORK/clean"
+    mkdir "$WORK/incremental" "$WORK/clean"
+    i=0
+    while [ $i -lt "$ITERATIONS" ]; do
+        if [ ! -e "$WORK/clean/$file.ob" ]; then
+            cp "tests/$file.as" "$WORK/incremental/$file.as"
+        else
+            incremental_runs=$((incremental_runs + 1))
+        fi
+        # edit the file which is assembled incrementally, the seed of each edit depends on the seed, the file and the iteration
+        awk -v seed="$SEED$i${#file}" '
+            { lines[n++] = $0 }
+            END {
+                srand(seed)
+                statements[0] = "mov #5, r3"; statements[1] = ".data 1,-2,3,4"; statements[2] = ".string \"abcdef\""
+                statements[3] = "ZZL" int(rand() * 3) ": jmp ZZL" int(rand() * 3); statements[4] = ".extern EXTZ" int(rand() * 3)
+                statements[5] = ".entry ZZL" int(rand() * 3); statements[6] = "lea EXTZ" int(rand() * 3) ", r1"
+                statements[7] = "jsr &ZZL" int(rand() * 3); statements[8] = "ZZD" int(rand() * 2) ": .data 7"
+                statements[9] = "prn ZZD" int(rand() * 2)
+                edits = 1 + int(rand() * 3)
+                for (e = 0; e < edits && n > 0; ++e) {
+                    kind = int(rand() * 4); at = int(rand() * n)
+                    if (kind == 0) { for (j = at; j < n - 1; ++j) lines[j] = lines[j + 1]; n-- }
+                    else if (kind == 1) { other = int(rand() * n); line = lines[at]; lines[at] = lines[other]; lines[other] = line }
+                    else {
+                        line = kind == 2 ? lines[at] : statements[int(rand() * 10)]
+                        for (j = n; j > at; --j) lines[j] = lines[j - 1]
+                        lines[at] = line; n++
+                    }
+                }
+                for (j = 0; j < n; ++j) print lines[j]
+            }' "$WORK/incremental/$file.as" > "$WORK/edited.as"
+        mv "$WORK/edited.as" "$WORK/incremental/$file.as"
+        cp "$WORK/incremental/$file.as" "$WORK/clean/$file.as"
+        rm -f "$WORK"/incremental/$file.am "$WORK"/incremental/$file.ob "$WORK"/incremental/$file.ent "$WORK"/incremental/$file.ext
+        rm -f "$WORK"/clean/$file.am "$WORK"/clean/$file.ob "$WORK"/clean/$file.ent "$WORK"/clean/$file.ext
+
+        (cd "$WORK/incremental" && "$ASSEMBLER" --incremental "$file" > stdout.txt 2>&1; echo "exit $?" >> stdout.txt)
+        (cd "$WORK/clean" && "$ASSEMBLER" "$file" > stdout.txt 2>&1; echo "exit $?" >> stdout.txt)
+        for artifact in stdout.txt $file.am $file.ob $file.ent $file.ext; do
+            if [ -e "$WORK/incremental/$artifact" ] || [ -e "$WORK/clean/$artifact" ]; then
+                if ! cmp -s "$WORK/incremental/$artifact" "$WORK/clean/$artifact"; then
+                    echo "FAIL: $file, iteration $i (seed $SEED): $artifact differs from a clean assembly"
+                    failures=$((failures + 1))
+                fi
+            fi
+        done
+        i=$((i + 1))
+    done
+done
+
+if [ $failures -ne 0 ]; then
+    echo "$failures differences found"
+    exit 1
+fi
+echo "incremental assembly matched clean assembly in $ITERATIONS edits of each file ($incremental_runs of them reused the state of a previous version)"
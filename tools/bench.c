@@ -0,0 +1,474 @@
+/* The benchmark driver of the assembler (see make bench).
+   It generates deterministic corpora of increasing size, runs each stage of the pipeline (expand_macros, first_pass, second_pass and the
+   output of the artifacts) and the whole pipeline end to end on each corpus several times, and writes the median, the 95th percentile and
+   the throughput of each into a JSON file. Everything runs in memory (on temporary files), so the disk is not measured.
+   usage: benchmark [--repetitions N] [--out results.json]
+          benchmark --compare base.json new.json [--threshold percent]
+   The compare mode reads two result files written by this driver and flags each stage whose median got slower by more than the threshold. */
+/* we need POSIX for clock_gettime */
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include "macros.h"
+#include "first_pass.h"
+#include "second_pass.h"
+#include "output.h"
+#include "workload.h"
+
+/* Exit code for when the user calls this binary in a wrong manner  */
+#define BAD_USAGE_EXIT_CODE 2
+
+/* Exit code for when a benchmark could not run or its results could not be read or written */
+#define BENCH_ERROR_EXIT_CODE 3
+
+/* Exit code for when the compare mode found a regression */
+#define BENCH_REGRESSION_EXIT_CODE 4
+
+/* The default amount of times each stage runs on each corpus */
+#define BENCH_DEFAULT_REPETITIONS 11
+
+/* The default threshold (in percent) a median has to get slower by to be flagged as a regression */
+#define BENCH_DEFAULT_THRESHOLD 10.0
+
+/* The biggest amount of results a result file may contain, and the biggest length of a corpus or a stage name in it */
+#define BENCH_MAX_RESULTS 64
+#define BENCH_MAX_NAME_LENGTH 31
+
+/* The biggest amount of labels a generated corpus defines. Symbols are searched linearly (see symbol_table.h), so without a bound
+   the bigger corpora would measure the amount of labels rather than the amount of lines */
+#define BENCH_MAX_LABELS 1024
+
+/* The stages which are measured */
+typedef enum
+{
+    BENCH_STAGE_EXPAND_MACROS,
+    BENCH_STAGE_FIRST_PASS,
+    BENCH_STAGE_SECOND_PASS,
+    BENCH_STAGE_OUTPUT,
+    /* all of the above, one after the other */
+    BENCH_STAGE_END_TO_END,
+    /* The amount of stages */
+    BENCH_STAGE_COUNT
+} BenchStage;
+
+/* A corpus which is benchmarked */
+typedef struct
+{
+    /* the name of the corpus in the results */
+    const char *name;
+    /* the amount of lines of source to generate */
+    unsigned long lines;
+} BenchCorpus;
+
+/* A single result: the summary of the times a stage took on a corpus */
+typedef struct
+{
+    char corpus[BENCH_MAX_NAME_LENGTH + 1];
+    char stage[BENCH_MAX_NAME_LENGTH + 1];
+    /* the size of the corpus */
+    unsigned long lines;
+    unsigned long bytes;
+    /* the amount of times the stage ran */
+    unsigned long runs;
+    /* the median, the 95th percentile and the minimum of the times, in seconds */
+    double median;
+    double p95;
+    double min;
+} BenchResult;
+
+/* Everything which is set up for running the stages on a corpus */
+typedef struct
+{
+    /* the source of the corpus, its expansion and the artifacts */
+    FILE *source;
+    FILE *am;
+    FILE *artifacts;
+    /* the arena each run allocates in. It is reset after each run */
+    Arena arena;
+    /* the amount of errors which were reported */
+    unsigned long errors;
+} BenchContext;
+
+const char *bench_stage_names[BENCH_STAGE_COUNT] = {"expand_macros", "first_pass", "second_pass", "output", "end_to_end"};
+
+/* The corpora, in increasing size. The largest one is well within the address space of the machine (see MAX_ADDRESS) */
+const BenchCorpus bench_corpora[] = {{"small", 1000}, {"medium", 10000}, {"large", 100000}};
+
+/* Read a clock in seconds */
+double bench_clock()
+{
+    struct timespec now;
+    if (clock_gettime(CLOCK_MONOTONIC, &now) != 0)
+    {
+        return 0;
+    }
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/* Generate a corpus of (about) lines lines into out (see workload.h): external symbols, macros, and then a mix of instructions,
+   macro invocations, .data and .string directives, comments and empty lines, with a label on a quarter of the statements
+   (up to BENCH_MAX_LABELS) and a few .entry directives.
+   The corpus is the same for the same amount of lines. Returns the amount of lines which were generated, or 0 if writing failed. */
+unsigned long bench_generate_corpus(FILE *out, unsigned long lines)
+{
+    WorkloadParams params;
+    WorkloadSummary summary;
+    workload_default_params(&params);
+    params.seed = 2024;
+    params.lines = lines;
+    params.max_labels = BENCH_MAX_LABELS;
+    return workload_generate(out, &params, &summary) ? summary.lines : 0;
+}
+
+/* The error callback of the benchmarks: counts the errors (the corpora are expected to have none) */
+void bench_error_callback(Error error, void *data)
+{
+    (void)error;
+    ((BenchContext *)data)->errors++;
+}
+
+/* Run a single stage on the corpus once and return the time it took in seconds. The stages which come before it run first (and are not timed).
+   Returns a negative time if the stage failed. */
+double bench_run_stage(BenchContext *context, BenchStage stage)
+{
+    ErrorCallback err_callback;
+    MacroExpansionResult macro_expansion_result;
+    FirstPassResult first_pass_result;
+    SecondPassResult second_pass_result;
+    ArtifactType artifact_type;
+    double start = 0, end;
+    bool success = TRUE;
+
+    err_callback.callback = bench_error_callback;
+    err_callback.data = context;
+    err_callback.should_stop = NULL;
+    rewind(context->source);
+    rewind(context->am);
+    rewind(context->artifacts);
+    if (stage == BENCH_STAGE_EXPAND_MACROS || stage == BENCH_STAGE_END_TO_END)
+    {
+        start = bench_clock();
+    }
+    /* the expansion is the same each time, so the .am file is overwritten with the same content */
+    macro_expansion_result = expand_macros(context->source, context->am, err_callback, &context->arena);
+    fflush(context->am);
+    end = bench_clock();
+    arena_reset(&context->arena);
+    if (stage == BENCH_STAGE_EXPAND_MACROS || macro_expansion_result.encountered_error)
+    {
+        return macro_expansion_result.encountered_error ? -1 : end - start;
+    }
+
+    rewind(context->am);
+    if (stage == BENCH_STAGE_FIRST_PASS)
+    {
+        start = bench_clock();
+    }
+    first_pass_result = first_pass(context->am, err_callback, &context->arena);
+    if (stage == BENCH_STAGE_FIRST_PASS)
+    {
+        end = bench_clock();
+        arena_reset(&context->arena);
+        return first_pass_result.encountered_error ? -1 : end - start;
+    }
+
+    rewind(context->am);
+    if (stage == BENCH_STAGE_SECOND_PASS)
+    {
+        start = bench_clock();
+    }
+    second_pass_result = second_pass(context->am, first_pass_result, err_callback, &context->arena);
+    if (stage == BENCH_STAGE_SECOND_PASS || second_pass_result.encountered_error || first_pass_result.encountered_error)
+    {
+        end = bench_clock();
+        arena_reset(&context->arena);
+        return second_pass_result.encountered_error || first_pass_result.encountered_error ? -1 : end - start;
+    }
+
+    if (stage == BENCH_STAGE_OUTPUT)
+    {
+        start = bench_clock();
+    }
+    for (artifact_type = ARTIFACT_OB; artifact_type <= ARTIFACT_EXT; ++artifact_type)
+    {
+        if (artifact_is_necessary(artifact_type, &second_pass_result) && write_artifact(context->artifacts, artifact_type, &second_pass_result) < 0)
+        {
+            success = FALSE;
+        }
+    }
+    fflush(context->artifacts);
+    end = bench_clock();
+    arena_reset(&context->arena);
+    return success ? end - start : -1;
+}
+
+/* Compare two times, for qsort */
+int bench_compare_times(const void *a, const void *b)
+{
+    double first = *(const double *)a, second = *(const double *)b;
+    return first < second ? -1 : first > second;
+}
+
+/* Run a stage on a corpus repetitions times (after a warmup run which is not measured), and summarize the times into result.
+   times is a buffer of repetitions times. Returns TRUE if successful, FALSE if the stage failed */
+bool bench_stage(BenchContext *context, BenchStage stage, int repetitions, double *times, BenchResult *result)
+{
+    int i;
+    if (bench_run_stage(context, stage) < 0)
+    {
+        return FALSE;
+    }
+    for (i = 0; i < repetitions; ++i)
+    {
+        if ((times[i] = bench_run_stage(context, stage)) < 0)
+        {
+            return FALSE;
+        }
+    }
+    qsort(times, repetitions, sizeof(double), bench_compare_times);
+    strcpy(result->stage, bench_stage_names[stage]);
+    result->runs = repetitions;
+    result->median = repetitions % 2 == 1 ? times[repetitions / 2] : (times[repetitions / 2 - 1] + times[repetitions / 2]) / 2;
+    /* the nearest rank percentile */
+    result->p95 = times[(repetitions * 95 + 99) / 100 - 1];
+    result->min = times[0];
+    return TRUE;
+}
+
+/* Divide an amount by a time in seconds. Returns 0 if no time passed */
+double bench_rate(unsigned long amount, double seconds)
+{
+    return seconds > 0 ? amount / seconds : 0;
+}
+
+/* Write a result as a single line of JSON (which is what the compare mode reads back, see bench_read_results) */
+void bench_write_result(FILE *out, BenchResult *result, bool is_last)
+{
+    fprintf(out, "    {\"corpus\": \"%s\", \"stage\": \"%s\", \"lines\": %lu, \"bytes\": %lu, \"runs\": %lu, ", result->corpus, result->stage,
+            result->lines, result->bytes, result->runs);
+    fprintf(out, "\"median_seconds\": %.9f, \"p95_seconds\": %.9f, \"min_seconds\": %.9f, \"lines_per_second\": %.1f, \"bytes_per_second\": %.1f}%s\n",
+            result->median, result->p95, result->min, bench_rate(result->lines, result->median), bench_rate(result->bytes, result->median),
+            is_last ? "" : ",");
+}
+
+/* Run all the benchmarks and write their results into out_path (and a summary to stdout). Returns the exit code */
+int bench_run(int repetitions, const char *out_path)
+{
+    BenchContext context;
+    BenchResult results[BENCH_MAX_RESULTS];
+    int result_count = 0, i, corpus_count = sizeof(bench_corpora) / sizeof(bench_corpora[0]);
+    BenchStage stage;
+    BenchResult *result;
+    double *times;
+    unsigned long lines;
+    FILE *out;
+    bool success = TRUE;
+
+    if ((times = malloc(repetitions * sizeof(double))) == NULL)
+    {
+        printf("error: allocation failure\n");
+        return BENCH_ERROR_EXIT_CODE;
+    }
+    arena_init(&context.arena);
+    for (i = 0; i < corpus_count && success; ++i)
+    {
+        context.errors = 0;
+        context.source = tmpfile();
+        context.am = tmpfile();
+        context.artifacts = tmpfile();
+        if (context.source == NULL || context.am == NULL || context.artifacts == NULL)
+        {
+            printf("error: could not create temporary files\n");
+            success = FALSE;
+        }
+        else
+        {
+            if ((lines = bench_generate_corpus(context.source, bench_corpora[i].lines)) == 0 || fflush(context.source) != 0)
+            {
+                printf("error: could not generate corpus %s\n", bench_corpora[i].name);
+                success = FALSE;
+            }
+            for (stage = 0; stage < BENCH_STAGE_COUNT && success; ++stage)
+            {
+                result = &results[result_count++];
+                strcpy(result->corpus, bench_corpora[i].name);
+                result->lines = lines;
+                result->bytes = ftell(context.source);
+                if (!bench_stage(&context, stage, repetitions, times, result))
+                {
+                    printf("error: %s failed on corpus %s (%lu errors)\n", bench_stage_names[stage], bench_corpora[i].name, context.errors);
+                    success = FALSE;
+                    break;
+                }
+                printf("%-8s %-14s median %10.3f ms  p95 %10.3f ms  %12.0f lines/s\n", result->corpus, result->stage, result->median * 1e3,
+                       result->p95 * 1e3, bench_rate(result->lines, result->median));
+                fflush(stdout);
+            }
+        }
+        if (context.source != NULL)
+        {
+            fclose(context.source);
+        }
+        if (context.am != NULL)
+        {
+            fclose(context.am);
+        }
+        if (context.artifacts != NULL)
+        {
+            fclose(context.artifacts);
+        }
+    }
+    arena_free(&context.arena);
+    free(times);
+    if (!success)
+    {
+        return BENCH_ERROR_EXIT_CODE;
+    }
+
+    if ((out = fopen(out_path, "w")) == NULL)
+    {
+        printf("error: could not open %s for writing\n", out_path);
+        return BENCH_ERROR_EXIT_CODE;
+    }
+    fprintf(out, "{\n  \"repetitions\": %d,\n  \"results\": [\n", repetitions);
+    for (i = 0; i < result_count; ++i)
+    {
+        bench_write_result(out, &results[i], i + 1 == result_count);
+    }
+    fprintf(out, "  ]\n}\n");
+    success = !ferror(out);
+    if (fclose(out) != 0 || !success)
+    {
+        printf("error: could not write %s\n", out_path);
+        return BENCH_ERROR_EXIT_CODE;
+    }
+    printf("results written to %s\n", out_path);
+    return 0;
+}
+
+/* Read the results out of a result file written by bench_run (each result is on a line of its own).
+   Returns the amount of results, or -1 if the file could not be read */
+int bench_read_results(const char *path, BenchResult *results)
+{
+    char line[512];
+    int count = 0;
+    BenchResult *result;
+    FILE *in = fopen(path, "r");
+    if (in == NULL)
+    {
+        return -1;
+    }
+    while (count < BENCH_MAX_RESULTS && fgets(line, sizeof(line), in) != NULL)
+    {
+        result = &results[count];
+        if (sscanf(line, " {\"corpus\": \"%31[^\"]\", \"stage\": \"%31[^\"]\", \"lines\": %lu, \"bytes\": %lu, \"runs\": %lu, \"median_seconds\": %lf, "
+                         "\"p95_seconds\": %lf, \"min_seconds\": %lf",
+                   result->corpus, result->stage, &result->lines, &result->bytes, &result->runs, &result->median, &result->p95, &result->min) == 8)
+        {
+            count++;
+        }
+    }
+    fclose(in);
+    return count;
+}
+
+/* Compare the results of two result files and print the change of each median. Returns the exit code */
+int bench_compare(const char *base_path, const char *new_path, double threshold)
+{
+    BenchResult base[BENCH_MAX_RESULTS], current[BENCH_MAX_RESULTS];
+    int base_count, current_count, i, j, regressions = 0;
+    double change;
+
+    if ((base_count = bench_read_results(base_path, base)) <= 0)
+    {
+        printf("error: could not read any results out of %s\n", base_path);
+        return BENCH_ERROR_EXIT_CODE;
+    }
+    if ((current_count = bench_read_results(new_path, current)) <= 0)
+    {
+        printf("error: could not read any results out of %s\n", new_path);
+        return BENCH_ERROR_EXIT_CODE;
+    }
+    for (i = 0; i < current_count; ++i)
+    {
+        for (j = 0; j < base_count && (strcmp(base[j].corpus, current[i].corpus) != 0 || strcmp(base[j].stage, current[i].stage) != 0); ++j)
+            ;
+        if (j == base_count)
+        {
+            printf("%-8s %-14s new (no base result)\n", current[i].corpus, current[i].stage);
+            continue;
+        }
+        if (base[j].lines != current[i].lines || base[j].bytes != current[i].bytes)
+        {
+            printf("%-8s %-14s corpus differs from the base, not compared\n", current[i].corpus, current[i].stage);
+            continue;
+        }
+        change = base[j].median > 0 ? (current[i].median / base[j].median - 1) * 100 : 0;
+        printf("%-8s %-14s median %10.3f ms -> %10.3f ms  %+7.1f%%%s\n", current[i].corpus, current[i].stage, base[j].median * 1e3,
+               current[i].median * 1e3, change, change > threshold ? "  REGRESSION" : "");
+        regressions += change > threshold;
+    }
+    if (regressions > 0)
+    {
+        printf("%d regressions beyond %.1f%%\n", regressions, threshold);
+        return BENCH_REGRESSION_EXIT_CODE;
+    }
+    printf("no regressions beyond %.1f%%\n", threshold);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int repetitions = BENCH_DEFAULT_REPETITIONS;
+    double threshold = BENCH_DEFAULT_THRESHOLD;
+    const char *out_path = "bench.json";
+    const char *compare_paths[2] = {NULL, NULL};
+    char *end;
+    bool bad_usage = FALSE;
+    int i;
+
+    for (i = 1; i < argc && !bad_usage; ++i)
+    {
+        if (strcmp(argv[i], "--repetitions") == 0)
+        {
+            bad_usage = i + 1 >= argc || (repetitions = (int)strtol(argv[++i], &end, 10)) <= 0 || *end != 0;
+        }
+        else if (strcmp(argv[i], "--out") == 0)
+        {
+            bad_usage = i + 1 >= argc;
+            out_path = bad_usage ? out_path : argv[++i];
+        }
+        else if (strcmp(argv[i], "--compare") == 0)
+        {
+            bad_usage = i + 2 >= argc;
+            if (!bad_usage)
+            {
+                compare_paths[0] = argv[++i];
+                compare_paths[1] = argv[++i];
+            }
+        }
+        else if (strcmp(argv[i], "--threshold") == 0)
+        {
+            bad_usage = i + 1 >= argc || (threshold = strtod(argv[++i], &end)) < 0 || *end != 0;
+        }
+        else
+        {
+            bad_usage = TRUE;
+        }
+    }
+    if (bad_usage)
+    {
+        printf("usage: benchmark [--repetitions N] [--out results.json]\n"
+               "       benchmark --compare base.json new.json [--threshold percent]\n"
+               "Runs each stage of the assembler on generated corpora and writes the median, p95 and throughput of each into a JSON file,\n"
+               "or compares two such files and flags the stages whose median got slower by more than the threshold (default: 10%%).\n");
+        return BAD_USAGE_EXIT_CODE;
+    }
+    if (compare_paths[0] != NULL)
+    {
+        return bench_compare(compare_paths[0], compare_paths[1], threshold);
+    }
+    return bench_run(repetitions, out_path);
+}
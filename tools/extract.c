@@ -0,0 +1,144 @@
+/* A small tool which recreates the individual artifact files (.am, .ob, .ent, .ext) out of a container file written by
+   assembler --container (see container.h).
+   usage: extract [-l] container [module1] [module2] ...
+   Without any modules, the artifacts of every module in the container are recreated. With -l, the contents of the container are listed instead.
+   The files are created relative to the current directory: a module name is used as a relative path (it may contain '/', since it is the
+   file base the assembler was given), but modules with an absolute name or with a ".." component are never extracted, so a container
+   cannot make this tool write outside of the current directory. */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "container.h"
+#include "output.h"
+
+/* Exit code for when the user calls this binary in a wrong manner  */
+#define BAD_USAGE_EXIT_CODE 2
+
+/* Exit code for when the container could not be read or an artifact could not be written */
+#define EXTRACT_ERROR_EXIT_CODE 3
+
+/* Check whether or not a module was requested in the command line. No requested modules means that all of them are requested. */
+bool is_requested_module(const char *module, char **modules, int module_count)
+{
+    int i;
+    if (module_count == 0)
+    {
+        return TRUE;
+    }
+    for (i = 0; i < module_count; ++i)
+    {
+        if (strcmp(modules[i], module) == 0)
+        {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/* Check whether or not a module name is a relative path which stays inside the current directory:
+   it does not start with '/' and none of its components is "..". */
+bool is_safe_module_name(const char *module)
+{
+    const char *component = module;
+    const char *component_end;
+    if (*module == '/')
+    {
+        return FALSE;
+    }
+    while (*component != 0)
+    {
+        component_end = strchr(component, '/');
+        if (component_end == NULL)
+        {
+            component_end = component + strlen(component);
+        }
+        if (component_end - component == 2 && component[0] == '.' && component[1] == '.')
+        {
+            return FALSE;
+        }
+        component = *component_end == '/' ? component_end + 1 : component_end;
+    }
+    return TRUE;
+}
+
+/* Recreate the file of a single artifact. Returns TRUE if successful, FALSE otherwise. */
+bool extract_artifact(Container *container, ContainerEntry *entry)
+{
+    FILE *out;
+    bool success;
+    char *filename;
+    if (!is_safe_module_name(entry->module))
+    {
+        printf("error: refusing to extract %s%s since it would be written outside of the current directory\n", entry->module,
+               artifact_extension(entry->type));
+        return FALSE;
+    }
+    if ((filename = malloc(strlen(entry->module) + MAX_ARTIFACT_EXTENSION_LENGTH + 1)) == NULL)
+    {
+        return FALSE;
+    }
+    sprintf(filename, "%s%s", entry->module, artifact_extension(entry->type));
+    if ((out = fopen(filename, "w")) == NULL)
+    {
+        printf("error: could not open file %s for writing\n", filename);
+        free(filename);
+        return FALSE;
+    }
+    success = container_read_artifact(container, entry, out);
+    if (fclose(out) != 0 || !success)
+    {
+        printf("error: could not extract %s\n", filename);
+        success = FALSE;
+    }
+    free(filename);
+    return success;
+}
+
+int main(int argc, char **argv)
+{
+    Container container;
+    ContainerEntry *entry;
+    bool list_only = FALSE;
+    bool success = TRUE;
+    char *container_path;
+    uint32 i;
+    int arg = 1;
+
+    if (arg < argc && strcmp(argv[arg], "-l") == 0)
+    {
+        list_only = TRUE;
+        arg++;
+    }
+    if (arg >= argc)
+    {
+        printf("usage: extract [-l] container [module1] [module2] ...\n"
+               "Recreates the artifact files of the given modules (or of all modules if none are given) out of a container.\n"
+               "-l: list the contents of the container instead\n");
+        return BAD_USAGE_EXIT_CODE;
+    }
+    container_path = argv[arg++];
+
+    if (!container_open(&container, container_path))
+    {
+        printf("error: could not read container %s\n", container_path);
+        return EXTRACT_ERROR_EXIT_CODE;
+    }
+    for (i = 0; i < container.entries->len; ++i)
+    {
+        entry = container_entry_vec_get_ptr(container.entries, i);
+        if (!is_requested_module(entry->module, argv + arg, argc - arg))
+        {
+            continue;
+        }
+        if (list_only)
+        {
+            printf("%s%s %u\n", entry->module, artifact_extension(entry->type), entry->length);
+        }
+        else if (!extract_artifact(&container, entry))
+        {
+            success = FALSE;
+        }
+    }
+    container_free(&container);
+    return success ? 0 : EXTRACT_ERROR_EXIT_CODE;
+}
@@ -0,0 +1,219 @@
+/* A tool which generates synthetic assembly programs for benchmarks and stress tests (see workload.h).
+   The same options (and seed) always generate the same program. A summary of the program is printed to stderr.
+   usage: generate [options] [-o out.as]
+   Without -o, the program is written to stdout. See the usage message below for the options. */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "workload.h"
+#include "first_pass.h"
+
+/* Exit code for when the user calls this binary in a wrong manner  */
+#define BAD_USAGE_EXIT_CODE 2
+
+/* Exit code for when the program could not be written */
+#define GENERATE_ERROR_EXIT_CODE 3
+
+/* Parse a whole string as an unsigned number. Returns TRUE if successful, FALSE otherwise */
+bool generate_parse_number(const char *str, unsigned long *number)
+{
+    char *end;
+    if (*str < '0' || *str > '9')
+    {
+        return FALSE;
+    }
+    *number = strtoul(str, &end, 10);
+    return *end == 0;
+}
+
+/* Parse a whole string as a percentage (0-100). Returns TRUE if successful, FALSE otherwise */
+bool generate_parse_percent(const char *str, unsigned int *percent)
+{
+    unsigned long number;
+    if (!generate_parse_number(str, &number) || number > 100)
+    {
+        return FALSE;
+    }
+    *percent = (unsigned int)number;
+    return TRUE;
+}
+
+/* Parse a list of exactly count comma separated weights (e.g. "4,1,1,0"). Returns TRUE if successful, FALSE otherwise */
+bool generate_parse_weights(const char *str, unsigned int *weights, int count)
+{
+    char *end;
+    int i;
+    for (i = 0; i < count; ++i)
+    {
+        if (*str < '0' || *str > '9')
+        {
+            return FALSE;
+        }
+        weights[i] = (unsigned int)strtoul(str, &end, 10);
+        if (*end != (i + 1 == count ? 0 : ','))
+        {
+            return FALSE;
+        }
+        str = end + 1;
+    }
+    return TRUE;
+}
+
+/* Parse the name of the errors of the program (see WorkloadErrors). Returns TRUE if successful, FALSE otherwise */
+bool generate_parse_errors(const char *str, WorkloadErrors *errors)
+{
+    const char *names[] = {"none", "lines", "macros", "overflow"};
+    int i;
+    for (i = 0; i < (int)(sizeof(names) / sizeof(*names)); ++i)
+    {
+        if (strcmp(str, names[i]) == 0)
+        {
+            *errors = (WorkloadErrors)i;
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+int main(int argc, char **argv)
+{
+    WorkloadParams params;
+    WorkloadSummary summary;
+    const char *out_path = NULL;
+    FILE *out = stdout;
+    bool bad_usage = FALSE, success;
+    int i;
+
+    workload_default_params(&params);
+    for (i = 1; i < argc && !bad_usage; ++i)
+    {
+        /* each option takes a value */
+        if (i + 1 >= argc)
+        {
+            bad_usage = TRUE;
+        }
+        else if (strcmp(argv[i], "-o") == 0)
+        {
+            out_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--seed") == 0)
+        {
+            bad_usage = !generate_parse_number(argv[++i], &params.seed);
+        }
+        else if (strcmp(argv[i], "--lines") == 0)
+        {
+            bad_usage = !generate_parse_number(argv[++i], &params.lines);
+        }
+        else if (strcmp(argv[i], "--mix") == 0)
+        {
+            bad_usage = !generate_parse_weights(argv[++i], params.instruction_weights, WORKLOAD_INSTRUCTION_COUNT);
+        }
+        else if (strcmp(argv[i], "--operands") == 0)
+        {
+            bad_usage = !generate_parse_weights(argv[++i], params.operand_weights, WORKLOAD_OPERAND_COUNT);
+        }
+        else if (strcmp(argv[i], "--label-percent") == 0)
+        {
+            bad_usage = !generate_parse_percent(argv[++i], &params.label_percent);
+        }
+        else if (strcmp(argv[i], "--max-labels") == 0)
+        {
+            bad_usage = !generate_parse_number(argv[++i], &params.max_labels);
+        }
+        else if (strcmp(argv[i], "--directive-percent") == 0)
+        {
+            bad_usage = !generate_parse_percent(argv[++i], &params.directive_percent);
+        }
+        else if (strcmp(argv[i], "--string-percent") == 0)
+        {
+            bad_usage = !generate_parse_percent(argv[++i], &params.string_percent);
+        }
+        else if (strcmp(argv[i], "--externs") == 0)
+        {
+            bad_usage = !generate_parse_number(argv[++i], &params.extern_count);
+        }
+        else if (strcmp(argv[i], "--extern-percent") == 0)
+        {
+            bad_usage = !generate_parse_percent(argv[++i], &params.extern_percent);
+        }
+        else if (strcmp(argv[i], "--entry-percent") == 0)
+        {
+            bad_usage = !generate_parse_percent(argv[++i], &params.entry_percent);
+        }
+        else if (strcmp(argv[i], "--macros") == 0)
+        {
+            bad_usage = !generate_parse_number(argv[++i], &params.macro_count);
+        }
+        else if (strcmp(argv[i], "--macro-body") == 0)
+        {
+            bad_usage = !generate_parse_number(argv[++i], &params.macro_body_lines);
+        }
+        else if (strcmp(argv[i], "--macro-call-percent") == 0)
+        {
+            bad_usage = !generate_parse_percent(argv[++i], &params.macro_call_percent);
+        }
+        else if (strcmp(argv[i], "--comment-percent") == 0)
+        {
+            bad_usage = !generate_parse_percent(argv[++i], &params.comment_percent);
+        }
+        else if (strcmp(argv[i], "--errors") == 0)
+        {
+            bad_usage = !generate_parse_errors(argv[++i], &params.errors);
+        }
+        else if (strcmp(argv[i], "--error-percent") == 0)
+        {
+            bad_usage = !generate_parse_percent(argv[++i], &params.error_percent);
+        }
+        else
+        {
+            bad_usage = TRUE;
+        }
+    }
+    if (bad_usage)
+    {
+        printf("usage: generate [options] [-o out.as]\n"
+               "Generates a synthetic assembly program (to stdout without -o). The same options always generate the same program.\n"
+               "  --seed N                  seed of the pseudo random generator (default: 1)\n"
+               "  --lines N                 amount of lines (default: 1000)\n"
+               "  --mix w0,...,w15          weights of the instructions, from mov to stop (default: all 1)\n"
+               "  --operands i,s,a,r        weights of immediate, symbol, &address and register operands (default: all 1)\n");
+        printf("  --label-percent P         percentage of statements with a label (default: 25)\n"
+               "  --max-labels N            biggest amount of labels, 0 for no bound (default: 0)\n"
+               "  --directive-percent P     percentage of statements which are .data or .string (default: 20)\n"
+               "  --string-percent P        percentage of those which are .string (default: 50)\n");
+        printf("  --externs N               amount of .extern directives (default: 8)\n"
+               "  --extern-percent P        percentage of symbol operands which are external (default: 20)\n"
+               "  --entry-percent P         percentage of labels with a .entry directive (default: 10)\n");
+        printf("  --macros N                amount of macros (default: 8)\n"
+               "  --macro-body N            amount of lines in each macro (default: 3)\n"
+               "  --macro-call-percent P    percentage of statements which invoke a macro (default: 5)\n"
+               "  --comment-percent P       percentage of comments and empty lines (default: 10)\n"
+               "  --errors KIND             none, lines, macros or overflow (default: none)\n"
+               "  --error-percent P         percentage of erroneous statements, each kind appears at least once (default: 5)\n");
+        return BAD_USAGE_EXIT_CODE;
+    }
+
+    if (out_path != NULL && (out = fopen(out_path, "w")) == NULL)
+    {
+        fprintf(stderr, "error: could not open %s for writing\n", out_path);
+        return GENERATE_ERROR_EXIT_CODE;
+    }
+    success = workload_generate(out, &params, &summary);
+    if (out != stdout)
+    {
+        success = fclose(out) == 0 && success;
+    }
+    if (!success)
+    {
+        fprintf(stderr, "error: could not write the program\n");
+        return GENERATE_ERROR_EXIT_CODE;
+    }
+    fprintf(stderr, "%lu lines, %lu bytes, %lu labels, %lu words, %lu errors\n", summary.lines, summary.bytes, summary.labels, summary.words,
+            summary.errors);
+    if (params.errors != WORKLOAD_ERRORS_OVERFLOW && summary.words > MAX_ADDRESS - INSTRUCTION_MEMORY_START)
+    {
+        fprintf(stderr, "warning: the program takes more words than fit in the address space of the machine (%d)\n",
+                MAX_ADDRESS - INSTRUCTION_MEMORY_START);
+    }
+    return 0;
+}
@@ -0,0 +1,474 @@
+/* The microbenchmarks of the hot functions of the parser and the encoder (see make microbench).
+   The inputs of each function are taken out of real .am files: every line goes through parse_line, the start of every statement through
+   parse_symbol (the way parse_line looks for a label), and the integers, operands, instructions and symbols of the parsed lines
+   through parse_int32_base10, parse_operand, encode_instruction, encode_operand and symbol_table_search.
+   Each function runs over all of its inputs once to warm up, then the amount of rounds is calibrated so that a sample takes long enough to
+   measure, and the median of several samples is reported in nanoseconds and in cycles per call, along with the time per line of the input.
+   parse_line parses a copy of each line (as it may modify the line), so the cost of the copy alone is reported as "(line copy)".
+   usage: microbenchmark file1.am [file2.am] ... */
+/* we need POSIX for clock_gettime */
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include "parser.h"
+#include "second_pass.h"
+#include "vector.h"
+
+/* Exit code for when the user calls this binary in a wrong manner  */
+#define BAD_USAGE_EXIT_CODE 2
+
+/* Exit code for when the inputs could not be read */
+#define MICRO_ERROR_EXIT_CODE 3
+
+/* The shortest time a sample may take in seconds. The amount of rounds in a sample is doubled until it takes at least this long */
+#define MICRO_MIN_SAMPLE_SECONDS 0.02
+
+/* The amount of samples which are measured for each function (the median is reported) */
+#define MICRO_SAMPLE_COUNT 7
+
+/* The address the symbols of the inputs are given in the symbol table */
+#define MICRO_SYMBOL_ADDRESS 100
+
+VECTOR_HEADER(Instruction, InstructionVector, instruction)
+VECTOR_IMPL(Instruction, InstructionVector, instruction)
+VECTOR_HEADER(Operand, OperandVector, operand)
+VECTOR_IMPL(Operand, OperandVector, operand)
+
+/* A list of null terminated strings */
+typedef struct
+{
+    /* the characters of all the strings, each followed by a null terminator */
+    CharVector *chars;
+    /* the position of each string in chars */
+    U32Vector *offsets;
+} MicroStrings;
+
+/* The inputs of the microbenchmarks */
+typedef struct
+{
+    /* every line of the files (with its newline, the way the passes read it) */
+    MicroStrings lines;
+    /* the start of every line which is not empty nor a comment (after any leading space), which parse_line looks for a label in */
+    MicroStrings statements;
+    /* every integer of the files (of immediates and of .data directives) */
+    MicroStrings integers;
+    /* every operand of the instructions of the files */
+    MicroStrings operands;
+    /* every instruction of the files */
+    InstructionVector *instructions;
+    /* every operand of the instructions of the files whose symbol (if it has one) is defined in the files */
+    OperandVector *resolved_operands;
+    /* the names of the symbols resolved_operands refer to, in the order they refer to them */
+    MicroStrings symbol_references;
+    /* the symbols of all the files */
+    SymbolTable symbol_table;
+    Arena arena;
+} MicroInputs;
+
+/* Written with the results of the calls, so that the compiler can't optimize them away */
+volatile uint32 micro_sink;
+
+/* The inputs (set by main before the benchmarks run) */
+MicroInputs micro_inputs;
+
+/* Read a clock in seconds */
+double micro_clock()
+{
+    struct timespec now;
+    if (clock_gettime(CLOCK_MONOTONIC, &now) != 0)
+    {
+        return 0;
+    }
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/* Read the cycle counter of the processor (the time stamp counter on x86), or 0 where there is none */
+double micro_cycles()
+{
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    unsigned int low, high;
+    __asm__ __volatile__("rdtsc" : "=a"(low), "=d"(high));
+    return high * 4294967296.0 + low;
+#else
+    return 0;
+#endif
+}
+
+/* Initialize an empty list of strings. Returns TRUE if successful, FALSE if an allocation failed */
+bool micro_strings_init(MicroStrings *strings)
+{
+    strings->chars = char_vec_create();
+    strings->offsets = u32_vec_create();
+    return strings->chars != NULL && strings->offsets != NULL;
+}
+
+/* Add a string to a list of strings. Returns TRUE if successful, FALSE if an allocation failed */
+bool micro_strings_push(MicroStrings *strings, const char *str)
+{
+    return u32_vec_push(strings->offsets, strings->chars->len) && char_vec_push_n(strings->chars, str, strlen(str) + 1);
+}
+
+/* Get the i-th string of a list of strings */
+char *micro_strings_get(MicroStrings *strings, uint32 i)
+{
+    return strings->chars->array + strings->offsets->array[i];
+}
+
+/* The end of a label, the way parse_line looks for it */
+bool micro_label_end_indicator(char c)
+{
+    return c == ':';
+}
+
+/* Add the text of an operand to the inputs of parse_operand */
+bool micro_collect_operand(Operand *operand)
+{
+    char buf[MAX_LABEL_SIZE + 16];
+    switch (operand->type)
+    {
+    case OPERAND_IMMEDIATE:
+        sprintf(buf, "#%d", operand->value.immediate);
+        break;
+    case OPERAND_REGISTER:
+        sprintf(buf, "r%d", operand->value.register_num);
+        break;
+    case OPERAND_ADDRESS:
+        sprintf(buf, "&%s", operand->value.symbol_name);
+        break;
+    default:
+        strcpy(buf, operand->value.symbol_name);
+        break;
+    }
+    return micro_strings_push(&micro_inputs.operands, buf);
+}
+
+/* Add the parts of a parsed line to the inputs. Returns TRUE if successful, FALSE if an allocation failed */
+bool micro_collect_line(ParseLineData *data)
+{
+    char buf[32];
+    uint32 i;
+    Operand *operands[2];
+    if (data->parse_label_data.result == HAS_SYMBOL && data->type != PARSE_LINE_ERROR &&
+        symbol_table_search(micro_inputs.symbol_table, data->parse_label_data.val.symbol_buffer) == NULL &&
+        !symbol_table_insert(micro_inputs.symbol_table, data->parse_label_data.val.symbol_buffer, MICRO_SYMBOL_ADDRESS, SYMBOL_CONTEXT_CODE, 0))
+    {
+        return FALSE;
+    }
+    if (data->type == PARSE_LINE_DIRECTIVE)
+    {
+        if (data->val.directive.type == DIRECTIVE_EXTERN && symbol_table_search(micro_inputs.symbol_table, data->val.directive.val.extern_symbol) == NULL &&
+            !symbol_table_insert(micro_inputs.symbol_table, data->val.directive.val.extern_symbol, 0, SYMBOL_CONTEXT_EXTERNAL, 0))
+        {
+            return FALSE;
+        }
+        for (i = 0; data->val.directive.type == DIRECTIVE_DATA && i < data->val.directive.val.data.amount_of_integers; ++i)
+        {
+            sprintf(buf, "%d", data->val.directive.val.data.integers[i]);
+            if (!micro_strings_push(&micro_inputs.integers, buf))
+            {
+                return FALSE;
+            }
+        }
+    }
+    else if (data->type == PARSE_LINE_INSTRUCTION)
+    {
+        if (!instruction_vec_push(micro_inputs.instructions, data->val.instruction))
+        {
+            return FALSE;
+        }
+        operands[0] = &data->val.instruction.operand1;
+        operands[1] = &data->val.instruction.operand2;
+        for (i = 0; i < data->val.instruction.operand_amount; ++i)
+        {
+            if (!micro_collect_operand(operands[i]))
+            {
+                return FALSE;
+            }
+            if (operands[i]->type == OPERAND_IMMEDIATE)
+            {
+                sprintf(buf, "%d", operands[i]->value.immediate);
+                if (!micro_strings_push(&micro_inputs.integers, buf))
+                {
+                    return FALSE;
+                }
+            }
+        }
+    }
+    return TRUE;
+}
+
+/* Read the inputs out of the files. Returns TRUE if successful, FALSE otherwise */
+bool micro_read_inputs(char **paths, int path_count)
+{
+    char line[MAX_LINE_LENGTH + 2]; /* +2 for newline + null termination */
+    char work[MAX_LINE_LENGTH + 2];
+    ParseLineData data;
+    Instruction *instruction;
+    Operand *operands[2];
+    FILE *file;
+    uint32 i, j;
+    int path;
+
+    arena_init(&micro_inputs.arena);
+    if (!micro_strings_init(&micro_inputs.lines) || !micro_strings_init(&micro_inputs.statements) || !micro_strings_init(&micro_inputs.integers) ||
+        !micro_strings_init(&micro_inputs.operands) || !micro_strings_init(&micro_inputs.symbol_references) ||
+        (micro_inputs.instructions = instruction_vec_create()) == NULL || (micro_inputs.resolved_operands = operand_vec_create()) == NULL ||
+        !symbol_table_init(&micro_inputs.symbol_table, &micro_inputs.arena))
+    {
+        printf("error: allocation failure\n");
+        return FALSE;
+    }
+    for (path = 0; path < path_count; ++path)
+    {
+        if ((file = fopen(paths[path], "r")) == NULL)
+        {
+            printf("error: could not open %s\n", paths[path]);
+            return FALSE;
+        }
+        while (fgets(line, sizeof(line), file))
+        {
+            strcpy(work, line);
+            parse_line(work, &data);
+            if (!micro_strings_push(&micro_inputs.lines, line) ||
+                (data.type != PARSE_LINE_EMPTY && data.type != PARSE_LINE_COMMENT && !micro_strings_push(&micro_inputs.statements, skip_space(line))) ||
+                !micro_collect_line(&data))
+            {
+                printf("error: allocation failure\n");
+                fclose(file);
+                return FALSE;
+            }
+        }
+        fclose(file);
+    }
+    /* the operands encode_operand can encode are the ones whose symbols are known, now that all the symbols are */
+    for (i = 0; i < micro_inputs.instructions->len; ++i)
+    {
+        instruction = instruction_vec_get_ptr(micro_inputs.instructions, i);
+        operands[0] = &instruction->operand1;
+        operands[1] = &instruction->operand2;
+        for (j = 0; j < instruction->operand_amount; ++j)
+        {
+            if ((operands[j]->type == OPERAND_SYMBOL || operands[j]->type == OPERAND_ADDRESS) &&
+                symbol_table_search(micro_inputs.symbol_table, operands[j]->value.symbol_name) == NULL)
+            {
+                continue;
+            }
+            if (!operand_vec_push(micro_inputs.resolved_operands, *operands[j]) ||
+                ((operands[j]->type == OPERAND_SYMBOL || operands[j]->type == OPERAND_ADDRESS) &&
+                 !micro_strings_push(&micro_inputs.symbol_references, operands[j]->value.symbol_name)))
+            {
+                printf("error: allocation failure\n");
+                return FALSE;
+            }
+        }
+    }
+    return TRUE;
+}
+
+/* A round of each microbenchmark: calls the function on each of its inputs once. Returns the amount of calls */
+
+uint32 micro_round_parse_line()
+{
+    char work[MAX_LINE_LENGTH + 2];
+    ParseLineData data;
+    uint32 i;
+    MicroStrings *lines = &micro_inputs.lines;
+    for (i = 0; i < lines->offsets->len; ++i)
+    {
+        /* parse_line may modify the line, so it parses a copy (the way the passes parse a copy of the line they read) */
+        strcpy(work, micro_strings_get(lines, i));
+        parse_line(work, &data);
+        micro_sink += data.type;
+    }
+    return lines->offsets->len;
+}
+
+uint32 micro_round_line_copy()
+{
+    char work[MAX_LINE_LENGTH + 2];
+    uint32 i;
+    MicroStrings *lines = &micro_inputs.lines;
+    for (i = 0; i < lines->offsets->len; ++i)
+    {
+        strcpy(work, micro_strings_get(lines, i));
+        micro_sink += work[0];
+    }
+    return lines->offsets->len;
+}
+
+uint32 micro_round_parse_symbol()
+{
+    ParseSymbolData data;
+    uint32 i;
+    MicroStrings *statements = &micro_inputs.statements;
+    for (i = 0; i < statements->offsets->len; ++i)
+    {
+        parse_symbol(micro_strings_get(statements, i), micro_label_end_indicator, &data);
+        micro_sink += data.result;
+    }
+    return statements->offsets->len;
+}
+
+uint32 micro_round_parse_int32_base10()
+{
+    int32 integer;
+    int chars_read;
+    bool is_negative;
+    uint32 i;
+    MicroStrings *integers = &micro_inputs.integers;
+    for (i = 0; i < integers->offsets->len; ++i)
+    {
+        micro_sink += parse_int32_base10(micro_strings_get(integers, i), &integer, &chars_read, &is_negative) + integer;
+    }
+    return integers->offsets->len;
+}
+
+uint32 micro_round_parse_operand()
+{
+    Operand operand;
+    ParseError parse_error;
+    uint32 i, operand_length;
+    MicroStrings *operands = &micro_inputs.operands;
+    for (i = 0; i < operands->offsets->len; ++i)
+    {
+        micro_sink += parse_operand(micro_strings_get(operands, i), &operand_length, &operand, &parse_error) + operand.type;
+    }
+    return operands->offsets->len;
+}
+
+uint32 micro_round_encode_instruction()
+{
+    uint32 i;
+    InstructionVector *instructions = micro_inputs.instructions;
+    for (i = 0; i < instructions->len; ++i)
+    {
+        micro_sink += encode_instruction(&instructions->array[i]);
+    }
+    return instructions->len;
+}
+
+uint32 micro_round_encode_operand()
+{
+    uint32 i;
+    OperandVector *operands = micro_inputs.resolved_operands;
+    for (i = 0; i < operands->len; ++i)
+    {
+        micro_sink += encode_operand(&operands->array[i], &micro_inputs.symbol_table, MICRO_SYMBOL_ADDRESS + i);
+    }
+    return operands->len;
+}
+
+uint32 micro_round_symbol_table_search()
+{
+    uint32 i;
+    MicroStrings *references = &micro_inputs.symbol_references;
+    for (i = 0; i < references->offsets->len; ++i)
+    {
+        micro_sink += symbol_table_search(micro_inputs.symbol_table, micro_strings_get(references, i))->addr;
+    }
+    return references->offsets->len;
+}
+
+/* A microbenchmark */
+typedef struct
+{
+    /* the name of the function which is measured */
+    const char *name;
+    /* runs a round of the benchmark, returning the amount of calls it made */
+    uint32 (*round)();
+} Microbenchmark;
+
+const Microbenchmark microbenchmarks[] = {{"parse_line", micro_round_parse_line},
+                                          {"(line copy)", micro_round_line_copy},
+                                          {"parse_symbol", micro_round_parse_symbol},
+                                          {"parse_int32_base10", micro_round_parse_int32_base10},
+                                          {"parse_operand", micro_round_parse_operand},
+                                          {"encode_instruction", micro_round_encode_instruction},
+                                          {"encode_operand", micro_round_encode_operand},
+                                          {"symbol_table_search", micro_round_symbol_table_search}};
+
+/* Compare two doubles, for qsort */
+int micro_compare_doubles(const void *a, const void *b)
+{
+    double first = *(const double *)a, second = *(const double *)b;
+    return first < second ? -1 : first > second;
+}
+
+/* Run a microbenchmark and print its results. line_count is the amount of lines of the inputs */
+void micro_run(const Microbenchmark *benchmark, uint32 line_count)
+{
+    double seconds[MICRO_SAMPLE_COUNT], cycles[MICRO_SAMPLE_COUNT];
+    double start, start_cycles, median_seconds, median_cycles;
+    unsigned long rounds = 1, round;
+    uint32 calls;
+    int sample;
+
+    /* warm up (and count the calls of a round) */
+    calls = benchmark->round();
+    if (calls == 0)
+    {
+        printf("%-20s %12s\n", benchmark->name, "no inputs");
+        return;
+    }
+    /* calibrate the amount of rounds in a sample */
+    while (TRUE)
+    {
+        start = micro_clock();
+        for (round = 0; round < rounds; ++round)
+        {
+            benchmark->round();
+        }
+        if (micro_clock() - start >= MICRO_MIN_SAMPLE_SECONDS)
+        {
+            break;
+        }
+        rounds *= 2;
+    }
+    for (sample = 0; sample < MICRO_SAMPLE_COUNT; ++sample)
+    {
+        start = micro_clock();
+        start_cycles = micro_cycles();
+        for (round = 0; round < rounds; ++round)
+        {
+            benchmark->round();
+        }
+        cycles[sample] = (micro_cycles() - start_cycles) / rounds;
+        seconds[sample] = (micro_clock() - start) / rounds;
+    }
+    qsort(seconds, MICRO_SAMPLE_COUNT, sizeof(double), micro_compare_doubles);
+    qsort(cycles, MICRO_SAMPLE_COUNT, sizeof(double), micro_compare_doubles);
+    median_seconds = seconds[MICRO_SAMPLE_COUNT / 2];
+    median_cycles = cycles[MICRO_SAMPLE_COUNT / 2];
+    printf("%-20s %12lu %12.2f %12.1f %12.2f\n", benchmark->name, (unsigned long)calls, median_seconds / calls * 1e9, median_cycles / calls,
+           median_seconds / line_count * 1e9);
+}
+
+int main(int argc, char **argv)
+{
+    uint32 i;
+    if (argc < 2)
+    {
+        printf("usage: microbenchmark file1.am [file2.am] ...\n"
+               "Measures the parser and the encoder functions over the lines of the given (macro expanded) files.\n");
+        return BAD_USAGE_EXIT_CODE;
+    }
+    if (!micro_read_inputs(argv + 1, argc - 1))
+    {
+        return MICRO_ERROR_EXIT_CODE;
+    }
+    printf("%u lines, %u statements, %u integers, %u operands, %u instructions, %u symbol references\n", micro_inputs.lines.offsets->len,
+           micro_inputs.statements.offsets->len, micro_inputs.integers.offsets->len, micro_inputs.operands.offsets->len,
+           micro_inputs.instructions->len, micro_inputs.symbol_references.offsets->len);
+    if (micro_cycles() == 0)
+    {
+        printf("note: there is no cycle counter on this platform, so cycles are reported as 0\n");
+    }
+    printf("%-20s %12s %12s %12s %12s\n", "function", "calls/round", "ns/call", "cycles/call", "ns/line");
+    for (i = 0; i < sizeof(microbenchmarks) / sizeof(microbenchmarks[0]); ++i)
+    {
+        micro_run(&microbenchmarks[i], micro_inputs.lines.offsets->len);
+    }
+    return 0;
+}
@@ -0,0 +1,456 @@
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include "workload.h"
+#include "first_pass.h"
+
+/* A buffer which is big enough for any piece of a line the generator writes at once */
+#define WORKLOAD_PRINT_BUFFER_SIZE 512
+
+/* The amount of values in each .data directive of WORKLOAD_ERRORS_OVERFLOW */
+#define WORKLOAD_OVERFLOW_DATA_VALUES 24
+
+/* The state of a program which is being generated */
+typedef struct
+{
+    const WorkloadParams *params;
+    FILE *out;
+    WorkloadSummary *summary;
+    /* the state of the pseudo random generator */
+    unsigned long random_state;
+    /* the amount of labels the program defines (L0, L1, ...) and the next one to define */
+    unsigned long label_count;
+    unsigned long next_label;
+    /* the amount of words each macro takes when it is invoked */
+    unsigned long *macro_words;
+    /* the next error template to write, and a number which makes the names the error templates define unique */
+    unsigned long next_error;
+    unsigned long error_serial;
+} WorkloadGenerator;
+
+/* The names of the instructions, by InstructionType */
+const char *workload_instruction_names[WORKLOAD_INSTRUCTION_COUNT] = {"mov", "cmp", "add", "sub", "lea", "clr", "not", "inc",
+                                                                      "dec", "jmp", "bne", "jsr", "red", "prn", "rts", "stop"};
+
+/* The erroneous statements of WORKLOAD_ERRORS_LINES, each with a single error. A template may use %lu (up to twice) for a unique number.
+   Between them they cover every kind of error the passes report, other than ERROR_TYPE_MEMORY_OVERFLOWN (see WORKLOAD_ERRORS_OVERFLOW) */
+const char *workload_line_errors[] = {
+    /* ERROR_TYPE_SYMBOL_PARSE */
+    "1label%lu: stop\n",
+    "lab$el%lu: stop\n",
+    "averylonglabelnamewhichisoverthelimit%lu: stop\n",
+    ": inc r1\n",
+    "data: stop\n",
+    "mov: stop\n",
+    "r3: stop\n",
+    /* ERROR_TYPE_PARSE */
+    "X%lu:\n",
+    "X%lu:stop\n",
+    ".dat 5\n",
+    ".data\n",
+    ".data a\n",
+    ".data 5x\n",
+    ".data 5,\n",
+    ".data 99999999\n",
+    ".data -99999999\n",
+    ".string abc\"\n",
+    ".string \"abc\n",
+    ".entry\n",
+    ".entry 1bad\n",
+    ".extern\n",
+    ".extern 1bad\n",
+    "foo r1\n",
+    "prn #\n",
+    "prn #99999999\n",
+    "prn #-99999999\n",
+    "prn r1 x\n",
+    "inc 1bad\n",
+    "inc r1, r2\n",
+    "mov r1\n",
+    "inc r1,\n",
+    "lea #1, r2\n",
+    "add , r2\n",
+    /* ERROR_TYPE_SYMBOL_ALREADY_DEFINED */
+    "L0: stop\n",
+    /* ERROR_TYPE_SYMBOL_NOT_DEFINED */
+    "jmp UNDEFINED%lu\n",
+    ".entry UNDEFINED%lu\n",
+    /* ERROR_TYPE_EXTERNAL_SYMBOL_USED_IN_ENTRY_DIRECTIVE */
+    ".extern XE%lu\n.entry XE%lu\n"};
+
+/* The erroneous macro definitions (and lines) of WORKLOAD_ERRORS_MACROS, one of each kind of macro expansion error (see ExpandMacroErrorType).
+   A template may use %lu (up to twice) for a unique number. The invalid definitions have no body, since the expander copies the body of an
+   invalid definition into the macro which was defined before it */
+const char *workload_macro_errors[] = {
+    "; this comment is %lu characters too long, since no line of a program may be longer than eighty characters\n",
+    "mcro\nmcroend\n",
+    "mcro 3bad%lu\nmcroend\n",
+    "mcro mov\nmcroend\n",
+    "mcro data\nmcroend\n",
+    "mcro r5\nmcroend\n",
+    "mcro ba$d%lu\nmcroend\n",
+    "mcro averylongmacronamewhichisoverthelimit%lu\nmcroend\n",
+    "mcro dup%lu\nmcroend\ndup%lu: stop\n"};
+
+/* Write a piece of the program. format may use %lu up to twice, for the same number (see the error templates) */
+bool workload_print(WorkloadGenerator *generator, const char *format, ...)
+{
+    char buf[WORKLOAD_PRINT_BUFFER_SIZE];
+    char *c;
+    va_list args;
+    va_start(args, format);
+    vsprintf(buf, format, args);
+    va_end(args);
+    for (c = buf; *c != 0; ++c)
+    {
+        if (*c == '\n')
+        {
+            generator->summary->lines++;
+        }
+    }
+    generator->summary->bytes += c - buf;
+    return fputs(buf, generator->out) != EOF;
+}
+
+/* Get the next pseudo random number in the range [0, bound) (a 32 bit linear congruential generator, which is the same on every platform) */
+unsigned long workload_random(WorkloadGenerator *generator, unsigned long bound)
+{
+    generator->random_state = (generator->random_state * 1103515245UL + 12345UL) & 0xffffffffUL;
+    return (generator->random_state >> 8) % bound;
+}
+
+/* Whether or not an event of the given percentage happens */
+bool workload_chance(WorkloadGenerator *generator, unsigned int percent)
+{
+    return workload_random(generator, 100) < percent;
+}
+
+/* Choose an index by the weights of the given indices (or evenly between them if their weights are all 0) */
+int workload_weighted_choice(WorkloadGenerator *generator, const unsigned int *weights, const int *indices, int index_count)
+{
+    unsigned long total = 0, choice;
+    int i;
+    for (i = 0; i < index_count; ++i)
+    {
+        total += weights[indices[i]];
+    }
+    if (total == 0)
+    {
+        return indices[workload_random(generator, index_count)];
+    }
+    choice = workload_random(generator, total);
+    for (i = 0; choice >= weights[indices[i]]; ++i)
+    {
+        choice -= weights[indices[i]];
+    }
+    return indices[i];
+}
+
+/* Write an operand of one of the given types. Returns the amount of words it takes, or -1 if writing failed */
+int workload_write_operand(WorkloadGenerator *generator, const OperandType *types, int type_count)
+{
+    const WorkloadParams *params = generator->params;
+    int indices[WORKLOAD_OPERAND_COUNT];
+    int i;
+    bool success;
+    for (i = 0; i < type_count; ++i)
+    {
+        indices[i] = types[i];
+    }
+    switch (workload_weighted_choice(generator, params->operand_weights, indices, type_count))
+    {
+    case OPERAND_IMMEDIATE:
+        success = workload_print(generator, "#%ld", (long)workload_random(generator, 2001) - 1000);
+        break;
+    case OPERAND_SYMBOL:
+        if (params->extern_count > 0 && workload_chance(generator, params->extern_percent))
+        {
+            success = workload_print(generator, "E%lu", workload_random(generator, params->extern_count));
+        }
+        else
+        {
+            success = workload_print(generator, "L%lu", workload_random(generator, generator->label_count));
+        }
+        break;
+    case OPERAND_ADDRESS:
+        success = workload_print(generator, "&L%lu", workload_random(generator, generator->label_count));
+        break;
+    default:
+        /* registers are encoded into the word of the instruction */
+        return workload_print(generator, "r%lu", workload_random(generator, 8)) ? 0 : -1;
+    }
+    return success ? 1 : -1;
+}
+
+/* Write an instruction (without a label) by the instruction weights, with operands of the types it accepts.
+   Returns the amount of words it takes, or -1 if writing failed */
+long workload_write_instruction(WorkloadGenerator *generator)
+{
+    int indices[WORKLOAD_INSTRUCTION_COUNT];
+    InstructionType type;
+    const OperandType *src_types, *dest_types;
+    int i, src_count, dest_count, src_words = 0, dest_words = 0;
+    for (i = 0; i < WORKLOAD_INSTRUCTION_COUNT; ++i)
+    {
+        indices[i] = i;
+    }
+    type = workload_weighted_choice(generator, generator->params->instruction_weights, indices, WORKLOAD_INSTRUCTION_COUNT);
+    src_types = acceptable_src_operands(type, &src_count);
+    dest_types = acceptable_dest_operands(type, &dest_count);
+    if (!workload_print(generator, "%s", workload_instruction_names[type]))
+    {
+        return -1;
+    }
+    if (src_count > 0)
+    {
+        if (!workload_print(generator, " ") || (src_words = workload_write_operand(generator, src_types, src_count)) < 0 ||
+            !workload_print(generator, ","))
+        {
+            return -1;
+        }
+    }
+    if (dest_count > 0)
+    {
+        if (!workload_print(generator, " ") || (dest_words = workload_write_operand(generator, dest_types, dest_count)) < 0)
+        {
+            return -1;
+        }
+    }
+    return workload_print(generator, "\n") ? 1 + src_words + dest_words : -1;
+}
+
+/* Write a .data or a .string directive (without a label) by the string percentage. Returns the amount of words it takes, or -1 if writing failed */
+long workload_write_directive(WorkloadGenerator *generator)
+{
+    unsigned long i, value_count, serial;
+    if (workload_chance(generator, generator->params->string_percent))
+    {
+        serial = workload_random(generator, 1000);
+        /* the characters of "workload string " and the number, and the terminating 0 */
+        return workload_print(generator, ".string \"workload string %lu\"\n", serial)
+                   ? (long)strlen("workload string ") + (serial >= 100 ? 3 : serial >= 10 ? 2 : 1) + 1
+                   : -1;
+    }
+    value_count = 1 + workload_random(generator, 4);
+    if (!workload_print(generator, ".data %ld", (long)workload_random(generator, 20001) - 10000))
+    {
+        return -1;
+    }
+    for (i = 1; i < value_count; ++i)
+    {
+        if (!workload_print(generator, ", %ld", (long)workload_random(generator, 20001) - 10000))
+        {
+            return -1;
+        }
+    }
+    return workload_print(generator, "\n") ? (long)value_count : -1;
+}
+
+/* Write the next error template of the given ones */
+bool workload_write_error(WorkloadGenerator *generator, const char **templates, unsigned long template_count)
+{
+    const char *template = templates[generator->next_error++ % template_count];
+    generator->summary->errors++;
+    generator->error_serial++;
+    return workload_print(generator, template, generator->error_serial, generator->error_serial);
+}
+
+/* Write the .extern directives and the macro definitions */
+bool workload_write_header(WorkloadGenerator *generator)
+{
+    const WorkloadParams *params = generator->params;
+    unsigned long i, j;
+    long words;
+    if (!workload_print(generator, "; generated workload of %lu lines (seed %lu)\n", params->lines, params->seed))
+    {
+        return FALSE;
+    }
+    for (i = 0; i < params->extern_count; ++i)
+    {
+        if (!workload_print(generator, ".extern E%lu\n", i))
+        {
+            return FALSE;
+        }
+    }
+    for (i = 0; i < params->macro_count; ++i)
+    {
+        /* the bodies have no labels, since a label in a body would be defined again by each invocation */
+        generator->macro_words[i] = 0;
+        if (!workload_print(generator, "mcro m%lu\n", i))
+        {
+            return FALSE;
+        }
+        for (j = 0; j < params->macro_body_lines; ++j)
+        {
+            if ((words = workload_write_instruction(generator)) < 0)
+            {
+                return FALSE;
+            }
+            generator->macro_words[i] += words;
+        }
+        if (!workload_print(generator, "mcroend\n"))
+        {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+/* Write a single line of the body of the program: a comment, an empty line, an erroneous statement, a macro invocation,
+   or a (possibly labeled) instruction or directive */
+bool workload_write_line(WorkloadGenerator *generator, const char **error_templates, unsigned long error_template_count)
+{
+    const WorkloadParams *params = generator->params;
+    unsigned long label = generator->next_label, macro;
+    bool labeled;
+    long words;
+
+    if (workload_chance(generator, params->comment_percent))
+    {
+        return workload_random(generator, 2) == 0 ? workload_print(generator, "; a comment between the statements\n")
+                                                  : workload_print(generator, "\n");
+    }
+    if (error_template_count > 0 && workload_chance(generator, params->error_percent))
+    {
+        return workload_write_error(generator, error_templates, error_template_count);
+    }
+    /* the labels which are left are defined on every line once there are as many of them as lines left */
+    labeled = label < generator->label_count &&
+              (workload_chance(generator, params->label_percent) ||
+               generator->label_count - label >= params->lines - (generator->summary->lines < params->lines ? generator->summary->lines : params->lines));
+    if (!labeled && params->macro_count > 0 && workload_chance(generator, params->macro_call_percent))
+    {
+        macro = workload_random(generator, params->macro_count);
+        generator->summary->words += generator->macro_words[macro];
+        return workload_print(generator, "m%lu\n", macro);
+    }
+    if (labeled)
+    {
+        generator->next_label++;
+        generator->summary->labels++;
+        if (!workload_print(generator, "L%lu: ", label))
+        {
+            return FALSE;
+        }
+    }
+    words = workload_chance(generator, params->directive_percent) ? workload_write_directive(generator) : workload_write_instruction(generator);
+    if (words < 0)
+    {
+        return FALSE;
+    }
+    generator->summary->words += words;
+    return !labeled || !workload_chance(generator, params->entry_percent) || workload_print(generator, ".entry L%lu\n", label);
+}
+
+/* Write .data directives until the program takes more words than the address space of the machine has */
+bool workload_write_overflow(WorkloadGenerator *generator)
+{
+    int i;
+    generator->summary->errors++;
+    while (generator->summary->words <= MAX_ADDRESS - INSTRUCTION_MEMORY_START)
+    {
+        if (!workload_print(generator, ".data 0"))
+        {
+            return FALSE;
+        }
+        for (i = 1; i < WORKLOAD_OVERFLOW_DATA_VALUES; ++i)
+        {
+            if (!workload_print(generator, ",0"))
+            {
+                return FALSE;
+            }
+        }
+        if (!workload_print(generator, "\n"))
+        {
+            return FALSE;
+        }
+        generator->summary->words += WORKLOAD_OVERFLOW_DATA_VALUES;
+    }
+    return TRUE;
+}
+
+void workload_default_params(WorkloadParams *params)
+{
+    int i;
+    params->seed = 1;
+    params->lines = 1000;
+    for (i = 0; i < WORKLOAD_INSTRUCTION_COUNT; ++i)
+    {
+        params->instruction_weights[i] = 1;
+    }
+    for (i = 0; i < WORKLOAD_OPERAND_COUNT; ++i)
+    {
+        params->operand_weights[i] = 1;
+    }
+    params->label_percent = 25;
+    params->max_labels = 0;
+    params->directive_percent = 20;
+    params->string_percent = 50;
+    params->extern_count = 8;
+    params->extern_percent = 20;
+    params->entry_percent = 10;
+    params->macro_count = 8;
+    params->macro_body_lines = 3;
+    params->macro_call_percent = 5;
+    params->comment_percent = 10;
+    params->errors = WORKLOAD_ERRORS_NONE;
+    params->error_percent = 5;
+}
+
+bool workload_generate(FILE *out, const WorkloadParams *params, WorkloadSummary *summary)
+{
+    WorkloadGenerator generator;
+    const char **error_templates = NULL;
+    unsigned long error_template_count = 0;
+    bool success;
+
+    memset(summary, 0, sizeof(*summary));
+    generator.params = params;
+    generator.out = out;
+    generator.summary = summary;
+    generator.random_state = params->seed;
+    generator.next_label = 0;
+    generator.next_error = 0;
+    generator.error_serial = 0;
+    /* there is always a label, so that there is something for the symbol and the address operands to refer to */
+    generator.label_count = params->lines / 100 * params->label_percent + params->lines % 100 * params->label_percent / 100;
+    if (params->max_labels != 0 && generator.label_count > params->max_labels)
+    {
+        generator.label_count = params->max_labels;
+    }
+    if (generator.label_count == 0)
+    {
+        generator.label_count = 1;
+    }
+    if (params->errors == WORKLOAD_ERRORS_LINES)
+    {
+        error_templates = workload_line_errors;
+        error_template_count = sizeof(workload_line_errors) / sizeof(*workload_line_errors);
+    }
+    else if (params->errors == WORKLOAD_ERRORS_MACROS)
+    {
+        error_templates = workload_macro_errors;
+        error_template_count = sizeof(workload_macro_errors) / sizeof(*workload_macro_errors);
+    }
+    if ((generator.macro_words = malloc((params->macro_count + 1) * sizeof(unsigned long))) == NULL)
+    {
+        return FALSE;
+    }
+
+    success = workload_write_header(&generator);
+    while (success && (summary->lines < params->lines || generator.next_label < generator.label_count))
+    {
+        success = workload_write_line(&generator, error_templates, error_template_count);
+    }
+    /* each of the error templates appears at least once */
+    while (success && generator.next_error < error_template_count)
+    {
+        success = workload_write_error(&generator, error_templates, error_template_count);
+    }
+    if (success && params->errors == WORKLOAD_ERRORS_OVERFLOW)
+    {
+        success = workload_write_overflow(&generator);
+    }
+    free(generator.macro_words);
+    return success && !ferror(out);
+}
@@ -0,0 +1,93 @@
+/* This module generates synthetic assembly programs (.as files) for benchmarks and stress tests (see tools/generate.c and tools/bench.c).
+   The programs are valid unless errors are asked for, and are the same for the same parameters (including the seed) on every platform.
+   A program is made of .extern directives, macro definitions, and then a body of statements: instructions (with operands of the shapes each
+   instruction accepts), .data and .string directives, macro invocations, comments and empty lines, with labels on some of the statements
+   and .entry directives for some of the labels. */
+#ifndef _MMN14_WORKLOAD_H_
+#define _MMN14_WORKLOAD_H_
+#include <stdio.h>
+#include "instructions.h"
+
+/* The amount of instruction types (see InstructionType) and of operand types (see OperandType) */
+#define WORKLOAD_INSTRUCTION_COUNT 16
+#define WORKLOAD_OPERAND_COUNT 4
+
+/* The errors a generated program has */
+typedef enum
+{
+    /* No errors - the program assembles successfully */
+    WORKLOAD_ERRORS_NONE,
+    /* Erroneous statements (label, syntax, operand, directive, duplicate and undefined symbol errors), which both passes report */
+    WORKLOAD_ERRORS_LINES,
+    /* Erroneous macro definitions and a line which is too long, which macro expansion reports (so the passes never run) */
+    WORKLOAD_ERRORS_MACROS,
+    /* Enough data to overflow the address space of the machine (see MAX_ADDRESS) */
+    WORKLOAD_ERRORS_OVERFLOW
+} WorkloadErrors;
+
+/* The parameters of a generated program. Percentages are in the range 0-100 */
+typedef struct
+{
+    /* the seed of the pseudo random generator */
+    unsigned long seed;
+    /* the amount of lines of the program (the program ends once it's at least this long and all of its labels are defined) */
+    unsigned long lines;
+    /* the relative weight of each instruction type in the instructions */
+    unsigned int instruction_weights[WORKLOAD_INSTRUCTION_COUNT];
+    /* the relative weight of each operand type (immediate, symbol, &address, register) in the operands, out of the ones each operand accepts */
+    unsigned int operand_weights[WORKLOAD_OPERAND_COUNT];
+    /* the percentage of statements which have a label, and the biggest amount of labels (0 for no bound). There is always at least 1 label */
+    unsigned int label_percent;
+    unsigned long max_labels;
+    /* the percentage of statements which are .data or .string directives, and the percentage of those which are .string directives */
+    unsigned int directive_percent;
+    unsigned int string_percent;
+    /* the amount of .extern directives, and the percentage of symbol operands which refer to an external symbol */
+    unsigned long extern_count;
+    unsigned int extern_percent;
+    /* the percentage of labels which have a .entry directive */
+    unsigned int entry_percent;
+    /* the amount of macros, the amount of lines in the body of each, and the percentage of statements which are macro invocations */
+    unsigned long macro_count;
+    unsigned long macro_body_lines;
+    unsigned int macro_call_percent;
+    /* the percentage of lines which are comments or empty lines */
+    unsigned int comment_percent;
+    /* the errors of the program, and the percentage of statements which are erroneous (for WORKLOAD_ERRORS_LINES and WORKLOAD_ERRORS_MACROS).
+       Each kind of error appears at least once regardless of the percentage */
+    WorkloadErrors errors;
+    unsigned int error_percent;
+} WorkloadParams;
+
+/* A summary of a generated program */
+typedef struct
+{
+    /* the amount of lines of the program */
+    unsigned long lines;
+    /* the amount of bytes of the program */
+    unsigned long bytes;
+    /* the amount of labels the program defines */
+    unsigned long labels;
+    /* the amount of words the program's instructions and data take (after its macros are expanded) */
+    unsigned long words;
+    /* the amount of erroneous statements in the program */
+    unsigned long errors;
+} WorkloadSummary;
+
+/**
+ * @brief Fill parameters with the defaults: an even mix of instructions and operands, a label on a quarter of the statements,
+ * some directives, externals, entries, macros and comments, and no errors
+ * @param params out parameter - the parameters to fill
+ */
+void workload_default_params(WorkloadParams *params);
+
+/**
+ * @brief Generate a program into a stream
+ * @param out the stream to write to
+ * @param params the parameters of the program
+ * @param summary out parameter - a summary of the program
+ * @return TRUE if successful, FALSE if writing to the stream failed.
+ */
+bool workload_generate(FILE *out, const WorkloadParams *params, WorkloadSummary *summary);
+
+#endif